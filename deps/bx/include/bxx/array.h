@@ -101,9 +101,10 @@ namespace bx
     {
         if (m_numItems == m_maxItems)    {
             int newsz = m_numExpand + m_maxItems;
-            m_buff = (Ty*)BX_REALLOC(m_alloc, m_buff, sizeof(Ty)*newsz);
-            if (!m_buff)
+            Ty* buff = (Ty*)BX_REALLOC(m_alloc, m_buff, sizeof(Ty)*newsz);
+            if (!buff)
                 return nullptr;
+            m_buff = buff;
             m_maxItems = newsz;
         }
 
@@ -126,9 +127,10 @@ namespace bx
     {
         if (m_maxItems < m_numItems + _count) {
             int newsz = BX_ALIGN_MASK((_count + m_numItems), m_numExpand-1);
-            m_buff = (Ty*)BX_REALLOC(m_alloc, m_buff, sizeof(Ty)*newsz);
-            if (!m_buff)
+            Ty* buff = (Ty*)BX_REALLOC(m_alloc, m_buff, sizeof(Ty)*newsz);
+            if (!buff)
                 return nullptr;
+            m_buff = buff;
             m_maxItems = newsz;
         }
 
@@ -95,38 +95,47 @@ namespace bx
         {
             // Grow buffer if needed
             if (m_partition == m_maxItems) {
-                uint16_t prevMax = m_maxItems;
-                m_maxItems += m_growSize;
-                size_t totalSize = 2 * sizeof(uint16_t)*m_maxItems;
-                for (int i = 0; i < m_numBuffers; i++)
-                    totalSize += m_itemSizes[i] * m_maxItems;
-
-                void* prevBuff = m_indices;
-                uint8_t* buff = (uint8_t*)BX_ALLOC(m_alloc, totalSize);
-                if (!buff)
+                if (!reserve(m_maxItems + m_growSize))
                     return UINT16_MAX;
-
-                // Fill the new buffer
-                memcpy(buff, m_indices, sizeof(uint16_t)*prevMax);
-                m_indices = (uint16_t*)buff;        buff += sizeof(uint16_t)*m_maxItems;
-                memcpy(buff, m_revIndices, sizeof(uint16_t)*prevMax);
-                m_revIndices = (uint16_t*)buff;     buff += sizeof(uint16_t)*m_maxItems;
-                for (int i = 0; i < m_numBuffers; i++) {
-                    memcpy(buff, m_buffers[i], m_itemSizes[i] * prevMax);
-                    m_buffers[i] = buff;
-                    buff += m_itemSizes[i] * m_maxItems;
-                }
-
-                for (uint16_t i = prevMax, c = m_maxItems; i < c; i++) {
-                    m_indices[i] = i;
-                    m_revIndices[i] = i;
-                }
-                BX_FREE(m_alloc, prevBuff);
             }
 
             return m_indices[m_partition++];
         }
 
+        // Grows the buffers to hold at least maxItems, used before allocating many handles at once
+        bool reserve(uint16_t maxItems)
+        {
+            if (maxItems <= m_maxItems)
+                return true;
+
+            uint16_t prevMax = m_maxItems;
+            size_t totalSize = getMemorySize(maxItems);
+
+            void* prevBuff = m_indices;
+            uint8_t* buff = (uint8_t*)BX_ALLOC(m_alloc, totalSize);
+            if (!buff)
+                return false;
+            m_maxItems = maxItems;
+
+            // Fill the new buffer
+            memcpy(buff, m_indices, sizeof(uint16_t)*prevMax);
+            m_indices = (uint16_t*)buff;        buff += sizeof(uint16_t)*m_maxItems;
+            memcpy(buff, m_revIndices, sizeof(uint16_t)*prevMax);
+            m_revIndices = (uint16_t*)buff;     buff += sizeof(uint16_t)*m_maxItems;
+            for (int i = 0; i < m_numBuffers; i++) {
+                memcpy(buff, m_buffers[i], m_itemSizes[i] * prevMax);
+                m_buffers[i] = buff;
+                buff += m_itemSizes[i] * m_maxItems;
+            }
+
+            for (uint16_t i = prevMax, c = m_maxItems; i < c; i++) {
+                m_indices[i] = i;
+                m_revIndices[i] = i;
+            }
+            BX_FREE(m_alloc, prevBuff);
+            return true;
+        }
+
         void freeHandle(uint16_t handle)
         {
             assert(handle < m_maxItems);
@@ -158,8 +167,50 @@ namespace bx
         }
 
         uint16_t getCount() const  { return m_partition; }
+        uint16_t getMaxItems() const { return m_maxItems; }
 		const uint16_t* getIndices() const { return m_indices; }
 
+        // Raw memory of the pool (indices + all buffers), can be saved and restored with a single memcpy
+        const void* getMemory() const { return m_indices; }
+
+        size_t getMemorySize(uint16_t maxItems) const
+        {
+            size_t totalSize = 2 * sizeof(uint16_t)*maxItems;
+            for (int i = 0; i < m_numBuffers; i++)
+                totalSize += m_itemSizes[i] * maxItems;
+            return totalSize;
+        }
+
+        size_t getMemorySize() const
+        {
+            return getMemorySize(m_maxItems);
+        }
+
+        // Restores raw memory that is fetched by 'getMemory' of a pool with 'maxItems' capacity
+        // The pool must be able to hold maxItems already (see reserve), so restoring never allocates
+        bool restoreMemory(const void* mem, uint16_t maxItems, uint16_t count)
+        {
+            assert(count <= maxItems);
+            if (maxItems > m_maxItems)
+                return false;
+
+            const uint8_t* src = (const uint8_t*)mem;
+            memcpy(m_indices, src, sizeof(uint16_t)*maxItems);      src += sizeof(uint16_t)*maxItems;
+            memcpy(m_revIndices, src, sizeof(uint16_t)*maxItems);   src += sizeof(uint16_t)*maxItems;
+            for (int i = 0; i < m_numBuffers; i++) {
+                memcpy(m_buffers[i], src, m_itemSizes[i] * maxItems);
+                src += m_itemSizes[i] * maxItems;
+            }
+
+            // Handles after the restored range are all free
+            for (uint16_t i = maxItems, c = m_maxItems; i < c; i++) {
+                m_indices[i] = i;
+                m_revIndices[i] = i;
+            }
+            m_partition = count;
+            return true;
+        }
+
         uint16_t handleAt(uint16_t index) const
         {
             assert(index < m_partition);
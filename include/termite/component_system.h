@@ -15,6 +15,7 @@ namespace termite
     static const uint32_t kEntityGenerationMask = (1 << kEntityGenerationBits) - 1;
     
     struct GfxDriverApi;
+    struct MemoryBlock;
 
     struct Entity
     {
@@ -38,9 +39,13 @@ namespace termite
     struct ComponentTypeT {};
     struct ComponentT {};
     struct ComponentGroupT {};
+    struct ComponentQueryT {};
     typedef PhantomType<uint16_t, ComponentTypeT, UINT16_MAX> ComponentTypeHandle;
     typedef PhantomType<uint32_t, ComponentT, UINT32_MAX> ComponentHandle;
     typedef PhantomType<uint16_t, ComponentGroupT, UINT16_MAX> ComponentGroupHandle;
+    typedef PhantomType<uint16_t, ComponentQueryT, UINT16_MAX> ComponentQueryHandle;
+
+    static const int kComponentQueryMaxTypes = 8;
 
     // Entity Management
     TERMITE_API EntityManager* createEntityManager(bx::AllocatorI* alloc, int bufferSize = 0);
@@ -48,6 +53,9 @@ namespace termite
 
 	TERMITE_API Entity createEntity(EntityManager* emgr);
 	TERMITE_API void destroyEntity(EntityManager* emgr, Entity ent);
+    /// Creates/Destroys many entities at once, returns number of created entities
+    TERMITE_API int createEntities(EntityManager* emgr, Entity* ents, int count);
+    TERMITE_API void destroyEntities(EntityManager* emgr, const Entity* ents, int count);
 	TERMITE_API bool isEntityAlive(EntityManager* emgr, Entity ent);
     TERMITE_API void setEntityActive(Entity ent, bool active, uint32_t flags = 0);
 
@@ -80,11 +88,19 @@ namespace termite
 
         void(*debug)(const ComponentHandle* handles, uint16_t count, ImGuiApi_v0* imgui, void* userData);
 
+        // Snapshot callbacks (optional): Component data is raw copied into/from snapshots
+        // 'serialize' is called on the copied data inside the snapshot, 'deserialize' is called on the restored data
+        // Use them to fix pointers or external references within component data
+        void(*serialize)(ComponentHandle handle, void* snapshotData);
+        void(*deserialize)(ComponentHandle handle, void* data);
+
         ComponentCallbacks() :
             createInstance(nullptr),
             destroyInstance(nullptr),
             setActive(nullptr),
-            debug(nullptr)
+            debug(nullptr),
+            serialize(nullptr),
+            deserialize(nullptr)
         {
             memset(updateStageFn, 0x00, sizeof(UpdateStageFunc)*ComponentUpdateStage::Count);
         }
@@ -121,6 +137,21 @@ namespace termite
                                                 ComponentGroupHandle group = ComponentGroupHandle());
 	TERMITE_API void destroyComponent(EntityManager* emgr, Entity ent, ComponentHandle handle);
 
+    /// Creates components of the same type for many entities, component data is allocated at once
+    /// 'handles' (optional) receives created component handles, returns number of created components
+    TERMITE_API int createComponents(EntityManager* emgr, const Entity* ents, int count, ComponentTypeHandle handle,
+                                     ComponentHandle* handles = nullptr, ComponentGroupHandle group = ComponentGroupHandle());
+
+    // Snapshots: Saves/Loads entity manager state and all component data into a flat memory blob
+    //            Snapshots are global, they hold the components of every type, so 'emgr' must be the only entity manager
+    //            Component types must be registered in the same order as they were when the snapshot was saved
+    //            Loading does not call create/destroy callbacks, only 'deserialize' is called for each restored component
+    //            Loading either restores the whole snapshot, or fails and leaves entities and components untouched
+    TERMITE_API uint32_t getComponentSnapshotSize(EntityManager* emgr);
+    TERMITE_API uint32_t saveComponentSnapshot(EntityManager* emgr, void* buffer, uint32_t bufferSize);
+    TERMITE_API MemoryBlock* saveComponentSnapshot(EntityManager* emgr, bx::AllocatorI* alloc = nullptr);
+    TERMITE_API result_t loadComponentSnapshot(EntityManager* emgr, const void* data, uint32_t size);
+
     TERMITE_API void runComponentGroup(ComponentUpdateStage::Enum stage, ComponentGroupHandle groupHandle, float dt);
 
     /// Calls 'debug' callbacks on all components
@@ -142,10 +173,29 @@ namespace termite
     TERMITE_API uint16_t getGroupComponentsByType(ComponentGroupHandle groupHandle, ComponentHandle* handles, 
                                                   uint16_t maxComponents, ComponentTypeHandle typeHandle);
 
+    // ComponentQuery: Caches all entities that have every component type of the query, and all of them are active
+    //                 Results are updated incrementally when components are created, destroyed or (de)activated
+    //                 Data arrays are parallel, so index 'i' of every type and entity array belongs to the same entity
+    TERMITE_API ComponentQueryHandle createComponentQuery(const ComponentTypeHandle* types, int numTypes, 
+                                                          bx::AllocatorI* alloc = nullptr, int poolSize = 0);
+    TERMITE_API void destroyComponentQuery(ComponentQueryHandle handle);
+
+    TERMITE_API int getComponentQueryCount(ComponentQueryHandle handle);
+    TERMITE_API const Entity* getComponentQueryEntities(ComponentQueryHandle handle);
+    // typeIndex: index of the component type in the array passed to createComponentQuery
+    TERMITE_API const ComponentHandle* getComponentQueryHandles(ComponentQueryHandle handle, int typeIndex);
+    TERMITE_API void* const* getComponentQueryData(ComponentQueryHandle handle, int typeIndex);
+
     template <typename Ty> 
     Ty* getComponentData(ComponentHandle handle)
     {
         return (Ty*)getComponentData(handle);
     }
+
+    template <typename Ty>
+    Ty* const* getComponentQueryData(ComponentQueryHandle handle, int typeIndex)
+    {
+        return (Ty* const*)getComponentQueryData(handle, typeIndex);
+    }
     
 } // namespace termite
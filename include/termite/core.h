@@ -32,6 +32,7 @@ namespace termite
     struct GfxDriverApi;
     struct IoDriverApi;
     struct RendererApi;
+    struct RenderGraph;
     struct PhysDriver2DApi;
 
     struct InitEngineFlags
@@ -40,7 +41,8 @@ namespace termite
         {
             None = 0,
             EnableJobDispatcher = 0x1,
-            LockThreadsToCores = 0x2
+            LockThreadsToCores = 0x2,
+            RenderThread = 0x4          // Run gfx driver's renderFrame on a dedicated thread, doFrame only encodes
         };
 
         typedef uint8_t Bits;
@@ -68,6 +70,7 @@ namespace termite
         uint16_t gfxWidth;
         uint16_t gfxHeight;
         GfxResetFlag::Bits gfxDriverFlags; 
+        uint32_t gfxCacheSize;      // in Kb, Max disk size of compiled shader cache, 0 disables the cache
         int keymap[19];
 
         // Sound
@@ -108,6 +111,7 @@ namespace termite
             gfxHeight = 0;
             gfxDeviceId = 0;
             gfxDriverFlags = 0;
+            gfxCacheSize = 16*1024;
             memset(keymap, 0x00, sizeof(keymap));
 
             audioFreq = AudioFreq::Freq22Khz;
@@ -208,6 +212,8 @@ namespace termite
     TERMITE_API IoDriverApi* getBlockingIoDriver() T_THREAD_SAFE;
     TERMITE_API IoDriverApi* getAsyncIoDriver() T_THREAD_SAFE;
     TERMITE_API RendererApi* getRenderer() T_THREAD_SAFE;
+    // Passes are added during game update, and are executed at the end of the frame
+    TERMITE_API RenderGraph* getRenderGraph();
     TERMITE_API SoundDriverApi* getSoundDriver() T_THREAD_SAFE;
     TERMITE_API PhysDriver2DApi* getPhys2dDriver() T_THREAD_SAFE;
     TERMITE_API uint32_t getEngineVersion() T_THREAD_SAFE;
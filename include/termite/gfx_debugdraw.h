@@ -20,6 +20,7 @@ namespace termite
 
     // Automatically 'Begin's the VectorGfx if provided in arguments
     // VectorGfx will be set to screen-space 2d coordinates
+    // Shapes are transformed on CPU and batched by render state, batches are submitted in 'ddEnd'
     TERMITE_API void ddBegin(DebugDrawContext* ctx, uint8_t viewId, 
                              const recti_t& viewport, 
                              const mtx4x4_t& viewMtx, const mtx4x4_t& projMtx, 
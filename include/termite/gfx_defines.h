@@ -288,6 +288,32 @@ namespace termite
         GPUDesc gpu[4];
     };
 
+    // Render side subsystems that submit draws through GfxDriverApi
+    struct GfxSubsystem
+    {
+        enum Enum
+        {
+            Sprite = 0,
+            Text,
+            VectorGfx,
+            DebugDraw,
+            ImGui,
+            Model,
+
+            Count
+        };
+    };
+
+    struct GfxSubsystemStats
+    {
+        uint32_t numSubmits;        //!< Draw calls submitted.
+        uint32_t numBatches;        //!< Batches flushed.
+        uint32_t numVerts;          //!< Vertices written (or instances for instanced draws).
+        uint32_t numIndices;        //!< Indices written.
+        uint32_t transientBytes;    //!< Transient vertex/index/instance bytes allocated.
+        uint32_t numDropped;        //!< Flushes dropped or cut because transient buffers were full.
+    };
+
     struct GfxStats
     {
         uint64_t cpuTimeBegin;  //!< CPU frame begin time.
@@ -310,6 +336,15 @@ namespace termite
         uint16_t height;        //!< Backbuffer height in pixels.
         uint16_t textWidth;     //!< Debug text width in characters.
         uint16_t textHeight;    //!< Debug text height in characters.
+
+        // Recorded by drivers that track submits (Null driver), zero otherwise
+        uint32_t numStateChanges;   //!< Render state changes between draw calls.
+        uint32_t numProgramChanges; //!< Program changes between draw calls.
+        uint32_t numTextureChanges; //!< Texture binding changes between draw calls.
+        uint32_t numIndices;        //!< Indices (or vertices for non-indexed draws) submitted.
+        uint32_t transientVbUsed;   //!< Transient vertex/instance buffer bytes used.
+        uint32_t transientIbUsed;   //!< Transient index buffer bytes used.
+        uint64_t bytesUploaded;     //!< Bytes uploaded to driver (buffers, textures, uniforms, transforms).
     };
 
     struct HMDDesc
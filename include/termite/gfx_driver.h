@@ -18,6 +18,14 @@ namespace termite
     TERMITE_API bool vdeclHas(VertexDecl* vdecl, VertexAttrib::Enum _attrib);
     TERMITE_API uint32_t vdeclGetSize(VertexDecl* vdecl, uint32_t _num);
 
+    // Per subsystem render stats, subsystems write to the current frame and getGfxSubsystemStats returns the last frame
+    TERMITE_API GfxSubsystemStats* getGfxSubsystemFrameStats(GfxSubsystem::Enum subsystem);
+    TERMITE_API const GfxSubsystemStats& getGfxSubsystemStats(GfxSubsystem::Enum subsystem);
+    TERMITE_API const char* getGfxSubsystemName(GfxSubsystem::Enum subsystem);
+
+    // ImGui window with driver and per subsystem stats of the last frame
+    TERMITE_API void showGfxStatsOverlay(bool* opened = nullptr);
+
     class VertexDeclHelper
     {
     private:
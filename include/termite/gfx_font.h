@@ -86,6 +86,8 @@ namespace termite
 
     TERMITE_API TextBatch* createTextBatch(int maxChars, ResourceHandle fontHandle, bx::AllocatorI* alloc);
     TERMITE_API void beginText(TextBatch* batch, const mtx4x4_t& viewProjMtx, const vec2_t screenSize);
+    // Text layouts are cached between two consecutive frames (beginText calls), so unchanged text is only copied
+    // maxChars must not exceed 16384 (16bit indices)
     TERMITE_API void addText(TextBatch* batch, color_t color, float scale,
                              const rect_t& rectFit, TextAlign::Enum align, 
                              const char* text);
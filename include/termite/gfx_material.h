@@ -19,17 +19,20 @@ namespace termite
         struct Var
         {
             char name[32];
-            UniformType type;
+            UniformType::Enum type;
             int num;
         };
 
     public:
         MaterialDecl();
-        
+
         MaterialDecl& begin();
-        MaterialDecl& add(const char* name, UniformType type, int num = 1);
+        MaterialDecl& add(const char* name, UniformType::Enum type, int num = 1);
         void end();
 
+        int getCount() const    { return m_count; }
+        const Var& getVar(int index) const  { return m_vars[index]; }
+
     private:
         Var m_vars[MAX_MATERIAL_VARS];
         int m_count;
@@ -38,6 +41,41 @@ namespace termite
     TERMITE_API MaterialLib* createMaterialLib(bx::AllocatorI* alloc, GfxDriverApi* driver);
     TERMITE_API void destroyMaterialLib(MaterialLib* lib);
 
-    TERMITE_API MaterialHandle createMaterial(MaterialLib* lib);
+    // Material values are packed into a single uniform block, in the order of the declaration
+    TERMITE_API MaterialHandle createMaterial(MaterialLib* lib, const MaterialDecl& decl, ProgramHandle prog);
     TERMITE_API void destroyMaterial(MaterialLib* lib, MaterialHandle handle);
+
+    // Returns the var index within the material, -1 if not found
+    TERMITE_API int findMaterialVar(MaterialLib* lib, MaterialHandle handle, const char* name);
+    // Values are kept in the material's uniform block, and are uploaded by applyMaterial
+    TERMITE_API void setMaterialVar(MaterialLib* lib, MaterialHandle handle, int var, const void* value, int num = 1);
+    TERMITE_API ProgramHandle getMaterialProgram(MaterialLib* lib, MaterialHandle handle);
+
+    // Uploads all values of the material for the next submit, returns the number of uniforms uploaded
+    TERMITE_API int applyMaterial(MaterialLib* lib, MaterialHandle handle);
+
+    // 64-bit draw sort key: view (8 bits) | program (16 bits) | material (16 bits) | depth (24 bits)
+    // Sorting draws by key groups them by program and then by material, to minimize state and uniform changes
+    // Depth is normalized [0, 1], invert it for back-to-front order
+    inline uint64_t makeDrawSortKey(uint8_t viewId, ProgramHandle prog, MaterialHandle mtl, float depth)
+    {
+        depth = depth < 0 ? 0 : (depth > 1.0f ? 1.0f : depth);
+        return (uint64_t(viewId) << 56) |
+               (uint64_t(uint16_t(prog)) << 40) |
+               (uint64_t(uint16_t(mtl)) << 24) |
+               uint64_t(uint32_t(depth*float(0xffffff)));
+    }
+
+    inline void decodeDrawSortKey(uint64_t key, uint8_t* viewId, ProgramHandle* prog, MaterialHandle* mtl,
+                                  uint32_t* depth)
+    {
+        if (viewId)
+            *viewId = uint8_t(key >> 56);
+        if (prog)
+            *prog = ProgramHandle(uint16_t((key >> 40) & 0xffff));
+        if (mtl)
+            *mtl = MaterialHandle(uint16_t((key >> 24) & 0xffff));
+        if (depth)
+            *depth = uint32_t(key & 0xffffff);
+    }
 } // namespace termite
@@ -19,6 +19,46 @@ namespace termite
     struct ModelInstance
     {
         ResourceHandle modelHandle;
+        ResourceHandle animHandle;  // "modelanim" resource, invalid for bind pose
+        float time;     // Animation time, in seconds
+        float speed;
+        bool looped;
+    };
+
+    // Animation clip loaded from tanim files, channels are bound to nodes/joints by name
+    struct ModelAnim
+    {
+        struct Channel
+        {
+            char bindto[32];
+            vec4_t* poss;   // Position (xyz) and uniform scale (w), one for each frame
+            quat_t* rots;   // Rotation, one for each frame
+
+            // Compressed clips (poss/rots are null): Reduced keys, data of each channel is contiguous
+            int numPosKeys;
+            int numRotKeys;
+            vec4_t posMin;
+            vec4_t posScale;            // Dequantize: posMin + key*posScale
+            const uint16_t* posFrames;  // Frame index of each position key
+            const uint16_t* posKeys;    // 4 for each key: x, y, z, scale
+            const uint16_t* rotFrames;  // Frame index of each rotation key
+            const uint16_t* rotKeys;    // 3 for each key: smallest three components
+        };
+
+        int fps;
+        int numFrames;
+        int numChannels;
+        bool hasScale;
+        bool compressed;
+        Channel* channels;
+    };
+
+    // A model to draw, with an optional instance for animated node/skinning matrices
+    struct ModelDraw
+    {
+        ResourceHandle model;
+        ModelInstance* inst;
+        mtx4x4_t worldMtx;
     };
 
     struct Model
@@ -58,6 +98,7 @@ namespace termite
             char name[32];
             mtx4x4_t offsetMtx;
             int parent;
+            bool sceneRoot;     // Pose is transformed by skeleton's rootMtx
         };
 
         struct Skeleton
@@ -76,6 +117,8 @@ namespace termite
             void* verts;
             uint16_t* indices;
             Skeleton* skel;
+            vec3_t posOffset;   // Quantized (Int16) positions: pos = posOffset + a_position*posScale
+            vec3_t posScale;    // Uniform
         };
 
         int numNodes;
@@ -96,10 +139,34 @@ namespace termite
 
     void registerModelToResourceLib();
 
-    ModelInstance* createModelInstance(Model* model);
+    // Instances evaluate node and skinning matrices of a model, optionally driven by a "modelanim" resource
+    TERMITE_API ModelInstance* createModelInstance(ResourceHandle modelHandle, bx::AllocatorI* alloc = nullptr);
+    TERMITE_API void destroyModelInstance(ModelInstance* inst);
+    TERMITE_API void setModelInstanceAnim(ModelInstance* inst, ResourceHandle animHandle, bool looped = true,
+                                          float speed = 1.0f);
+
+    // Advances time and evaluates poses of all instances, work is split between worker threads
+    TERMITE_API void updateModelInstances(ModelInstance** insts, int numInsts, float dt);
+
+    // Results of the last update: World matrix for each node, skinning matrices for skinned geometries
+    TERMITE_API const mtx4x4_t* getModelInstanceNodeMtxs(ModelInstance* inst);
+    TERMITE_API const mtx4x4_t* getModelInstanceSkinMtxs(ModelInstance* inst, int geo, int* numJoints = nullptr);
 
     TERMITE_API VertexBufferHandle getModelVertexBuffer(Model* model, int index);
     TERMITE_API IndexBufferHandle getModelIndexBuffer(Model* model, int index);
 
+    // Called before each submit, for binding material 'mtl' (Submesh::mtl) of the model
+    typedef void(*SetModelStateCallback)(GfxDriverApi* driver, const Model* model, int mtl, void* userData);
+
+    // Flattens node hierarchies to world matrices and culls the nodes against the frustum of viewProjMtx
+    // Identical mesh/submesh pairs are merged into instanced draws with instProg (world matrix in i_data0..i_data3)
+    // Single draws and skinned geometries use prog, skinned geometries get a matrix for each joint
+    // Quantized geometry's dequantize (translate + uniform scale) is folded into the matrices, so shaders should
+    // transform normals with w=0 and normalize them: normalize(mul(u_model[0], vec4(a_normal, 0.0)).xyz)
+    // Returns the number of draw calls
+    TERMITE_API int drawModels(uint8_t viewId, const ModelDraw* draws, int numDraws, const mtx4x4_t& viewProjMtx,
+                               ProgramHandle prog, ProgramHandle instProg, GfxState::Bits state,
+                               SetModelStateCallback stateCallback = nullptr, void* userData = nullptr);
+
 } // namespace termite
 
@@ -2,16 +2,101 @@
 
 #include "bx/bx.h"
 
+#include "types.h"
+#include "gfx_defines.h"
+
+// View Id ranges:
+//  - [0, T_RENDER_GRAPH_FIRST_VIEWID): Assigned manually, by legacy callers like updateSceneManager,
+//    drawBlurPostProcess and the renderer's own views. These views are submitted before the graph's
+//  - [T_RENDER_GRAPH_FIRST_VIEWID, 254): Assigned by the render graph. Graph passes can import framebuffers that
+//    are rendered in the manual range (ex. scene manager output) and post-process them
+//  - 254, 255: nanovg and imgui
+#define T_RENDER_GRAPH_FIRST_VIEWID 128
+
+// RendererApi members after 'render' are only read from renderers that report at least this version in their
+// PluginDesc, older renderers only provide init/shutdown/render
+#define T_RENDERER_API_VERSION_1 T_MAKE_VERSION(1, 0)
+
 namespace termite
 {
     struct GfxDriverApi;
     struct GfxPlatformData;
+    struct RenderGraph;
+
+    struct RenderGraphResourceT {};
+    struct RenderPassT {};
+    typedef PhantomType<uint16_t, RenderGraphResourceT, UINT16_MAX> RenderGraphResource;
+    typedef PhantomType<uint16_t, RenderPassT, UINT16_MAX> RenderPassHandle;
 
     struct RendererApi
     {
 		result_t(*init)(bx::AllocatorI* alloc, GfxDriverApi* driver);
 		void(*shutdown)();
 		void(*render)(const void* renderData);
+
+        // v1, Optional: Called at the beginning of each frame, before game update, so renderer passes come first
+        // There is no render data at this point, passes should fetch what they need in their callbacks
+        // Renderer's own views (render) should stay below T_RENDER_GRAPH_FIRST_VIEWID
+        void(*setupRenderGraph)(RenderGraph* graph);
+    };
+
+    // Transient render target, width/height of zero means the size is relative to backbuffer by 'ratio'
+    struct RenderTargetDesc
+    {
+        uint16_t width;
+        uint16_t height;
+        BackbufferRatio::Enum ratio;
+        TextureFormat::Enum format;
+        TextureFlag::Bits flags;
+
+        RenderTargetDesc()
+        {
+            width = height = 0;
+            ratio = BackbufferRatio::Equal;
+            format = TextureFormat::RGBA8;
+            flags = TextureFlag::RT | TextureFlag::U_Clamp | TextureFlag::V_Clamp;
+        }
     };
+
+    // viewId is assigned by the graph, all 'numViews' views of the pass are set to the pass's first output
+    // (or the backbuffer if the pass has no outputs), with no clear and sequential mode off
+    // data is a copy of the data given to addRenderPass
+    typedef void(*RenderPassCallback)(RenderGraph* graph, uint8_t viewId, const void* data);
+
+    // Render graph: Passes declare their framebuffer inputs and outputs, and are executed in the order they are added
+    // Limitation: The engine adds no passes of it's own, the stock renderer doesn't implement setupRenderGraph
+    //             Games add passes to getRenderGraph() in their update (ex. addBlurRenderPasses)
+    // - Passes that do not contribute to imported targets (ex. backbuffer) are culled
+    // - Transient targets are allocated from a pool, targets with equal descs and no overlapping lifetime share memory
+    // - View Ids are assigned in execution order, within [firstViewId, firstViewId + maxViews)
+    TERMITE_API RenderGraph* createRenderGraph(bx::AllocatorI* alloc, GfxDriverApi* driver, uint8_t firstViewId,
+                                               uint16_t maxViews);
+    TERMITE_API void destroyRenderGraph(RenderGraph* graph);
+
+    // Clears passes and resources, pooled framebuffers are kept
+    TERMITE_API void resetRenderGraph(RenderGraph* graph);
+    TERMITE_API void executeRenderGraph(RenderGraph* graph);
+
+    TERMITE_API RenderGraphResource createRenderGraphTarget(RenderGraph* graph, const char* name,
+                                                            const RenderTargetDesc& desc);
+    TERMITE_API RenderGraphResource importRenderGraphTarget(RenderGraph* graph, const char* name, FrameBufferHandle fb,
+                                                            uint16_t width, uint16_t height);
+    TERMITE_API RenderGraphResource getRenderGraphBackbuffer(RenderGraph* graph);
+
+    TERMITE_API RenderPassHandle addRenderPass(RenderGraph* graph, const char* name, RenderPassCallback callback,
+                                               const void* data = nullptr, uint32_t dataSize = 0, uint8_t numViews = 1);
+    TERMITE_API void renderPassRead(RenderGraph* graph, RenderPassHandle pass, RenderGraphResource res);
+    TERMITE_API void renderPassWrite(RenderGraph* graph, RenderPassHandle pass, RenderGraphResource res);
+    // Pass is never culled
+    TERMITE_API void setRenderPassSideEffect(RenderGraph* graph, RenderPassHandle pass);
+
+    // Valid inside pass callbacks
+    TERMITE_API FrameBufferHandle getRenderGraphFrameBuffer(RenderGraph* graph, RenderGraphResource res);
+    TERMITE_API TextureHandle getRenderGraphTexture(RenderGraph* graph, RenderGraphResource res);
+    TERMITE_API const RenderTargetDesc& getRenderGraphTargetDesc(RenderGraph* graph, RenderGraphResource res);
+
+    // Stats of the last execute
+    TERMITE_API void getRenderGraphStats(RenderGraph* graph, int* numPasses, int* numCulled, int* numTargets,
+                                         int* numPooledFbs);
 } // namespace termite
 
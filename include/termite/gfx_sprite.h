@@ -16,6 +16,7 @@ namespace termite
 {
     struct Sprite;
     struct SpriteCache;
+    struct SpriteAnimGroup;
 
     struct SpriteFlag
     {
@@ -105,6 +106,16 @@ namespace termite
     TERMITE_API void resumeSpriteAnim(Sprite* sprite);
     TERMITE_API void stopSpriteAnim(Sprite* sprite);
     TERMITE_API void replaySpriteAnim(Sprite* sprite);
+
+    // SpriteAnimGroup keeps animation state of many sprites in SoA arrays and advances them in a single vectorized pass
+    // Callbacks are deferred until all sprites in the group are advanced, and are called on the caller thread
+    // Callbacks may remove or destroy sprites of the group (their pending callbacks are dropped), but not the group itself
+    // Sprites that are in a group should not be passed to 'animateSprites'
+    TERMITE_API SpriteAnimGroup* createSpriteAnimGroup(int maxSprites, bx::AllocatorI* alloc);
+    TERMITE_API void destroySpriteAnimGroup(SpriteAnimGroup* group);
+    TERMITE_API bool addSpriteToAnimGroup(SpriteAnimGroup* group, Sprite* sprite);
+    TERMITE_API void removeSpriteFromAnimGroup(Sprite* sprite);
+    TERMITE_API void animateSpriteGroup(SpriteAnimGroup* group, float dt);
     
     // Set frame callbacks: Frame callbacks are called when sprite animation reaches them
     TERMITE_API void setSpriteFrameCallbackByTag(Sprite* sprite, const char* frameTag, SpriteFrameCallback callback,
@@ -149,28 +160,33 @@ namespace termite
     TERMITE_API void convertSpritePhysicsVerts(vec2_t* ptsOut, const vec2_t* ptsIn, int numPts, Sprite* sprite);
 
     // Dynamically draw sprites
+    // viewRect (optional): World space rect of the view (cam2dGetRect), sprites outside of it are culled
     TERMITE_API void drawSprites(uint8_t viewId, Sprite** sprites, uint16_t numSprites, const mtx3x3_t* mats,
                                  ProgramHandle progOverride = ProgramHandle(), SetSpriteStateCallback stateCallback = nullptr,
-                                 void* stateUserData = nullptr);
+                                 void* stateUserData = nullptr, const rect_t* viewRect = nullptr);
     inline void drawSprite(uint8_t viewId, Sprite* sprite, const mtx3x3_t& mat,
                            ProgramHandle progOverride = ProgramHandle(), SetSpriteStateCallback stateCallback = nullptr,
-                           void* stateUserData = nullptr)
+                           void* stateUserData = nullptr, const rect_t* viewRect = nullptr)
     {
         assert(sprite);
-        drawSprites(viewId, &sprite, 1, &mat, progOverride, stateCallback, stateUserData);
+        drawSprites(viewId, &sprite, 1, &mat, progOverride, stateCallback, stateUserData, viewRect);
     }
 
     // SpriteCache contains static sprite rendering data
     // When filled 'fillSpriteCache', the rendering data is saved in GPU buffer for consistant use
     // Call 'updateSpriteCache' if current sprites inside the cache needs to be updated (like animation frames)
+    // Only sprites with multiple frames are updated, Sprites must stay alive while they are in the cache
     TERMITE_API SpriteCache* createSpriteCache(uint16_t maxSprites);
     TERMITE_API void destroySpriteCache(SpriteCache* scache);
     TERMITE_API void fillSpriteCache(SpriteCache* scache, Sprite** sprites, uint16_t numSprites,
                                      const mtx3x3_t* mats,
-                                     ProgramHandle progOverride = ProgramHandle(), SetSpriteStateCallback stateCallback = nullptr);
+                                     ProgramHandle progOverride = ProgramHandle(), SetSpriteStateCallback stateCallback = nullptr,
+                                     void* stateUserData = nullptr);
     TERMITE_API void updateSpriteCache(SpriteCache* scache);
+    TERMITE_API void drawSpriteCache(uint8_t viewId, SpriteCache* scache);
 
     // Registers "spritesheet" resource type and Loads SpriteSheet object
+    // Files with ".tsheet" extension are loaded as binary (sheetmaker), others as TexturePacker json
     struct LoadSpriteSheetParams
     {
         TextureFlag::Bits flags;
@@ -3,6 +3,7 @@
 #include "bx/bx.h"
 
 #include "gfx_defines.h"
+#include "gfx_render.h"
 #include "vec_math.h"
 
 namespace termite
@@ -38,9 +39,13 @@ namespace termite
                                                        uint16_t width, uint16_t height, 
                                                        float stdDev, 
                                                        TextureFormat::Enum fmt = TextureFormat::RGBA8);
+    // Uses 3 views starting from *viewId and advances it, ids must be below T_RENDER_GRAPH_FIRST_VIEWID
     TERMITE_API TextureHandle drawBlurPostProcess(PostProcessBlur* blur, uint8_t* viewId, TextureHandle sourceTexture, 
                                                   float radius = 1.0f);
     TERMITE_API TextureHandle getBlurPostProcessTexture(PostProcessBlur* blur);
+    // Adds downsample and two blur passes to the graph, returns the blurred (transient) target
+    TERMITE_API RenderGraphResource addBlurRenderPasses(RenderGraph* graph, PostProcessBlur* blur,
+                                                        RenderGraphResource source, float radius = 1.0f);
     TERMITE_API void destroyBlurPostProcess(PostProcessBlur* blur);
 
     // Vignette/Sepia PostProcess
@@ -53,6 +58,10 @@ namespace termite
     TERMITE_API TextureHandle drawVignetteSepiaPostProcess(PostProcessVignetteSepia* vignette, uint8_t viewId,
                                                            FrameBufferHandle targetFb, TextureHandle sourceTexture, 
                                                            float intensity = 1.0f);
+    // Writes to 'target', or to a new transient target if it's invalid, returns the target
+    TERMITE_API RenderGraphResource addVignetteSepiaRenderPass(RenderGraph* graph, PostProcessVignetteSepia* vignette,
+                                                               RenderGraphResource source, float intensity = 1.0f,
+                                                               RenderGraphResource target = RenderGraphResource());
     TERMITE_API void destroyVignetteSepiaPostProcess(PostProcessVignetteSepia* vignette);
 
 } // namespace termite
@@ -12,6 +12,8 @@ namespace termite
     result_t initVectorGfx(bx::AllocatorI* alloc, GfxDriverApi* driver);
     void shutdownVectorGfx();
 
+    // 'maxVerts' and 'maxBatches' are initial buffer sizes, buffers grow if more is drawn
+    // Transforms are applied on CPU, draw calls only break on texture/font or scissor changes
     TERMITE_API VectorGfxContext* createVectorGfxContext(int maxVerts = 0, int maxBatches = 0);
     TERMITE_API void destroyVectorGfxContext(VectorGfxContext* ctx);
 
@@ -131,6 +131,8 @@ namespace termite {
 #ifdef T_GFX_API
 #include "vec_math.h"
 #include "gfx_defines.h"
+#include "gfx_material.h"
+#include "gfx_render.h"
 namespace termite {
     struct IoDriverApi;
 
@@ -151,6 +153,30 @@ namespace termite {
         bool(*vdeclHas)(VertexDecl* vdecl, VertexAttrib::Enum _attrib);
         uint32_t(*vdeclGetSize)(VertexDecl* vdecl, uint32_t _num);
     };
+
+    // v1: Extends v0, returned by getApi(ApiId::Gfx, 1)
+    struct GfxApi_v1 : GfxApi_v0
+    {
+        MaterialLib* (*createMaterialLib)(bx::AllocatorI* alloc, GfxDriverApi* driver);
+        void(*destroyMaterialLib)(MaterialLib* lib);
+        MaterialHandle(*createMaterial)(MaterialLib* lib, const MaterialDecl& decl, ProgramHandle prog);
+        void(*destroyMaterial)(MaterialLib* lib, MaterialHandle handle);
+        int(*findMaterialVar)(MaterialLib* lib, MaterialHandle handle, const char* name);
+        void(*setMaterialVar)(MaterialLib* lib, MaterialHandle handle, int var, const void* value, int num);
+        ProgramHandle(*getMaterialProgram)(MaterialLib* lib, MaterialHandle handle);
+        int(*applyMaterial)(MaterialLib* lib, MaterialHandle handle);
+        RenderGraphResource(*createRenderGraphTarget)(RenderGraph* graph, const char* name, const RenderTargetDesc& desc);
+        RenderGraphResource(*importRenderGraphTarget)(RenderGraph* graph, const char* name, FrameBufferHandle fb,
+                                                      uint16_t width, uint16_t height);
+        RenderGraphResource(*getRenderGraphBackbuffer)(RenderGraph* graph);
+        RenderPassHandle(*addRenderPass)(RenderGraph* graph, const char* name, RenderPassCallback callback,
+                                         const void* data, uint32_t dataSize, uint8_t numViews);
+        void(*renderPassRead)(RenderGraph* graph, RenderPassHandle pass, RenderGraphResource res);
+        void(*renderPassWrite)(RenderGraph* graph, RenderPassHandle pass, RenderGraphResource res);
+        void(*setRenderPassSideEffect)(RenderGraph* graph, RenderPassHandle pass);
+        FrameBufferHandle(*getRenderGraphFrameBuffer)(RenderGraph* graph, RenderGraphResource res);
+        TextureHandle(*getRenderGraphTexture)(RenderGraph* graph, RenderGraphResource res);
+    };
 }
 #endif
 
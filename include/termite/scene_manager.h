@@ -128,7 +128,8 @@ namespace termite
     TERMITE_API Scene* findScene(SceneManager* mgr, const char* name, FindSceneMode::Enum mode = FindSceneMode::All);
     TERMITE_API int findSceneByTag(SceneManager* mgr, Scene** pScenes, int maxScenes, uint32_t tag, FindSceneMode::Enum mode = FindSceneMode::All);
 
-    // 
+    // Scenes and transition effects use views starting from *viewId, which is advanced by the number of views used
+    // Ids must stay below T_RENDER_GRAPH_FIRST_VIEWID, output framebuffer (pRenderFb) can be imported to the render graph
     TERMITE_API void updateSceneManager(SceneManager* mgr, float dt, uint8_t* viewId,
                                         const vec2i_t renderSize,
                                         FrameBufferHandle* pRenderFb = nullptr, TextureHandle* pRenderTex = nullptr);
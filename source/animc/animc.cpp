@@ -38,12 +38,18 @@ struct Args
     bool verbose;
     ZAxis zaxis;
     int fps;
+    bool uncompressed;
+    float posTolerance;
+    float rotTolerance;     // In radians
 
     Args()
     {
         verbose = false;
         zaxis = ZAxis::Unknown;
         fps = 30;
+        uncompressed = false;
+        posTolerance = 0.0005f;
+        rotTolerance = 0.001f;
     }
 };
 
@@ -144,7 +150,8 @@ static AnimData* importAnim(const Args& args)
                     scale = (achannel->mScalingKeys[f].mValue.x +
                              achannel->mScalingKeys[f].mValue.y +
                              achannel->mScalingKeys[f].mValue.z) / 3.0f;
-                    hasScale = !bx::fequal(scale, 1.0f, 0.00001f);
+                    if (!bx::fequal(scale, 1.0f, 0.00001f))
+                        hasScale = true;
                 }
 
                 float* p = &channel->poss[f * 4];
@@ -169,12 +176,154 @@ static AnimData* importAnim(const Args& args)
     return anim;
 }
 
-static bool exportAnimFile(const char* animFilepath, const AnimData& anim)
+static void interpolateKey(float* result, const float* a, const float* b, float t, bool isQuat)
 {
+    if (!isQuat) {
+        for (int i = 0; i < 4; i++)
+            result[i] = a[i] + (b[i] - a[i])*t;
+        return;
+    }
+
+    // nlerp on the shortest path, same as the runtime
+    float sign = (a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3]) < 0 ? -1.0f : 1.0f;
+    float len = 0;
+    for (int i = 0; i < 4; i++) {
+        result[i] = a[i] + (b[i]*sign - a[i])*t;
+        len += result[i]*result[i];
+    }
+    len = len > 0 ? 1.0f/sqrtf(len) : 0;
+    for (int i = 0; i < 4; i++)
+        result[i] *= len;
+}
+
+// Checks if frames between 'start' and 'end' can be interpolated from the two keys within tolerance
+// For rotations, tolerance is compared against 1 - |dot|
+static bool canInterpolate(const float* keys, int start, int end, bool isQuat, float tolerance)
+{
+    const float* a = &keys[start*4];
+    const float* b = &keys[end*4];
+    for (int f = start + 1; f < end; f++) {
+        float r[4];
+        const float* k = &keys[f*4];
+        interpolateKey(r, a, b, float(f - start)/float(end - start), isQuat);
+        if (isQuat) {
+            float d = bx::fabsolute(r[0]*k[0] + r[1]*k[1] + r[2]*k[2] + r[3]*k[3]);
+            if (1.0f - d > tolerance)
+                return false;
+        } else {
+            for (int i = 0; i < 4; i++) {
+                if (bx::fabsolute(r[i] - k[i]) > tolerance)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Keeps first and last frames, and any frame that can't be interpolated from the previous kept key
+static int reduceKeys(const float* keys, int numFrames, bool isQuat, float tolerance, uint16_t* keptFrames)
+{
+    int numKept = 0;
+    keptFrames[numKept++] = 0;
+    int start = 0;
+    while (start < numFrames - 1) {
+        int end = start + 1;
+        while (end + 1 < numFrames && canInterpolate(keys, start, end + 1, isQuat, tolerance))
+            end++;
+        keptFrames[numKept++] = uint16_t(end);
+        start = end;
+    }
+    return numKept;
+}
+
+// Smallest three: Drops the largest component (made positive) and maps the rest to 15 bits
+static void packQuat(uint16_t* dest, const float* q)
+{
+    int largest = 0;
+    for (int i = 1; i < 4; i++) {
+        if (bx::fabsolute(q[i]) > bx::fabsolute(q[largest]))
+            largest = i;
+    }
+
+    float sign = q[largest] < 0 ? -1.0f : 1.0f;
+    for (int i = 0, k = 0; i < 4; i++) {
+        if (i == largest)
+            continue;
+        float v = bx::fsaturate(q[i]*sign*bx::sqrt2*0.5f + 0.5f);
+        dest[k++] = uint16_t(v*32767.0f + 0.5f);
+    }
+    dest[0] |= uint16_t((largest & 1) << 15);
+    dest[1] |= uint16_t((largest >> 1) << 15);
+}
+
+static bool writePackedChannel(bx::CrtFileWriter* file, const AnimData::Channel& channel, int numFrames,
+                               const Args& args, bx::Error* err)
+{
+    uint16_t* posFrames = (uint16_t*)BX_ALLOC(&g_alloc, sizeof(uint16_t)*numFrames);
+    uint16_t* rotFrames = (uint16_t*)BX_ALLOC(&g_alloc, sizeof(uint16_t)*numFrames);
+    uint16_t* poss = (uint16_t*)BX_ALLOC(&g_alloc, sizeof(uint16_t)*4*numFrames);
+    uint16_t* rots = (uint16_t*)BX_ALLOC(&g_alloc, sizeof(uint16_t)*3*numFrames);
+    if (!posFrames || !rotFrames || !poss || !rots)
+        return false;
+
+    taChannelPacked pchannel;
+    memset(&pchannel, 0x00, sizeof(pchannel));
+    bx::strlcpy(pchannel.bindto, channel.c.bindto, sizeof(pchannel.bindto));
+    pchannel.numPosKeys = reduceKeys(channel.poss, numFrames, false, args.posTolerance, posFrames);
+    pchannel.numRotKeys = reduceKeys(channel.rots, numFrames, true, 1.0f - cosf(args.rotTolerance*0.5f), rotFrames);
+
+    // Quantize positions/scale in the channel's range
+    float posMax[4];
+    for (int i = 0; i < 4; i++) {
+        pchannel.posMin[i] = posMax[i] = channel.poss[posFrames[0]*4 + i];
+        for (int k = 1; k < pchannel.numPosKeys; k++) {
+            float v = channel.poss[posFrames[k]*4 + i];
+            pchannel.posMin[i] = bx::fmin(pchannel.posMin[i], v);
+            posMax[i] = bx::fmax(posMax[i], v);
+        }
+        pchannel.posScale[i] = (posMax[i] - pchannel.posMin[i]) / 65535.0f;
+    }
+
+    for (int k = 0; k < pchannel.numPosKeys; k++) {
+        const float* p = &channel.poss[posFrames[k]*4];
+        for (int i = 0; i < 4; i++) {
+            float s = pchannel.posScale[i];
+            poss[k*4 + i] = s > 0 ? uint16_t(bx::fclamp((p[i] - pchannel.posMin[i])/s + 0.5f, 0, 65535.0f)) : 0;
+        }
+    }
+
+    for (int k = 0; k < pchannel.numRotKeys; k++)
+        packQuat(&rots[k*3], &channel.rots[rotFrames[k]*4]);
+
+    file->write(&pchannel, sizeof(pchannel), err);
+    file->write(posFrames, sizeof(uint16_t)*pchannel.numPosKeys, err);
+    file->write(poss, sizeof(uint16_t)*4*pchannel.numPosKeys, err);
+    file->write(rotFrames, sizeof(uint16_t)*pchannel.numRotKeys, err);
+    file->write(rots, sizeof(uint16_t)*3*pchannel.numRotKeys, err);
+
+    if (args.verbose) {
+        g_logger->text("Channel '%s': %d position keys, %d rotation keys (%d frames)", pchannel.bindto,
+                       pchannel.numPosKeys, pchannel.numRotKeys, numFrames);
+    }
+
+    BX_FREE(&g_alloc, rots);
+    BX_FREE(&g_alloc, poss);
+    BX_FREE(&g_alloc, rotFrames);
+    BX_FREE(&g_alloc, posFrames);
+    return true;
+}
+
+static bool exportAnimFile(const char* animFilepath, const AnimData& anim, const Args& args)
+{
+    if (!args.uncompressed && anim.numFrames > UINT16_MAX) {
+        g_logger->fatal("Too many frames (%d) for compressed format", anim.numFrames);
+        return false;
+    }
+
     // Write to file
     taHeader header;
     header.sign = TANIM_SIGN;
-    header.version = TANIM_VERSION;
+    header.version = args.uncompressed ? TANIM_VERSION_10 : TANIM_VERSION_20;
     header.fps = anim.fps;
     header.hasScale = anim.hasScale ? 1 : 0;
     header.numFrames = anim.numFrames;
@@ -191,9 +340,18 @@ static bool exportAnimFile(const char* animFilepath, const AnimData& anim)
     file.write(&header, sizeof(header), &err);
 
     for (int i = 0; i < anim.numChannels; i++) {
+        if (!args.uncompressed) {
+            if (!writePackedChannel(&file, anim.channels[i], anim.numFrames, args, &err)) {
+                g_logger->fatal("Out of memory");
+                file.close();
+                return false;
+            }
+            continue;
+        }
+
         file.write(&anim.channels[i].c, sizeof(taChannel), &err);
-        file.write(&anim.channels[i].poss, sizeof(float) * 4 * header.numFrames, &err);
-        file.write(&anim.channels[i].rots, sizeof(float) * 4 * header.numFrames, &err);
+        file.write(anim.channels[i].poss, sizeof(float) * 4 * header.numFrames, &err);
+        file.write(anim.channels[i].rots, sizeof(float) * 4 * header.numFrames, &err);
     }
 
     file.close();
@@ -210,7 +368,10 @@ static void showHelp()
         "  -v --verbose Verbose mode\n"
         "  -z --zaxis <zaxis> Set Z-Axis, choises are ['UP', 'GL']\n"
         "  -j --jsonlog Enable json logging instead of normal text\n"
-        "  -f --fps <fps> default number of frames-per-second\n";
+        "  -f --fps <fps> default number of frames-per-second\n"
+        "  -u --uncompressed Write raw keys for every frame (v1.0 format)\n"
+        "  -p --postol <tolerance> Position/Scale error tolerance for key reduction (default: 0.0005)\n"
+        "  -r --rottol <tolerance> Rotation error tolerance for key reduction, in radians (default: 0.001)\n";
     puts(help);
 }
 
@@ -232,6 +393,9 @@ int main(int argc, char** argv)
     args.inFilepath = cmd.findOption('i', "input", "");
     args.outFilepath = cmd.findOption('o', "output", "");
     bool jsonLog = cmd.hasArg('j', "jsonlog");
+    args.uncompressed = cmd.hasArg('u', "uncompressed");
+    args.posTolerance = (float)atof(cmd.findOption('p', "postol", "0.0005"));
+    args.rotTolerance = (float)atof(cmd.findOption('r', "rottol", "0.001"));
 
     bool help = cmd.hasArg('h', "help");
     if (help) {
@@ -258,7 +422,7 @@ int main(int argc, char** argv)
     AnimData* anim = importAnim(args);
     if (!anim)
         return -1;
-    int ret = exportAnimFile(args.outFilepath.cstr(), *anim) ? 0 : -1;
+    int ret = exportAnimFile(args.outFilepath.cstr(), *anim, args) ? 0 : -1;
 
     // cleanup
     for (int i = 0; i < anim->numChannels; i++) {
@@ -0,0 +1,1217 @@
+#include "termite/core.h"
+
+#include "termite/plugin_api.h"
+#include "termite/gfx_driver.h"
+
+#include "bx/timer.h"
+#include "bx/uint32_t.h"
+#include "bxx/handle_pool.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cassert>
+
+// Null graphics driver: Implements GfxDriverApi without any GPU or window
+// Transient/instance buffers and transforms are really allocated, so CPU side of renderers do the same work
+// Submits are only recorded in GfxStats (draw calls, state changes, bytes uploaded), useful for headless benchmarks
+
+using namespace termite;
+
+#define NULL_TRANSIENT_VB_SIZE (6<<20)
+#define NULL_TRANSIENT_IB_SIZE (2<<20)
+#define NULL_MAX_MATRIX_CACHE (16*1024)
+#define NULL_MAX_TEXTURE_STAGES 8
+
+struct NullResourceType
+{
+    enum Enum
+    {
+        Texture = 0,
+        FrameBuffer,
+        OcclusionQuery,
+        IndexBuffer,
+        DynamicIndexBuffer,
+        VertexBuffer,
+        DynamicVertexBuffer,
+        Uniform,
+        Program,
+        IndirectBuffer,
+        Shader,
+
+        Count
+    };
+};
+
+struct NullResource
+{
+    uint32_t size;      // Buffer/Texture size in bytes
+    uint16_t stride;    // Vertex stride or uniform element size
+    uint16_t num;       // Number of uniform elements
+    uint16_t texture;   // FrameBuffer texture
+};
+
+// Memory returned by alloc/copy/makeRef, it's released when the driver consumes it
+struct NullMemory
+{
+    GfxMemory m;
+    gfxReleaseMemCallback releaseFn;
+    void* userData;
+    bool ref;
+};
+
+// Current draw state, reset after each submit unless 'preserveState' is set
+struct NullDrawState
+{
+    GfxState::Bits state;
+    uint32_t numIndices;
+    uint32_t numVertices;
+    uint32_t numInstances;
+    uint16_t textures[NULL_MAX_TEXTURE_STAGES];
+};
+
+struct NullDriver
+{
+    bx::AllocatorI* alloc;
+    GfxDriverEventsI* callbacks;
+    bool init;
+    GfxCaps caps;
+    GfxStats stats;     // Stats of the last frame
+    GfxStats frameStats;// Stats of the frame that is being recorded
+    HMDDesc hmd;
+    GfxInternalData internal;
+    bx::HandlePool resources[NullResourceType::Count];
+
+    uint8_t* tvb;
+    uint32_t tvbOffset;
+    uint8_t* tib;
+    uint32_t tibOffset;
+    float* matrixCache;
+    uint32_t numMatrices;
+
+    NullDrawState draw;
+    GfxState::Bits lastState;
+    uint16_t lastProgram;
+    uint16_t lastTextures[NULL_MAX_TEXTURE_STAGES];
+    uint32_t frame;
+    int64_t frameStartTime;
+
+    NullDriver()
+    {
+        alloc = nullptr;
+        callbacks = nullptr;
+        init = false;
+        memset(&caps, 0x00, sizeof(caps));
+        memset(&stats, 0x00, sizeof(stats));
+        memset(&frameStats, 0x00, sizeof(frameStats));
+        memset(&hmd, 0x00, sizeof(hmd));
+        memset(&internal, 0x00, sizeof(internal));
+        tvb = tib = nullptr;
+        tvbOffset = tibOffset = 0;
+        matrixCache = nullptr;
+        numMatrices = 0;
+        memset(&draw, 0x00, sizeof(draw));
+        lastState = 0;
+        lastProgram = UINT16_MAX;
+        memset(lastTextures, 0xff, sizeof(lastTextures));
+        frame = 0;
+        frameStartTime = 0;
+    }
+};
+
+static NullDriver g_null;
+
+// Bits per pixel of TextureFormat::Enum
+static const uint8_t k_formatBpp[] = {
+    4, 8, 8, 4, 8, 8, 8,                // BC1..BC7
+    4, 4, 8, 4,                         // ETC1, ETC2, ETC2A, ETC2A1
+    2, 4, 2, 4, 2, 4,                   // PTC12..PTC24
+    0,                                  // Unknown
+    1, 8, 8, 8, 8, 8,                   // R1, A8, R8, R8I, R8U, R8S
+    16, 16, 16, 16, 16,                 // R16, R16I, R16U, R16F, R16S
+    32, 32, 32,                         // R32I, R32U, R32F
+    16, 16, 16, 16,                     // RG8, RG8I, RG8U, RG8S
+    32, 32, 32, 32, 32,                 // RG16, RG16I, RG16U, RG16F, RG16S
+    64, 64, 64,                         // RG32I, RG32U, RG32F
+    24, 24, 24, 24,                     // RGB8, RGB8I, RGB8U, RGB8S
+    32, 32, 32, 32, 32, 32,             // RGB9E5F, BGRA8, RGBA8, RGBA8I, RGBA8U, RGBA8S
+    64, 64, 64, 64, 64,                 // RGBA16, RGBA16I, RGBA16U, RGBA16F, RGBA16S
+    128, 128, 128,                      // RGBA32I, RGBA32U, RGBA32F
+    16, 16, 16, 32, 32,                 // R5G6B5, RGBA4, RGB5A1, RGB10A2, R11G11B10F
+    0,                                  // UnknownDepth
+    16, 32, 32, 32, 16, 32, 32, 8       // D16, D24, D24S8, D32, D16F, D24F, D32F, D0S8
+};
+static_assert(BX_COUNTOF(k_formatBpp) == TextureFormat::Count, "Format bpp table mismatch");
+
+// Size of each UniformType::Enum element
+static const uint16_t k_uniformSize[] = {
+    sizeof(int32_t),    // Int1
+    0,                  // End
+    sizeof(float)*4,    // Vec4
+    sizeof(float)*9,    // Mat3
+    sizeof(float)*16    // Mat4
+};
+static_assert(BX_COUNTOF(k_uniformSize) == UniformType::Count, "Uniform size table mismatch");
+
+static uint16_t newResource(NullResourceType::Enum type, uint32_t size = 0, uint16_t stride = 0, uint16_t num = 0)
+{
+    uint16_t handle = g_null.resources[type].newHandle();
+    if (handle == UINT16_MAX)
+        return UINT16_MAX;
+    NullResource* r = g_null.resources[type].getHandleData<NullResource>(0, handle);
+    r->size = size;
+    r->stride = stride;
+    r->num = num;
+    r->texture = UINT16_MAX;
+    return handle;
+}
+
+static NullResource* getResource(NullResourceType::Enum type, uint16_t handle)
+{
+    return g_null.resources[type].getHandleData<NullResource>(0, handle);
+}
+
+static void freeResource(NullResourceType::Enum type, uint16_t handle)
+{
+    if (handle != UINT16_MAX)
+        g_null.resources[type].freeHandle(handle);
+}
+
+// Counts the memory as uploaded and releases it
+static uint32_t consumeMem(const GfxMemory* mem)
+{
+    if (!mem)
+        return 0;
+
+    NullMemory* m = (NullMemory*)mem;
+    uint32_t size = m->m.size;
+    g_null.frameStats.bytesUploaded += size;
+    if (m->ref && m->releaseFn)
+        m->releaseFn(m->m.data, m->userData);
+    BX_FREE(g_null.alloc, m);
+    return size;
+}
+
+static void calcTextureSize(TextureInfo* info, uint16_t width, uint16_t height, uint16_t depth, bool cubemap,
+                            bool hasMips, uint16_t numLayers, TextureFormat::Enum fmt)
+{
+    uint32_t bpp = k_formatBpp[fmt];
+    bool compressed = fmt < TextureFormat::Unknown;
+    width = bx::uint32_max(1, width);
+    height = bx::uint32_max(1, height);
+    depth = bx::uint32_max(1, depth);
+    numLayers = bx::uint32_max(1, numLayers);
+
+    uint8_t numMips = 1;
+    if (hasMips) {
+        uint32_t maxSide = bx::uint32_max(bx::uint32_max(width, height), depth);
+        while (maxSide > 1) {
+            maxSide >>= 1;
+            numMips++;
+        }
+    }
+
+    uint32_t size = 0;
+    uint32_t w = width, h = height, d = depth;
+    for (uint8_t i = 0; i < numMips; i++) {
+        // Compressed formats are stored in 4x4 blocks
+        uint32_t mw = compressed ? bx::uint32_max(4, w) : w;
+        uint32_t mh = compressed ? bx::uint32_max(4, h) : h;
+        size += mw*mh*d*bpp/8;
+        w = bx::uint32_max(1, w >> 1);
+        h = bx::uint32_max(1, h >> 1);
+        d = bx::uint32_max(1, d >> 1);
+    }
+
+    info->format = fmt;
+    info->width = width;
+    info->height = height;
+    info->depth = depth;
+    info->numMips = numMips;
+    info->bitsPerPixel = uint8_t(bpp);
+    info->cubeMap = cubemap;
+    info->storageSize = size*numLayers*(cubemap ? 6 : 1);
+}
+
+static result_t initNull(uint16_t deviceId, GfxDriverEventsI* callbacks, bx::AllocatorI* alloc)
+{
+    BX_UNUSED(deviceId);
+
+    g_null.alloc = alloc;
+    g_null.callbacks = callbacks;
+
+    const uint32_t itemSize = sizeof(NullResource);
+    for (int i = 0; i < NullResourceType::Count; i++) {
+        if (!g_null.resources[i].create(&itemSize, 1, 256, 256, alloc))
+            return T_ERR_OUTOFMEM;
+    }
+
+    g_null.tvb = (uint8_t*)BX_ALIGNED_ALLOC(alloc, NULL_TRANSIENT_VB_SIZE, 16);
+    g_null.tib = (uint8_t*)BX_ALIGNED_ALLOC(alloc, NULL_TRANSIENT_IB_SIZE, 16);
+    g_null.matrixCache = (float*)BX_ALIGNED_ALLOC(alloc, sizeof(float)*16*NULL_MAX_MATRIX_CACHE, 16);
+    if (!g_null.tvb || !g_null.tib || !g_null.matrixCache)
+        return T_ERR_OUTOFMEM;
+
+    GfxCaps& caps = g_null.caps;
+    caps.type = RendererType::Noop;
+    caps.supported = GpuCapsFlag::Instancing | GpuCapsFlag::Index32 | GpuCapsFlag::Texture3D |
+        GpuCapsFlag::VertexAttribHalf | GpuCapsFlag::VertexAttribUint8 | GpuCapsFlag::TextureBlit;
+    caps.maxDrawCalls = 65535;
+    caps.maxTextureSize = 16384;
+    caps.maxViews = 256;
+    caps.maxFBAttachments = 8;
+    caps.numGPUs = 0;
+    for (int i = 0; i < TextureFormat::Count; i++)
+        caps.formats[i] = 1;
+    g_null.internal.caps = &g_null.caps;
+
+    g_null.frameStats.cpuTimerFreq = g_null.stats.cpuTimerFreq = bx::getHPFrequency();
+    g_null.frameStartTime = bx::getHPCounter();
+    g_null.init = true;
+    return 0;
+}
+
+static void shutdownNull()
+{
+    bx::AllocatorI* alloc = g_null.alloc;
+    if (!alloc)
+        return;
+
+    if (g_null.tvb)
+        BX_ALIGNED_FREE(alloc, g_null.tvb, 16);
+    if (g_null.tib)
+        BX_ALIGNED_FREE(alloc, g_null.tib, 16);
+    if (g_null.matrixCache)
+        BX_ALIGNED_FREE(alloc, g_null.matrixCache, 16);
+    for (int i = 0; i < NullResourceType::Count; i++)
+        g_null.resources[i].destroy();
+
+    g_null.tvb = g_null.tib = nullptr;
+    g_null.matrixCache = nullptr;
+    g_null.init = false;
+    g_null.alloc = nullptr;
+}
+
+static void resetNull(uint32_t width, uint32_t height, GfxResetFlag::Bits flags)
+{
+    BX_UNUSED(flags);
+    g_null.frameStats.width = uint16_t(width);
+    g_null.frameStats.height = uint16_t(height);
+}
+
+static void resetView(uint8_t viewId)
+{
+}
+
+static uint32_t frame()
+{
+    // Transient data is uploaded once per frame
+    GfxStats& fs = g_null.frameStats;
+    fs.transientVbUsed = g_null.tvbOffset;
+    fs.transientIbUsed = g_null.tibOffset;
+    fs.bytesUploaded += g_null.tvbOffset + g_null.tibOffset;
+
+    int64_t now = bx::getHPCounter();
+    fs.cpuTimeBegin = g_null.frameStartTime;
+    fs.cpuTimeEnd = now;
+    g_null.frameStartTime = now;
+
+    g_null.stats = fs;
+
+    // Reset frame data
+    uint16_t width = fs.width, height = fs.height;
+    memset(&fs, 0x00, sizeof(fs));
+    fs.cpuTimerFreq = bx::getHPFrequency();
+    fs.width = width;
+    fs.height = height;
+
+    g_null.tvbOffset = 0;
+    g_null.tibOffset = 0;
+    g_null.numMatrices = 0;
+    memset(&g_null.draw, 0x00, sizeof(g_null.draw));
+    g_null.lastState = 0;
+    g_null.lastProgram = UINT16_MAX;
+    memset(g_null.lastTextures, 0xff, sizeof(g_null.lastTextures));
+
+    return g_null.frame++;
+}
+
+static void setDebug(GfxDebugFlag::Bits debugFlags)
+{
+}
+
+static RendererType::Enum getRendererType()
+{
+    return RendererType::Noop;
+}
+
+static const GfxCaps& getCaps()
+{
+    return g_null.caps;
+}
+
+static const GfxStats& getStats()
+{
+    return g_null.stats;
+}
+
+static const HMDDesc& getHMD()
+{
+    return g_null.hmd;
+}
+
+// Rendering happens in 'frame', so a dedicated render thread has nothing to do and exits after init
+static RenderFrameType::Enum renderFrame()
+{
+    return g_null.init ? RenderFrameType::Exiting : RenderFrameType::NoContext;
+}
+
+static void setPlatformData(const GfxPlatformData& data)
+{
+}
+
+static const GfxInternalData& getInternalData()
+{
+    return g_null.internal;
+}
+
+static void overrideInternal(TextureHandle handle, uintptr_t ptr)
+{
+}
+
+static void overrideInternal2(TextureHandle handle, uint16_t width, uint16_t height, uint8_t numMips,
+                              TextureFormat::Enum fmt, TextureFlag::Bits flags)
+{
+}
+
+static void discard()
+{
+    memset(&g_null.draw, 0x00, sizeof(g_null.draw));
+}
+
+static uint32_t touch(uint8_t id)
+{
+    return 0;
+}
+
+static void setPaletteColor(uint8_t index, uint32_t rgba)
+{
+}
+
+static void setPaletteColorRgba(uint8_t index, float rgba[4])
+{
+}
+
+static void setPaletteColorRgbaf(uint8_t index, float r, float g, float b, float a)
+{
+}
+
+static void saveScreenshot(const char* filepath)
+{
+}
+
+static void setViewName(uint8_t id, const char* name)
+{
+}
+
+static void setViewRect(uint8_t id, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+}
+
+static void setViewRectRatio(uint8_t id, uint16_t x, uint16_t y, BackbufferRatio::Enum ratio)
+{
+}
+
+static void setViewScissor(uint8_t id, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+}
+
+static void setViewClear(uint8_t id, GfxClearFlag::Bits flags, uint32_t rgba, float depth, uint8_t stencil)
+{
+}
+
+static void setViewClearPalette(uint8_t id, GfxClearFlag::Bits flags, float depth, uint8_t stencil,
+                                uint8_t color0, uint8_t color1, uint8_t color2, uint8_t color3,
+                                uint8_t color4, uint8_t color5, uint8_t color6, uint8_t color7)
+{
+}
+
+static void setViewSeq(uint8_t id, bool enabled)
+{
+}
+
+static void setViewTransform(uint8_t id, const void* view, const void* projLeft, GfxViewFlag::Bits flags,
+                             const void* projRight)
+{
+}
+
+static void setViewFrameBuffer(uint8_t id, FrameBufferHandle handle)
+{
+}
+
+static void setMarker(const char* marker)
+{
+}
+
+static void setState(GfxState::Bits state, uint32_t rgba)
+{
+    g_null.draw.state = state;
+}
+
+static void setStencil(GfxStencilState::Bits frontStencil, GfxStencilState::Bits backStencil)
+{
+}
+
+static uint16_t setScissor(uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+    return 0;
+}
+
+static void setScissorCache(uint16_t cache)
+{
+}
+
+static uint32_t allocTransform(GpuTransform* transform, uint16_t num)
+{
+    uint32_t first = g_null.numMatrices;
+    num = uint16_t(bx::uint32_min(num, NULL_MAX_MATRIX_CACHE - first));
+    transform->data = g_null.matrixCache + first*16;
+    transform->num = num;
+    g_null.numMatrices += num;
+    return first;
+}
+
+static uint32_t setTransform(const void* mtx, uint16_t num)
+{
+    GpuTransform transform;
+    uint32_t first = allocTransform(&transform, num);
+    if (transform.num > 0) {
+        memcpy(transform.data, mtx, sizeof(float)*16*transform.num);
+        g_null.frameStats.bytesUploaded += sizeof(float)*16*transform.num;
+    }
+    return first;
+}
+
+static void setTransformCached(uint32_t cache, uint16_t num)
+{
+}
+
+static void setCondition(OcclusionQueryHandle handle, bool visible)
+{
+}
+
+static void setIndexBuffer(IndexBufferHandle handle, uint32_t firstIndex, uint32_t numIndices)
+{
+    NullResource* r = getResource(NullResourceType::IndexBuffer, handle.value);
+    g_null.draw.numIndices = numIndices != UINT32_MAX ? numIndices : r->size/sizeof(uint16_t);
+}
+
+static void setDynamicIndexBuffer(DynamicIndexBufferHandle handle, uint32_t firstIndex, uint32_t numIndices)
+{
+    NullResource* r = getResource(NullResourceType::DynamicIndexBuffer, handle.value);
+    g_null.draw.numIndices = numIndices != UINT32_MAX ? numIndices : r->size/sizeof(uint16_t);
+}
+
+static void setTransientIndexBufferI(const TransientIndexBuffer* tib, uint32_t firstIndex, uint32_t numIndices)
+{
+    g_null.draw.numIndices = bx::uint32_min(numIndices, tib->size/sizeof(uint16_t));
+}
+
+static void setTransientIndexBuffer(const TransientIndexBuffer* tib)
+{
+    g_null.draw.numIndices = tib->size/sizeof(uint16_t);
+}
+
+static void setVertexBuffer(VertexBufferHandle handle)
+{
+    NullResource* r = getResource(NullResourceType::VertexBuffer, handle.value);
+    g_null.draw.numVertices = r->stride ? r->size/r->stride : 0;
+}
+
+static void setVertexBufferI(VertexBufferHandle handle, uint32_t vertexIndex, uint32_t numVertices)
+{
+    NullResource* r = getResource(NullResourceType::VertexBuffer, handle.value);
+    g_null.draw.numVertices = numVertices != UINT32_MAX ? numVertices : (r->stride ? r->size/r->stride : 0);
+}
+
+static void setDynamicVertexBuffer(DynamicVertexBufferHandle handle, uint32_t startVertex, uint32_t numVertices)
+{
+    NullResource* r = getResource(NullResourceType::DynamicVertexBuffer, handle.value);
+    g_null.draw.numVertices = numVertices != UINT32_MAX ? numVertices : (r->stride ? r->size/r->stride : 0);
+}
+
+static void setTransientVertexBuffer(const TransientVertexBuffer* tvb)
+{
+    g_null.draw.numVertices = tvb->stride ? tvb->size/tvb->stride : 0;
+}
+
+static void setTransientVertexBufferI(const TransientVertexBuffer* tvb, uint32_t startVertex, uint32_t numVertices)
+{
+    g_null.draw.numVertices = numVertices;
+}
+
+static void setInstanceDataBuffer(const InstanceDataBuffer* idb, uint32_t num)
+{
+    g_null.draw.numInstances = bx::uint32_min(num, idb->num);
+}
+
+static void setInstanceDataBufferVb(VertexBufferHandle handle, uint32_t startVertex, uint32_t num)
+{
+    g_null.draw.numInstances = num;
+}
+
+static void setInstanceDataBufferDynamicVb(DynamicVertexBufferHandle handle, uint32_t startVertex, uint32_t num)
+{
+    g_null.draw.numInstances = num;
+}
+
+static void setTexture(uint8_t stage, UniformHandle sampler, TextureHandle handle, TextureFlag::Bits flags)
+{
+    if (stage < NULL_MAX_TEXTURE_STAGES)
+        g_null.draw.textures[stage] = handle.value + 1;     // Zero means no texture
+}
+
+// Records a draw call and the state changes compared to the previous one
+static uint32_t recordDraw(ProgramHandle program, bool preserveState)
+{
+    NullDrawState& draw = g_null.draw;
+    GfxStats& fs = g_null.frameStats;
+
+    fs.numDraw++;
+    fs.numIndices += draw.numIndices ? draw.numIndices : draw.numVertices;
+    if (draw.state != g_null.lastState) {
+        fs.numStateChanges++;
+        g_null.lastState = draw.state;
+    }
+    if (program.value != g_null.lastProgram) {
+        fs.numProgramChanges++;
+        g_null.lastProgram = program.value;
+    }
+    for (int i = 0; i < NULL_MAX_TEXTURE_STAGES; i++) {
+        if (draw.textures[i] && draw.textures[i] != g_null.lastTextures[i]) {
+            fs.numTextureChanges++;
+            g_null.lastTextures[i] = draw.textures[i];
+        }
+    }
+
+    if (!preserveState)
+        memset(&draw, 0x00, sizeof(draw));
+    return 0;
+}
+
+static uint32_t submit(uint8_t viewId, ProgramHandle program, int32_t depth, bool preserveState)
+{
+    return recordDraw(program, preserveState);
+}
+
+static uint32_t submitWithOccQuery(uint8_t viewId, ProgramHandle program, OcclusionQueryHandle occQuery, int32_t depth, bool preserveState)
+{
+    return recordDraw(program, preserveState);
+}
+
+static uint32_t submitIndirect(uint8_t viewId, ProgramHandle program, IndirectBufferHandle indirectHandle, uint16_t start,
+                               uint16_t num, int32_t depth, bool preserveState)
+{
+    return recordDraw(program, preserveState);
+}
+
+static void setComputeBufferIb(uint8_t stage, IndexBufferHandle handle, GpuAccessFlag::Enum access)
+{
+}
+
+static void setComputeBufferVb(uint8_t stage, VertexBufferHandle handle, GpuAccessFlag::Enum access)
+{
+}
+
+static void setComputeBufferDynamicIb(uint8_t stage, DynamicIndexBufferHandle handle, GpuAccessFlag::Enum access)
+{
+}
+
+static void setComputeBufferDynamicVb(uint8_t stage, DynamicVertexBufferHandle handle, GpuAccessFlag::Enum access)
+{
+}
+
+static void setComputeBufferIndirect(uint8_t stage, IndirectBufferHandle handle, GpuAccessFlag::Enum access)
+{
+}
+
+static void setComputeImage(uint8_t stage, UniformHandle sampler, TextureHandle handle, uint8_t mip,
+                            GpuAccessFlag::Enum access, TextureFormat::Enum fmt)
+{
+}
+
+static uint32_t computeDispatch(uint8_t viewId, ProgramHandle handle, uint16_t numX, uint16_t numY, uint16_t numZ,
+                                GfxSubmitFlag::Bits flags)
+{
+    g_null.frameStats.numCompute++;
+    return 0;
+}
+
+static uint32_t computeDispatchIndirect(uint8_t viewId, ProgramHandle handle, IndirectBufferHandle indirectHandle,
+                                        uint16_t start, uint16_t num, GfxSubmitFlag::Bits flags)
+{
+    g_null.frameStats.numCompute++;
+    return 0;
+}
+
+static void blit(uint8_t viewId, TextureHandle dest, uint16_t destX, uint16_t destY, TextureHandle src,
+                 uint16_t srcX, uint16_t srcY, uint16_t width, uint16_t height)
+{
+}
+
+static void blitMip(uint8_t viewId, TextureHandle dest, uint8_t destMip, uint16_t destX, uint16_t destY,
+                    uint16_t destZ, TextureHandle src, uint8_t srcMip, uint16_t srcX, uint16_t srcY,
+                    uint16_t srcZ, uint16_t width, uint16_t height, uint16_t depth)
+{
+}
+
+static const GfxMemory* allocMem(uint32_t size)
+{
+    NullMemory* m = (NullMemory*)BX_ALLOC(g_null.alloc, sizeof(NullMemory) + size);
+    if (!m)
+        return nullptr;
+    m->m.data = (uint8_t*)(m + 1);
+    m->m.size = size;
+    m->releaseFn = nullptr;
+    m->userData = nullptr;
+    m->ref = false;
+    return &m->m;
+}
+
+static const GfxMemory* copy(const void* data, uint32_t size)
+{
+    const GfxMemory* mem = allocMem(size);
+    if (mem)
+        memcpy(mem->data, data, size);
+    return mem;
+}
+
+static const GfxMemory* makeRef(const void* data, uint32_t size, gfxReleaseMemCallback releaseFn, void* userData)
+{
+    NullMemory* m = (NullMemory*)BX_ALLOC(g_null.alloc, sizeof(NullMemory));
+    if (!m)
+        return nullptr;
+    m->m.data = (uint8_t*)data;
+    m->m.size = size;
+    m->releaseFn = releaseFn;
+    m->userData = userData;
+    m->ref = true;
+    return &m->m;
+}
+
+static ShaderHandle createShader(const GfxMemory* mem)
+{
+    consumeMem(mem);
+    return ShaderHandle(newResource(NullResourceType::Shader));
+}
+
+static uint16_t getShaderUniforms(ShaderHandle handle, UniformHandle* uniforms, uint16_t _max)
+{
+    return 0;
+}
+
+static void destroyShader(ShaderHandle handle)
+{
+    freeResource(NullResourceType::Shader, handle.value);
+}
+
+static void destroyUniform(UniformHandle handle)
+{
+    freeResource(NullResourceType::Uniform, handle.value);
+}
+
+static ProgramHandle createProgram(ShaderHandle vsh, ShaderHandle fsh, bool destroyShaders)
+{
+    if (destroyShaders) {
+        destroyShader(vsh);
+        destroyShader(fsh);
+    }
+    return ProgramHandle(newResource(NullResourceType::Program));
+}
+
+static void destroyProgram(ProgramHandle handle)
+{
+    freeResource(NullResourceType::Program, handle.value);
+}
+
+static UniformHandle createUniform(const char* name, UniformType::Enum type, uint16_t num)
+{
+    return UniformHandle(newResource(NullResourceType::Uniform, 0, k_uniformSize[type], num));
+}
+
+static void setUniform(UniformHandle handle, const void* value, uint16_t num)
+{
+    NullResource* r = getResource(NullResourceType::Uniform, handle.value);
+    num = num != UINT16_MAX ? num : r->num;
+    g_null.frameStats.bytesUploaded += r->stride*num;
+}
+
+static VertexBufferHandle createVertexBuffer(const GfxMemory* mem, const VertexDecl& decl, GpuBufferFlag::Bits flags)
+{
+    uint32_t size = consumeMem(mem);
+    return VertexBufferHandle(newResource(NullResourceType::VertexBuffer, size, decl.stride));
+}
+
+static DynamicVertexBufferHandle createDynamicVertexBuffer(uint32_t numVertices, const VertexDecl& decl,
+                                                           GpuBufferFlag::Bits flags)
+{
+    return DynamicVertexBufferHandle(newResource(NullResourceType::DynamicVertexBuffer, numVertices*decl.stride,
+                                                 decl.stride));
+}
+
+static DynamicVertexBufferHandle createDynamicVertexBufferMem(const GfxMemory* mem, const VertexDecl& decl,
+                                                              GpuBufferFlag::Bits flags)
+{
+    uint32_t size = consumeMem(mem);
+    return DynamicVertexBufferHandle(newResource(NullResourceType::DynamicVertexBuffer, size, decl.stride));
+}
+
+static void updateDynamicVertexBuffer(DynamicVertexBufferHandle handle, uint32_t startVertex, const GfxMemory* mem)
+{
+    NullResource* r = getResource(NullResourceType::DynamicVertexBuffer, handle.value);
+    uint32_t size = consumeMem(mem);
+    r->size = bx::uint32_max(r->size, startVertex*r->stride + size);
+}
+
+static void destroyVertexBuffer(VertexBufferHandle handle)
+{
+    freeResource(NullResourceType::VertexBuffer, handle.value);
+}
+
+static void destroyDynamicVertexBuffer(DynamicVertexBufferHandle handle)
+{
+    freeResource(NullResourceType::DynamicVertexBuffer, handle.value);
+}
+
+static uint32_t getAvailTransientVertexBuffer(uint32_t num, const VertexDecl& decl)
+{
+    uint32_t stride = decl.stride;
+    uint32_t offset = ((g_null.tvbOffset + stride - 1)/stride)*stride;
+    if (offset >= NULL_TRANSIENT_VB_SIZE)
+        return 0;
+    return bx::uint32_min(num, (NULL_TRANSIENT_VB_SIZE - offset)/stride);
+}
+
+static void allocTransientVertexBuffer(TransientVertexBuffer* tvb, uint32_t num, const VertexDecl& decl)
+{
+    uint32_t stride = decl.stride;
+    uint32_t offset = ((g_null.tvbOffset + stride - 1)/stride)*stride;
+    num = getAvailTransientVertexBuffer(num, decl);
+
+    tvb->data = g_null.tvb + offset;
+    tvb->size = num*stride;
+    tvb->startVertex = offset/stride;
+    tvb->stride = uint16_t(stride);
+    tvb->handle = VertexBufferHandle(0);
+    tvb->decl = VertexDeclHandle(0);
+    g_null.tvbOffset = offset + tvb->size;
+}
+
+static IndexBufferHandle createIndexBuffer(const GfxMemory* mem, GpuBufferFlag::Bits flags)
+{
+    uint32_t size = consumeMem(mem);
+    return IndexBufferHandle(newResource(NullResourceType::IndexBuffer, size));
+}
+
+static DynamicIndexBufferHandle createDynamicIndexBuffer(uint32_t num, GpuBufferFlag::Bits flags)
+{
+    uint32_t indexSize = (flags & GpuBufferFlag::Index32) ? sizeof(uint32_t) : sizeof(uint16_t);
+    return DynamicIndexBufferHandle(newResource(NullResourceType::DynamicIndexBuffer, num*indexSize));
+}
+
+static DynamicIndexBufferHandle createDynamicIndexBufferMem(const GfxMemory* mem, GpuBufferFlag::Bits flags)
+{
+    uint32_t size = consumeMem(mem);
+    return DynamicIndexBufferHandle(newResource(NullResourceType::DynamicIndexBuffer, size));
+}
+
+static void updateDynamicIndexBuffer(DynamicIndexBufferHandle handle, uint32_t startIndex, const GfxMemory* mem)
+{
+    NullResource* r = getResource(NullResourceType::DynamicIndexBuffer, handle.value);
+    uint32_t size = consumeMem(mem);
+    r->size = bx::uint32_max(r->size, startIndex*sizeof(uint16_t) + size);
+}
+
+static void destroyIndexBuffer(IndexBufferHandle handle)
+{
+    freeResource(NullResourceType::IndexBuffer, handle.value);
+}
+
+static void destroyDynamicIndexBuffer(DynamicIndexBufferHandle handle)
+{
+    freeResource(NullResourceType::DynamicIndexBuffer, handle.value);
+}
+
+static uint32_t getAvailTransientIndexBuffer(uint32_t num)
+{
+    uint32_t offset = BX_ALIGN_MASK(g_null.tibOffset, sizeof(uint16_t) - 1);
+    if (offset >= NULL_TRANSIENT_IB_SIZE)
+        return 0;
+    return bx::uint32_min(num, (NULL_TRANSIENT_IB_SIZE - offset)/sizeof(uint16_t));
+}
+
+static void allocTransientIndexBuffer(TransientIndexBuffer* tib, uint32_t num)
+{
+    uint32_t offset = BX_ALIGN_MASK(g_null.tibOffset, sizeof(uint16_t) - 1);
+    num = getAvailTransientIndexBuffer(num);
+
+    tib->data = g_null.tib + offset;
+    tib->size = num*sizeof(uint16_t);
+    tib->startIndex = offset/sizeof(uint16_t);
+    tib->handle = IndexBufferHandle(0);
+    g_null.tibOffset = offset + tib->size;
+}
+
+// Reads the dimensions from DDS and KTX headers, other containers are reported as 1x1 RGBA8
+static void readTextureHeader(const GfxMemory* mem, TextureInfo* info)
+{
+    uint32_t width = 1, height = 1;
+    const uint8_t* data = mem->data;
+    if (mem->size >= 20 && memcmp(data, "DDS ", 4) == 0) {
+        memcpy(&height, data + 12, sizeof(uint32_t));
+        memcpy(&width, data + 16, sizeof(uint32_t));
+    } else if (mem->size >= 44 && memcmp(data + 1, "KTX ", 4) == 0) {
+        memcpy(&width, data + 36, sizeof(uint32_t));
+        memcpy(&height, data + 40, sizeof(uint32_t));
+    }
+    calcTextureSize(info, uint16_t(width), uint16_t(height), 1, false, false, 1, TextureFormat::RGBA8);
+}
+
+static TextureHandle createTexture(const GfxMemory* mem, TextureFlag::Bits flags, uint8_t skipMips, TextureInfo* info)
+{
+    TextureInfo tinfo;
+    readTextureHeader(mem, &tinfo);
+    if (info)
+        *info = tinfo;
+    consumeMem(mem);
+    return TextureHandle(newResource(NullResourceType::Texture, tinfo.storageSize));
+}
+
+static TextureHandle createTexture2D(uint16_t width, uint16_t height, bool hasMips, uint16_t numLayers,
+                                     TextureFormat::Enum fmt, TextureFlag::Bits flags, const GfxMemory* mem)
+{
+    TextureInfo info;
+    calcTextureSize(&info, width, height, 1, false, hasMips, numLayers, fmt);
+    consumeMem(mem);
+    return TextureHandle(newResource(NullResourceType::Texture, info.storageSize));
+}
+
+static TextureHandle createTexture2DRatio(BackbufferRatio::Enum ratio, bool hasMips, uint16_t numLayers,
+                                          TextureFormat::Enum fmt, TextureFlag::Bits flags)
+{
+    TextureInfo info;
+    calcTextureSize(&info, g_null.frameStats.width, g_null.frameStats.height, 1, false, hasMips, numLayers, fmt);
+    return TextureHandle(newResource(NullResourceType::Texture, info.storageSize));
+}
+
+static void updateTexture2D(TextureHandle handle, uint16_t layer, uint8_t mip, uint16_t x, uint16_t y, uint16_t width,
+                            uint16_t height, const GfxMemory* mem, uint16_t pitch)
+{
+    consumeMem(mem);
+}
+
+static TextureHandle createTexture3D(uint16_t width, uint16_t height, uint16_t depth, bool hasMips,
+                                     TextureFormat::Enum fmt, TextureFlag::Bits flags, const GfxMemory* mem)
+{
+    TextureInfo info;
+    calcTextureSize(&info, width, height, depth, false, hasMips, 1, fmt);
+    consumeMem(mem);
+    return TextureHandle(newResource(NullResourceType::Texture, info.storageSize));
+}
+
+static void updateTexture3D(TextureHandle handle, uint8_t mip, uint16_t x, uint16_t y, uint16_t z,
+                            uint16_t width, uint16_t height, uint16_t depth, const GfxMemory* mem)
+{
+    consumeMem(mem);
+}
+
+static TextureHandle createTextureCube(uint16_t size, bool hasMips, uint16_t numLayers, TextureFormat::Enum fmt,
+                                       TextureFlag::Bits flags, const GfxMemory* mem)
+{
+    TextureInfo info;
+    calcTextureSize(&info, size, size, 1, true, hasMips, numLayers, fmt);
+    consumeMem(mem);
+    return TextureHandle(newResource(NullResourceType::Texture, info.storageSize));
+}
+
+static void updateTextureCube(TextureHandle handle, uint16_t layer, CubeSide::Enum side, uint8_t mip, uint16_t x, uint16_t y,
+                              uint16_t width, uint16_t height, const GfxMemory* mem, uint16_t pitch)
+{
+    consumeMem(mem);
+}
+
+static void readTexture(TextureHandle handle, void* data, uint8_t mip)
+{
+}
+
+static void destroyTexture(TextureHandle handle)
+{
+    freeResource(NullResourceType::Texture, handle.value);
+}
+
+static FrameBufferHandle createFrameBufferWithTexture(TextureHandle texture, bool destroyTexture)
+{
+    uint16_t handle = newResource(NullResourceType::FrameBuffer);
+    if (handle != UINT16_MAX)
+        getResource(NullResourceType::FrameBuffer, handle)->texture = destroyTexture ? texture.value : UINT16_MAX;
+    return FrameBufferHandle(handle);
+}
+
+static FrameBufferHandle createFrameBuffer(uint16_t width, uint16_t height, TextureFormat::Enum fmt, TextureFlag::Bits flags)
+{
+    return createFrameBufferWithTexture(createTexture2D(width, height, false, 1, fmt, flags, nullptr), true);
+}
+
+static FrameBufferHandle createFrameBufferRatio(BackbufferRatio::Enum ratio, TextureFormat::Enum fmt, TextureFlag::Bits flags)
+{
+    return createFrameBufferWithTexture(createTexture2DRatio(ratio, false, 1, fmt, flags), true);
+}
+
+static FrameBufferHandle createFrameBufferMRT(uint8_t num, const TextureHandle* handles, bool destroyTextures)
+{
+    return createFrameBufferWithTexture(num > 0 ? handles[0] : TextureHandle(), destroyTextures);
+}
+
+static FrameBufferHandle createFrameBufferAttachment(uint8_t num, const GfxAttachment* attachment, bool destroyTextures)
+{
+    return createFrameBufferWithTexture(num > 0 ? attachment[0].handle : TextureHandle(), destroyTextures);
+}
+
+static FrameBufferHandle createFrameBufferNative(void* nwh, uint16_t width, uint16_t height, TextureFormat::Enum depthFmt)
+{
+    return createFrameBufferWithTexture(TextureHandle(), false);
+}
+
+static void destroyFrameBuffer(FrameBufferHandle handle)
+{
+    if (!handle.isValid())
+        return;
+    NullResource* r = getResource(NullResourceType::FrameBuffer, handle.value);
+    freeResource(NullResourceType::Texture, r->texture);
+    freeResource(NullResourceType::FrameBuffer, handle.value);
+}
+
+static TextureHandle getFrameBufferTexture(FrameBufferHandle handle, uint8_t attachment)
+{
+    return TextureHandle(getResource(NullResourceType::FrameBuffer, handle.value)->texture);
+}
+
+static uint32_t getAvailInstanceDataBuffer(uint32_t num, uint16_t stride)
+{
+    uint32_t offset = BX_ALIGN_16(g_null.tvbOffset) + BX_ALIGN_16(sizeof(InstanceDataBuffer));
+    if (offset >= NULL_TRANSIENT_VB_SIZE)
+        return 0;
+    return bx::uint32_min(num, (NULL_TRANSIENT_VB_SIZE - offset)/stride);
+}
+
+// Instance data is allocated from the transient vertex buffer, header included
+static const InstanceDataBuffer* allocInstanceDataBuffer(uint32_t num, uint16_t stride)
+{
+    num = getAvailInstanceDataBuffer(num, stride);
+    uint32_t offset = BX_ALIGN_16(g_null.tvbOffset);
+    InstanceDataBuffer* idb = (InstanceDataBuffer*)(g_null.tvb + offset);
+    offset += BX_ALIGN_16(sizeof(InstanceDataBuffer));
+
+    idb->data = g_null.tvb + offset;
+    idb->size = num*stride;
+    idb->offset = offset;
+    idb->num = num;
+    idb->stride = stride;
+    idb->handle = VertexBufferHandle(0);
+    g_null.tvbOffset = offset + idb->size;
+    return idb;
+}
+
+static IndirectBufferHandle createIndirectBuffer(uint32_t num)
+{
+    return IndirectBufferHandle(newResource(NullResourceType::IndirectBuffer));
+}
+
+static void destroyIndirectBuffer(IndirectBufferHandle handle)
+{
+    freeResource(NullResourceType::IndirectBuffer, handle.value);
+}
+
+static OcclusionQueryHandle createOccQuery()
+{
+    return OcclusionQueryHandle(newResource(NullResourceType::OcclusionQuery));
+}
+
+static OcclusionQueryResult::Enum getResult(OcclusionQueryHandle handle)
+{
+    return OcclusionQueryResult::Visible;
+}
+
+static void destroyOccQuery(OcclusionQueryHandle handle)
+{
+    freeResource(NullResourceType::OcclusionQuery, handle.value);
+}
+
+static void dbgTextClear(uint8_t attr, bool small)
+{
+}
+
+static void dbgTextPrintf(uint16_t x, uint16_t y, uint8_t attr, const char* format, ...)
+{
+}
+
+static void dbgTextImage(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const void* data, uint16_t pitch)
+{
+}
+
+PluginDesc* getNullDriverDesc()
+{
+    static PluginDesc desc;
+    strcpy(desc.name, "Null");
+    strcpy(desc.description, "Null Graphics Driver (Headless)");
+    desc.type = PluginType::GraphicsDriver;
+    desc.version = T_MAKE_VERSION(1, 0);
+    return &desc;
+}
+
+void* initNullDriver(bx::AllocatorI* alloc, GetApiFunc getApi)
+{
+    static GfxDriverApi api;
+
+    api.init = initNull;
+    api.shutdown = shutdownNull;
+    api.reset = resetNull;
+    api.frame = frame;
+    api.setDebug = setDebug;
+    api.getRendererType = getRendererType;
+    api.getCaps = getCaps;
+    api.getStats = getStats;
+    api.getHMD = getHMD;
+    api.renderFrame = renderFrame;
+    api.setPlatformData = setPlatformData;
+    api.getInternalData = getInternalData;
+    api.overrideInternal = overrideInternal;
+    api.overrideInternal2 = overrideInternal2;
+    api.discard = discard;
+    api.touch = touch;
+    api.setPaletteColor = setPaletteColor;
+    api.setPaletteColorRgba = setPaletteColorRgba;
+    api.setPaletteColorRgbaf = setPaletteColorRgbaf;
+    api.saveScreenshot = saveScreenshot;
+    api.setViewName = setViewName;
+    api.setViewRect = setViewRect;
+    api.setViewRectRatio = setViewRectRatio;
+    api.setViewScissor = setViewScissor;
+    api.setViewClear = setViewClear;
+    api.setViewClearPalette = setViewClearPalette;
+    api.setViewSeq = setViewSeq;
+    api.setViewTransform = setViewTransform;
+    api.setViewFrameBuffer = setViewFrameBuffer;
+    api.resetView = resetView;
+    api.setMarker = setMarker;
+    api.setState = setState;
+    api.setStencil = setStencil;
+    api.setScissor = setScissor;
+    api.setScissorCache = setScissorCache;
+    api.allocTransform = allocTransform;
+    api.setTransform = setTransform;
+    api.setTransformCached = setTransformCached;
+    api.setCondition = setCondition;
+    api.setIndexBuffer = setIndexBuffer;
+    api.setDynamicIndexBuffer = setDynamicIndexBuffer;
+    api.setTransientIndexBuffer = setTransientIndexBuffer;
+    api.setTransientIndexBufferI = setTransientIndexBufferI;
+    api.setVertexBuffer = setVertexBuffer;
+    api.setVertexBufferI = setVertexBufferI;
+    api.setDynamicVertexBuffer = setDynamicVertexBuffer;
+    api.setTransientVertexBuffer = setTransientVertexBuffer;
+    api.setTransientVertexBufferI = setTransientVertexBufferI;
+    api.setInstanceDataBuffer = setInstanceDataBuffer;
+    api.setInstanceDataBufferVb = setInstanceDataBufferVb;
+    api.setInstanceDataBufferDynamicVb = setInstanceDataBufferDynamicVb;
+    api.setTexture = setTexture;
+    api.submit = submit;
+    api.submitWithOccQuery = submitWithOccQuery;
+    api.submitIndirect = submitIndirect;
+    api.setComputeBufferIb = setComputeBufferIb;
+    api.setComputeBufferVb = setComputeBufferVb;
+    api.setComputeBufferDynamicVb = setComputeBufferDynamicVb;
+    api.setComputeBufferDynamicIb = setComputeBufferDynamicIb;
+    api.setComputeBufferIndirect = setComputeBufferIndirect;
+    api.setComputeImage = setComputeImage;
+    api.computeDispatch = computeDispatch;
+    api.computeDispatchIndirect = computeDispatchIndirect;
+    api.blit = blit;
+    api.blitMip = blitMip;
+    api.alloc = allocMem;
+    api.copy = copy;
+    api.makeRef = makeRef;
+    api.createShader = createShader;
+    api.getShaderUniforms = getShaderUniforms;
+    api.destroyShader = destroyShader;
+    api.createProgram = createProgram;
+    api.destroyProgram = destroyProgram;
+    api.destroyUniform = destroyUniform;
+    api.createUniform = createUniform;
+    api.setUniform = setUniform;
+    api.createVertexBuffer = createVertexBuffer;
+    api.createDynamicVertexBuffer = createDynamicVertexBuffer;
+    api.createDynamicVertexBufferMem = createDynamicVertexBufferMem;
+    api.updateDynamicVertexBuffer = updateDynamicVertexBuffer;
+    api.destroyVertexBuffer = destroyVertexBuffer;
+    api.destroyDynamicVertexBuffer = destroyDynamicVertexBuffer;
+    api.getAvailTransientVertexBuffer = getAvailTransientVertexBuffer;
+    api.getAvailTransientIndexBuffer = getAvailTransientIndexBuffer;
+    api.allocTransientVertexBuffer = allocTransientVertexBuffer;
+    api.allocTransientIndexBuffer = allocTransientIndexBuffer;
+    api.createIndexBuffer = createIndexBuffer;
+    api.createDynamicIndexBuffer = createDynamicIndexBuffer;
+    api.updateDynamicIndexBuffer = updateDynamicIndexBuffer;
+    api.createDynamicIndexBufferMem = createDynamicIndexBufferMem;
+    api.destroyIndexBuffer = destroyIndexBuffer;
+    api.destroyDynamicIndexBuffer = destroyDynamicIndexBuffer;
+    api.calcTextureSize = calcTextureSize;
+    api.createTexture = createTexture;
+    api.createTexture2D = createTexture2D;
+    api.createTexture2DRatio = createTexture2DRatio;
+    api.updateTexture2D = updateTexture2D;
+    api.createTexture3D = createTexture3D;
+    api.updateTexture3D = updateTexture3D;
+    api.createTextureCube = createTextureCube;
+    api.updateTextureCube = updateTextureCube;
+    api.readTexture = readTexture;
+    api.destroyTexture = destroyTexture;
+    api.createFrameBuffer = createFrameBuffer;
+    api.createFrameBufferRatio = createFrameBufferRatio;
+    api.createFrameBufferMRT = createFrameBufferMRT;
+    api.createFrameBufferNative = createFrameBufferNative;
+    api.createFrameBufferAttachment = createFrameBufferAttachment;
+    api.destroyFrameBuffer = destroyFrameBuffer;
+    api.getFrameBufferTexture = getFrameBufferTexture;
+    api.getAvailInstanceDataBuffer = getAvailInstanceDataBuffer;
+    api.allocInstanceDataBuffer = allocInstanceDataBuffer;
+    api.createIndirectBuffer = createIndirectBuffer;
+    api.destroyIndirectBuffer = destroyIndirectBuffer;
+    api.createOccQuery = createOccQuery;
+    api.getResult = getResult;
+    api.destroyOccQuery = destroyOccQuery;
+    api.dbgTextClear = dbgTextClear;
+    api.dbgTextPrintf = dbgTextPrintf;
+    api.dbgTextImage = dbgTextImage;
+
+    return &api;
+}
+
+void shutdownNullDriver()
+{
+}
+
+#ifdef termite_SHARED_LIB
+T_PLUGIN_EXPORT void* termiteGetPluginApi(uint16_t apiId, uint32_t version)
+{
+    static PluginApi_v0 v0;
+
+    if (version == 0) {
+        v0.init = initNullDriver;
+        v0.shutdown = shutdownNullDriver;
+        v0.getDesc = getNullDriverDesc;
+        return &v0;
+    } else {
+        return nullptr;
+    }
+}
+#endif
@@ -72,6 +72,7 @@ static void imguiDrawLists(ImDrawData* data)
     assert(g_Im);
 
     GfxDriverApi* driver = g_Im->driver;
+    GfxSubsystemStats* stats = getGfxSubsystemFrameStats(GfxSubsystem::ImGui);
 
     float proj[16];
     float width = ImGui::GetIO().DisplaySize.x;
@@ -97,11 +98,16 @@ static void imguiDrawLists(ImDrawData* data)
         if (driver->getAvailTransientVertexBuffer(numVertices, imVertexPosCoordColor::Decl) != numVertices ||
             driver->getAvailTransientIndexBuffer(numIndices) != numIndices) 
         {
+            stats->numDropped++;
             break;
         }
 
         driver->allocTransientVertexBuffer(&tvb, numVertices, imVertexPosCoordColor::Decl);
         driver->allocTransientIndexBuffer(&tib, numIndices);
+        stats->numVerts += numVertices;
+        stats->numIndices += numIndices;
+        stats->transientBytes += tvb.size + tib.size;
+        stats->numBatches++;
 
         // Fill Vertex/Index data
         imVertexPosCoordColor* verts = (imVertexPosCoordColor*)tvb.data;
@@ -141,6 +147,7 @@ static void imguiDrawLists(ImDrawData* data)
                 driver->setState(state, 0);
 
                 driver->submit(viewId, g_Im->progHandle, 0, false);
+                stats->numSubmits++;
             }
 
             indexOffset += cmd.ElemCount;
@@ -3,19 +3,37 @@
 #include "bx/bx.h"
 
 #define TSPRITE_SIGN 0x54535052
-#define TSPRITE_VERSION 0x312e30
+#define TSPRITE_VERSION_10 0x312e30     // 1.0
+#define TSPRITE_VERSION_11 0x312e31     // 1.1: sprites carry name hash and full frame info
+#define TSPRITE_VERSION TSPRITE_VERSION_11
 
 #pragma pack(push, 1)
 
 namespace termite
 {
-    struct tsSprite
+    struct tsSprite10
     {
         float tx0, ty0;
         float tx1, ty1;
         uint64_t tag; // 0 or hashed name value
     };
 
+    // Holds all the fields of the runtime SpriteSheetFrame, so loading needs no texture lookups or math
+    // Fields are converted one by one on load, the layouts are not the same (packed, 64-bit hashes)
+    struct tsSprite
+    {
+        float tx0, ty0;
+        float tx1, ty1;
+        uint64_t tag;           // 0 or hashed tag name
+        uint64_t nameHash;      // tinystl::hash_string of sprite name, used for frame lookups
+        float pivot[2];         // (-0.5~0.5), Y is up
+        float sourceSize[2];    // Original sprite size in pixels
+        float posOffset[2];     // Trimmed offset, normalized
+        float sizeOffset[2];    // Trimmed size, normalized
+        float rotOffset;        // Degrees, 0 or -90
+        float pixelRatio;       // sourceSize.x / sourceSize.y
+    };
+
     struct tsAnimation
     {
         char name[32];
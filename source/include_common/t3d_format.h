@@ -4,6 +4,9 @@
 
 #define T3D_SIGN        0x543344	// T3D
 #define T3D_VERSION_10	0x312e30	// 1.0
+#define T3D_VERSION_20	0x322e30	// 2.0
+#define T3D_VERSION_21	0x322e31	// 2.1
+#define T3D_BLOB_ALIGN  16          // v2.0: Alignment of vertex/index blobs from the start of the file
 
 #pragma pack(push, 1)
 
@@ -33,6 +36,29 @@ namespace termite
         };
     };
 
+    // Same order as termite::VertexAttribType
+    struct t3dVertexAttribType
+    {
+        enum Enum
+        {
+            Uint8,
+            Uint10,
+            Int16,
+            Half,
+            Float
+        };
+    };
+
+    // v2.0: Replaces the t3dVertexAttrib::Enum array of v1.0, so vertices can be quantized
+    struct t3dVertexAttribDesc
+    {
+        t3dVertexAttrib::Enum attrib;
+        uint8_t type;   // t3dVertexAttribType
+        uint8_t num;
+        uint8_t normalized;
+        uint8_t asInt;
+    };
+
     struct t3dTextureUsage
     {
         enum Enum
@@ -56,6 +82,15 @@ namespace termite
         int parent;
     };
 
+    // v2.1: Array of joint flags follows initPose
+    struct t3dJointFlag
+    {
+        enum Enum
+        {
+            SceneRoot = 0x1     // Joint's node is a direct child of the scene root, initPose includes skel.rootMtx
+        };
+    };
+
     struct t3dGeometry
     {
         int numTris;
@@ -66,18 +101,29 @@ namespace termite
         struct skel_t
         {
             int numJoints;
-            float rootMtx[12];
+            float rootMtx[12];  // v2.1: Includes the scale of the model
         } skel;
 
 #if 0
         h3dJoint* joints;
         float* initPose;    // array of 4x3 matrices float[12]
+        int* jointFlags;    // v2.1: t3dJointFlag
         t3dVertexAttrib::Enum* attribs;  
         void* verts;    // each vertex is packed into single struct
         uint16_t* indices;
 #endif
     };
 
+    // v2.0: Follows t3dGeometry, vertex and index data are not inlined, but are stored in blobs
+    //       aligned to T3D_BLOB_ALIGN, so they can be referenced directly from the loaded file
+    struct t3dGeometryBlobs
+    {
+        float posOffset[3];     // Int16 positions: pos = posOffset + a_position*posScale
+        float posScale[3];      // Uniform, all components are equal
+        int64_t indicesOffset;
+        int64_t vertsOffset;
+    };
+
     struct t3dSubmesh
     {
         int mtl;
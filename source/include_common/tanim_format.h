@@ -3,7 +3,9 @@
 #include "bx/bx.h"
 
 #define TANIM_SIGN 0x54414e4d   // TANM
-#define TANIM_VERSION 0x312e30  // 1.0
+#define TANIM_VERSION_10 0x312e30   // 1.0: Raw keys for every frame
+#define TANIM_VERSION_20 0x322e30   // 2.0: Reduced and quantized keys
+#define TANIM_VERSION TANIM_VERSION_20
 
 #pragma pack(push, 1)
 
@@ -19,6 +21,28 @@ namespace termite
 #endif
     };
 
+    // v2 channel, followed by key data:
+    //  - Position keys: uint16_t frames[numPosKeys], uint16_t values[numPosKeys*4] (x, y, z, scale)
+    //    Dequantized by posMin + value*posScale
+    //  - Rotation keys: uint16_t frames[numRotKeys], uint16_t values[numRotKeys*3]
+    //    Smallest three components, mapped from [-1/sqrt(2), 1/sqrt(2)] to 15 bits
+    //    Index of the dropped (largest) component is in top bits of first and second values
+    struct taChannelPacked
+    {
+        char bindto[32];
+        float posMin[4];
+        float posScale[4];
+        int numPosKeys;
+        int numRotKeys;
+
+#if 0
+        uint16_t* posFrames;
+        uint16_t* poss;
+        uint16_t* rotFrames;
+        uint16_t* rots;
+#endif
+    };
+
     struct taClip
     {
         char name[32];
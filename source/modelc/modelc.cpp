@@ -1,11 +1,13 @@
 #include <cstdio>
 #include <cstdlib>
+#include <cfloat>
 
 #include "bx/allocator.h"
 #include "bx/commandline.h"
 #include "bx/crtimpl.h"
 #include "bx/fpumath.h"
 #include "bx/string.h"
+#include "bx/uint32_t.h"
 #include "bxx/array.h"
 #include "bxx/path.h"
 
@@ -27,6 +29,16 @@
 
 using namespace termite;
 
+struct VertexQuant
+{
+    enum Enum
+    {
+        None,
+        Half,   // Half floats
+        Int16   // Normalized 16-bit positions/normals, half float texcoords, 8-bit weights
+    };
+};
+
 static bx::CrtAllocator g_alloc;
 static LogFormatProxy* g_logger = nullptr;
 
@@ -40,11 +52,15 @@ struct Args
     ZAxis zaxis;
     bx::Path outputMtl;
     char modelName[32];
+    bool optimize;
+    VertexQuant::Enum quant;
 
     Args()
     {
         verbose = false;
         buildTangents = false;
+        optimize = true;
+        quant = VertexQuant::None;
         scale = 1.0f;
         zaxis = ZAxis::Unknown;
         modelName[0] = 0;
@@ -58,10 +74,14 @@ struct ModelData
         t3dGeometry g;
         t3dJoint* joints;
         float* initPose;
+        int* jointFlags;
         t3dVertexAttrib::Enum* attribs;
         int* attribOffsets;
+        t3dVertexAttribDesc* attribDescs;   // Final vertex layout, filled by quantizeGeo
         void* verts;
         uint16_t* indices;
+        float posOffset[3];
+        float posScale[3];
     };
 
     struct Material
@@ -105,12 +125,16 @@ struct ModelData
                 BX_FREE(&g_alloc, geo.attribs);
             if (geo.attribOffsets)
                 BX_FREE(&g_alloc, geo.attribOffsets);
+            if (geo.attribDescs)
+                BX_FREE(&g_alloc, geo.attribDescs);
             if (geo.indices)
                 BX_FREE(&g_alloc, geo.indices);
             if (geo.joints)
                 BX_FREE(&g_alloc, geo.joints);
             if (geo.initPose)
                 BX_FREE(&g_alloc, geo.initPose);
+            if (geo.jointFlags)
+                BX_FREE(&g_alloc, geo.jointFlags);
         }
 
         for (int i = 0; i < meshes.getCount(); i++) {
@@ -219,11 +243,9 @@ static int findGeoBoneIndex(const bx::Array<aiNode*>& bones, const char *name)
 
 static void setupGeoJoints(const aiScene* scene, const bx::Array<aiNode*>& bones,
                            const bx::Array<aiBone*>& skinBones, const Args& conf,
-                           const mtx4x4_t& rootMtx, t3dJoint* joints, float* initPose)
+                           const mtx4x4_t& rootMtx, t3dJoint* joints, float* initPose, int* jointFlags)
 {
     mtx4x4_t offsetMtx;
-    mtx4x4_t scaleMtx;
-    bx::mtxScale(scaleMtx.f, conf.scale, conf.scale, conf.scale);
 
     for (int i = 0; i < bones.getCount(); i++) {
         aiNode* bone = bones[i];
@@ -239,6 +261,7 @@ static void setupGeoJoints(const aiScene* scene, const bx::Array<aiNode*>& bones
 
         saveMtx(offsetMtx, joints[i].offsetMtx);
         joints[i].parent = -1;
+        jointFlags[i] = 0;
 
         // Resolve parent and Transformation of joint
         aiNode* ajointNode = findNodeRecursive(scene->mRootNode, bone->mName.C_Str());
@@ -247,7 +270,8 @@ static void setupGeoJoints(const aiScene* scene, const bx::Array<aiNode*>& bones
                 findGeoBoneIndex(bones, ajointNode->mParent->mName.C_Str()) : -1;
             mtx4x4_t jointMtx = convertMtx(ajointNode->mTransformation, conf.zaxis);
             if (ajointNode->mParent == scene->mRootNode) {
-                jointMtx = (jointMtx * rootMtx) * scaleMtx;
+                jointMtx = jointMtx * rootMtx;
+                jointFlags[i] |= t3dJointFlag::SceneRoot;
             }
             saveMtx(jointMtx, &initPose[i * 12]);
         }
@@ -263,6 +287,477 @@ static int findAttrib(const t3dVertexAttrib::Enum* attribs, int numAttribs, t3dV
     return -1;
 }
 
+// Vertex cache optimization (Tom Forsyth's linear-speed algorithm), reorders triangles of an index range
+static const int kVertexCacheSize = 32;
+
+static float getVertexCacheScore(int cachePos, int numTrisLeft)
+{
+    if (numTrisLeft == 0)
+        return -1.0f;
+
+    float score = 0;
+    if (cachePos >= 0) {
+        // Last triangle's vertices get a fixed score, so the next triangle doesn't favor them
+        if (cachePos < 3)
+            score = 0.75f;
+        else
+            score = powf(1.0f - float(cachePos - 3) / float(kVertexCacheSize - 3), 1.5f);
+    }
+
+    // Boost vertices with few triangles left, to get rid of lone triangles
+    return score + 2.0f*powf(float(numTrisLeft), -0.5f);
+}
+
+static void optimizeVertexCache(uint16_t* indices, int numIndices, int numVerts)
+{
+    int numTris = numIndices / 3;
+    if (numTris < 2)
+        return;
+
+    int* numTrisLeft = (int*)BX_ALLOC(&g_alloc, sizeof(int)*numVerts);
+    int* triStart = (int*)BX_ALLOC(&g_alloc, sizeof(int)*(numVerts + 1));
+    int* triList = (int*)BX_ALLOC(&g_alloc, sizeof(int)*numIndices);
+    int* cachePos = (int*)BX_ALLOC(&g_alloc, sizeof(int)*numVerts);
+    float* vertScore = (float*)BX_ALLOC(&g_alloc, sizeof(float)*numVerts);
+    float* triScore = (float*)BX_ALLOC(&g_alloc, sizeof(float)*numTris);
+    bool* triAdded = (bool*)BX_ALLOC(&g_alloc, sizeof(bool)*numTris);
+    uint16_t* result = (uint16_t*)BX_ALLOC(&g_alloc, sizeof(uint16_t)*numIndices);
+
+    // Vertex -> triangle adjacency
+    memset(numTrisLeft, 0x00, sizeof(int)*numVerts);
+    for (int i = 0; i < numIndices; i++)
+        numTrisLeft[indices[i]]++;
+    triStart[0] = 0;
+    for (int i = 0; i < numVerts; i++)
+        triStart[i + 1] = triStart[i] + numTrisLeft[i];
+    memset(numTrisLeft, 0x00, sizeof(int)*numVerts);
+    for (int i = 0; i < numIndices; i++) {
+        int v = indices[i];
+        triList[triStart[v] + numTrisLeft[v]++] = i / 3;
+    }
+
+    for (int i = 0; i < numVerts; i++) {
+        cachePos[i] = -1;
+        vertScore[i] = getVertexCacheScore(-1, numTrisLeft[i]);
+    }
+
+    int bestTri = -1;
+    float bestScore = -1.0f;
+    for (int i = 0; i < numTris; i++) {
+        const uint16_t* tri = &indices[i * 3];
+        triAdded[i] = false;
+        triScore[i] = vertScore[tri[0]] + vertScore[tri[1]] + vertScore[tri[2]];
+        if (triScore[i] > bestScore) {
+            bestScore = triScore[i];
+            bestTri = i;
+        }
+    }
+
+    int cache[kVertexCacheSize + 3];
+    int cacheCount = 0;
+    int firstTri = 0;
+
+    for (int n = 0; n < numTris; n++) {
+        // Nothing useful in the cache, pick the best of the remaining triangles
+        if (bestTri == -1) {
+            while (triAdded[firstTri])
+                firstTri++;
+            bestScore = -1.0f;
+            for (int i = firstTri; i < numTris; i++) {
+                if (!triAdded[i] && triScore[i] > bestScore) {
+                    bestScore = triScore[i];
+                    bestTri = i;
+                }
+            }
+        }
+
+        const uint16_t* tri = &indices[bestTri * 3];
+        triAdded[bestTri] = true;
+        memcpy(&result[n * 3], tri, sizeof(uint16_t) * 3);
+
+        // Remove the triangle from it's vertices
+        for (int k = 0; k < 3; k++) {
+            int v = tri[k];
+            int* list = &triList[triStart[v]];
+            int count = numTrisLeft[v];
+            for (int j = 0; j < count; j++) {
+                if (list[j] == bestTri) {
+                    list[j] = list[count - 1];
+                    break;
+                }
+            }
+            numTrisLeft[v]--;
+        }
+
+        // Push triangle vertices to the front of the LRU cache
+        int newCache[kVertexCacheSize + 3];
+        int newCount = 0;
+        for (int k = 0; k < 3; k++)
+            newCache[newCount++] = tri[k];
+        for (int j = 0; j < cacheCount; j++) {
+            int v = cache[j];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCount++] = v;
+        }
+
+        cacheCount = bx::uint32_min(newCount, kVertexCacheSize);
+        for (int j = 0; j < newCount; j++) {
+            int v = newCache[j];
+            cachePos[v] = j < cacheCount ? j : -1;
+            vertScore[v] = getVertexCacheScore(cachePos[v], numTrisLeft[v]);
+        }
+        memcpy(cache, newCache, sizeof(int)*cacheCount);
+
+        // Update triangles touching the cache (including evicted vertices) and pick the best one
+        bestTri = -1;
+        bestScore = -1.0f;
+        for (int j = 0; j < newCount; j++) {
+            int v = newCache[j];
+            const int* list = &triList[triStart[v]];
+            for (int c = 0, cc = numTrisLeft[v]; c < cc; c++) {
+                int t = list[c];
+                const uint16_t* ttri = &indices[t * 3];
+                triScore[t] = vertScore[ttri[0]] + vertScore[ttri[1]] + vertScore[ttri[2]];
+                if (j < cacheCount && triScore[t] > bestScore) {
+                    bestScore = triScore[t];
+                    bestTri = t;
+                }
+            }
+        }
+    }
+
+    memcpy(indices, result, sizeof(uint16_t)*numIndices);
+
+    BX_FREE(&g_alloc, result);
+    BX_FREE(&g_alloc, triAdded);
+    BX_FREE(&g_alloc, triScore);
+    BX_FREE(&g_alloc, vertScore);
+    BX_FREE(&g_alloc, cachePos);
+    BX_FREE(&g_alloc, triList);
+    BX_FREE(&g_alloc, triStart);
+    BX_FREE(&g_alloc, numTrisLeft);
+}
+
+struct TriCluster
+{
+    float key;
+    int startTri;
+    int numTris;
+};
+
+static int compareTriClusters(const void* a, const void* b)
+{
+    float ka = ((const TriCluster*)a)->key;
+    float kb = ((const TriCluster*)b)->key;
+    return ka < kb ? 1 : (ka > kb ? -1 : 0);
+}
+
+// Overdraw optimization: Splits the (cache optimized) triangles into clusters where the vertex cache restarts,
+// and sorts them so the clusters facing out of the mesh center are drawn first
+// Clusters are kept intact, so the vertex cache efficiency is mostly preserved
+static void optimizeOverdraw(uint16_t* indices, int numIndices, const uint8_t* verts, int numVerts,
+                             int vertStride, int posOffset)
+{
+    static const int kFifoCacheSize = 16;
+
+    int numTris = numIndices / 3;
+    if (numTris < 2)
+        return;
+
+    TriCluster* clusters = (TriCluster*)BX_ALLOC(&g_alloc, sizeof(TriCluster)*numTris);
+    vec3_t* centers = (vec3_t*)BX_ALLOC(&g_alloc, sizeof(vec3_t)*numTris);
+    vec3_t* normals = (vec3_t*)BX_ALLOC(&g_alloc, sizeof(vec3_t)*numTris);
+    float* areas = (float*)BX_ALLOC(&g_alloc, sizeof(float)*numTris);
+    int* stamps = (int*)BX_ALLOC(&g_alloc, sizeof(int)*numVerts);
+    uint16_t* result = (uint16_t*)BX_ALLOC(&g_alloc, sizeof(uint16_t)*numIndices);
+    memset(stamps, 0x00, sizeof(int)*numVerts);
+
+    // Find cluster boundaries, by simulating a FIFO cache
+    int numClusters = 0;
+    int timestamp = kFifoCacheSize + 1;
+    for (int i = 0; i < numTris; i++) {
+        int misses = 0;
+        for (int k = 0; k < 3; k++) {
+            int v = indices[i * 3 + k];
+            if (timestamp - stamps[v] > kFifoCacheSize) {
+                stamps[v] = timestamp++;
+                misses++;
+            }
+        }
+
+        if (i == 0 || misses == 3) {
+            clusters[numClusters].startTri = i;
+            clusters[numClusters].numTris = 0;
+            numClusters++;
+        }
+        clusters[numClusters - 1].numTris++;
+    }
+
+    // Area weighted center and normal of each cluster
+    vec3_t meshCenter = vec3f(0, 0, 0);
+    float meshArea = 0;
+    for (int i = 0; i < numClusters; i++) {
+        vec3_t center = vec3f(0, 0, 0);
+        vec3_t normal = vec3f(0, 0, 0);
+        float area = 0;
+        for (int t = clusters[i].startTri, te = t + clusters[i].numTris; t < te; t++) {
+            const float* p0 = (const float*)(verts + vertStride*indices[t * 3] + posOffset);
+            const float* p1 = (const float*)(verts + vertStride*indices[t * 3 + 1] + posOffset);
+            const float* p2 = (const float*)(verts + vertStride*indices[t * 3 + 2] + posOffset);
+
+            float e0[3], e1[3], n[3];
+            bx::vec3Sub(e0, p1, p0);
+            bx::vec3Sub(e1, p2, p0);
+            bx::vec3Cross(n, e0, e1);
+            float triArea = bx::vec3Length(n);
+
+            for (int k = 0; k < 3; k++)
+                center.f[k] += (p0[k] + p1[k] + p2[k])*triArea/3.0f;
+            bx::vec3Add(normal.f, normal.f, n);
+            area += triArea;
+        }
+
+        if (area > 0) 
+            bx::vec3Mul(center.f, center.f, 1.0f/area);
+        else
+            center = vec3fv((const float*)(verts + vertStride*indices[clusters[i].startTri * 3] + posOffset));
+
+        centers[i] = center;
+        normals[i] = normal;
+        areas[i] = area;
+        meshArea += area;
+        vec3_t c;
+        bx::vec3Mul(c.f, center.f, area);
+        bx::vec3Add(meshCenter.f, meshCenter.f, c.f);
+    }
+    if (meshArea > 0)
+        bx::vec3Mul(meshCenter.f, meshCenter.f, 1.0f/meshArea);
+
+    for (int i = 0; i < numClusters; i++) {
+        vec3_t d;
+        float len = bx::vec3Length(normals[i].f);
+        bx::vec3Sub(d.f, centers[i].f, meshCenter.f);
+        clusters[i].key = len > 0 ? bx::vec3Dot(d.f, normals[i].f) / len : 0;
+    }
+
+    qsort(clusters, numClusters, sizeof(TriCluster), compareTriClusters);
+
+    uint16_t* idx = result;
+    for (int i = 0; i < numClusters; i++) {
+        memcpy(idx, &indices[clusters[i].startTri * 3], sizeof(uint16_t)*clusters[i].numTris * 3);
+        idx += clusters[i].numTris * 3;
+    }
+    memcpy(indices, result, sizeof(uint16_t)*numIndices);
+
+    BX_FREE(&g_alloc, result);
+    BX_FREE(&g_alloc, stamps);
+    BX_FREE(&g_alloc, areas);
+    BX_FREE(&g_alloc, normals);
+    BX_FREE(&g_alloc, centers);
+    BX_FREE(&g_alloc, clusters);
+}
+
+// Vertex fetch optimization: Reorders vertices by their first use in the index buffer, unused vertices are removed
+static void optimizeVertexFetch(ModelData::Geometry* geo)
+{
+    int numVerts = geo->g.numVerts;
+    int numIndices = geo->g.numTris * 3;
+    int stride = geo->g.vertStride;
+
+    int* remap = (int*)BX_ALLOC(&g_alloc, sizeof(int)*numVerts);
+    memset(remap, 0xff, sizeof(int)*numVerts);
+
+    int numUsed = 0;
+    for (int i = 0; i < numIndices; i++) {
+        int v = geo->indices[i];
+        if (remap[v] == -1)
+            remap[v] = numUsed++;
+        geo->indices[i] = (uint16_t)remap[v];
+    }
+
+    uint8_t* verts = (uint8_t*)BX_ALLOC(&g_alloc, numUsed*stride);
+    for (int i = 0; i < numVerts; i++) {
+        if (remap[i] != -1)
+            memcpy(verts + remap[i]*stride, (const uint8_t*)geo->verts + i*stride, stride);
+    }
+
+    BX_FREE(&g_alloc, geo->verts);
+    BX_FREE(&g_alloc, remap);
+    geo->verts = verts;
+    geo->g.numVerts = numUsed;
+}
+
+static void optimizeGeo(ModelData::Geometry* geo, const t3dSubmesh* submeshes, int numSubmeshes)
+{
+    int posOffset = geo->attribOffsets[findAttrib(geo->attribs, geo->g.numAttribs, t3dVertexAttrib::Position)];
+
+    // Triangles are only reordered within submeshes
+    for (int i = 0; i < numSubmeshes; i++) {
+        uint16_t* indices = geo->indices + submeshes[i].startIndex;
+        optimizeVertexCache(indices, submeshes[i].numIndices, geo->g.numVerts);
+        optimizeOverdraw(indices, submeshes[i].numIndices, (const uint8_t*)geo->verts, geo->g.numVerts,
+                         geo->g.vertStride, posOffset);
+    }
+
+    optimizeVertexFetch(geo);
+}
+
+static t3dVertexAttribDesc getVertexAttribDesc(t3dVertexAttrib::Enum attrib, VertexQuant::Enum quant)
+{
+    t3dVertexAttribDesc desc;
+    desc.attrib = attrib;
+    desc.normalized = 0;
+    desc.asInt = 0;
+
+    switch (attrib) {
+    case t3dVertexAttrib::Position:
+        desc.num = 3;
+        desc.type = quant == VertexQuant::Half ? t3dVertexAttribType::Half :
+            (quant == VertexQuant::Int16 ? t3dVertexAttribType::Int16 : t3dVertexAttribType::Float);
+        desc.normalized = quant == VertexQuant::Int16;
+        break;
+    case t3dVertexAttrib::Normal:
+    case t3dVertexAttrib::Tangent:
+    case t3dVertexAttrib::Bitangent:
+        desc.num = 3;
+        desc.type = quant == VertexQuant::Half ? t3dVertexAttribType::Half :
+            (quant == VertexQuant::Int16 ? t3dVertexAttribType::Int16 : t3dVertexAttribType::Float);
+        desc.normalized = quant == VertexQuant::Int16;
+        break;
+    case t3dVertexAttrib::Color0:
+        desc.num = 4;
+        desc.type = t3dVertexAttribType::Uint8;
+        desc.normalized = 1;
+        break;
+    case t3dVertexAttrib::Indices:
+        desc.num = 4;
+        desc.type = t3dVertexAttribType::Uint8;
+        break;
+    case t3dVertexAttrib::Weight:
+        desc.num = 4;
+        desc.type = quant == VertexQuant::Half ? t3dVertexAttribType::Half :
+            (quant == VertexQuant::Int16 ? t3dVertexAttribType::Uint8 : t3dVertexAttribType::Float);
+        desc.normalized = quant == VertexQuant::Int16;
+        break;
+    default:
+        // Texcoords, values may be out of [-1, 1] range, so they can only be half floats
+        desc.num = 2;
+        desc.type = quant != VertexQuant::None ? t3dVertexAttribType::Half : t3dVertexAttribType::Float;
+        break;
+    }
+    return desc;
+}
+
+static int getVertexAttribSize(const t3dVertexAttribDesc& desc)
+{
+    switch (desc.type) {
+    case t3dVertexAttribType::Uint8:    return desc.num;
+    case t3dVertexAttribType::Int16:
+    case t3dVertexAttribType::Half:     return desc.num * 2;
+    default:                            return desc.num * 4;
+    }
+}
+
+static int16_t quantizeSnorm16(float v)
+{
+    v = bx::fclamp(v, -1.0f, 1.0f);
+    return (int16_t)(v >= 0 ? v*32767.0f + 0.5f : v*32767.0f - 0.5f);
+}
+
+// Converts float vertex data to the layout of the quantization mode, fills attribDescs and position dequantize params
+static void quantizeGeo(ModelData::Geometry* geo, VertexQuant::Enum quant)
+{
+    int numAttribs = geo->g.numAttribs;
+    int numVerts = geo->g.numVerts;
+    int oldStride = geo->g.vertStride;
+
+    geo->attribDescs = (t3dVertexAttribDesc*)BX_ALLOC(&g_alloc, sizeof(t3dVertexAttribDesc)*numAttribs);
+    int* offsets = (int*)alloca(sizeof(int)*numAttribs);
+    int stride = 0;
+    for (int i = 0; i < numAttribs; i++) {
+        geo->attribDescs[i] = getVertexAttribDesc(geo->attribs[i], quant);
+        offsets[i] = stride;
+        stride += getVertexAttribSize(geo->attribDescs[i]);
+    }
+
+    // Positions are quantized within geometry bounds
+    int posOffset = geo->attribOffsets[findAttrib(geo->attribs, numAttribs, t3dVertexAttrib::Position)];
+    float pmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float pmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (int i = 0; i < numVerts; i++) {
+        const float* p = (const float*)((const uint8_t*)geo->verts + i*oldStride + posOffset);
+        for (int k = 0; k < 3; k++) {
+            pmin[k] = bx::fmin(pmin[k], p[k]);
+            pmax[k] = bx::fmax(pmax[k], p[k]);
+        }
+    }
+
+    // Scale is uniform (largest half extent), so the dequantize transform is a similarity and normals stay correct
+    // when it's folded into the model matrix
+    float posScale = 1.0f;
+    if (quant == VertexQuant::Int16 && numVerts > 0) {
+        posScale = 1e-6f;
+        for (int k = 0; k < 3; k++)
+            posScale = bx::fmax(posScale, (pmax[k] - pmin[k])*0.5f);
+    }
+
+    for (int k = 0; k < 3; k++) {
+        geo->posOffset[k] = 0;
+        geo->posScale[k] = posScale;
+        if (quant == VertexQuant::Int16 && numVerts > 0)
+            geo->posOffset[k] = (pmin[k] + pmax[k])*0.5f;
+    }
+
+    uint8_t* verts = (uint8_t*)BX_ALLOC(&g_alloc, numVerts*stride);
+    for (int i = 0; i < numVerts; i++) {
+        const uint8_t* src = (const uint8_t*)geo->verts + i*oldStride;
+        uint8_t* dest = verts + i*stride;
+
+        for (int a = 0; a < numAttribs; a++) {
+            const t3dVertexAttribDesc& desc = geo->attribDescs[a];
+            const uint8_t* s = src + geo->attribOffsets[a];
+            uint8_t* d = dest + offsets[a];
+
+            // Already packed attributes
+            if (desc.attrib == t3dVertexAttrib::Color0 || desc.attrib == t3dVertexAttrib::Indices) {
+                memcpy(d, s, 4);
+                continue;
+            }
+
+            const float* f = (const float*)s;
+            if (desc.type == t3dVertexAttribType::Float) {
+                memcpy(d, f, sizeof(float)*desc.num);
+            } else if (desc.type == t3dVertexAttribType::Half) {
+                for (int k = 0; k < desc.num; k++)
+                    ((uint16_t*)d)[k] = bx::halfFromFloat(f[k]);
+            } else if (desc.type == t3dVertexAttribType::Int16) {
+                for (int k = 0; k < desc.num; k++) {
+                    float v = desc.attrib == t3dVertexAttrib::Position ?
+                        (f[k] - geo->posOffset[k]) / geo->posScale[k] : f[k];
+                    ((int16_t*)d)[k] = quantizeSnorm16(v);
+                }
+            } else if (desc.type == t3dVertexAttribType::Uint8) {
+                // Weights: Keep the sum at 255, by adding the rounding error to the largest weight
+                int sum = 0;
+                int maxIdx = 0;
+                for (int k = 0; k < desc.num; k++) {
+                    d[k] = (uint8_t)(bx::fclamp(f[k], 0, 1.0f)*255.0f + 0.5f);
+                    sum += d[k];
+                    if (f[k] > f[maxIdx])
+                        maxIdx = k;
+                }
+                int w = int(d[maxIdx]) + 255 - sum;
+                if (sum > 0 && w >= 0 && w <= 255)
+                    d[maxIdx] = (uint8_t)w;
+            }
+        }
+    }
+
+    BX_FREE(&g_alloc, geo->verts);
+    geo->verts = verts;
+    geo->g.vertStride = stride;
+}
+
 static int importGeo(const aiScene* scene, ModelData* model, unsigned int* ameshIds,
                      uint32_t numMeshes, bool mainNode, t3dSubmesh* submeshes,
                      const Args& conf, const mtx4x4_t& rootMtx)
@@ -394,11 +889,16 @@ static int importGeo(const aiScene* scene, ModelData* model, unsigned int* amesh
         geo->g.skel.numJoints = bones.getCount();
         geo->joints = (t3dJoint*)BX_ALLOC(&g_alloc, sizeof(t3dJoint)*bones.getCount());
         geo->initPose = (float*)BX_ALLOC(&g_alloc, sizeof(float)*12*bones.getCount());
+        geo->jointFlags = (int*)BX_ALLOC(&g_alloc, sizeof(int)*bones.getCount());
         assert(geo->joints);
         assert(geo->initPose);
+        assert(geo->jointFlags);
 
-        mtx4x4_t jointRoot = convertMtx(scene->mRootNode->mTransformation, conf.zaxis);
-        setupGeoJoints(scene, bones, skinBones, conf, jointRoot, geo->joints, geo->initPose);
+        // Root includes the scale, so animated poses of the joints under the scene root can be composed the same way
+        mtx4x4_t scaleMtx;
+        bx::mtxScale(scaleMtx.f, conf.scale, conf.scale, conf.scale);
+        mtx4x4_t jointRoot = convertMtx(scene->mRootNode->mTransformation, conf.zaxis) * scaleMtx;
+        setupGeoJoints(scene, bones, skinBones, conf, jointRoot, geo->joints, geo->initPose, geo->jointFlags);
 
         saveMtx(jointRoot, geo->g.skel.rootMtx);
     }
@@ -530,6 +1030,9 @@ static int importGeo(const aiScene* scene, ModelData* model, unsigned int* amesh
     bones.destroy();
     skinBones.destroy();
 
+    if (conf.optimize)
+        optimizeGeo(geo, submeshes, numMeshes);
+
     return model->geos.getCount() - 1;
 }
 
@@ -795,15 +1298,31 @@ static int importNodeRecursive(const aiScene* scene, aiNode* anode, ModelData* m
     return myidx;
 }
 
+static void writePadding(bx::CrtFileWriter* file, int64_t offset, bx::Error* err)
+{
+    static const uint8_t zeros[T3D_BLOB_ALIGN] = {0};
+    int64_t pos = file->seek();
+    assert(offset - pos < T3D_BLOB_ALIGN);
+    if (offset > pos)
+        file->write(zeros, int32_t(offset - pos), err);
+}
+
+static int64_t alignBlobOffset(int64_t offset)
+{
+    return (offset + T3D_BLOB_ALIGN - 1) & ~int64_t(T3D_BLOB_ALIGN - 1);
+}
+
 static bool exportT3d(const char* t3dFilepath, const ModelData& model)
 {
     t3dHeader hdr;
     hdr.sign = T3D_SIGN;
-    hdr.version = T3D_VERSION_10;
+    hdr.version = T3D_VERSION_21;
 
     hdr.numNodes = model.nodes.getCount();
     hdr.numGeos = model.geos.getCount();
     hdr.numMeshes = model.meshes.getCount();
+    hdr.reserved1 = 0;
+    hdr.reserved2 = 0;
 
     bx::CrtFileWriter file;
     bx::Error err;
@@ -830,25 +1349,39 @@ static bool exportT3d(const char* t3dFilepath, const ModelData& model)
         file.write(mesh.submeshes, sizeof(t3dSubmesh)*mesh.m.numSubmeshes, &err);
     }
 
-    // Geos
+    // Geos: Header data, followed by aligned index and vertex blobs
     for (int i = 0; i < model.geos.getCount(); i++) {
         const ModelData::Geometry& geo = model.geos[i];
+        int numJoints = geo.g.skel.numJoints;
+        uint32_t indicesSize = sizeof(uint16_t)*geo.g.numTris * 3;
+
+        t3dGeometryBlobs blobs;
+        memcpy(blobs.posOffset, geo.posOffset, sizeof(blobs.posOffset));
+        memcpy(blobs.posScale, geo.posScale, sizeof(blobs.posScale));
+        blobs.indicesOffset = alignBlobOffset(file.seek() + sizeof(geo.g) + sizeof(blobs) +
+                                              (sizeof(t3dJoint) + sizeof(float)*12 + sizeof(int))*numJoints +
+                                              sizeof(t3dVertexAttribDesc)*geo.g.numAttribs);
+        blobs.vertsOffset = alignBlobOffset(blobs.indicesOffset + indicesSize);
+
         file.write(&geo.g, sizeof(geo.g), &err);
+        file.write(&blobs, sizeof(blobs), &err);
 
         if (geo.joints)
-            file.write(geo.joints, sizeof(t3dJoint)*geo.g.skel.numJoints, &err);
+            file.write(geo.joints, sizeof(t3dJoint)*numJoints, &err);
         if (geo.initPose)
-            file.write(geo.initPose, sizeof(float)*12*geo.g.skel.numJoints, &err);
-        if (geo.attribs)
-            file.write(geo.attribs, sizeof(t3dVertexAttrib)*geo.g.numAttribs, &err);
-        if (geo.indices)
-            file.write(geo.indices, sizeof(uint16_t)*geo.g.numTris * 3, &err);
-        if (geo.verts)
-            file.write(geo.verts, geo.g.vertStride*geo.g.numVerts, &err);
+            file.write(geo.initPose, sizeof(float)*12*numJoints, &err);
+        if (geo.jointFlags)
+            file.write(geo.jointFlags, sizeof(int)*numJoints, &err);
+        file.write(geo.attribDescs, sizeof(t3dVertexAttribDesc)*geo.g.numAttribs, &err);
+
+        writePadding(&file, blobs.indicesOffset, &err);
+        file.write(geo.indices, indicesSize, &err);
+        writePadding(&file, blobs.vertsOffset, &err);
+        file.write(geo.verts, geo.g.vertStride*geo.g.numVerts, &err);
     }
 
     // Materials block (Meta-data)
-    hdr.metaOffset = (int)file.seek();
+    hdr.metaOffset = file.seek();
     t3dMetablock metaMtl;
     strcpy(metaMtl.name, "Materials");
     metaMtl.stride = -1;
@@ -860,7 +1393,8 @@ static bool exportT3d(const char* t3dFilepath, const ModelData& model)
     for (int i = 0; i < model.mtls.getCount(); i++) {
         const ModelData::Material& mtl = model.mtls[i];
         file.write(&mtl.m, sizeof(mtl.m), &err);
-        file.write(&mtl.textures, sizeof(t3dTexture)*mtl.m.numTextures, &err);
+        if (mtl.m.numTextures)
+            file.write(mtl.textures, sizeof(t3dTexture)*mtl.m.numTextures, &err);
     }
 
     // Rewrite header (updated meta offset)
@@ -951,7 +1485,6 @@ static bool importModel(const Args& conf)
     uint32_t flags =
         aiProcess_JoinIdenticalVertices |
         aiProcess_Triangulate |
-        aiProcess_ImproveCacheLocality |
         aiProcess_LimitBoneWeights |
         aiProcess_OptimizeMeshes |
         aiProcess_RemoveRedundantMaterials |
@@ -962,6 +1495,10 @@ static bool importModel(const Args& conf)
         aiProcess_SortByPType |
         aiProcess_FindDegenerates;
 
+    // Vertex cache is optimized by ourselves (optimizeGeo), unless it's turned off
+    if (!conf.optimize)
+        flags |= aiProcess_ImproveCacheLocality;
+
     if (conf.buildTangents) {
         flags |= aiProcess_CalcTangentSpace | aiProcess_RemoveComponent;
         importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, aiComponent_TANGENTS_AND_BITANGENTS);
@@ -992,6 +1529,10 @@ static bool importModel(const Args& conf)
         return false;
     }
 
+    // Final vertex layout
+    for (int i = 0; i < model.geos.getCount(); i++)
+        quantizeGeo(model.geos.itemPtr(i), conf.quant);
+
     // Write to file
     if (!exportT3d(conf.outFilepath.cstr(), model)) {
         g_logger->fatal("Writing to file '%s' failed", conf.outFilepath.cstr());
@@ -1022,6 +1563,8 @@ static void showHelp()
         "  -s --scale <scale> Set scale multiplier (default=1)\n"
         "  -z --zaxis <zaxis> Set Z-Axis, choises are ['UP', 'GL']\n"
         "  -M --metafile <filepath> Output meta data to a file instead of stdout\n"
+        "  -x --nooptimize Skip vertex cache, overdraw and vertex fetch optimizations\n"
+        "  -q --quantize <mode> Quantize vertices, choises are ['half', '16bit']\n"
         "  -j --jsonlog Enable json logging instead of normal text\n";
     puts(help);
 }
@@ -1033,6 +1576,15 @@ int main(int argc, char** argv)
     bx::CommandLine cmd(argc, argv);
     conf.verbose = cmd.hasArg('v', "verbose");
     conf.buildTangents = cmd.hasArg('T', "maketangents");
+    conf.optimize = !cmd.hasArg('x', "nooptimize");
+
+    const char* quant = cmd.findOption('q', "quantize", "");
+    if (bx::stricmp(quant, "half") == 0)
+        conf.quant = VertexQuant::Half;
+    else if (bx::stricmp(quant, "16bit") == 0)
+        conf.quant = VertexQuant::Int16;
+    else
+        conf.quant = VertexQuant::None;
     
     const char* scaleStr = cmd.findOption('s', "scale", "1.0");
     sscanf(scaleStr, "%f", &conf.scale);
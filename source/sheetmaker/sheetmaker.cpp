@@ -415,6 +415,18 @@ static bool saveSpriteSheet(const char* filepath, const SpriteSheet* sheetInfo,
             tsprite.tx1 = sprite.tx1;
             tsprite.ty1 = sprite.ty1;
 
+            // Name is the source image filename, sprites are not trimmed
+            const TextureItem& texItem = theApp.textureDb->textures[sprite.textureItem];
+            bx::Path spriteName = bx::Path(texItem.filepath).getFilenameFull();
+            tsprite.nameHash = tinystl::hash_string(spriteName.cstr(), strlen(spriteName.cstr()));
+            tsprite.pivot[0] = tsprite.pivot[1] = 0;
+            tsprite.sourceSize[0] = (sprite.tx1 - sprite.tx0)*float(width);
+            tsprite.sourceSize[1] = (sprite.ty1 - sprite.ty0)*float(height);
+            tsprite.posOffset[0] = tsprite.posOffset[1] = 0;
+            tsprite.sizeOffset[0] = tsprite.sizeOffset[1] = 1.0f;
+            tsprite.rotOffset = 0;
+            tsprite.pixelRatio = tsprite.sourceSize[1] > 0 ? tsprite.sourceSize[0] / tsprite.sourceSize[1] : 1.0f;
+
             // Tag
             if (sprite.tag != -1 && sprite.tag < sheetInfo->numTags) {
                 const FrameTag& tag = sheetInfo->tags[sprite.tag];
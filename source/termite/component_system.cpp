@@ -4,13 +4,16 @@
 #include "bx/uint32_t.h"
 #include "bxx/array.h"
 #include "bxx/pool.h"
-#include "bxx/queue.h"
 #include "bxx/handle_pool.h"
 #include "bxx/hash_table.h"
 #include "bxx/logger.h"
+#include "bx/readerwriter.h"
 
 #define MIN_FREE_INDICES 1024
 
+#define COMPONENT_SNAPSHOT_SIGN 0x534e5343      // "CSNS"
+#define COMPONENT_SNAPSHOT_VERSION 1
+
 static const uint32_t kComponentHandleBits = 16;
 static const uint32_t kComponentHandleMask = (1 << kComponentHandleBits) - 1;
 static const uint32_t kComponentTypeHandleBits = 16;
@@ -24,39 +27,22 @@ using namespace termite;
 
 namespace termite
 {
-    typedef bx::MultiHashTable<ComponentHandle, uint32_t> EntityHashTable;  // EntityId -> Multiple Component Handles
-
     struct EntityManager
     {
-        struct FreeIndex
-        {
-            typedef bx::Queue<FreeIndex*>::Node QNode;
-
-            uint32_t index;
-            QNode qnode;
-
-            explicit FreeIndex(uint32_t _index) :
-                index(_index),
-                qnode(this)
-            {
-            }
-        };
-
         bx::AllocatorI* alloc;
-        bx::Pool<FreeIndex> freeIndexPool;
-        bx::Queue<FreeIndex*> freeIndexQueue;
+        uint32_t* freeIndices;          // Ring-buffer of free entity indices
+        uint32_t freeIndexCapacity;
+        uint32_t freeIndexStart;
         uint32_t freeIndexSize;
         bx::Array<uint16_t> generations;
-        EntityHashTable destroyTable; // keep a multi-hash for all components that entity has to destroy
-        EntityHashTable deactiveTable;
-		bx::Pool<EntityHashTable::Node> nodePool;
         uint16_t numEnts;
         
         EntityManager(bx::AllocatorI* _alloc) : 
             alloc(_alloc),
-            freeIndexSize(0),
-            destroyTable(bx::HashTableType::Mutable),
-            deactiveTable(bx::HashTableType::Mutable)
+            freeIndices(nullptr),
+            freeIndexCapacity(0),
+            freeIndexStart(0),
+            freeIndexSize(0)
         {
             numEnts = 0;
         }
@@ -70,34 +56,50 @@ struct ComponentType
     ComponentFlag::Bits flags;
     uint32_t dataSize;
     bx::HandlePool dataPool;
-    bx::HashTable<ComponentHandle, uint32_t> entTable;  // Entity -> ComponentHandle
+    uint32_t poolGeneration;            // Incremented whenever dataPool buffers are reallocated
+
+    // Entity -> Component lookup, 'entHeads' is indexed by entity index and keeps the first component instance
+    // Components of entities with the same index (dead ones that are not garbage collected yet) are chained in 'entNexts'
+    bx::Array<uint16_t> entHeads;
+    bx::Array<uint16_t> entNexts;       // Component instance -> Next instance with the same entity index
 
-    ComponentType() : 
-        entTable(bx::HashTableType::Mutable)
+    ComponentType()
     {
         strcpy(name, "");
         memset(&callbacks, 0x00, sizeof(callbacks));
         flags = ComponentFlag::None;
         dataSize = 0;
+        poolGeneration = 0;
     }
 };
 
 struct ComponentGroup
 {
+    // Batches are kept ordered by component type and map to contiguous ranges in 'components'
     struct Batch
     {
+        uint16_t typeIdx;
         int index;
         int count;
     };
 
-    bx::Array<ComponentHandle> components;
+    bx::Array<ComponentHandle> components;  // Always sorted by handle value (component-type is in higher bits)
     bx::Array<Batch> batches;
-    bool sorted;
+};
 
-    ComponentGroup() :
-        sorted(false)
-    {
-    }
+struct ComponentQuery
+{
+    ComponentTypeHandle types[kComponentQueryMaxTypes];
+    int numTypes;
+
+    // Parallel arrays of matched entities
+    bx::Array<Entity> entities;
+    bx::Array<ComponentHandle> handles[kComponentQueryMaxTypes];
+    bx::Array<void*> datas[kComponentQueryMaxTypes];
+    
+    // Pool generation of each component type, data pointers are refreshed when the pool is reallocated
+    uint32_t poolGenerations[kComponentQueryMaxTypes];
+    bx::Array<int> entSlots;   // Entity index -> index in matched arrays (-1 if not matched)
 };
 
 struct ComponentSystem
@@ -106,6 +108,7 @@ struct ComponentSystem
     bx::Array<ComponentType> components;
     bx::HashTableInt nameTable;
     bx::HandlePool componentGroups;
+    bx::HandlePool componentQueries;
 
     ComponentSystem(bx::AllocatorI* _alloc) : 
         alloc(_alloc),
@@ -115,19 +118,20 @@ struct ComponentSystem
 };
 
 static ComponentSystem* g_csys = nullptr;
+static int g_numEntityManagers = 0;     // Snapshots hold global component data, so they need a single entity manager
 
 EntityManager* termite::createEntityManager(bx::AllocatorI* alloc, int bufferSize)
 {
     EntityManager* emgr = BX_NEW(alloc, EntityManager)(alloc);
     if (!emgr)
         return nullptr;
+    g_numEntityManagers++;
     if (bufferSize <= 0)
         bufferSize = MIN_FREE_INDICES;
-    if (!emgr->generations.create(bufferSize, bufferSize, alloc) ||
-        !emgr->freeIndexPool.create(bufferSize, alloc) ||
-		!emgr->nodePool.create(bufferSize, alloc) ||
-        !emgr->destroyTable.create(bufferSize, alloc, &emgr->nodePool) ||
-        !emgr->deactiveTable.create(bufferSize, alloc, &emgr->nodePool))
+    emgr->freeIndices = (uint32_t*)BX_ALLOC(alloc, sizeof(uint32_t)*bufferSize);
+    emgr->freeIndexCapacity = bufferSize;
+    if (!emgr->freeIndices ||
+        !emgr->generations.create(bufferSize, bufferSize, alloc))
     {
         destroyEntityManager(emgr);
         return nullptr;
@@ -140,23 +144,60 @@ void termite::destroyEntityManager(EntityManager* emgr)
 {
     assert(emgr);
 
-    emgr->freeIndexPool.destroy();
-	emgr->nodePool.destroy();
+    if (emgr->freeIndices)
+        BX_FREE(emgr->alloc, emgr->freeIndices);
     emgr->generations.destroy();
-    emgr->deactiveTable.destroy();
-    emgr->destroyTable.destroy();
+    g_numEntityManagers--;
 
     BX_DELETE(emgr->alloc, emgr);
 }
 
+static bool reserveFreeIndices(EntityManager* emgr, uint32_t count)
+{
+    if (count <= emgr->freeIndexCapacity)
+        return true;
+
+    uint32_t capacity = bx::uint32_max(count, emgr->freeIndexCapacity*2);
+    uint32_t* indices = (uint32_t*)BX_ALLOC(emgr->alloc, sizeof(uint32_t)*capacity);
+    if (!indices)
+        return false;
+
+    // Unwrap the ring-buffer into the new buffer
+    uint32_t firstPart = bx::uint32_min(emgr->freeIndexSize, emgr->freeIndexCapacity - emgr->freeIndexStart);
+    memcpy(indices, emgr->freeIndices + emgr->freeIndexStart, sizeof(uint32_t)*firstPart);
+    memcpy(indices + firstPart, emgr->freeIndices, sizeof(uint32_t)*(emgr->freeIndexSize - firstPart));
+
+    BX_FREE(emgr->alloc, emgr->freeIndices);
+    emgr->freeIndices = indices;
+    emgr->freeIndexCapacity = capacity;
+    emgr->freeIndexStart = 0;
+    return true;
+}
+
+static inline uint32_t popFreeIndex(EntityManager* emgr)
+{
+    assert(emgr->freeIndexSize > 0);
+    uint32_t idx = emgr->freeIndices[emgr->freeIndexStart];
+    emgr->freeIndexStart = (emgr->freeIndexStart + 1) % emgr->freeIndexCapacity;
+    emgr->freeIndexSize--;
+    return idx;
+}
+
+static inline void pushFreeIndex(EntityManager* emgr, uint32_t idx)
+{
+    if (emgr->freeIndexSize == emgr->freeIndexCapacity) {
+        if (!reserveFreeIndices(emgr, emgr->freeIndexCapacity + 1))
+            return;
+    }
+    emgr->freeIndices[(emgr->freeIndexStart + emgr->freeIndexSize) % emgr->freeIndexCapacity] = idx;
+    emgr->freeIndexSize++;
+}
+
 Entity termite::createEntity(EntityManager* emgr)
 {
     uint32_t idx;
     if (emgr->freeIndexSize > MIN_FREE_INDICES) {
-        EntityManager::FreeIndex* fidx;
-        emgr->freeIndexQueue.pop(&fidx);
-        idx = fidx->index;
-        emgr->freeIndexSize--;
+        idx = popFreeIndex(emgr);
     } else {
         idx = emgr->generations.getCount();
         uint16_t* gen = emgr->generations.push();
@@ -167,14 +208,236 @@ Entity termite::createEntity(EntityManager* emgr)
     return ent;
 }
 
+int termite::createEntities(EntityManager* emgr, Entity* ents, int count)
+{
+    assert(ents);
+
+    // Recycle free indices first, the same way createEntity does
+    int numRecycled = 0;
+    if (emgr->freeIndexSize > MIN_FREE_INDICES)
+        numRecycled = bx::uint32_min(count, emgr->freeIndexSize - MIN_FREE_INDICES);
+    for (int i = 0; i < numRecycled; i++) {
+        uint32_t idx = popFreeIndex(emgr);
+        ents[i] = Entity(idx, emgr->generations[idx]);
+    }
+
+    // Allocate the rest of the indices at once
+    int numNew = count - numRecycled;
+    if (numNew > 0) {
+        uint32_t firstIdx = emgr->generations.getCount();
+        if (firstIdx + numNew > (1 << kEntityIndexBits)) {
+            assert(false);
+            numNew = (1 << kEntityIndexBits) - firstIdx;
+        }
+
+        uint16_t* gens = emgr->generations.pushMany(numNew);
+        if (!gens)
+            return numRecycled;
+        for (int i = 0; i < numNew; i++) {
+            gens[i] = 1;
+            ents[numRecycled + i] = Entity(firstIdx + i, 1);
+        }
+    }
+
+    return numRecycled + numNew;
+}
+
+// Pool buffers can move on growth, bump the generation so queries refresh their data pointers
+static bool reserveComponentPool(ComponentType& ctype, uint16_t maxItems)
+{
+    if (maxItems <= ctype.dataPool.getMaxItems())
+        return true;
+    if (!ctype.dataPool.reserve(maxItems))
+        return false;
+    ctype.poolGeneration++;
+    return true;
+}
+
+static uint16_t newComponentInstance(ComponentType& ctype)
+{
+    uint16_t maxItems = ctype.dataPool.getMaxItems();
+    uint16_t cIdx = ctype.dataPool.newHandle();
+    if (ctype.dataPool.getMaxItems() != maxItems)
+        ctype.poolGeneration++;
+    return cIdx;
+}
+
+// Grows entity lookup arrays to cover 'numEnts' entity indices and all the instances of the data pool
+// Must be called before linking new components, so linking itself can't fail
+static bool reserveEntityLookup(ComponentType& ctype, uint32_t numEnts)
+{
+    int numHeads = ctype.entHeads.getCount();
+    if ((int)numEnts > numHeads) {
+        uint16_t* heads = ctype.entHeads.pushMany((int)numEnts - numHeads);
+        if (!heads)
+            return false;
+        memset(heads, 0xff, sizeof(uint16_t)*(numEnts - numHeads));
+    }
+
+    int numNexts = ctype.entNexts.getCount();
+    int maxItems = ctype.dataPool.getMaxItems();
+    if (maxItems > numNexts) {
+        if (!ctype.entNexts.pushMany(maxItems - numNexts))
+            return false;
+    }
+    return true;
+}
+
+static uint16_t findEntityComponent(ComponentType& ctype, Entity ent)
+{
+    uint32_t entIdx = ent.getIndex();
+    if (entIdx >= (uint32_t)ctype.entHeads.getCount())
+        return UINT16_MAX;
+
+    uint16_t cIdx = ctype.entHeads[entIdx];
+    while (cIdx != UINT16_MAX) {
+        if (*ctype.dataPool.getHandleData<Entity>(0, cIdx) == ent)
+            return cIdx;
+        cIdx = ctype.entNexts[cIdx];
+    }
+    return UINT16_MAX;
+}
+
+static inline void linkEntityComponent(ComponentType& ctype, Entity ent, uint16_t cIdx)
+{
+    uint32_t entIdx = ent.getIndex();
+    ctype.entNexts[cIdx] = ctype.entHeads[entIdx];
+    ctype.entHeads[entIdx] = cIdx;
+}
+
+static void unlinkEntityComponent(ComponentType& ctype, Entity ent, uint16_t cIdx)
+{
+    uint16_t* link = &ctype.entHeads[ent.getIndex()];
+    while (*link != UINT16_MAX) {
+        if (*link == cIdx) {
+            *link = ctype.entNexts[cIdx];
+            return;
+        }
+        link = &ctype.entNexts[*link];
+    }
+}
+
+static int findComponentGroupBatch(const ComponentGroup* group, uint16_t typeIdx, bool* found)
+{
+    // Binary search for the batch of the type, returns the insert position if not found
+    int first = 0;
+    int last = group->batches.getCount();
+    while (first < last) {
+        int mid = (first + last) >> 1;
+        uint16_t midIdx = group->batches[mid].typeIdx;
+        if (midIdx == typeIdx) {
+            *found = true;
+            return mid;
+        } else if (midIdx < typeIdx) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    *found = false;
+    return first;
+}
+
+static void removeComponentGroupBatch(ComponentGroup* group, int batchIdx)
+{
+    ComponentGroup::Batch* batches = group->batches.getBuffer();
+    int numBatches = group->batches.getCount();
+    memmove(&batches[batchIdx], &batches[batchIdx + 1], (numBatches - batchIdx - 1)*sizeof(ComponentGroup::Batch));
+    group->batches.pop();
+}
+
 static void addToComponentGroup(ComponentGroupHandle handle, ComponentHandle component)
 {
     ComponentGroup* group = g_csys->componentGroups.getHandleData<ComponentGroup>(0, handle);
-    ComponentHandle* pchandle = group->components.push();
-    if (pchandle) {
-        *pchandle = component;
-        group->sorted = false;
+    uint16_t typeIdx = COMPONENT_TYPE_INDEX(component);
+
+    bool batchFound;
+    int batchIdx = findComponentGroupBatch(group, typeIdx, &batchFound);
+    if (!batchFound) {
+        // Insert a new empty batch for the type, it starts where the next batch starts
+        int numBatches = group->batches.getCount();
+        ComponentGroup::Batch* batch = group->batches.push();
+        if (!batch)
+            return;
+        ComponentGroup::Batch* batches = group->batches.getBuffer();
+        memmove(&batches[batchIdx + 1], &batches[batchIdx], (numBatches - batchIdx)*sizeof(ComponentGroup::Batch));
+        batches[batchIdx].typeIdx = typeIdx;
+        batches[batchIdx].index = batchIdx < numBatches ? batches[batchIdx + 1].index : group->components.getCount();
+        batches[batchIdx].count = 0;
+    }
+
+    // Binary insert the component into it's batch range, so the whole group stays sorted
+    int count = group->components.getCount();
+    if (!group->components.push()) {
+        if (!batchFound)
+            removeComponentGroupBatch(group, batchIdx);
+        return;
+    }
+    ComponentHandle* buff = group->components.getBuffer();
+    ComponentGroup::Batch& batch = group->batches[batchIdx];
+    ComponentHandle* first = buff + batch.index;
+    ComponentHandle* insertPtr = std::lower_bound(first, first + batch.count, component,
+        [](const ComponentHandle& a, const ComponentHandle& b) { return a.value < b.value; });
+    memmove(insertPtr + 1, insertPtr, (buff + count - insertPtr)*sizeof(ComponentHandle));
+    *insertPtr = component;
+    batch.count++;
+
+    // Shift the ranges of the batches after the modified one
+    for (int i = batchIdx + 1, c = group->batches.getCount(); i < c; i++)
+        group->batches[i].index++;
+}
+
+// Adds many components of the same type, merging them into the type's sorted batch range
+static void addManyToComponentGroup(ComponentGroupHandle handle, ComponentHandle* components, int num)
+{
+    if (num == 0)
+        return;
+
+    ComponentGroup* group = g_csys->componentGroups.getHandleData<ComponentGroup>(0, handle);
+    uint16_t typeIdx = COMPONENT_TYPE_INDEX(components[0]);
+
+    std::sort(components, components + num,
+              [](const ComponentHandle& a, const ComponentHandle& b) { return a.value < b.value; });
+
+    bool batchFound;
+    int batchIdx = findComponentGroupBatch(group, typeIdx, &batchFound);
+    if (!batchFound) {
+        int numBatches = group->batches.getCount();
+        ComponentGroup::Batch* batch = group->batches.push();
+        if (!batch)
+            return;
+        ComponentGroup::Batch* batches = group->batches.getBuffer();
+        memmove(&batches[batchIdx + 1], &batches[batchIdx], (numBatches - batchIdx)*sizeof(ComponentGroup::Batch));
+        batches[batchIdx].typeIdx = typeIdx;
+        batches[batchIdx].index = batchIdx < numBatches ? batches[batchIdx + 1].index : group->components.getCount();
+        batches[batchIdx].count = 0;
+    }
+
+    // Make room after the batch range, then merge from the back so nothing is overwritten before it's moved
+    int count = group->components.getCount();
+    if (!group->components.pushMany(num)) {
+        if (!batchFound)
+            removeComponentGroupBatch(group, batchIdx);
+        return;
+    }
+    ComponentHandle* buff = group->components.getBuffer();
+    ComponentGroup::Batch& batch = group->batches[batchIdx];
+    int batchEnd = batch.index + batch.count;
+    memmove(buff + batchEnd + num, buff + batchEnd, (count - batchEnd)*sizeof(ComponentHandle));
+
+    int src = batchEnd - 1;
+    int dst = batchEnd + num - 1;
+    int k = num - 1;
+    while (k >= 0) {
+        if (src >= batch.index && buff[src].value > components[k].value)
+            buff[dst--] = buff[src--];
+        else
+            buff[dst--] = components[k--];
     }
+    batch.count += num;
+
+    for (int i = batchIdx + 1, c = group->batches.getCount(); i < c; i++)
+        group->batches[i].index += num;
 }
 
 static void removeFromComponentGroup(ComponentGroupHandle handle, ComponentHandle component)
@@ -184,14 +447,169 @@ static void removeFromComponentGroup(ComponentGroupHandle handle, ComponentHandl
 
     ComponentGroup* group = g_csys->componentGroups.getHandleData<ComponentGroup>(0, handle);
 
+    bool batchFound;
+    int batchIdx = findComponentGroupBatch(group, COMPONENT_TYPE_INDEX(component), &batchFound);
+    if (!batchFound)
+        return;
+
+    // Find the component inside it's batch range and remove it by shifting the rest of the group
+    ComponentGroup::Batch& batch = group->batches[batchIdx];
+    ComponentHandle* buff = group->components.getBuffer();
+    ComponentHandle* first = buff + batch.index;
+    ComponentHandle* last = first + batch.count;
+    ComponentHandle* removePtr = std::lower_bound(first, last, component,
+        [](const ComponentHandle& a, const ComponentHandle& b) { return a.value < b.value; });
+    if (removePtr == last || *removePtr != component)
+        return;
+
+    int count = group->components.getCount();
+    memmove(removePtr, removePtr + 1, (buff + count - removePtr - 1)*sizeof(ComponentHandle));
+    group->components.pop();
+
+    int numBatches = group->batches.getCount();
+    for (int i = batchIdx + 1; i < numBatches; i++)
+        group->batches[i].index--;
+
+    // Remove the batch if it's empty
+    if (--batch.count == 0)
+        removeComponentGroupBatch(group, batchIdx);
+}
+
+static void rebuildComponentGroup(ComponentGroup* group)
+{
+    group->batches.clear();
     int count = group->components.getCount();
-    // Find the component and Swap current with the last group
-    int index = group->components.find(component);
-    if (index != -1) {
-        ComponentHandle* buff = group->components.getBuffer();
-        std::swap<ComponentHandle>(buff[index], buff[count-1]);
-        group->sorted = false;
-        group->components.pop();
+    if (count == 0)
+        return;
+
+    std::sort(group->components.itemPtr(0), group->components.itemPtr(0) + count,
+              [](const ComponentHandle& a, const ComponentHandle& b) { return a.value < b.value; });
+
+    // Batch by component-type
+    ComponentGroup::Batch* curBatch = nullptr;
+    for (int i = 0; i < count; i++) {
+        uint16_t typeIdx = COMPONENT_TYPE_INDEX(group->components[i]);
+        if (!curBatch || curBatch->typeIdx != typeIdx) {
+            curBatch = group->batches.push();
+            curBatch->typeIdx = typeIdx;
+            curBatch->index = i;
+            curBatch->count = 0;
+        }
+        curBatch->count++;
+    }
+}
+
+static int findComponentQueryType(const ComponentQuery* query, uint16_t typeIdx)
+{
+    for (int i = 0, c = query->numTypes; i < c; i++) {
+        if (query->types[i].value == typeIdx)
+            return i;
+    }
+    return -1;
+}
+
+static void addToComponentQuery(ComponentQuery* query, Entity ent)
+{
+    int entIdx = (int)ent.getIndex();
+    int numSlots = query->entSlots.getCount();
+    if (entIdx < numSlots) {
+        int slot = query->entSlots[entIdx];
+        if (slot != -1 && query->entities[slot] == ent)
+            return;
+    }
+
+    // Entity must have all component types of the query, and all of them must be active
+    ComponentHandle handles[kComponentQueryMaxTypes];
+    for (int i = 0, c = query->numTypes; i < c; i++) {
+        handles[i] = getComponent(query->types[i], ent);
+        if (!handles[i].isValid())
+            return;
+        ComponentType& ctype = g_csys->components[query->types[i].value];
+        if (!*ctype.dataPool.getHandleData<bool>(3, COMPONENT_INSTANCE_HANDLE(handles[i])))
+            return;
+    }
+
+    if (entIdx >= numSlots) {
+        int* slots = query->entSlots.pushMany(entIdx - numSlots + 1);
+        if (!slots)
+            return;
+        memset(slots, 0xff, sizeof(int)*(entIdx - numSlots + 1));
+    }
+
+    query->entSlots[entIdx] = query->entities.getCount();
+    *query->entities.push() = ent;
+    for (int i = 0, c = query->numTypes; i < c; i++) {
+        ComponentType& ctype = g_csys->components[query->types[i].value];
+        *query->handles[i].push() = handles[i];
+        *query->datas[i].push() = ctype.dataPool.getHandleData(1, COMPONENT_INSTANCE_HANDLE(handles[i]));
+    }
+}
+
+static void removeFromComponentQuery(ComponentQuery* query, Entity ent)
+{
+    int entIdx = (int)ent.getIndex();
+    if (entIdx >= query->entSlots.getCount())
+        return;
+    int slot = query->entSlots[entIdx];
+    if (slot == -1 || query->entities[slot] != ent)
+        return;
+
+    // Swap with the last item and pop
+    int last = query->entities.getCount() - 1;
+    Entity lastEnt = query->entities[last];
+    query->entities[slot] = lastEnt;
+    query->entities.pop();
+    for (int i = 0, c = query->numTypes; i < c; i++) {
+        query->handles[i][slot] = query->handles[i][last];
+        query->handles[i].pop();
+        query->datas[i][slot] = query->datas[i][last];
+        query->datas[i].pop();
+    }
+
+    query->entSlots[lastEnt.getIndex()] = slot;
+    query->entSlots[entIdx] = -1;
+}
+
+static void rebuildComponentQuery(ComponentQuery* query)
+{
+    query->entities.clear();
+    for (int i = 0, c = query->numTypes; i < c; i++) {
+        query->handles[i].clear();
+        query->datas[i].clear();
+    }
+    if (query->entSlots.getCount() > 0)
+        memset(query->entSlots.getBuffer(), 0xff, sizeof(int)*query->entSlots.getCount());
+    for (int i = 0, c = query->numTypes; i < c; i++)
+        query->poolGenerations[i] = g_csys->components[query->types[i].value].poolGeneration;
+
+    // Search the component type with the least instances for matching entities
+    int minType = 0;
+    for (int i = 1, c = query->numTypes; i < c; i++) {
+        if (g_csys->components[query->types[i].value].dataPool.getCount() < 
+            g_csys->components[query->types[minType].value].dataPool.getCount())
+        {
+            minType = i;
+        }
+    }
+
+    ComponentType& ctype = g_csys->components[query->types[minType].value];
+    for (uint16_t i = 0, c = ctype.dataPool.getCount(); i < c; i++) {
+        Entity ent = *ctype.dataPool.getHandleData<Entity>(0, ctype.dataPool.handleAt(i));
+        addToComponentQuery(query, ent);
+    }
+}
+
+static void updateComponentQueries(Entity ent, uint16_t typeIdx, bool add)
+{
+    for (int i = 0, c = g_csys->componentQueries.getCount(); i < c; i++) {
+        ComponentQuery* query = 
+            g_csys->componentQueries.getHandleData<ComponentQuery>(0, g_csys->componentQueries.handleAt(i));
+        if (findComponentQueryType(query, typeIdx) != -1) {
+            if (add)
+                addToComponentQuery(query, ent);
+            else
+                removeFromComponentQuery(query, ent);
+        }
     }
 }
 
@@ -201,72 +619,75 @@ static void destroyComponentNoImmAction(Entity ent, ComponentHandle handle)
 
     ComponentType& ctype = g_csys->components[COMPONENT_TYPE_INDEX(handle)];
     uint16_t instHandle = COMPONENT_INSTANCE_HANDLE(handle);
+    Entity owner = *ctype.dataPool.getHandleData<Entity>(0, instHandle);
 
     // Remove from component group
     ComponentGroupHandle groupHandle = *ctype.dataPool.getHandleData<ComponentGroupHandle>(2, instHandle);
     if (groupHandle.isValid())
         removeFromComponentGroup(groupHandle, handle);
 
+    // Remove entity from all queries that depend on the component type
+    updateComponentQueries(ent, COMPONENT_TYPE_INDEX(handle), false);
+
     // Call destroy callback
     if (ctype.callbacks.destroyInstance)
         ctype.callbacks.destroyInstance(ent, handle, ctype.dataPool.getHandleData(1, instHandle));
 
+    unlinkEntityComponent(ctype, owner, instHandle);
     ctype.dataPool.freeHandle(instHandle);
-
-    int r = ctype.entTable.find(ent.id);
-    if (r != -1)
-        ctype.entTable.remove(r);
 }
 
 void termite::destroyEntity(EntityManager* emgr, Entity ent)
 {
     assert(isEntityAlive(emgr, ent));
 
-    // Check if the entity has immediate deactivate components
-    // And deactivate all components registered to entity
-    int entIdx = emgr->deactiveTable.find(ent.id);
-    if (entIdx != -1) {
-        EntityHashTable::Node* node = emgr->deactiveTable[entIdx];
-        while (node) {
-            EntityHashTable::Node* next = node->next;
-
-            ComponentHandle handle = node->value;
-            ComponentType& ctype = g_csys->components[COMPONENT_TYPE_INDEX(handle)];
-            bool prevActive = *ctype.dataPool.getHandleData<bool>(3, handle);
-            if (prevActive) {
-                uint16_t cHandle = COMPONENT_INSTANCE_HANDLE(handle);
-                *(ctype.dataPool.getHandleData<bool>(3, cHandle)) = false;
-                if (ctype.callbacks.setActive)
-                    ctype.callbacks.setActive(handle, ctype.dataPool.getHandleData(1, cHandle), false, 0);
-            }
+    // Deactivate the entity's components that are flagged for immediate deactivation
+    int numTypes = g_csys->components.getCount();
+    for (int i = 0; i < numTypes; i++) {
+        ComponentType& ctype = g_csys->components[i];
+        if ((ctype.flags & ComponentFlag::ImmediateDeactivate) == 0)
+            continue;
 
-            emgr->deactiveTable.remove(entIdx, node);
-            node = next;
+        uint16_t cHandle = findEntityComponent(ctype, ent);
+        if (cHandle == UINT16_MAX)
+            continue;
+
+        bool* active = ctype.dataPool.getHandleData<bool>(3, cHandle);
+        if (*active) {
+            *active = false;
+            if (ctype.callbacks.setActive)
+                ctype.callbacks.setActive(COMPONENT_MAKE_HANDLE(i, cHandle), ctype.dataPool.getHandleData(1, cHandle), 
+                                          false, 0);
+            updateComponentQueries(ent, uint16_t(i), false);
         }
     }
 
-    // Check if the entity has immediate destroy components
-    // And destroy all components registered to entity
-    entIdx = emgr->destroyTable.find(ent.id);
-    if (entIdx != -1) {
-        EntityHashTable::Node* node = emgr->destroyTable[entIdx];
-        while (node) {
-            EntityHashTable::Node* next = node->next;
-            destroyComponentNoImmAction(ent, node->value);
+    // Then destroy the ones that are flagged for immediate destroy
+    for (int i = 0; i < numTypes; i++) {
+        ComponentType& ctype = g_csys->components[i];
+        if ((ctype.flags & ComponentFlag::ImmediateDestroy) == 0)
+            continue;
 
-            emgr->destroyTable.remove(entIdx, node);
-            node = next;
-        }
-    } 
+        uint16_t cHandle = findEntityComponent(ctype, ent);
+        if (cHandle != UINT16_MAX)
+            destroyComponentNoImmAction(ent, COMPONENT_MAKE_HANDLE(i, cHandle));
+    }
 
     uint32_t idx = ent.getIndex();
     ++emgr->generations[idx];
     
-    EntityManager::FreeIndex* fi = emgr->freeIndexPool.newInstance<int>(idx);
-    if (fi) {
-        emgr->freeIndexQueue.push(&fi->qnode);
-        emgr->freeIndexSize++;
-    }
+    pushFreeIndex(emgr, idx);
+}
+
+void termite::destroyEntities(EntityManager* emgr, const Entity* ents, int count)
+{
+    assert(ents);
+
+    if (!reserveFreeIndices(emgr, emgr->freeIndexSize + count))
+        return;
+
+    for (int i = 0; i < count; i++)
+        destroyEntity(emgr, ents[i]);
 }
 
 bool termite::isEntityAlive(EntityManager* emgr, Entity ent)
@@ -296,6 +717,8 @@ void termite::setEntityActive(Entity ent, bool active, uint32_t flags)
                 else
                     removeFromComponentGroup(groupHandle, handles[i]);
             }
+
+            updateComponentQueries(ent, COMPONENT_TYPE_INDEX(handles[i]), active);
         }
     }
 }
@@ -312,9 +735,11 @@ result_t termite::initComponentSystem(bx::AllocatorI* alloc)
         return T_ERR_OUTOFMEM;
 
     uint32_t cgSz = sizeof(ComponentGroup);
+    uint32_t cqSz = sizeof(ComponentQuery);
     if (!g_csys->components.create(32, 128, alloc) || 
         !g_csys->nameTable.create(128, alloc) ||
-        !g_csys->componentGroups.create(&cgSz, 1, 32, 32, alloc))
+        !g_csys->componentGroups.create(&cgSz, 1, 32, 32, alloc) ||
+        !g_csys->componentQueries.create(&cqSz, 1, 16, 16, alloc))
     {
         return T_ERR_OUTOFMEM;
     }
@@ -337,8 +762,13 @@ void termite::shutdownComponentSystem()
         }
 
         ctype.dataPool.destroy();
-        ctype.entTable.destroy();
+        ctype.entNexts.destroy();
+        ctype.entHeads.destroy();
     }
+    while (g_csys->componentQueries.getCount() > 0)
+        destroyComponentQuery(ComponentQueryHandle(g_csys->componentQueries.handleAt(0)));
+
+    g_csys->componentQueries.destroy();
     g_csys->componentGroups.destroy();
     g_csys->components.destroy();
     g_csys->nameTable.destroy();
@@ -401,7 +831,8 @@ ComponentTypeHandle termite::registerComponentType(const char* name, const Compo
     ctype->dataSize = dataSize;
     const uint32_t itemSizes[4] = {sizeof(Entity), dataSize, sizeof(ComponentGroupHandle), sizeof(bool)};
     if (!ctype->dataPool.create(itemSizes, BX_COUNTOF(itemSizes), poolSize, growSize, alloc ? alloc : g_csys->alloc) ||
-        !ctype->entTable.create(poolSize, alloc ? alloc : g_csys->alloc)) 
+        !ctype->entHeads.create(1024, 1024, alloc ? alloc : g_csys->alloc) ||
+        !ctype->entNexts.create(poolSize, growSize, alloc ? alloc : g_csys->alloc)) 
     {
         return ComponentTypeHandle();
     }
@@ -480,14 +911,18 @@ ComponentHandle termite::createComponent(EntityManager* emgr, Entity ent, Compon
 {
     ComponentType& ctype = g_csys->components[handle.value];
 
-    if (ctype.entTable.find(ent.id) != -1) {
+    if (findEntityComponent(ctype, ent) != UINT16_MAX) {
         assert(false);  // Component instance Already exists for the entity
         return ComponentHandle();
     }
 
-    uint16_t cIdx = ctype.dataPool.newHandle();
+    uint16_t cIdx = newComponentInstance(ctype);
     if (cIdx == UINT16_MAX)
         return ComponentHandle();
+    if (!reserveEntityLookup(ctype, ent.getIndex() + 1)) {
+        ctype.dataPool.freeHandle(cIdx);
+        return ComponentHandle();
+    }
     *ctype.dataPool.getHandleData<Entity>(0, cIdx) = ent;
     void* data = ctype.dataPool.getHandleData(1, cIdx);
     *ctype.dataPool.getHandleData<ComponentGroupHandle>(2, cIdx) = group;
@@ -498,15 +933,10 @@ ComponentHandle termite::createComponent(EntityManager* emgr, Entity ent, Compon
     if (group.isValid())
         addToComponentGroup(group, chandle);
 
-    ctype.entTable.add(ent.id, chandle);
+    linkEntityComponent(ctype, ent, cIdx);
 
-    if (ctype.flags & ComponentFlag::ImmediateDestroy) {
-        emgr->destroyTable.add(ent.id, chandle);
-    }
-
-    if (ctype.flags & ComponentFlag::ImmediateDeactivate) {
-        emgr->deactiveTable.add(ent.id, chandle);
-    }
+    // Add entity to all queries that depend on the component type
+    updateComponentQueries(ent, handle.value, true);
 
     // Call create callback
     if (ctype.callbacks.createInstance) {
@@ -516,82 +946,474 @@ ComponentHandle termite::createComponent(EntityManager* emgr, Entity ent, Compon
     return chandle;
 }
 
+int termite::createComponents(EntityManager* emgr, const Entity* ents, int count, ComponentTypeHandle handle,
+                              ComponentHandle* handles, ComponentGroupHandle group)
+{
+    assert(ents);
+    ComponentType& ctype = g_csys->components[handle.value];
+
+    // Allocate data for all components at once
+    uint32_t maxItems = bx::uint32_min(ctype.dataPool.getCount() + count, UINT16_MAX - 1);
+    if (!reserveComponentPool(ctype, uint16_t(maxItems)))
+        return 0;
+
+    uint32_t numEnts = 0;
+    for (int i = 0; i < count; i++)
+        numEnts = bx::uint32_max(numEnts, Entity(ents[i]).getIndex() + 1);
+    if (!reserveEntityLookup(ctype, numEnts))
+        return 0;
+
+    ComponentHandle* groupHandles = nullptr;
+    if (group.isValid()) {
+        groupHandles = (ComponentHandle*)BX_ALLOC(getTempAlloc(), sizeof(ComponentHandle)*count);
+        if (!groupHandles)
+            return 0;
+    }
+
+    int numCreated = 0;
+    for (int i = 0; i < count; i++) {
+        Entity ent = ents[i];
+        if (handles)
+            handles[i] = ComponentHandle();
+
+        if (findEntityComponent(ctype, ent) != UINT16_MAX) {
+            assert(false);  // Component instance Already exists for the entity
+            continue;
+        }
+
+        uint16_t cIdx = newComponentInstance(ctype);
+        if (cIdx == UINT16_MAX)
+            break;
+        *ctype.dataPool.getHandleData<Entity>(0, cIdx) = ent;
+        *ctype.dataPool.getHandleData<ComponentGroupHandle>(2, cIdx) = group;
+        *ctype.dataPool.getHandleData<bool>(3, cIdx) = true;
+
+        ComponentHandle chandle = COMPONENT_MAKE_HANDLE(handle.value, cIdx);
+
+        // Components are merged into the group once, after all are created
+        if (groupHandles)
+            groupHandles[numCreated] = chandle;
+
+        linkEntityComponent(ctype, ent, cIdx);
+        updateComponentQueries(ent, handle.value, true);
+
+        if (ctype.callbacks.createInstance)
+            ctype.callbacks.createInstance(ent, chandle, ctype.dataPool.getHandleData(1, cIdx));
+
+        if (handles)
+            handles[i] = chandle;
+        numCreated++;
+    }
+
+    if (groupHandles)
+        addManyToComponentGroup(group, groupHandles, numCreated);
+
+    return numCreated;
+}
+
 void termite::destroyComponent(EntityManager* emgr, Entity ent, ComponentHandle handle)
 {
     destroyComponentNoImmAction(ent, handle);
-    
-    ComponentFlag::Bits flags = g_csys->components[COMPONENT_TYPE_INDEX(handle)].flags;
-
-    if (flags & ComponentFlag::ImmediateDestroy) {
-        int r = emgr->destroyTable.find(ent.id);
-        if (r != -1) {
-            EntityHashTable::Node* node = emgr->destroyTable[r];
-            while (node) {
-                if (node->value == handle) {
-                    emgr->destroyTable.remove(r, node);
-                    break;
-                }
-                node = node->next;
+}
+
+#pragma pack(push, 1)
+struct ComponentSnapshotHeader
+{
+    uint32_t sign;
+    uint32_t version;
+    uint32_t numGenerations;
+    uint32_t numFreeIndices;
+    uint32_t numTypes;
+};
+
+struct ComponentSnapshotType
+{
+    uint32_t nameHash;
+    uint32_t dataSize;
+    uint16_t maxItems;
+    uint16_t count;
+    uint32_t memSize;
+};
+#pragma pack(pop)
+
+// Offset of component data buffer (index=1) inside HandlePool's raw memory, see HandlePool::getMemory
+static inline size_t getComponentDataOffset(uint16_t maxItems)
+{
+    return 2*sizeof(uint16_t)*maxItems + sizeof(Entity)*maxItems;
+}
+
+uint32_t termite::getComponentSnapshotSize(EntityManager* emgr)
+{
+    assert(emgr);
+
+    uint32_t size = sizeof(ComponentSnapshotHeader) + 
+        sizeof(uint16_t)*emgr->generations.getCount() + 
+        sizeof(uint32_t)*emgr->freeIndexSize;
+    for (int i = 0, c = g_csys->components.getCount(); i < c; i++)
+        size += sizeof(ComponentSnapshotType) + (uint32_t)g_csys->components[i].dataPool.getMemorySize();
+    return size;
+}
+
+uint32_t termite::saveComponentSnapshot(EntityManager* emgr, void* buffer, uint32_t bufferSize)
+{
+    assert(emgr);
+    assert(buffer);
+
+    if (g_numEntityManagers != 1) {
+        T_ERROR("Save snapshot failed: Snapshots need a single entity manager, there are %d", g_numEntityManagers);
+        return 0;
+    }
+
+    uint32_t size = getComponentSnapshotSize(emgr);
+    if (bufferSize < size)
+        return 0;
+
+    uint8_t* buff = (uint8_t*)buffer;
+    int numTypes = g_csys->components.getCount();
+
+    ComponentSnapshotHeader* header = (ComponentSnapshotHeader*)buff;
+    header->sign = COMPONENT_SNAPSHOT_SIGN;
+    header->version = COMPONENT_SNAPSHOT_VERSION;
+    header->numGenerations = emgr->generations.getCount();
+    header->numFreeIndices = emgr->freeIndexSize;
+    header->numTypes = numTypes;
+    buff += sizeof(ComponentSnapshotHeader);
+
+    // Entities
+    memcpy(buff, emgr->generations.getBuffer(), sizeof(uint16_t)*header->numGenerations);
+    buff += sizeof(uint16_t)*header->numGenerations;
+
+    uint32_t firstPart = bx::uint32_min(emgr->freeIndexSize, emgr->freeIndexCapacity - emgr->freeIndexStart);
+    memcpy(buff, emgr->freeIndices + emgr->freeIndexStart, sizeof(uint32_t)*firstPart);
+    buff += sizeof(uint32_t)*firstPart;
+    memcpy(buff, emgr->freeIndices, sizeof(uint32_t)*(emgr->freeIndexSize - firstPart));
+    buff += sizeof(uint32_t)*(emgr->freeIndexSize - firstPart);
+
+    // Components: Raw copy the whole pool memory of each component type
+    for (int i = 0; i < numTypes; i++) {
+        const ComponentType& ctype = g_csys->components[i];
+        uint16_t maxItems = ctype.dataPool.getMaxItems();
+
+        ComponentSnapshotType stype;
+        stype.nameHash = (uint32_t)tinystl::hash_string(ctype.name, strlen(ctype.name));
+        stype.dataSize = ctype.dataSize;
+        stype.maxItems = maxItems;
+        stype.count = ctype.dataPool.getCount();
+        stype.memSize = (uint32_t)ctype.dataPool.getMemorySize();
+        memcpy(buff, &stype, sizeof(stype));
+        buff += sizeof(stype);
+
+        memcpy(buff, ctype.dataPool.getMemory(), stype.memSize);
+        if (ctype.callbacks.serialize) {
+            uint8_t* sdata = buff + getComponentDataOffset(maxItems);
+            for (uint16_t k = 0; k < stype.count; k++) {
+                uint16_t cHandle = ctype.dataPool.handleAt(k);
+                ctype.callbacks.serialize(COMPONENT_MAKE_HANDLE(i, cHandle), sdata + cHandle*ctype.dataSize);
             }
         }
+        buff += stype.memSize;
     }
 
-    if (flags & ComponentFlag::ImmediateDeactivate) {
-        int r = emgr->deactiveTable.find(ent.id);
-        if (r != -1) {
-            EntityHashTable::Node* node = emgr->deactiveTable[r];
-            while (node) {
-                if (node->value == handle) {
-                    emgr->deactiveTable.remove(r, node);
-                    break;
-                }
-                node = node->next;
-            }
+    return size;
+}
+
+MemoryBlock* termite::saveComponentSnapshot(EntityManager* emgr, bx::AllocatorI* alloc)
+{
+    uint32_t size = getComponentSnapshotSize(emgr);
+    MemoryBlock* mem = createMemoryBlock(size, alloc);
+    if (!mem)
+        return nullptr;
+
+    if (!saveComponentSnapshot(emgr, mem->data, mem->size)) {
+        releaseMemoryBlock(mem);
+        return nullptr;
+    }
+    return mem;
+}
+
+static bool isComponentGroupAlive(ComponentGroupHandle handle)
+{
+    for (int i = 0, c = g_csys->componentGroups.getCount(); i < c; i++) {
+        if (g_csys->componentGroups.handleAt(i) == handle)
+            return true;
+    }
+    return false;
+}
+
+// Checks every type header, pool indices, entity and group handles of the snapshot, nothing is modified
+static bool validateComponentSnapshot(const ComponentSnapshotHeader& header, const uint8_t* data, uint32_t size)
+{
+    const uint8_t* end = data + size;
+    const uint8_t* buff = data + sizeof(header);
+
+    // Entities
+    buff += sizeof(uint16_t)*header.numGenerations;
+    for (uint32_t i = 0; i < header.numFreeIndices; i++) {
+        uint32_t idx;
+        memcpy(&idx, buff + i*sizeof(uint32_t), sizeof(idx));
+        if (idx >= header.numGenerations)
+            return false;
+    }
+    buff += sizeof(uint32_t)*header.numFreeIndices;
+
+    // Components
+    for (int i = 0, c = g_csys->components.getCount(); i < c; i++) {
+        const ComponentType& ctype = g_csys->components[i];
+
+        ComponentSnapshotType stype;
+        if (uint32_t(end - buff) < sizeof(stype))
+            return false;
+        memcpy(&stype, buff, sizeof(stype));
+        buff += sizeof(stype);
+
+        if (stype.nameHash != (uint32_t)tinystl::hash_string(ctype.name, strlen(ctype.name)) ||
+            stype.dataSize != ctype.dataSize ||
+            stype.count > stype.maxItems ||
+            stype.memSize != ctype.dataPool.getMemorySize(stype.maxItems) ||
+            uint32_t(end - buff) < stype.memSize)
+        {
+            T_ERROR("Load snapshot failed: Component '%s' does not match", ctype.name);
+            return false;
         }
+
+        // Indices and reverse indices
+        const uint8_t* indices = buff;
+        for (uint32_t k = 0; k < 2u*stype.maxItems; k++) {
+            uint16_t idx;
+            memcpy(&idx, indices + k*sizeof(uint16_t), sizeof(idx));
+            if (idx >= stype.maxItems)
+                return false;
+        }
+
+        // Entities and groups of live components
+        const uint8_t* ents = buff + 2*sizeof(uint16_t)*stype.maxItems;
+        const uint8_t* groups = buff + getComponentDataOffset(stype.maxItems) + stype.dataSize*stype.maxItems;
+        for (uint16_t k = 0; k < stype.count; k++) {
+            uint16_t cHandle;
+            memcpy(&cHandle, indices + k*sizeof(uint16_t), sizeof(cHandle));
+
+            Entity ent;
+            memcpy(&ent, ents + cHandle*sizeof(Entity), sizeof(ent));
+            if (ent.getIndex() >= header.numGenerations)
+                return false;
+
+            ComponentGroupHandle groupHandle;
+            memcpy(&groupHandle, groups + cHandle*sizeof(ComponentGroupHandle), sizeof(groupHandle));
+            if (groupHandle.isValid() && !isComponentGroupAlive(groupHandle))
+                return false;
+        }
+
+        buff += stype.memSize;
+    }
+
+    return true;
+}
+
+// bx::Array has no reserve, so grow the buffer by pushing and popping back, the items stay the same
+template <typename Ty>
+static bool reserveArray(bx::Array<Ty>* arr, int count)
+{
+    int numItems = arr->getCount();
+    if (count <= numItems)
+        return true;
+    if (!arr->pushMany(count - numItems))
+        return false;
+    while (arr->getCount() > numItems)
+        arr->pop();
+    return true;
+}
+
+// Grows every buffer that loading the (validated) snapshot writes to, so restoring it can't fail halfway
+// Only capacities change here, the contents stay the same
+static bool reserveComponentSnapshot(EntityManager* emgr, const ComponentSnapshotHeader& header, const uint8_t* data)
+{
+    if (!reserveFreeIndices(emgr, header.numFreeIndices) ||
+        !reserveArray(&emgr->generations, (int)header.numGenerations))
+    {
+        return false;
+    }
+
+    // Count the active components that go into each group
+    bx::AllocatorI* tmpAlloc = getTempAlloc();
+    int numGroupSlots = g_csys->componentGroups.getMaxItems();
+    int* groupCounts = (int*)BX_ALLOC(tmpAlloc, sizeof(int)*(numGroupSlots + 1));
+    if (!groupCounts)
+        return false;
+    memset(groupCounts, 0x00, sizeof(int)*(numGroupSlots + 1));
+
+    int numTypes = g_csys->components.getCount();
+    uint16_t* typeCounts = (uint16_t*)alloca(sizeof(uint16_t)*numTypes);
+    const uint8_t* buff = data + sizeof(header) + sizeof(uint16_t)*header.numGenerations + 
+        sizeof(uint32_t)*header.numFreeIndices;
+    bool r = true;
+    for (int i = 0; i < numTypes && r; i++) {
+        ComponentType& ctype = g_csys->components[i];
+        ComponentSnapshotType stype;
+        memcpy(&stype, buff, sizeof(stype));
+        buff += sizeof(stype);
+        typeCounts[i] = stype.count;
+
+        // Entity lookups are sized by the data pool, so it must be reserved first
+        if (!reserveComponentPool(ctype, stype.maxItems) || !reserveEntityLookup(ctype, header.numGenerations)) {
+            r = false;
+            break;
+        }
+
+        const uint8_t* groups = buff + getComponentDataOffset(stype.maxItems) + stype.dataSize*stype.maxItems;
+        const uint8_t* actives = groups + sizeof(ComponentGroupHandle)*stype.maxItems;
+        for (uint16_t k = 0; k < stype.count; k++) {
+            uint16_t cHandle;
+            memcpy(&cHandle, buff + k*sizeof(uint16_t), sizeof(cHandle));
+            ComponentGroupHandle groupHandle;
+            memcpy(&groupHandle, groups + cHandle*sizeof(ComponentGroupHandle), sizeof(groupHandle));
+            if (groupHandle.isValid() && actives[cHandle])
+                groupCounts[groupHandle.value]++;
+        }
+        buff += stype.memSize;
+    }
+
+    for (int i = 0, c = g_csys->componentGroups.getCount(); i < c && r; i++) {
+        ComponentGroupHandle handle = ComponentGroupHandle(g_csys->componentGroups.handleAt(i));
+        ComponentGroup* group = g_csys->componentGroups.getHandleData<ComponentGroup>(0, handle);
+        r = reserveArray(&group->components, groupCounts[handle.value]) && reserveArray(&group->batches, numTypes);
+    }
+    BX_FREE(tmpAlloc, groupCounts);
+
+    // Queries can't match more entities than their rarest component type has
+    for (int i = 0, c = g_csys->componentQueries.getCount(); i < c && r; i++) {
+        ComponentQuery* query = 
+            g_csys->componentQueries.getHandleData<ComponentQuery>(0, g_csys->componentQueries.handleAt(i));
+        int maxMatches = typeCounts[query->types[0].value];
+        for (int k = 1; k < query->numTypes; k++)
+            maxMatches = std::min<int>(maxMatches, typeCounts[query->types[k].value]);
+        r = reserveArray(&query->entities, maxMatches) && reserveArray(&query->entSlots, (int)header.numGenerations);
+        for (int k = 0; k < query->numTypes && r; k++)
+            r = reserveArray(&query->handles[k], maxMatches) && reserveArray(&query->datas[k], maxMatches);
     }
 
+    return r;
 }
 
-static void sortAndBatchComponents(ComponentGroup* group)
+result_t termite::loadComponentSnapshot(EntityManager* emgr, const void* data, uint32_t size)
 {
-    // Sort components if it's invalidated
-    if (!group->sorted) {
+    assert(emgr);
+    assert(data);
+
+    if (g_numEntityManagers != 1) {
+        T_ERROR("Load snapshot failed: Snapshots need a single entity manager, there are %d", g_numEntityManagers);
+        return T_ERR_FAILED;
+    }
+
+    bx::Error err;
+    bx::MemoryReader reader(data, size);
+
+    ComponentSnapshotHeader header;
+    reader.read(&header, sizeof(header), &err);
+    if (!err.isOk() || header.sign != COMPONENT_SNAPSHOT_SIGN) {
+        T_ERROR("Load snapshot failed: Invalid header");
+        return T_ERR_FAILED;
+    }
+
+    if (header.version != COMPONENT_SNAPSHOT_VERSION) {
+        T_ERROR("Load snapshot failed: Invalid version: 0x%x", header.version);
+        return T_ERR_FAILED;
+    }
+
+    int numTypes = g_csys->components.getCount();
+    if (header.numTypes != (uint32_t)numTypes) {
+        T_ERROR("Load snapshot failed: Component types does not match");
+        return T_ERR_FAILED;
+    }
+
+    uint64_t entitySize = sizeof(uint16_t)*uint64_t(header.numGenerations) +
+        sizeof(uint32_t)*uint64_t(header.numFreeIndices);
+    if (uint64_t(size) < sizeof(header) + entitySize) {
+        T_ERROR("Load snapshot failed: Corrupt data");
+        return T_ERR_FAILED;
+    }
+
+    // Validate everything before touching the world, so a bad snapshot leaves it intact
+    if (!validateComponentSnapshot(header, (const uint8_t*)data, size)) {
+        T_ERROR("Load snapshot failed: Corrupt data");
+        return T_ERR_FAILED;
+    }
+
+    // Allocate everything first, from here on restoring can't fail
+    if (!reserveComponentSnapshot(emgr, header, (const uint8_t*)data)) {
+        T_ERROR("Load snapshot failed: Out of memory");
+        return T_ERR_OUTOFMEM;
+    }
+
+    // Entities
+    emgr->generations.clear();
+    if (header.numGenerations) {
+        uint16_t* gens = emgr->generations.pushMany(header.numGenerations);
+        reader.read(gens, sizeof(uint16_t)*header.numGenerations, &err);
+    }
+
+    emgr->freeIndexStart = 0;
+    reader.read(emgr->freeIndices, sizeof(uint32_t)*header.numFreeIndices, &err);
+    emgr->freeIndexSize = header.numFreeIndices;
+
+    // Components
+    for (int i = 0; i < numTypes; i++) {
+        ComponentType& ctype = g_csys->components[i];
+
+        ComponentSnapshotType stype;
+        reader.read(&stype, sizeof(stype), &err);
+
+        ctype.dataPool.restoreMemory(reader.getDataPtr(), stype.maxItems, stype.count);
+        reader.seek(stype.memSize, bx::Whence::Current);
+
+        // Rebuild entity lookups
+        memset(ctype.entHeads.getBuffer(), 0xff, sizeof(uint16_t)*ctype.entHeads.getCount());
+        for (uint16_t k = 0; k < stype.count; k++) {
+            uint16_t cHandle = ctype.dataPool.handleAt(k);
+            ComponentHandle handle = COMPONENT_MAKE_HANDLE(i, cHandle);
+            linkEntityComponent(ctype, *ctype.dataPool.getHandleData<Entity>(0, cHandle), cHandle);
+
+            if (ctype.callbacks.deserialize)
+                ctype.callbacks.deserialize(handle, ctype.dataPool.getHandleData(1, cHandle));
+        }
+    }
+
+    // Rebuild component groups from the active components
+    for (int i = 0, c = g_csys->componentGroups.getCount(); i < c; i++) {
+        ComponentGroup* group = g_csys->componentGroups.getHandleData<ComponentGroup>(0, g_csys->componentGroups.handleAt(i));
+        group->components.clear();
         group->batches.clear();
-        int count = group->components.getCount();
-        if (count > 0) {
-            std::sort(group->components.itemPtr(0), group->components.itemPtr(0) + count,
-                      [](const ComponentHandle& a, const ComponentHandle& b) { return a.value < b.value; });
-
-            // Batch by component-type
-            ComponentTypeHandle prevHandle;
-            ComponentGroup::Batch* curBatch = nullptr;
-
-            for (int i = 0; i < count; i++) {
-                ComponentTypeHandle curHandle = ComponentTypeHandle(COMPONENT_TYPE_INDEX(group->components[i]));
-                if (curHandle != prevHandle) {
-                    curBatch = group->batches.push();
-                    curBatch->index = i;
-                    curBatch->count = 0;
-                    prevHandle = curHandle;
-                }
-                curBatch->count++;
-            }
+    }
 
+    for (int i = 0; i < numTypes; i++) {
+        ComponentType& ctype = g_csys->components[i];
+        for (uint16_t k = 0, kc = ctype.dataPool.getCount(); k < kc; k++) {
+            uint16_t cHandle = ctype.dataPool.handleAt(k);
+            ComponentGroupHandle groupHandle = *ctype.dataPool.getHandleData<ComponentGroupHandle>(2, cHandle);
+            if (groupHandle.isValid() && *ctype.dataPool.getHandleData<bool>(3, cHandle)) {
+                ComponentGroup* group = g_csys->componentGroups.getHandleData<ComponentGroup>(0, groupHandle);
+                *group->components.push() = COMPONENT_MAKE_HANDLE(i, cHandle);
+            }
         }
-        group->sorted = true;
     }
+
+    for (int i = 0, c = g_csys->componentGroups.getCount(); i < c; i++)
+        rebuildComponentGroup(g_csys->componentGroups.getHandleData<ComponentGroup>(0, g_csys->componentGroups.handleAt(i)));
+
+    for (int i = 0, c = g_csys->componentQueries.getCount(); i < c; i++)
+        rebuildComponentQuery(g_csys->componentQueries.getHandleData<ComponentQuery>(0, g_csys->componentQueries.handleAt(i)));
+
+    return 0;
 }
 
 void termite::runComponentGroup(ComponentUpdateStage::Enum stage, ComponentGroupHandle groupHandle, float dt)
 {
     assert(groupHandle.isValid());
     ComponentGroup* group = g_csys->componentGroups.getHandleData<ComponentGroup>(0, groupHandle);
-    sortAndBatchComponents(group);
 
     // Call their callbacks
     for (int i = 0, c = group->batches.getCount(); i < c; i++) {
         ComponentGroup::Batch batch = group->batches[i];
-        const ComponentType& ctype = g_csys->components[COMPONENT_TYPE_INDEX(group->components[batch.index])];
+        const ComponentType& ctype = g_csys->components[batch.typeIdx];
         if (ctype.callbacks.updateStageFn[stage])
             ctype.callbacks.updateStageFn[stage](group->components.itemPtr(batch.index), batch.count, dt);
     }
@@ -662,10 +1484,10 @@ ComponentHandle termite::getComponent(ComponentTypeHandle handle, Entity ent)
     assert(handle.isValid());
     assert(ent.isValid());
 
-    const ComponentType& ctype = g_csys->components[handle.value];
-    int r = ctype.entTable.find(ent.id);
-    if (r != -1)
-        return ComponentHandle(ctype.entTable[r]);
+    ComponentType& ctype = g_csys->components[handle.value];
+    uint16_t cHandle = findEntityComponent(ctype, ent);
+    if (cHandle != UINT16_MAX)
+        return COMPONENT_MAKE_HANDLE(handle.value, cHandle);
     else
         return ComponentHandle();
 }
@@ -723,16 +1545,16 @@ uint16_t termite::getEntityComponents(Entity ent, ComponentHandle* handles, uint
 {
     int index = 0;
     for (int i = 0, c = g_csys->components.getCount(); i < c; i++) {
-        const ComponentType& ctype = g_csys->components[i];
-        int r = ctype.entTable.find(ent.id);
-        if (r == -1)
+        ComponentType& ctype = g_csys->components[i];
+        uint16_t cHandle = findEntityComponent(ctype, ent);
+        if (cHandle == UINT16_MAX)
             continue;
 
         if (index == maxComponents)
             return maxComponents;
 
         if (handles)
-            handles[index] = ctype.entTable[r];
+            handles[index] = COMPONENT_MAKE_HANDLE(i, cHandle);
         index ++;
     }
 
@@ -756,19 +1578,101 @@ uint16_t termite::getGroupComponentsByType(ComponentGroupHandle groupHandle, Com
     assert(groupHandle.isValid());
     ComponentGroup* group = g_csys->componentGroups.getHandleData<ComponentGroup>(0, groupHandle);
 
-    sortAndBatchComponents(group);
+    bool batchFound;
+    int batchIdx = findComponentGroupBatch(group, typeHandle.value, &batchFound);
+    if (!batchFound)
+        return 0;
 
-    for (int i = 0, c = group->batches.getCount(); i < c; i++) {
-        const ComponentGroup::Batch& batch = group->batches[i];
-        if (typeHandle == ComponentTypeHandle(COMPONENT_TYPE_INDEX(group->components[batch.index]))) {
-            uint16_t count = std::min<uint16_t>(maxComponents, (uint16_t)batch.count);
-            if (handles) {
-                memcpy(handles, group->components.itemPtr(batch.index), count*sizeof(ComponentHandle));
-            }
-            return count;
-        }
+    const ComponentGroup::Batch& batch = group->batches[batchIdx];
+    uint16_t count = std::min<uint16_t>(maxComponents, (uint16_t)batch.count);
+    if (handles) {
+        memcpy(handles, group->components.itemPtr(batch.index), count*sizeof(ComponentHandle));
     }
+    return count;
+}
 
-    return 0;
+ComponentQueryHandle termite::createComponentQuery(const ComponentTypeHandle* types, int numTypes, 
+                                                   bx::AllocatorI* alloc, int poolSize)
+{
+    assert(types);
+    assert(numTypes > 0 && numTypes <= kComponentQueryMaxTypes);
+
+    if (!alloc)
+        alloc = g_csys->alloc;
+    if (poolSize <= 0)
+        poolSize = 200;
+
+    ComponentQueryHandle handle = ComponentQueryHandle(g_csys->componentQueries.newHandle());
+    if (!handle.isValid())
+        return handle;
+
+    ComponentQuery* query = new(g_csys->componentQueries.getHandleData(0, handle)) ComponentQuery();
+    memcpy(query->types, types, sizeof(ComponentTypeHandle)*numTypes);
+    query->numTypes = numTypes;
+    bool r = query->entities.create(poolSize, poolSize, alloc) && query->entSlots.create(poolSize, poolSize, alloc);
+    for (int i = 0; i < numTypes && r; i++) {
+        assert(types[i].isValid());
+        r = query->handles[i].create(poolSize, poolSize, alloc) && query->datas[i].create(poolSize, poolSize, alloc);
+    }
+
+    if (!r) {
+        destroyComponentQuery(handle);
+        return ComponentQueryHandle();
+    }
+
+    rebuildComponentQuery(query);
+    return handle;
 }
 
+void termite::destroyComponentQuery(ComponentQueryHandle handle)
+{
+    assert(handle.isValid());
+    ComponentQuery* query = g_csys->componentQueries.getHandleData<ComponentQuery>(0, handle);
+
+    for (int i = 0; i < query->numTypes; i++) {
+        query->datas[i].destroy();
+        query->handles[i].destroy();
+    }
+    query->entSlots.destroy();
+    query->entities.destroy();
+    g_csys->componentQueries.freeHandle(handle);
+}
+
+int termite::getComponentQueryCount(ComponentQueryHandle handle)
+{
+    assert(handle.isValid());
+    return g_csys->componentQueries.getHandleData<ComponentQuery>(0, handle)->entities.getCount();
+}
+
+const Entity* termite::getComponentQueryEntities(ComponentQueryHandle handle)
+{
+    assert(handle.isValid());
+    return g_csys->componentQueries.getHandleData<ComponentQuery>(0, handle)->entities.getBuffer();
+}
+
+const ComponentHandle* termite::getComponentQueryHandles(ComponentQueryHandle handle, int typeIndex)
+{
+    assert(handle.isValid());
+    ComponentQuery* query = g_csys->componentQueries.getHandleData<ComponentQuery>(0, handle);
+    assert(typeIndex < query->numTypes);
+    return query->handles[typeIndex].getBuffer();
+}
+
+void* const* termite::getComponentQueryData(ComponentQueryHandle handle, int typeIndex)
+{
+    assert(handle.isValid());
+    ComponentQuery* query = g_csys->componentQueries.getHandleData<ComponentQuery>(0, handle);
+    assert(typeIndex < query->numTypes);
+
+    // Component data pool is reallocated, refresh the data pointers
+    ComponentType& ctype = g_csys->components[query->types[typeIndex].value];
+    if (query->poolGenerations[typeIndex] != ctype.poolGeneration) {
+        const ComponentHandle* handles = query->handles[typeIndex].getBuffer();
+        void** datas = query->datas[typeIndex].getBuffer();
+        for (int i = 0, c = query->entities.getCount(); i < c; i++)
+            datas[i] = ctype.dataPool.getHandleData(1, COMPONENT_INSTANCE_HANDLE(handles[i]));
+        query->poolGenerations[typeIndex] = ctype.poolGeneration;
+    }
+
+    return query->datas[typeIndex].getBuffer();
+}
@@ -3,6 +3,9 @@
 #include "bx/readerwriter.h"
 #include "bx/os.h"
 #include "bx/cpu.h"
+#include "bx/thread.h"
+#include "bx/sem.h"
+#include "bx/hash.h"
 #include "bxx/path.h"
 #include "bxx/inifile.h"
 #include "bxx/pool.h"
@@ -12,6 +15,7 @@
 #include "bxx/string.h"
 
 #include "gfx_defines.h"
+#include "gfx_driver_internal.h"
 #include "gfx_font.h"
 #include "gfx_utils.h"
 #include "gfx_texture.h"
@@ -64,6 +68,12 @@
 #define NANOVG_VIEWID 254
 #define LOG_STRING_SIZE 256
 
+// Graphics driver cache (compiled shaders/programs)
+#define GFX_CACHE_SIGN 0x63786667   // "gfxc"
+#define GFX_CACHE_VERSION 1
+#define GFX_CACHE_MAX_ENTRIES 1024
+#define GFX_CACHE_INDEX_FILENAME "tgfxcache.idx"
+
 using namespace termite;
 
 typedef std::chrono::high_resolution_clock TClock;
@@ -97,28 +107,69 @@ struct HeapMemoryImpl
     }
 };
 
+struct GfxCacheEntry
+{
+    uint64_t id;
+    uint32_t size;
+    uint32_t lastUse;   // Use counter value of the last read/write, least recently used entries are evicted first
+};
+
+// Header of each cached item file
+struct GfxCacheFileHeader
+{
+    uint32_t sign;
+    uint32_t version;
+    uint64_t id;
+    uint32_t size;
+    uint32_t hash;      // Murmur2A hash of the data
+};
+
+// Index file: GfxCacheIndexHeader + GfxCacheEntry[count]
+struct GfxCacheIndexHeader
+{
+    uint32_t sign;
+    uint32_t version;
+    uint32_t count;
+    uint32_t useCounter;
+};
+
 class GfxDriverEvents : public GfxDriverEventsI
 {
 private:
     bx::Lock m_lock;
 
-public:
-    void onFatal(GfxFatalType::Enum type, const char* str) override;
-    void onTraceVargs(const char* filepath, int line, const char* format, va_list argList) override;
+    // Disk cache, items are stored as separate files in the cache directory through the blocking IoDriver
+    bx::Lock m_cacheLock;
+    bx::Array<GfxCacheEntry> m_cacheEntries;
+    uint64_t m_cacheTotalSize;
+    uint32_t m_cacheUseCounter;
+    bool m_cacheLoaded;
+    bool m_cacheDirty;
 
-    uint32_t onCacheReadSize(uint64_t id) override
-    {
-        return 0;
-    }
+    void loadCacheIndex();
+    void saveCacheIndex();
+    int findCacheEntry(uint64_t id) const;
+    void removeCacheEntry(int index);
+    void removeUnindexedCacheFiles();
 
-    bool onCacheRead(uint64_t id, void* data, uint32_t size) override
+public:
+    GfxDriverEvents() :
+        m_cacheTotalSize(0),
+        m_cacheUseCounter(0),
+        m_cacheLoaded(false),
+        m_cacheDirty(false)
     {
-        return false;
     }
 
-    void onCacheWrite(uint64_t id, const void* data, uint32_t size) override
-    {
-    }
+    void onFatal(GfxFatalType::Enum type, const char* str) override;
+    void onTraceVargs(const char* filepath, int line, const char* format, va_list argList) override;
+
+    uint32_t onCacheReadSize(uint64_t id) override;
+    bool onCacheRead(uint64_t id, void* data, uint32_t size) override;
+    void onCacheWrite(uint64_t id, const void* data, uint32_t size) override;
+
+    // Saves the index and frees cache data, must be called before IoDriver shutdown
+    void shutdownCache();
 
     void onScreenShot(const char *filePath, uint32_t width, uint32_t height, uint32_t pitch, 
                       const void *data, uint32_t size, bool yflip) override
@@ -156,6 +207,8 @@ struct Core
     UpdateCallback updateFn;
     Config conf;
     RendererApi* renderer;
+    uint32_t rendererVersion;
+    RenderGraph* renderGraph;
     FrameData frameData;
     double timeMultiplier;
     bx::Pool<HeapMemoryImpl> memPool;
@@ -174,6 +227,11 @@ struct Core
     Remotery* rmt;
     bx::Array<ConsoleCommand> consoleCmds;
 
+    // Render thread (InitEngineFlags::RenderThread)
+    bx::Thread renderThread;
+    bx::Semaphore renderThreadSem;
+    volatile int32_t renderThreadStop;
+
     bool init;
 
     Core() :
@@ -185,11 +243,14 @@ struct Core
         sndDriver = nullptr;
         updateFn = nullptr;
         renderer = nullptr;
+        rendererVersion = 0;
+        renderGraph = nullptr;
         ioDriver = nullptr;
         timeMultiplier = 1.0;
         gfxLogCache = nullptr;
         numGfxLogCache = 0;
         rmt = nullptr;
+        renderThreadStop = 0;
         init = false;
         memset(&frameData, 0x00, sizeof(frameData));
     }
@@ -269,6 +330,35 @@ static void remoteryInputHandlerCallback(const char* text, void* context)
     }
 }
 
+// Calls gfx driver's renderFrame in a loop, main thread encodes the next frame while this one submits the current
+// Frame pacing: gfxDriver->frame() blocks until this thread has consumed the previous frame, so the main thread
+// is never more than one frame ahead
+static int32_t renderThreadFn(void* userData)
+{
+    GfxDriverApi* gfxDriver = (GfxDriverApi*)userData;
+
+    // First call before driver init binds this thread as the render thread
+    gfxDriver->renderFrame();
+    g_core->renderThreadSem.post();
+
+    while (!g_core->renderThreadStop) {
+        RenderFrameType::Enum r = gfxDriver->renderFrame();
+        if (r == RenderFrameType::Exiting)
+            break;
+        else if (r == RenderFrameType::NoContext)
+            bx::sleep(1);   // Driver is not initialized yet, or init has failed
+    }
+    return 0;
+}
+
+static void stopRenderThread()
+{
+    if (g_core->renderThread.isRunning()) {
+        bx::atomicExchange<int32_t>(&g_core->renderThreadStop, 1);
+        g_core->renderThread.shutdown();
+    }
+}
+
 static void callbackConf(const char* key, const char* value, void* userParam)
 {
     Config* conf = (Config*)userParam;
@@ -406,6 +496,7 @@ result_t termite::initialize(const Config& conf, UpdateCallback updateFn, const
         if (r > 0) {
             g_core->renderer = (RendererApi*)initPlugin(pluginHandle, g_alloc);
             const PluginDesc& desc = getPluginDesc(pluginHandle);
+            g_core->rendererVersion = desc.version;
             BX_TRACE("Found Renderer: %s v%d.%d", desc.name, T_VERSION_MAJOR(desc.version), T_VERSION_MINOR(desc.version));
 
             if (!platform) {
@@ -432,6 +523,10 @@ result_t termite::initialize(const Config& conf, UpdateCallback updateFn, const
                   T_VERSION_MINOR(desc.version));
         if (platform)
             g_core->gfxDriver->setPlatformData(*platform);
+        if (conf.engineFlags & InitEngineFlags::RenderThread) {
+            g_core->renderThread.init(renderThreadFn, g_core->gfxDriver, 0, "RenderThread");
+            g_core->renderThreadSem.wait();
+        }
         if (T_FAILED(g_core->gfxDriver->init(conf.gfxDeviceId, &g_core->gfxDriverEvents, g_alloc))) {
             BX_END_FATAL();
             dumpGfxLog();
@@ -452,6 +547,14 @@ result_t termite::initialize(const Config& conf, UpdateCallback updateFn, const
             BX_END_OK();
         }
 
+        // Render graph has it's own view Id range, after manually assigned views and before nanovg and imgui
+        g_core->renderGraph = createRenderGraph(g_alloc, g_core->gfxDriver, T_RENDER_GRAPH_FIRST_VIEWID,
+                                                NANOVG_VIEWID - T_RENDER_GRAPH_FIRST_VIEWID);
+        if (!g_core->renderGraph) {
+            T_ERROR("Core init failed: Could not create render graph");
+            return T_ERR_OUTOFMEM;
+        }
+
         // Init and Register graphics resource loaders
         initTextureLoader(g_core->gfxDriver, g_alloc);
         registerTextureToResourceLib();
@@ -671,6 +774,10 @@ void termite::shutdown(ShutdownCallback callback, void* userData)
     shutdownModelLoader();
     shutdownTextureLoader();
     shutdownGfxUtils();
+    if (g_core->renderGraph) {
+        destroyRenderGraph(g_core->renderGraph);
+        g_core->renderGraph = nullptr;
+    }
     BX_END_OK();
 
     if (g_core->renderer) {
@@ -684,7 +791,11 @@ void termite::shutdown(ShutdownCallback callback, void* userData)
         BX_BEGINP("Shutting down Graphics Driver");
         g_core->gfxDriver->shutdown();
         g_core->gfxDriver = nullptr;
+
+        // Driver shutdown flushes the last frames through the render thread, so it can be joined afterwards
+        stopRenderThread();
         BX_END_OK();
+        g_core->gfxDriverEvents.shutdownCache();
         dumpGfxLog();
     }
 
@@ -765,6 +876,14 @@ void termite::doFrame()
         ImGuizmo::BeginFrame();
     }
 
+    // Renderer's passes are added before the game's
+    if (g_core->renderGraph) {
+        resetRenderGraph(g_core->renderGraph);
+        RendererApi* renderer = g_core->renderer;
+        if (renderer && g_core->rendererVersion >= T_RENDERER_API_VERSION_1 && renderer->setupRenderGraph)
+            renderer->setupRenderGraph(g_core->renderGraph);
+    }
+
     rmt_BeginCPUSample(Game_Update, 0);
     if (g_core->updateFn)
         g_core->updateFn(fdt);
@@ -782,14 +901,22 @@ void termite::doFrame()
     if (g_core->renderer)
         g_core->renderer->render(nullptr);
 
+    rmt_BeginCPUSample(RenderGraph, 0);
+    if (g_core->renderGraph)
+        executeRenderGraph(g_core->renderGraph);
+    rmt_EndCPUSample(); // RenderGraph
+
     rmt_BeginCPUSample(Async_Loop, 0);
     if (g_core->ioDriver->async)
         g_core->ioDriver->async->runAsyncLoop();
     rmt_EndCPUSample(); // Async_Loop
 
+    // In RenderThread mode, this waits for the render thread to finish the previous frame and hands over this one
     rmt_BeginCPUSample(Gfx_DrawFrame, 0);
-    if (g_core->gfxDriver)
+    if (g_core->gfxDriver) {
         g_core->gfxDriver->frame();
+        swapGfxSubsystemStats();
+    }
     rmt_EndCPUSample(); // GfxFrame
 
     fd.frame++;
@@ -1012,6 +1139,11 @@ GfxDriverApi* termite::getGfxDriver()
     return g_core->gfxDriver;
 }
 
+RenderGraph* termite::getRenderGraph()
+{
+    return g_core->renderGraph;
+}
+
 IoDriverApi* termite::getBlockingIoDriver() T_THREAD_SAFE
 {
     return g_core->ioDriver->blocking;
@@ -1097,13 +1229,13 @@ void GfxDriverEvents::onFatal(GfxFatalType::Enum type, const char* str)
     bx::strlcpy(strTrimed, str, sizeof(strTrimed));
     strTrimed[strlen(strTrimed) - 1] = 0;
 
+    m_lock.lock();
     if (g_core->numGfxLogCache < 1000) {
-        m_lock.lock();
         g_core->gfxLogCache = (LogCache*)BX_REALLOC(g_alloc, g_core->gfxLogCache, sizeof(LogCache) * (++g_core->numGfxLogCache));
         g_core->gfxLogCache[g_core->numGfxLogCache-1].type = bx::LogType::Fatal;
         strcpy(g_core->gfxLogCache[g_core->numGfxLogCache-1].text, strTrimed);
-        m_lock.unlock();
     }
+    m_lock.unlock();
 }
 
 void GfxDriverEvents::onTraceVargs(const char* filepath, int line, const char* format, va_list argList)
@@ -1111,12 +1243,265 @@ void GfxDriverEvents::onTraceVargs(const char* filepath, int line, const char* f
     char text[LOG_STRING_SIZE];
     vsnprintf(text, sizeof(text), format, argList);
     text[strlen(text) - 1] = 0;
+    m_lock.lock();
     if (g_core->numGfxLogCache < 1000) {
-        m_lock.lock();
         g_core->gfxLogCache = (LogCache*)BX_REALLOC(g_alloc, g_core->gfxLogCache, sizeof(LogCache) * (++g_core->numGfxLogCache));
         g_core->gfxLogCache[g_core->numGfxLogCache-1].type = bx::LogType::Verbose;
         strcpy(g_core->gfxLogCache[g_core->numGfxLogCache-1].text, text);
-        m_lock.unlock();
     }
+    m_lock.unlock();
 
 }
+
+static bx::Path getGfxCacheFilepath(uint64_t id)
+{
+    char filename[64];
+    bx::snprintf(filename, sizeof(filename), "tgfxcache_%016llx.bin", (unsigned long long)id);
+    bx::Path filepath(g_cacheDir);
+    filepath.join(filename);
+    return filepath;
+}
+
+void GfxDriverEvents::loadCacheIndex()
+{
+    if (m_cacheLoaded)
+        return;
+    m_cacheLoaded = true;
+    m_cacheEntries.create(64, 64, g_alloc);
+
+    IoDriverApi* io = g_core->ioDriver->blocking;
+    bx::Path indexFilepath(g_cacheDir);
+    indexFilepath.join(GFX_CACHE_INDEX_FILENAME);
+    if (indexFilepath.getType() != bx::PathType::File) {
+        removeUnindexedCacheFiles();
+        return;
+    }
+
+    MemoryBlock* mem = io->read(indexFilepath.cstr(), IoPathType::Absolute);
+    if (!mem) {
+        removeUnindexedCacheFiles();
+        return;
+    }
+
+    const GfxCacheIndexHeader* header = (const GfxCacheIndexHeader*)mem->data;
+    if (mem->size < sizeof(GfxCacheIndexHeader) || 
+        header->sign != GFX_CACHE_SIGN || 
+        header->version != GFX_CACHE_VERSION ||
+        header->count > GFX_CACHE_MAX_ENTRIES ||
+        mem->size != sizeof(GfxCacheIndexHeader) + header->count*sizeof(GfxCacheEntry))
+    {
+        BX_WARN("Gfx cache index is corrupt, cache is reset");
+        releaseMemoryBlock(mem);
+        m_cacheDirty = true;
+        removeUnindexedCacheFiles();
+        return;
+    }
+
+    const GfxCacheEntry* entries = (const GfxCacheEntry*)(header + 1);
+    uint32_t count = header->count;
+    GfxCacheEntry* dest = m_cacheEntries.pushMany(count);
+    memcpy(dest, entries, sizeof(GfxCacheEntry)*count);
+    for (uint32_t i = 0; i < count; i++)
+        m_cacheTotalSize += entries[i].size;
+    m_cacheUseCounter = header->useCounter;
+
+    releaseMemoryBlock(mem);
+
+    // Item files can also be left behind if the app exits before the index is saved
+    removeUnindexedCacheFiles();
+}
+
+// Deletes item files in the cache directory that are not in the index, so they don't escape the size limit
+void GfxDriverEvents::removeUnindexedCacheFiles()
+{
+    DIR* dir = opendir(g_cacheDir.cstr());
+    if (!dir)
+        return;
+
+    int numRemoved = 0;
+    dirent* ent;
+    while ((ent = readdir(dir)) != nullptr) {
+        if (ent->d_type != DT_REG && ent->d_type != DT_UNKNOWN)
+            continue;
+
+        unsigned long long id;
+        char ext[8];
+        if (strlen(ent->d_name) != 30 ||
+            sscanf(ent->d_name, "tgfxcache_%016llx.%3s", &id, ext) != 2 ||
+            strcmp(ext, "bin") != 0)
+        {
+            continue;
+        }
+
+        if (findCacheEntry(uint64_t(id)) == -1) {
+            bx::Path filepath(g_cacheDir);
+            filepath.join(ent->d_name);
+            remove(filepath.cstr());
+            numRemoved++;
+        }
+    }
+    closedir(dir);
+
+    if (numRemoved > 0)
+        BX_VERBOSE("Removed %d unindexed gfx cache files", numRemoved);
+}
+
+void GfxDriverEvents::saveCacheIndex()
+{
+    if (!m_cacheDirty)
+        return;
+
+    int count = m_cacheEntries.getCount();
+    MemoryBlock* mem = createMemoryBlock(uint32_t(sizeof(GfxCacheIndexHeader) + count*sizeof(GfxCacheEntry)), g_alloc);
+    if (!mem)
+        return;
+
+    GfxCacheIndexHeader* header = (GfxCacheIndexHeader*)mem->data;
+    header->sign = GFX_CACHE_SIGN;
+    header->version = GFX_CACHE_VERSION;
+    header->count = uint32_t(count);
+    header->useCounter = m_cacheUseCounter;
+    if (count > 0)
+        memcpy(header + 1, m_cacheEntries.getBuffer(), sizeof(GfxCacheEntry)*count);
+
+    bx::Path indexFilepath(g_cacheDir);
+    indexFilepath.join(GFX_CACHE_INDEX_FILENAME);
+    if (g_core->ioDriver->blocking->write(indexFilepath.cstr(), mem, IoPathType::Absolute) == mem->size)
+        m_cacheDirty = false;
+    releaseMemoryBlock(mem);
+}
+
+int GfxDriverEvents::findCacheEntry(uint64_t id) const
+{
+    for (int i = 0, c = m_cacheEntries.getCount(); i < c; i++) {
+        if (m_cacheEntries[i].id == id)
+            return i;
+    }
+    return -1;
+}
+
+void GfxDriverEvents::removeCacheEntry(int index)
+{
+    const GfxCacheEntry& entry = m_cacheEntries[index];
+    remove(getGfxCacheFilepath(entry.id).cstr());     // IoDriver has no delete
+    m_cacheTotalSize -= entry.size;
+
+    int last = m_cacheEntries.getCount() - 1;
+    if (index != last)
+        m_cacheEntries[index] = m_cacheEntries[last];
+    m_cacheEntries.pop();
+    m_cacheDirty = true;
+}
+
+uint32_t GfxDriverEvents::onCacheReadSize(uint64_t id)
+{
+    if (g_core->conf.gfxCacheSize == 0 || !g_core->ioDriver->blocking)
+        return 0;
+
+    bx::LockScope lock(m_cacheLock);
+    loadCacheIndex();
+    int index = findCacheEntry(id);
+    return index != -1 ? m_cacheEntries[index].size : 0;
+}
+
+bool GfxDriverEvents::onCacheRead(uint64_t id, void* data, uint32_t size)
+{
+    if (g_core->conf.gfxCacheSize == 0 || !g_core->ioDriver->blocking)
+        return false;
+
+    bx::LockScope lock(m_cacheLock);
+    loadCacheIndex();
+    int index = findCacheEntry(id);
+    if (index == -1)
+        return false;
+
+    bx::Path filepath = getGfxCacheFilepath(id);
+    MemoryBlock* mem = filepath.getType() == bx::PathType::File ? 
+        g_core->ioDriver->blocking->read(filepath.cstr(), IoPathType::Absolute) : nullptr;
+
+    // Validate the file, corrupt or stale items are removed, so the driver compiles and writes them again
+    const GfxCacheFileHeader* header = mem ? (const GfxCacheFileHeader*)mem->data : nullptr;
+    if (!header ||
+        mem->size != sizeof(GfxCacheFileHeader) + size ||
+        header->sign != GFX_CACHE_SIGN ||
+        header->version != GFX_CACHE_VERSION ||
+        header->id != id ||
+        header->size != size ||
+        header->hash != bx::hashMurmur2A(header + 1, size))
+    {
+        BX_WARN("Gfx cache item 0x%016llx is invalid, removed", (unsigned long long)id);
+        if (mem)
+            releaseMemoryBlock(mem);
+        removeCacheEntry(index);
+        return false;
+    }
+
+    memcpy(data, header + 1, size);
+    releaseMemoryBlock(mem);
+
+    m_cacheEntries[index].lastUse = ++m_cacheUseCounter;
+    m_cacheDirty = true;
+    return true;
+}
+
+void GfxDriverEvents::onCacheWrite(uint64_t id, const void* data, uint32_t size)
+{
+    uint64_t maxSize = uint64_t(g_core->conf.gfxCacheSize)*1024;
+    if (maxSize == 0 || size > maxSize || !g_core->ioDriver->blocking)
+        return;
+
+    bx::LockScope lock(m_cacheLock);
+    loadCacheIndex();
+
+    int index = findCacheEntry(id);
+    if (index != -1)
+        removeCacheEntry(index);
+
+    // Evict least recently used items until the new one fits
+    while (m_cacheEntries.getCount() > 0 && 
+           (m_cacheTotalSize + size > maxSize || m_cacheEntries.getCount() >= GFX_CACHE_MAX_ENTRIES)) 
+    {
+        int lruIndex = 0;
+        for (int i = 1, c = m_cacheEntries.getCount(); i < c; i++) {
+            if (m_cacheEntries[i].lastUse < m_cacheEntries[lruIndex].lastUse)
+                lruIndex = i;
+        }
+        removeCacheEntry(lruIndex);
+    }
+
+    MemoryBlock* mem = createMemoryBlock(sizeof(GfxCacheFileHeader) + size, g_alloc);
+    if (!mem)
+        return;
+    GfxCacheFileHeader* header = (GfxCacheFileHeader*)mem->data;
+    header->sign = GFX_CACHE_SIGN;
+    header->version = GFX_CACHE_VERSION;
+    header->id = id;
+    header->size = size;
+    header->hash = bx::hashMurmur2A(data, size);
+    memcpy(header + 1, data, size);
+
+    bx::Path filepath = getGfxCacheFilepath(id);
+    if (g_core->ioDriver->blocking->write(filepath.cstr(), mem, IoPathType::Absolute) == mem->size) {
+        GfxCacheEntry* entry = m_cacheEntries.push();
+        entry->id = id;
+        entry->size = size;
+        entry->lastUse = ++m_cacheUseCounter;
+        m_cacheTotalSize += size;
+        m_cacheDirty = true;
+
+        // Items are only written after compiling, which is rare, so keep the index in sync with the files
+        saveCacheIndex();
+    }
+    releaseMemoryBlock(mem);
+}
+
+void GfxDriverEvents::shutdownCache()
+{
+    bx::LockScope lock(m_cacheLock);
+    if (m_cacheLoaded) {
+        saveCacheIndex();
+        m_cacheEntries.destroy();
+        m_cacheLoaded = false;
+        m_cacheTotalSize = 0;
+    }
+}
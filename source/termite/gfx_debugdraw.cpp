@@ -8,8 +8,11 @@
 #include "camera.h"
 
 #include "bx/uint32_t.h"
+#include "bxx/array.h"
 #include "bxx/pool.h"
 #include "bxx/stack.h"
+#include "bxx/logger.h"
+#include "Remotery.h"
 
 #include <cstdarg>
 
@@ -18,6 +21,7 @@
 
 #define STATE_POOL_SIZE 8
 #define MAX_TEXT_SIZE 256
+#define BATCH_GROW_SIZE 4096
 
 using namespace termite;
 
@@ -60,6 +64,18 @@ public:
     virtual GfxState::Bits setStates(VectorGfxContext* ctx, GfxDriverApi* driver, const void* params) = 0;
 };
 
+// Primitives are collected into batches by their render state and drawn in 'ddEnd'
+struct DebugDrawBatch
+{
+    enum Enum
+    {
+        Solid = 0,      // Triangles, depth tested, alpha blended
+        Lines,          // Depth tested lines
+        Lines2D,        // Alpha blended lines, without depth test
+        Count
+    };
+};
+
 struct DebugDrawState
 {
     typedef bx::Stack<DebugDrawState*>::Node SNode;
@@ -94,6 +110,7 @@ namespace termite
         VectorGfxContext* vgCtx;
         mtx4x4_t billboardMtx;
         mtx4x4_t viewProjMtx;
+        bx::Array<eddVertexPosCoordColor> batches[DebugDrawBatch::Count];   // Transformed vertices, colors are baked
 
         DebugDrawContext(bx::AllocatorI* _alloc) : alloc(_alloc)
         {
@@ -108,19 +125,21 @@ namespace termite
     };
 } // namespace termite
 
+// Unit shapes are kept on CPU, they are transformed and pushed into batches on each draw
 struct Shape
 {
-    VertexBufferHandle vb;
-    uint32_t numVerts;
+    vec3_t* verts;
+    int numVerts;
 
     Shape()
     {
+        verts = nullptr;
         numVerts = 0;
     }
 
-    Shape(VertexBufferHandle _vb, uint32_t _numVerts)
+    Shape(vec3_t* _verts, int _numVerts)
     {
-        vb = _vb;
+        verts = _verts;
         numVerts = _numVerts;
     }
 };
@@ -136,6 +155,7 @@ struct dbgMgr
     UniformHandle uColor;
 
     Shape bbShape;
+    Shape boxShape;
     Shape bsphereShape;
     Shape sphereShape;
 
@@ -169,6 +189,25 @@ static bool projectToScreen(vec2_t* result, const vec3_t point, const recti_t& r
     return true;
 }
 
+static Shape createShape(const eddVertexPosCoordColor* verts, int numVerts)
+{
+    vec3_t* pts = (vec3_t*)BX_ALLOC(g_dbg->alloc, sizeof(vec3_t)*numVerts);
+    if (!pts)
+        return Shape();
+    for (int i = 0; i < numVerts; i++)
+        pts[i] = vec3f(verts[i].x, verts[i].y, verts[i].z);
+    return Shape(pts, numVerts);
+}
+
+static void destroyShape(Shape* shape)
+{
+    if (shape->verts) {
+        BX_FREE(g_dbg->alloc, shape->verts);
+        shape->verts = nullptr;
+    }
+    shape->numVerts = 0;
+}
+
 static Shape createSolidAABB()
 {
     aabb_t box = aabbEmpty();
@@ -202,11 +241,7 @@ static Shape createSolidAABB()
     verts[30].setPos(pts[3]); verts[31].setPos(pts[2]); verts[32].setPos(pts[6]);
     verts[33].setPos(pts[6]); verts[34].setPos(pts[7]); verts[35].setPos(pts[3]);
 
-    for (int i = 0; i < numVerts; i++)
-        verts[i].color = 0xffffffff;
-
-    return Shape(g_dbg->driver->createVertexBuffer(g_dbg->driver->copy(verts, sizeof(eddVertexPosCoordColor) * numVerts),
-                                                   eddVertexPosCoordColor::Decl, GpuBufferFlag::None), numVerts);
+    return createShape(verts, numVerts);
 }
 
 static Shape createAABB()
@@ -241,11 +276,7 @@ static Shape createAABB()
     verts[20].setPos(pts[7]);   verts[21].setPos(pts[6]);
     verts[22].setPos(pts[6]);   verts[23].setPos(pts[2]);
 
-    for (int i = 0; i < numVerts; i++)
-        verts[i].color = 0xffffffff;
-
-    return Shape(g_dbg->driver->createVertexBuffer(g_dbg->driver->copy(verts, sizeof(eddVertexPosCoordColor) * numVerts),
-        eddVertexPosCoordColor::Decl, GpuBufferFlag::None), numVerts);
+    return createShape(verts, numVerts);
 }
 
 
@@ -272,12 +303,7 @@ static Shape createBoundingSphere(int numSegs)
         theta += dt;
     }
 
-    for (int i = 0; i < numVerts; i++)
-        verts[i].color = 0xffffffff;
-
-    return Shape(g_dbg->driver->createVertexBuffer(
-        g_dbg->driver->copy(verts, size), eddVertexPosCoordColor::Decl, GpuBufferFlag::None),
-        numVerts);
+    return createShape(verts, numVerts);
 }
 
 static Shape createSphere(int numSegsX, int numSegsY)
@@ -374,12 +400,69 @@ static Shape createSphere(int numSegsX, int numSegsY)
         }
     }
 
-    for (int i = 0; i < numVerts; i++)
-        verts[i].color = 0xffffffff;
+    return createShape(verts, numVerts);
+}
 
-    return Shape(g_dbg->driver->createVertexBuffer(
-        g_dbg->driver->copy(verts, size), eddVertexPosCoordColor::Decl, GpuBufferFlag::None),
-        numVerts);
+static GfxState::Bits getBatchState(DebugDrawBatch::Enum batch)
+{
+    switch (batch) {
+    case DebugDrawBatch::Solid:
+        return GfxState::RGBWrite | GfxState::DepthTestLess | gfxStateBlendAlpha();
+    case DebugDrawBatch::Lines:
+        return GfxState::RGBWrite | GfxState::DepthTestLess | GfxState::PrimitiveLines;
+    default:
+        return GfxState::RGBWrite | GfxState::PrimitiveLines | gfxStateBlendAlpha();
+    }
+}
+
+static uint32_t getStateColor(const DebugDrawState* state)
+{
+    const vec4_t& c = state->color;
+    return colorRGBAf(c.x, c.y, c.z, c.w*state->alpha).n;
+}
+
+// Modulates the color with the state color, same as the shader's u_color
+static uint32_t getStateColor(const DebugDrawState* state, color_t color)
+{
+    const vec4_t& c = state->color;
+    return color4u(uint8_t(float(color.r)*c.x), uint8_t(float(color.g)*c.y), uint8_t(float(color.b)*c.z),
+                   uint8_t(float(color.a)*c.w*state->alpha)).n;
+}
+
+static eddVertexPosCoordColor* pushVerts(DebugDrawContext* ctx, DebugDrawBatch::Enum batch, int numVerts)
+{
+    eddVertexPosCoordColor* verts = ctx->batches[batch].pushMany(numVerts);
+    if (verts)
+        memset(verts, 0x00, sizeof(eddVertexPosCoordColor)*numVerts);
+    return verts;
+}
+
+static void pushShape(DebugDrawContext* ctx, DebugDrawBatch::Enum batch, const Shape& shape, const mtx4x4_t& mtx,
+                      uint32_t color)
+{
+    eddVertexPosCoordColor* verts = pushVerts(ctx, batch, shape.numVerts);
+    if (!verts)
+        return;
+    for (int i = 0, c = shape.numVerts; i < c; i++) {
+        bx::vec3MulMtx(&verts[i].x, shape.verts[i].f, mtx.f);
+        verts[i].color = color;
+    }
+}
+
+static void pushLine(DebugDrawContext* ctx, DebugDrawBatch::Enum batch, const vec3_t& startPt, const vec3_t& endPt,
+                     const mtx4x4_t* mtx, uint32_t color)
+{
+    eddVertexPosCoordColor* verts = pushVerts(ctx, batch, 2);
+    if (!verts)
+        return;
+    if (mtx) {
+        bx::vec3MulMtx(&verts[0].x, startPt.f, mtx->f);
+        bx::vec3MulMtx(&verts[1].x, endPt.f, mtx->f);
+    } else {
+        verts[0].setPos(startPt);
+        verts[1].setPos(endPt);
+    }
+    verts[0].color = verts[1].color = color;
 }
 
 result_t termite::initDebugDraw(bx::AllocatorI* alloc, GfxDriverApi* driver)
@@ -425,6 +508,7 @@ result_t termite::initDebugDraw(bx::AllocatorI* alloc, GfxDriverApi* driver)
     assert(g_dbg->whiteTexture.isValid());
 
     g_dbg->bbShape = createAABB();
+    g_dbg->boxShape = createSolidAABB();
     g_dbg->bsphereShape = createBoundingSphere(30);
     g_dbg->sphereShape = createSphere(12, 9);
 
@@ -435,14 +519,11 @@ void termite::shutdownDebugDraw()
 {
     if (!g_dbg)
         return;
-    GfxDriverApi* driver = g_dbg->driver;
 
-    if (g_dbg->bbShape.vb.isValid())
-        driver->destroyVertexBuffer(g_dbg->bbShape.vb);
-    if (g_dbg->sphereShape.vb.isValid())
-        driver->destroyVertexBuffer(g_dbg->sphereShape.vb);
-    if (g_dbg->bsphereShape.vb.isValid())
-        driver->destroyVertexBuffer(g_dbg->bsphereShape.vb);
+    destroyShape(&g_dbg->bbShape);
+    destroyShape(&g_dbg->boxShape);
+    destroyShape(&g_dbg->sphereShape);
+    destroyShape(&g_dbg->bsphereShape);
 
     if (g_dbg->uColor.isValid())
         g_dbg->driver->destroyUniform(g_dbg->uColor);
@@ -475,6 +556,13 @@ DebugDrawContext* termite::createDebugDrawContext()
         return nullptr;
     }
 
+    for (int i = 0; i < DebugDrawBatch::Count; i++) {
+        if (!ctx->batches[i].create(BATCH_GROW_SIZE, BATCH_GROW_SIZE, alloc)) {
+            destroyDebugDrawContext(ctx);
+            return nullptr;
+        }
+    }
+
     // Push one state into state-stack
     DebugDrawState* state = ctx->statePool.newInstance();
     ctx->stateStack.push(&state->snode);
@@ -493,6 +581,8 @@ void termite::destroyDebugDrawContext(DebugDrawContext* ctx)
     if (ctx->defaultFontHandle.isValid())
         unloadResource(ctx->defaultFontHandle);
 
+    for (int i = 0; i < DebugDrawBatch::Count; i++)
+        ctx->batches[i].destroy();
     ctx->statePool.destroy();
     BX_DELETE(ctx->alloc, ctx);
 }
@@ -506,6 +596,8 @@ void termite::ddBegin(DebugDrawContext* ctx, uint8_t viewId, const recti_t& view
     ctx->vgCtx = vg;
     ctx->viewport = viewport;
     ctx->readyToDraw = true;
+    for (int i = 0; i < DebugDrawBatch::Count; i++)
+        ctx->batches[i].clear();
 
     bx::mtxMul(ctx->viewProjMtx.f, viewMtx.f, projMtx.f);
     ctx->billboardMtx = mtx4x4f3(viewMtx.m11, viewMtx.m21, viewMtx.m31,
@@ -524,6 +616,49 @@ void termite::ddBegin(DebugDrawContext* ctx, uint8_t viewId, const recti_t& view
 
 void termite::ddEnd(DebugDrawContext* ctx)
 {
+    // Submit batches, one draw call per batch
+    // Colors and transforms are already baked into the vertices
+    rmt_BeginCPUSample(DebugDraw_End, 0);
+    GfxDriverApi* driver = ctx->driver;
+    mtx4x4_t ident = mtx4x4Ident();
+    vec4_t white = vec4f(1.0f, 1.0f, 1.0f, 1.0f);
+    GfxSubsystemStats* stats = getGfxSubsystemFrameStats(GfxSubsystem::DebugDraw);
+
+    for (int i = 0; i < DebugDrawBatch::Count; i++) {
+        bx::Array<eddVertexPosCoordColor>& batch = ctx->batches[i];
+        int total = batch.getCount();
+        if (total == 0)
+            continue;
+
+        // Draw whatever fits in the transient buffer, with whole primitives
+        int numVerts = driver->getAvailTransientVertexBuffer(total, eddVertexPosCoordColor::Decl);
+        numVerts -= numVerts % (i == DebugDrawBatch::Solid ? 3 : 2);
+        if (numVerts < total) {
+            BX_WARN("Debug draw: Transient buffer is full, %d of %d vertices are drawn", numVerts, total);
+            stats->numDropped++;
+        }
+
+        if (numVerts > 0) {
+            TransientVertexBuffer tvb;
+            driver->allocTransientVertexBuffer(&tvb, numVerts, eddVertexPosCoordColor::Decl);
+            memcpy(tvb.data, batch.getBuffer(), sizeof(eddVertexPosCoordColor)*numVerts);
+
+            driver->setTransientVertexBuffer(&tvb);
+            driver->setTransform(ident.f, 1);
+            driver->setState(getBatchState(DebugDrawBatch::Enum(i)), 0);
+            driver->setUniform(g_dbg->uColor, white.f, 1);
+            driver->setTexture(0, g_dbg->uTexture, g_dbg->whiteTexture, TextureFlag::FromTexture);
+            driver->submit(ctx->viewId, g_dbg->program, 0, false);
+
+            stats->numVerts += numVerts;
+            stats->transientBytes += tvb.size;
+            stats->numBatches++;
+            stats->numSubmits++;
+        }
+        batch.clear();
+    }
+    rmt_EndCPUSample(); // DebugDraw_End
+
     if (ctx->vgCtx)
         vgEnd(ctx->vgCtx);
     ctx->readyToDraw = false;
@@ -600,17 +735,45 @@ void termite::ddRect(DebugDrawContext* ctx, const vec3_t& vmin, const vec3_t& vm
 
 void termite::ddLine(DebugDrawContext* ctx, const vec3_t& startPt, const vec3_t& endPt, const mtx4x4_t* modelMtx /*= nullptr*/)
 {
-    assert(0);
+    DebugDrawState* state;
+    ctx->stateStack.peek(&state);
+    pushLine(ctx, DebugDrawBatch::Lines, startPt, endPt, modelMtx, getStateColor(state));
 }
 
 void termite::ddCircle(DebugDrawContext* ctx, const vec3_t& pos, float radius, const mtx4x4_t* modelMtx /*= nullptr*/, bool showDir /*= false*/)
 {
-    assert(0);
+    // Circle is on XY plane
+    mtx4x4_t mtx;
+    bx::mtxSRT(mtx.f,
+               radius, radius, radius,
+               0, 0, 0,
+               pos.x, pos.y, pos.z);
+    if (modelMtx)
+        mtx = mtx * (*modelMtx);
+
+    DebugDrawState* state;
+    ctx->stateStack.peek(&state);
+    uint32_t color = getStateColor(state);
+    pushShape(ctx, DebugDrawBatch::Lines, g_dbg->bsphereShape, mtx, color);
+    if (showDir)
+        pushLine(ctx, DebugDrawBatch::Lines, vec3f(0, 0, 0), vec3f(1.0f, 0, 0), &mtx, color);
 }
 
 void termite::ddRect(DebugDrawContext* ctx, const vec3_t& minpt, const vec3_t& maxpt, const mtx4x4_t* modelMtx /*= nullptr*/)
 {
-    assert(0);
+    // Rect is on XY plane
+    vec3_t pts[4] = {
+        vec3f(minpt.x, minpt.y, minpt.z),
+        vec3f(maxpt.x, minpt.y, minpt.z),
+        vec3f(maxpt.x, maxpt.y, minpt.z),
+        vec3f(minpt.x, maxpt.y, minpt.z)
+    };
+
+    DebugDrawState* state;
+    ctx->stateStack.peek(&state);
+    uint32_t color = getStateColor(state);
+    for (int i = 0; i < 4; i++)
+        pushLine(ctx, DebugDrawBatch::Lines, pts[i], pts[(i + 1) % 4], modelMtx, color);
 }
 
 void termite::ddSnapGridXZ(DebugDrawContext* ctx, const Camera& cam, float spacing, float boldSpacing, float maxDepth,
@@ -654,18 +817,17 @@ void termite::ddSnapGridXZ(DebugDrawContext* ctx, const Camera& cam, float spaci
     int numVerts = (xlines + ylines) * 2;
 
     // Draw
-    GfxDriverApi* driver = ctx->driver;
-    if (driver->getAvailTransientVertexBuffer(numVerts, eddVertexPosCoordColor::Decl) != numVerts)
+    eddVertexPosCoordColor* verts = pushVerts(ctx, DebugDrawBatch::Lines, numVerts);
+    if (!verts)
         return;
-    TransientVertexBuffer tvb;
-    driver->allocTransientVertexBuffer(&tvb, numVerts, eddVertexPosCoordColor::Decl);
-    eddVertexPosCoordColor* verts = (eddVertexPosCoordColor*)tvb.data;
 
     DebugDrawState* state;
     ctx->stateStack.peek(&state);
+    uint32_t normalColor = getStateColor(state, color);
+    uint32_t boldStateColor = getStateColor(state, boldColor);
     
     int i = 0;
-    for (float zoffset = snapbox.zmin; zoffset <= snapbox.zmax; zoffset += spacing, i += 2) {
+    for (float zoffset = snapbox.zmin; zoffset <= snapbox.zmax && i < numVerts; zoffset += spacing, i += 2) {
         verts[i].x = snapbox.xmin;
         verts[i].y = 0;
         verts[i].z = zoffset;
@@ -675,10 +837,10 @@ void termite::ddSnapGridXZ(DebugDrawContext* ctx, const Camera& cam, float spaci
         verts[ni].y = 0;
         verts[ni].z = zoffset;
 
-        verts[i].color = verts[ni].color = !bx::fequal(bx::fmod(zoffset, boldSpacing), 0.0f, 0.0001f) ? color.n : boldColor.n;
+        verts[i].color = verts[ni].color = !bx::fequal(bx::fmod(zoffset, boldSpacing), 0.0f, 0.0001f) ? normalColor : boldStateColor;
     }
 
-    for (float xoffset = snapbox.xmin; xoffset <= snapbox.xmax; xoffset += spacing, i += 2) {
+    for (float xoffset = snapbox.xmin; xoffset <= snapbox.xmax && i < numVerts; xoffset += spacing, i += 2) {
         verts[i].x = xoffset;
         verts[i].y = 0;
         verts[i].z = snapbox.zmin;
@@ -688,17 +850,8 @@ void termite::ddSnapGridXZ(DebugDrawContext* ctx, const Camera& cam, float spaci
         verts[ni].y = 0;
         verts[ni].z = snapbox.zmax;
 
-        verts[i].color = verts[ni].color = !bx::fequal(bx::fmod(xoffset, boldSpacing), 0.0f, 0.0001f) ? color.n : boldColor.n;
+        verts[i].color = verts[ni].color = !bx::fequal(bx::fmod(xoffset, boldSpacing), 0.0f, 0.0001f) ? normalColor : boldStateColor;
     }
-
-    mtx4x4_t ident = mtx4x4Ident();
-
-    driver->setTransientVertexBuffer(&tvb);
-    driver->setTransform(ident.f, 1);
-    driver->setState(GfxState::RGBWrite | GfxState::DepthTestLess | GfxState::PrimitiveLines, 0);
-    driver->setUniform(g_dbg->uColor, state->color.f, 1);
-    driver->setTexture(0, g_dbg->uTexture, g_dbg->whiteTexture, TextureFlag::FromTexture);
-    driver->submit(ctx->viewId, g_dbg->program, 0, false);
 }
 
 void termite::ddSnapGridXY(DebugDrawContext* ctx, const Camera2D& cam, float spacing, float boldSpacing,
@@ -729,15 +882,14 @@ void termite::ddSnapGridXY(DebugDrawContext* ctx, const Camera2D& cam, float spa
     int numVerts = (xlines + ylines) * 2;
 
     // Draw
-    GfxDriverApi* driver = ctx->driver;
-    if (driver->getAvailTransientVertexBuffer(numVerts, eddVertexPosCoordColor::Decl) != numVerts)
+    eddVertexPosCoordColor* verts = pushVerts(ctx, DebugDrawBatch::Lines2D, numVerts);
+    if (!verts)
         return;
-    TransientVertexBuffer tvb;
-    driver->allocTransientVertexBuffer(&tvb, numVerts, eddVertexPosCoordColor::Decl);
-    eddVertexPosCoordColor* verts = (eddVertexPosCoordColor*)tvb.data;
 
     DebugDrawState* state;
     ctx->stateStack.peek(&state);
+    uint32_t normalColor = getStateColor(state, color);
+    uint32_t boldStateColor = getStateColor(state, boldColor);
 
     int i = 0;
 
@@ -754,7 +906,7 @@ void termite::ddSnapGridXY(DebugDrawContext* ctx, const Camera2D& cam, float spa
     }
 
     // Horizontal Lines
-    for (float yoffset = snapRect.ymin; yoffset <= snapRect.ymax; yoffset += spacing, i += 2) {
+    for (float yoffset = snapRect.ymin; yoffset <= snapRect.ymax && i < numVerts; yoffset += spacing, i += 2) {
         verts[i].x = snapRect.xmin;
         verts[i].y = yoffset;
         verts[i].z = 0;
@@ -766,9 +918,9 @@ void termite::ddSnapGridXY(DebugDrawContext* ctx, const Camera2D& cam, float spa
 
         verts[i].tx = verts[i].ty = verts[ni].tx = verts[ni].ty = 0;    
         if (!bx::fequal(bx::fmod(yoffset, boldSpacing), 0.0f, 0.0001f)) {
-            verts[i].color = verts[ni].color = color.n;
+            verts[i].color = verts[ni].color = normalColor;
         } else {
-            verts[i].color = verts[ni].color = boldColor.n;
+            verts[i].color = verts[ni].color = boldStateColor;
             if (showVerticalInfo) {
                 vec2_t screenPt;
                 projectToScreen(&screenPt, vec3f(snapRect.xmin + spacing, yoffset, 0), ctx->viewport, ctx->viewProjMtx);
@@ -778,7 +930,7 @@ void termite::ddSnapGridXY(DebugDrawContext* ctx, const Camera2D& cam, float spa
     }
 
     // Vertical Lines
-    for (float xoffset = snapRect.xmin; xoffset <= snapRect.xmax; xoffset += spacing, i += 2) {
+    for (float xoffset = snapRect.xmin; xoffset <= snapRect.xmax && i < numVerts; xoffset += spacing, i += 2) {
         verts[i].x = xoffset;
         verts[i].y = snapRect.ymin;
         verts[i].z = 0;
@@ -789,17 +941,8 @@ void termite::ddSnapGridXY(DebugDrawContext* ctx, const Camera2D& cam, float spa
         verts[ni].z = 0;
 
         verts[i].tx = verts[i].ty = verts[ni].tx = verts[ni].ty = 0;
-        verts[i].color = verts[ni].color = !bx::fequal(bx::fmod(xoffset, boldSpacing), 0.0f, 0.0001f) ? color.n : boldColor.n;
+        verts[i].color = verts[ni].color = !bx::fequal(bx::fmod(xoffset, boldSpacing), 0.0f, 0.0001f) ? normalColor : boldStateColor;
     }
-
-    mtx4x4_t ident = mtx4x4Ident();
-
-    driver->setTransientVertexBuffer(&tvb);
-    driver->setTransform(ident.f, 1);
-    driver->setState(GfxState::RGBWrite | GfxState::PrimitiveLines | gfxStateBlendAlpha(), 0);
-    driver->setUniform(g_dbg->uColor, state->color.f, 1);
-    driver->setTexture(0, g_dbg->uTexture, g_dbg->whiteTexture, TextureFlag::FromTexture);
-    driver->submit(ctx->viewId, g_dbg->program, 0, false);
 }
 
 void termite::ddBoundingBox(DebugDrawContext* ctx, const aabb_t bb, bool showInfo /*= false*/)
@@ -815,17 +958,9 @@ void termite::ddBoundingBox(DebugDrawContext* ctx, const aabb_t bb, bool showInf
                0, 0, 0,
                center.x, center.y, center.z);
 
-    Shape shape = g_dbg->bbShape;
     DebugDrawState* state;
     ctx->stateStack.peek(&state);
-
-    GfxDriverApi* driver = g_dbg->driver;
-    driver->setVertexBuffer(shape.vb);
-    driver->setTransform(mtx.f, 1);
-    driver->setUniform(g_dbg->uColor, state->color.f, 1);
-    driver->setState(GfxState::RGBWrite | GfxState::DepthTestLess | GfxState::PrimitiveLines, 0);
-    driver->setTexture(0, g_dbg->uTexture, g_dbg->whiteTexture, TextureFlag::FromTexture);
-    driver->submit(ctx->viewId, g_dbg->program, 0, false);
+    pushShape(ctx, DebugDrawBatch::Lines, g_dbg->bbShape, mtx, getStateColor(state));
 
     if (showInfo) {
         vec2_t center2d;
@@ -857,15 +992,7 @@ void termite::ddBoundingSphere(DebugDrawContext* ctx, const sphere_t sphere, boo
 
     DebugDrawState* state;
     ctx->stateStack.peek(&state);
-
-    GfxDriverApi* driver = g_dbg->driver;
-    Shape shape = g_dbg->bsphereShape;
-    driver->setVertexBuffer(shape.vb);
-    driver->setTransform(mtx.f, 1);
-    driver->setUniform(g_dbg->uColor, state->color.f, 1);
-    driver->setState(GfxState::RGBWrite | GfxState::DepthTestLess | GfxState::PrimitiveLines, 0);
-    driver->setTexture(0, g_dbg->uTexture, g_dbg->whiteTexture, TextureFlag::FromTexture);
-    driver->submit(ctx->viewId, g_dbg->program, 0, false);
+    pushShape(ctx, DebugDrawBatch::Lines, g_dbg->bsphereShape, mtx, getStateColor(state));
 
     if (showInfo) {
         vec2_t center2d;
@@ -883,17 +1010,47 @@ void termite::ddBoundingSphere(DebugDrawContext* ctx, const sphere_t sphere, boo
 
 void termite::ddBox(DebugDrawContext* ctx, const aabb_t aabb, const mtx4x4_t* modelMtx /*= nullptr*/)
 {
-	assert(false);
+    vec3_t center = (aabb.vmin + aabb.vmax)*0.5f;
+    mtx4x4_t mtx;
+    bx::mtxSRT(mtx.f,
+               aabb.vmax.x - aabb.vmin.x, aabb.vmax.y - aabb.vmin.y, aabb.vmax.z - aabb.vmin.z,
+               0, 0, 0,
+               center.x, center.y, center.z);
+    if (modelMtx)
+        mtx = mtx * (*modelMtx);
+
+    DebugDrawState* state;
+    ctx->stateStack.peek(&state);
+    pushShape(ctx, DebugDrawBatch::Solid, g_dbg->boxShape, mtx, getStateColor(state));
 }
 
 void termite::ddSphere(DebugDrawContext* ctx, const sphere_t sphere, const mtx4x4_t* modelMtx /*= nullptr*/)
 {
-	assert(false);
+    mtx4x4_t mtx;
+    bx::mtxSRT(mtx.f,
+               sphere.r, sphere.r, sphere.r,
+               0, 0, 0,
+               sphere.x, sphere.y, sphere.z);
+    if (modelMtx)
+        mtx = mtx * (*modelMtx);
+
+    DebugDrawState* state;
+    ctx->stateStack.peek(&state);
+    pushShape(ctx, DebugDrawBatch::Solid, g_dbg->sphereShape, mtx, getStateColor(state));
 }
 
 void termite::ddAxis(DebugDrawContext* ctx, const vec3_t axis, const mtx4x4_t* modelMtx /*= nullptr*/)
 {
-	assert(false);
+    // X = Red, Y = Green, Z = Blue, length of each line is the axis component
+    DebugDrawState* state;
+    ctx->stateStack.peek(&state);
+    vec3_t origin = vec3f(0, 0, 0);
+    pushLine(ctx, DebugDrawBatch::Lines, origin, vec3f(axis.x, 0, 0), modelMtx, 
+             getStateColor(state, color4u(255, 0, 0, 255)));
+    pushLine(ctx, DebugDrawBatch::Lines, origin, vec3f(0, axis.y, 0), modelMtx, 
+             getStateColor(state, color4u(0, 255, 0, 255)));
+    pushLine(ctx, DebugDrawBatch::Lines, origin, vec3f(0, 0, axis.z), modelMtx, 
+             getStateColor(state, color4u(0, 0, 255, 255)));
 }
 
 void termite::ddSetFont(DebugDrawContext* ctx, ResourceHandle fontHandle)
@@ -3,6 +3,9 @@
 #include "bx/hash.h"
 
 #include "gfx_driver.h"
+#include "gfx_driver_internal.h"
+
+#include "imgui/imgui.h"
 
 using namespace termite;
 
@@ -48,6 +51,19 @@ static const uint8_t(*gAttribTypeSize[])[VertexAttribType::Count][4] =
 };
 BX_STATIC_ASSERT(BX_COUNTOF(gAttribTypeSize) == RendererType::Count + 1);
 
+static const char* gSubsystemNames[GfxSubsystem::Count] = {
+    "Sprite",
+    "Text",
+    "VectorGfx",
+    "DebugDraw",
+    "ImGui",
+    "Model"
+};
+
+// Current frame is written by subsystems, last frame is swapped in doFrame
+static GfxSubsystemStats gSubsystemStats[GfxSubsystem::Count];
+static GfxSubsystemStats gSubsystemStatsLast[GfxSubsystem::Count];
+
 VertexDecl* termite::vdeclBegin(VertexDecl* vdecl, RendererType::Enum _type /*= RendererType::Noop*/)
 {
     vdecl->hash = (uint32_t)_type;
@@ -105,3 +121,75 @@ uint32_t termite::vdeclGetSize(VertexDecl* vdecl, uint32_t _num)
 {
     return _num*vdecl->stride;
 }
+
+GfxSubsystemStats* termite::getGfxSubsystemFrameStats(GfxSubsystem::Enum subsystem)
+{
+    return &gSubsystemStats[subsystem];
+}
+
+const GfxSubsystemStats& termite::getGfxSubsystemStats(GfxSubsystem::Enum subsystem)
+{
+    return gSubsystemStatsLast[subsystem];
+}
+
+const char* termite::getGfxSubsystemName(GfxSubsystem::Enum subsystem)
+{
+    return gSubsystemNames[subsystem];
+}
+
+void termite::swapGfxSubsystemStats()
+{
+    memcpy(gSubsystemStatsLast, gSubsystemStats, sizeof(gSubsystemStats));
+    memset(gSubsystemStats, 0x00, sizeof(gSubsystemStats));
+}
+
+void termite::showGfxStatsOverlay(bool* opened)
+{
+    GfxDriverApi* driver = getGfxDriver();
+    if (!driver)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(520.0f, 240.0f), ImGuiSetCond_FirstUseEver);
+    if (!ImGui::Begin("Gfx Stats", opened)) {
+        ImGui::End();
+        return;
+    }
+
+    const GfxStats& stats = driver->getStats();
+    ImGui::Text("Draws: %u  Computes: %u", stats.numDraw, stats.numCompute);
+    if (stats.numStateChanges || stats.numProgramChanges || stats.bytesUploaded) {
+        ImGui::Text("State changes: %u  Program changes: %u  Texture changes: %u", 
+                    stats.numStateChanges, stats.numProgramChanges, stats.numTextureChanges);
+        ImGui::Text("Uploaded: %.1f kb  Transient VB: %.1f kb  Transient IB: %.1f kb", 
+                    double(stats.bytesUploaded)/1024.0, double(stats.transientVbUsed)/1024.0, 
+                    double(stats.transientIbUsed)/1024.0);
+    }
+    ImGui::Separator();
+
+    ImGui::Columns(7, "GfxSubsystemStats");
+    ImGui::Text("Subsystem");   ImGui::NextColumn();
+    ImGui::Text("Submits");     ImGui::NextColumn();
+    ImGui::Text("Batches");     ImGui::NextColumn();
+    ImGui::Text("Verts");       ImGui::NextColumn();
+    ImGui::Text("Indices");     ImGui::NextColumn();
+    ImGui::Text("Transient");   ImGui::NextColumn();
+    ImGui::Text("Dropped");     ImGui::NextColumn();
+    ImGui::Separator();
+
+    for (int i = 0; i < GfxSubsystem::Count; i++) {
+        const GfxSubsystemStats& s = gSubsystemStatsLast[i];
+        ImGui::Text("%s", gSubsystemNames[i]);                      ImGui::NextColumn();
+        ImGui::Text("%u", s.numSubmits);                            ImGui::NextColumn();
+        ImGui::Text("%u", s.numBatches);                            ImGui::NextColumn();
+        ImGui::Text("%u", s.numVerts);                              ImGui::NextColumn();
+        ImGui::Text("%u", s.numIndices);                            ImGui::NextColumn();
+        ImGui::Text("%.1f kb", double(s.transientBytes)/1024.0);    ImGui::NextColumn();
+        if (s.numDropped)
+            ImGui::TextColored(ImVec4(1.0f, 0.2f, 0.2f, 1.0f), "%u", s.numDropped);
+        else
+            ImGui::Text("0");
+        ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+    ImGui::End();
+}
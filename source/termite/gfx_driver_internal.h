@@ -0,0 +1,9 @@
+#pragma once
+
+// Engine-internal gfx driver functions, called by core only and not exported
+
+namespace termite
+{
+    // Called once per frame after the driver frame: current frame's subsystem stats become the last frame's
+    void swapGfxSubsystemStats();
+} // namespace termite
@@ -13,6 +13,7 @@
 #include "bxx/hash_table.h"
 #include "bxx/pool.h"
 #include "bx/string.h"
+#include "Remotery.h"
 
 #include T_MAKE_SHADER_PATH(shaders_h, font_normal.vso)
 #include T_MAKE_SHADER_PATH(shaders_h, font_normal.fso)
@@ -128,9 +129,12 @@ namespace termite
         int numKerns;
         FontKerning* kerns;
         bx::HashTable<int, uint16_t> glyphTable;    // CharId -> index to glyphs
+        bx::HashTable<float, uint32_t> kernTable;   // (FirstCharId << 16)|SecondCharId -> kerning amount
+        int asciiGlyphs[256];                       // Direct CharId -> index to glyphs for the first 256 chars, -1 if missing
 
         Font() : 
-            glyphTable(bx::HashTableType::Immutable)
+            glyphTable(bx::HashTableType::Immutable),
+            kernTable(bx::HashTableType::Immutable)
         {
             name[0] = 0;
             size = 0;
@@ -145,6 +149,8 @@ namespace termite
             kerns = nullptr;
             for (int i = 0; i < MAX_FONT_PAGES; i++)
                 texHandles[i].reset();
+            for (int i = 0; i < 256; i++)
+                asciiGlyphs[i] = -1;
         }
     };
 
@@ -170,14 +176,37 @@ namespace termite
     VertexDecl TextVertex::Decl;
 
 
+    struct TextLayout
+    {
+        int firstVert;
+        int numQuads;
+        int textLen;
+        uint32_t checkHash;     // Second hash of the layout with another seed, table key + this make 64 bits
+    };
+
+    // Quads that are generated in one frame, layouts of the previous frame are copied instead of being rebuilt
+    struct TextLayoutCache
+    {
+        TextVertex* verts;
+        bx::HashTable<TextLayout, uint32_t> layouts;    // Layout key -> quads in 'verts'
+
+        TextLayoutCache() :
+            verts(nullptr),
+            layouts(bx::HashTableType::Mutable)
+        {
+        }
+    };
+
     struct TextBatch
     {
         bx::AllocatorI* alloc;
         ResourceHandle fontHandle;
         int maxChars;
         int numChars;
-        TextVertex* verts;
-        uint16_t* indices;
+        TextVertex* verts;      // Vertices of the current frame, points to one of the caches
+        uint16_t* indices;      // Constant quad indices, filled on create
+        TextLayoutCache caches[2];
+        int cacheIdx;
         uint32_t mtxHash;
         vec2_t screenSize;
         mtx4x4_t viewProjMtx;
@@ -189,6 +218,7 @@ namespace termite
             numChars(0),
             verts(nullptr),
             indices(nullptr),
+            cacheIdx(0),
             mtxHash(0)
         {
         }
@@ -371,6 +401,38 @@ namespace termite
         assert(handle.isValid());
     }
 
+    // Builds lookup tables after glyphs and kernings are loaded, 'buff' must have the memory for both hash tables
+    static bool createFontTables(Font* font, uint8_t* buff)
+    {
+        if (font->numKerns > 0) {
+            if (!font->kernTable.createWithBuffer(font->numKerns, buff))
+                return false;
+            buff += bx::HashTable<float, uint32_t>::GetImmutableSizeBytes(font->numKerns);
+        }
+
+        if (!font->glyphTable.createWithBuffer(font->numGlyphs, buff))
+            return false;
+
+        for (int i = 0; i < font->numGlyphs; i++) {
+            const FontGlyph& glyph = font->glyphs[i];
+            font->glyphTable.add(glyph.charId, i);
+            if (glyph.charId < 256)
+                font->asciiGlyphs[glyph.charId] = i;
+
+            for (int k = glyph.kernIdx, end = glyph.kernIdx + glyph.numKerns; k < end; k++) {
+                const FontKerning& kern = font->kerns[k];
+                font->kernTable.add((uint32_t(glyph.charId) << 16) | kern.secondCharId, kern.amount);
+            }
+        }
+        return true;
+    }
+
+    static size_t getFontTablesSize(int numGlyphs, int numKerns)
+    {
+        return (numKerns > 0 ? bx::HashTable<float, uint32_t>::GetImmutableSizeBytes(numKerns) : 0) +
+            bx::HashTable<int, uint16_t>::GetImmutableSizeBytes(numGlyphs);
+    }
+
     static Font* loadFontText(const MemoryBlock* mem, const char* filepath, const LoadFontParams& params, bx::AllocatorI* alloc)
     {
         bx::AllocatorI* tmpAlloc = getTempAlloc();
@@ -601,7 +663,7 @@ namespace termite
         size_t totalSz = sizeof(Font) +
             numGlyphs*sizeof(FontGlyph) +
             numKernings*sizeof(FontKerning) +
-            bx::HashTable<int, uint16_t>::GetImmutableSizeBytes(numGlyphs);
+            getFontTablesSize(numGlyphs, numKernings);
         uint8_t* buff = (uint8_t*)BX_ALLOC(alloc, totalSz);
         Font* font = new(buff) Font;
         if (!font)
@@ -612,14 +674,6 @@ namespace termite
         font->kerns = (FontKerning*)buff;
         buff += numKernings*sizeof(FontKerning);
 
-        // Hashtable for characters
-        if (!font->glyphTable.createWithBuffer(numGlyphs, buff)) {
-            assert(false);
-            return nullptr;
-        }
-        for (int i = 0; i < numGlyphs; i++)
-            font->glyphTable.add(glyphs[i].charId, i);
-
         strcpy(font->name, name);
         font->base = base;
         font->lineHeight = lineHeight;
@@ -648,6 +702,12 @@ namespace termite
         if (numKernings > 0)
             memcpy(font->kerns, kernings, numKernings*sizeof(FontKerning));
 
+        // Lookup tables for characters and kernings
+        if (!createFontTables(font, buff)) {
+            assert(false);
+            return nullptr;
+        }
+
         return font;
     }
 
@@ -705,16 +765,16 @@ namespace termite
 
         // Kernings
         int last_r = ms.read(&block, sizeof(block), &err);
-        int numKerns = block.size / sizeof(fntKernPair_t);
+        int numKerns = last_r > 0 ? int(block.size / sizeof(fntKernPair_t)) : 0;
         fntKernPair_t* kerns = (fntKernPair_t*)alloca(sizeof(fntKernPair_t)*(numKerns + 1));
-        if (numKerns > 0 && last_r > 0)
+        if (numKerns > 0)
             ms.read(kerns, block.size, &err);
 
         // Create font
         size_t totalSz = sizeof(Font) + 
             numGlyphs*sizeof(FontGlyph) + 
             numKerns*sizeof(FontKerning) + 
-            bx::HashTable<int, uint16_t>::GetImmutableSizeBytes(numGlyphs);
+            getFontTablesSize(numGlyphs, numKerns);
         uint8_t* buff = (uint8_t*)BX_ALLOC(alloc, totalSz);
         Font* font = new(buff) Font;
         if (!font)
@@ -725,12 +785,6 @@ namespace termite
         font->kerns = (FontKerning*)buff;
         buff += numKerns*sizeof(FontKerning);
 
-        // Hashtable for characters
-        if (!font->glyphTable.createWithBuffer(numGlyphs, buff)) {
-            assert(false);
-            return nullptr;
-        }
-
         bx::strlcpy(font->name, fontName, sizeof(font->name));
         font->size = info.font_size;
         font->lineHeight = common.line_height;
@@ -760,14 +814,12 @@ namespace termite
             font->glyphs[i].xoffset = (float)ch.xoffset;
             font->glyphs[i].yoffset = (float)ch.yoffset;
 
-            font->glyphTable.add(uint16_t(ch.id), i);
-
             charWidth = std::max<uint16_t>(charWidth, ch.xadvance);
         }
         font->numGlyphs = numGlyphs;
         font->charWidth = charWidth;
 
-        if (numKerns > 0 && last_r > 0) {
+        if (numKerns > 0) {
             memset(font->kerns, 0x00, sizeof(FontKerning)*numKerns);
 
             for (int i = 0; i < numKerns; i++) {
@@ -789,6 +841,12 @@ namespace termite
         }
         font->numKerns = numKerns;
 
+        // Lookup tables for characters and kernings
+        if (!createFontTables(font, buff)) {
+            assert(false);
+            return nullptr;
+        }
+
         return font;
     }
 
@@ -816,6 +874,7 @@ namespace termite
             }
         }
         font->glyphTable.destroy();
+        font->kernTable.destroy();
 
         BX_FREE(alloc ? alloc : g_fontSys->alloc, font);
     }
@@ -872,17 +931,18 @@ namespace termite
     float getFontGlyphKerning(Font* font, int glyphIdx, int nextGlyphIdx)
     {
         const FontGlyph& ch = font->glyphs[glyphIdx];
-        uint16_t nextCharId = font->glyphs[nextGlyphIdx].charId;
+        if (ch.numKerns == 0)
+            return 0;
 
-        for (int i = ch.kernIdx, end = ch.kernIdx + ch.numKerns; i < end; i++) {
-            if (font->kerns[i].secondCharId == nextCharId)
-                return font->kerns[i].amount;
-        }
-        return 0;
+        int index = font->kernTable.find((uint32_t(ch.charId) << 16) | font->glyphs[nextGlyphIdx].charId);
+        return index != -1 ? font->kernTable[index] : 0;
     }
 
     int findFontCharGlyph(Font* font, uint16_t chId)
     {
+        if (chId < 256)
+            return font->asciiGlyphs[chId];
+
         int index = font->glyphTable.find(chId);
         return index != -1 ? font->glyphTable[index] : -1;
     }
@@ -898,11 +958,33 @@ namespace termite
         assert(g_fontSys);
         assert(fontHandle.isValid());
 
+        assert(maxChars*4 <= UINT16_MAX);
+
         TextBatch* tbatch = g_fontSys->batchPool.newInstance<bx::AllocatorI*>(alloc);
-        tbatch->verts = (TextVertex*)BX_ALLOC(alloc, sizeof(TextVertex)*maxChars*4);
+        for (int i = 0; i < 2; i++) {
+            TextLayoutCache& cache = tbatch->caches[i];
+            cache.verts = (TextVertex*)BX_ALLOC(alloc, sizeof(TextVertex)*maxChars*4);
+            if (!cache.verts || !cache.layouts.create(64, alloc))
+                return nullptr;
+        }
         tbatch->indices = (uint16_t*)BX_ALLOC(alloc, sizeof(uint16_t)*maxChars*6);
-        if (!tbatch->verts || !tbatch->indices)
+        if (!tbatch->indices)
             return nullptr;
+
+        // Every char is a quad, so indices never change
+        uint16_t* indices = tbatch->indices;
+        for (int i = 0; i < maxChars; i++) {
+            uint16_t startVtx = uint16_t(i*4);
+            indices[0] = startVtx;
+            indices[1] = startVtx + 1;
+            indices[2] = startVtx + 2;
+            indices[3] = startVtx + 2;
+            indices[4] = startVtx + 1;
+            indices[5] = startVtx + 3;
+            indices += 6;
+        }
+
+        tbatch->verts = tbatch->caches[0].verts;
         tbatch->maxChars = maxChars;
         tbatch->fontHandle = fontHandle;
         return tbatch;
@@ -927,6 +1009,11 @@ namespace termite
             batch->mtxHash = mtxHash;
         }
 
+        // Swap caches, previous frame's layouts stay valid until the next beginText
+        batch->cacheIdx ^= 1;
+        TextLayoutCache& cache = batch->caches[batch->cacheIdx];
+        cache.layouts.clear();
+        batch->verts = cache.verts;
         batch->numChars = 0;
     }
 
@@ -949,9 +1036,6 @@ namespace termite
         vec2_t texSize = vec2f(font->scaleW, font->scaleH);
         int len = (int)strlen(text);
 
-        // Crop Characters
-        len = std::min<int>(len, batch->maxChars - batch->numChars);
-
         // Convert to screen rectangle
         auto projectToScreen = [viewProjMtx, screenSize](float x, float y)->vec2_t
         {
@@ -970,20 +1054,68 @@ namespace termite
         rect_t screenRect = rectv(projectToScreen(rectFit.xmin, rectFit.ymax), 
                                   projectToScreen(rectFit.xmax, rectFit.ymin));
 
-        // Make Quads
-        int vertexIdx = 0;
-        int indexIdx = 0;
-        int maxVerts = len*4;
-        float x = 0;
+        // Same text with the same font, scale, placement and color makes the same quads
+        // Layouts are keyed by one hash and verified by length and a second hash, so collisions are not reused
+        auto hashLayout = [&](uint32_t seed)->uint32_t {
+            bx::HashMurmur2A hasher;
+            hasher.begin(seed);
+            hasher.add<uintptr_t>(uintptr_t(font));
+            hasher.add(text, len);
+            hasher.add<float>(scale);
+            hasher.add<int>(int(align));
+            hasher.add<rect_t>(screenRect);
+            hasher.add<uint32_t>(color.n);
+            return hasher.end();
+        };
+        uint32_t layoutKey = hashLayout(0);
+        if (layoutKey == 0)
+            layoutKey = 1;  // Zero is the empty key in hash tables
+        uint32_t checkHash = hashLayout(0x9e3779b9);
 
         int firstVertIdx = batch->numChars*4;
         TextVertex* verts = batch->verts + firstVertIdx;
-        uint16_t* indices = batch->indices + batch->numChars*6;
+        TextLayoutCache& cache = batch->caches[batch->cacheIdx];
+        const TextLayoutCache& prevCache = batch->caches[batch->cacheIdx ^ 1];
+
+        // Reuse the quads if the text is already added in this frame or the previous one
+        const TextVertex* cachedVerts = nullptr;
+        int layoutIdx = cache.layouts.find(layoutKey);
+        if (layoutIdx != -1) {
+            cachedVerts = cache.verts;
+        } else {
+            layoutIdx = prevCache.layouts.find(layoutKey);
+            if (layoutIdx != -1)
+                cachedVerts = prevCache.verts;
+        }
+
+        bool collision = false;
+        if (cachedVerts) {
+            TextLayout layout = cachedVerts == cache.verts ? cache.layouts[layoutIdx] : prevCache.layouts[layoutIdx];
+            collision = layout.textLen != len || layout.checkHash != checkHash;
+            if (!collision && layout.numQuads <= batch->maxChars - batch->numChars) {
+                memcpy(verts, cachedVerts + layout.firstVert, sizeof(TextVertex)*layout.numQuads*4);
+                if (cachedVerts != cache.verts) {
+                    layout.firstVert = firstVertIdx;
+                    cache.layouts.add(layoutKey, layout);
+                }
+                batch->numChars += layout.numQuads;
+                return;
+            }
+        }
+
+        // Crop Characters, cropped text is not cached
+        int maxLen = batch->maxChars - batch->numChars;
+        bool cropped = len > maxLen;
+        len = std::min<int>(len, maxLen);
+
+        // Make Quads
+        int vertexIdx = 0;
+        float x = 0;
 
         for (int i = 0; i < len; i++) {
-            int gIdx = font->glyphTable.find(text[i]);
-            if (gIdx != -1) {
-                const FontGlyph& glyph = font->glyphs[font->glyphTable[gIdx]];
+            int glyphIdx = findFontCharGlyph(font, text[i]);
+            if (glyphIdx != -1) {
+                const FontGlyph& glyph = font->glyphs[glyphIdx];
                 
                 TextVertex& v0 = verts[vertexIdx];
                 TextVertex& v1 = verts[vertexIdx + 1];
@@ -1026,25 +1158,19 @@ namespace termite
                 x += (glyph.xadvance/* - xpadding*/)*scale;
 
                 // Kerning
-                int nextGlyphIdx = font->glyphTable.find(text[i+1]);
-                if (nextGlyphIdx != -1)
-                    x += getFontGlyphKerning(font, font->glyphTable[gIdx], font->glyphTable[nextGlyphIdx])*scale;
-
-                // Make Glyph Quad
-                int startVtx = firstVertIdx + vertexIdx;
-                indices[indexIdx] = startVtx;
-                indices[indexIdx + 1] = startVtx + 1;
-                indices[indexIdx + 2] = startVtx + 2;
-                indices[indexIdx + 3] = startVtx + 2;
-                indices[indexIdx + 4] = startVtx + 1;
-                indices[indexIdx + 5] = startVtx + 3;
+                if (i + 1 < len) {
+                    int nextGlyphIdx = findFontCharGlyph(font, text[i + 1]);
+                    if (nextGlyphIdx != -1)
+                        x += getFontGlyphKerning(font, glyphIdx, nextGlyphIdx)*scale;
+                }
 
                 vertexIdx += 4;
-                indexIdx += 6;
             }
         }
 
-        batch->numChars += len;
+        // Only the glyphs that are found make quads
+        int numQuads = vertexIdx/4;
+        batch->numChars += numQuads;
 
         // We have the final width, Calculate alignment
         vec2_t pos = vec2f(0, -font->lineHeight*0.5f*scale);
@@ -1062,10 +1188,19 @@ namespace termite
         }
 
         // Transform vertices by pos
-        for (int i = 0; i < maxVerts; i++) {
+        for (int i = 0; i < vertexIdx; i++) {
             verts[i].x += pos.x;
             verts[i].y += pos.y;
         }
+
+        if (!cropped && !collision) {
+            TextLayout layout;
+            layout.firstVert = firstVertIdx;
+            layout.numQuads = numQuads;
+            layout.textLen = len;
+            layout.checkHash = checkHash;
+            cache.layouts.add(layoutKey, layout);
+        }
     }
 
     void addTextf(TextBatch* batch, color_t color, float scale, const rect_t& rectFit, TextAlign::Enum align, const char* fmt, ...)
@@ -1081,6 +1216,8 @@ namespace termite
 
     static void drawTextBatch(GfxDriverApi* gDriver, TextBatch* batch, uint8_t viewId, ProgramHandle prog, Font* font)
     {
+        rmt_ScopedCPUSample(Text_Draw, 0);
+        GfxSubsystemStats* stats = getGfxSubsystemFrameStats(GfxSubsystem::Text);
         int reqVertices = batch->numChars * 4;
         int reqIndices = batch->numChars * 6;
         if (reqVertices == gDriver->getAvailTransientVertexBuffer(reqVertices, TextVertex::Decl) &&
@@ -1100,6 +1237,14 @@ namespace termite
             gDriver->setTransientVertexBuffer(&tvb);
             gDriver->setTransientIndexBuffer(&tib);
             gDriver->submit(viewId, prog, 0, false);
+
+            stats->numVerts += reqVertices;
+            stats->numIndices += reqIndices;
+            stats->transientBytes += tvb.size + tib.size;
+            stats->numBatches++;
+            stats->numSubmits++;
+        } else {
+            stats->numDropped++;
         }
     }
 
@@ -1149,8 +1294,12 @@ namespace termite
         assert(g_fontSys);
         assert(batch->alloc);
 
-        if (batch->verts)
-            BX_FREE(batch->alloc, batch->verts);
+        for (int i = 0; i < 2; i++) {
+            TextLayoutCache& cache = batch->caches[i];
+            if (cache.verts)
+                BX_FREE(batch->alloc, cache.verts);
+            cache.layouts.destroy();
+        }
         if (batch->indices)
             BX_FREE(batch->alloc, batch->indices);
 
@@ -1,28 +1,52 @@
 #include "pch.h"
 #include "gfx_material.h"
+#include "gfx_driver.h"
 
+#include "bx/uint32_t.h"
 #include "bxx/array.h"
 #include "bxx/hash_table.h"
 #include "bxx/handle_pool.h"
 
 using namespace termite;
 
+static const uint32_t kUniformTypeSize[UniformType::Count] = {
+    sizeof(int32_t),        // Int1
+    0,                      // End
+    sizeof(float) * 4,      // Vec4
+    sizeof(float) * 9,      // Mat3
+    sizeof(float) * 16      // Mat4
+};
+
 struct MaterialUniform
 {
     char name[32];
     UniformHandle handle;
+    UniformType::Enum type;
+    uint16_t num;
+    uint16_t offset;        // Offset into material's uniform block
 };
 
 struct Material
 {
+    ProgramHandle prog;
+    int numUniforms;
     MaterialUniform* uniforms;
+    uint8_t* block;         // Values of all uniforms, packed
 };
 
 namespace termite
 {
     struct MaterialLib
     {
+        bx::AllocatorI* alloc;
+        GfxDriverApi* driver;
         bx::HandlePool materials;
+
+        MaterialLib()
+        {
+            alloc = nullptr;
+            driver = nullptr;
+        }
     };
 
     MaterialDecl::MaterialDecl()
@@ -37,13 +61,13 @@ namespace termite
         return *this;
     }
 
-    MaterialDecl& MaterialDecl::add(const char* name, UniformType type, int num)
+    MaterialDecl& MaterialDecl::add(const char* name, UniformType::Enum type, int num)
     {
         assert(num >= 1);
 
         if (m_count < MAX_MATERIAL_VARS) {
             Var& v = m_vars[m_count++];
-            bx::strlcpy(v.name, name, sizeof(name));
+            bx::strlcpy(v.name, name, sizeof(v.name));
             v.type = type;
             v.num = num;
         }
@@ -59,20 +83,143 @@ namespace termite
 
 MaterialLib* termite::createMaterialLib(bx::AllocatorI* alloc, GfxDriverApi* driver)
 {
-    return nullptr;
+    MaterialLib* lib = BX_NEW(alloc, MaterialLib);
+    if (!lib)
+        return nullptr;
+
+    lib->alloc = alloc;
+    lib->driver = driver;
+
+    const uint32_t itemSize = sizeof(Material);
+    if (!lib->materials.create(&itemSize, 1, 64, 64, alloc)) {
+        BX_DELETE(alloc, lib);
+        return nullptr;
+    }
+
+    return lib;
 }
 
 void termite::destroyMaterialLib(MaterialLib* lib)
 {
+    if (!lib)
+        return;
 
+    while (lib->materials.getCount() > 0)
+        destroyMaterial(lib, MaterialHandle(lib->materials.handleAt(0)));
+    lib->materials.destroy();
+    BX_DELETE(lib->alloc, lib);
 }
 
-MaterialHandle termite::createMaterial(MaterialLib* lib)
+MaterialHandle termite::createMaterial(MaterialLib* lib, const MaterialDecl& decl, ProgramHandle prog)
 {
-    return MaterialHandle();
+    assert(lib);
+
+    int numUniforms = decl.getCount();
+    uint32_t blockSize = 0;
+    for (int i = 0; i < numUniforms; i++) {
+        const MaterialDecl::Var& var = decl.getVar(i);
+        blockSize += kUniformTypeSize[var.type]*var.num;
+    }
+    if (blockSize > UINT16_MAX) {
+        T_ERROR("Material uniform block is too large: %u bytes", blockSize);
+        return MaterialHandle();
+    }
+
+    // Uniforms and the uniform block are in a single buffer
+    uint8_t* buff = (uint8_t*)BX_ALIGNED_ALLOC(lib->alloc, sizeof(MaterialUniform)*numUniforms + blockSize, 16);
+    if (!buff)
+        return MaterialHandle();
+
+    uint16_t handle = lib->materials.newHandle();
+    if (handle == UINT16_MAX) {
+        BX_ALIGNED_FREE(lib->alloc, buff, 16);
+        return MaterialHandle();
+    }
+
+    Material* mtl = (Material*)lib->materials.getHandleData(0, handle);
+    mtl->prog = prog;
+    mtl->numUniforms = numUniforms;
+    mtl->uniforms = (MaterialUniform*)buff;
+    mtl->block = buff + sizeof(MaterialUniform)*numUniforms;
+    memset(mtl->block, 0x00, blockSize);
+
+    uint16_t offset = 0;
+    for (int i = 0; i < numUniforms; i++) {
+        const MaterialDecl::Var& var = decl.getVar(i);
+        MaterialUniform& u = mtl->uniforms[i];
+        bx::strlcpy(u.name, var.name, sizeof(u.name));
+        u.type = var.type;
+        u.num = uint16_t(var.num);
+        u.offset = offset;
+        u.handle = lib->driver->createUniform(var.name, var.type, uint16_t(var.num));
+        offset += uint16_t(kUniformTypeSize[var.type]*var.num);
+    }
+
+    return MaterialHandle(handle);
 }
 
 void termite::destroyMaterial(MaterialLib* lib, MaterialHandle handle)
 {
+    assert(lib);
+    assert(handle.isValid());
+
+    Material* mtl = (Material*)lib->materials.getHandleData(0, handle);
+    for (int i = 0; i < mtl->numUniforms; i++) {
+        if (mtl->uniforms[i].handle.isValid())
+            lib->driver->destroyUniform(mtl->uniforms[i].handle);
+    }
+    BX_ALIGNED_FREE(lib->alloc, mtl->uniforms, 16);
+
+    lib->materials.freeHandle(handle);
+}
+
+int termite::findMaterialVar(MaterialLib* lib, MaterialHandle handle, const char* name)
+{
+    assert(lib);
+    assert(handle.isValid());
+
+    const Material* mtl = (const Material*)lib->materials.getHandleData(0, handle);
+    for (int i = 0; i < mtl->numUniforms; i++) {
+        if (strcmp(mtl->uniforms[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+void termite::setMaterialVar(MaterialLib* lib, MaterialHandle handle, int var, const void* value, int num)
+{
+    assert(lib);
+    assert(handle.isValid());
+
+    Material* mtl = (Material*)lib->materials.getHandleData(0, handle);
+    assert(var >= 0 && var < mtl->numUniforms);
+
+    const MaterialUniform& u = mtl->uniforms[var];
+    uint32_t size = kUniformTypeSize[u.type]*bx::uint32_min(num, u.num);
+    memcpy(mtl->block + u.offset, value, size);
+}
+
+ProgramHandle termite::getMaterialProgram(MaterialLib* lib, MaterialHandle handle)
+{
+    assert(lib);
+    assert(handle.isValid());
+
+    return ((const Material*)lib->materials.getHandleData(0, handle))->prog;
+}
+
+int termite::applyMaterial(MaterialLib* lib, MaterialHandle handle)
+{
+    assert(lib);
+    assert(handle.isValid());
+
+    // Uniform values are attached to the next submit and draws are sorted afterwards, so a value that was set for
+    // a previous draw can't be relied upon: all uniforms of the material are uploaded on every apply
+    const Material* mtl = (const Material*)lib->materials.getHandleData(0, handle);
+    GfxDriverApi* driver = lib->driver;
+    for (int i = 0; i < mtl->numUniforms; i++) {
+        const MaterialUniform& u = mtl->uniforms[i];
+        driver->setUniform(u.handle, mtl->block + u.offset, u.num);
+    }
 
+    return mtl->numUniforms;
 }
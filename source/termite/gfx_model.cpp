@@ -1,12 +1,23 @@
 #include "pch.h"
 
 #include "bx/readerwriter.h"
+#include "bx/float4x4_t.h"
+#include "bx/fpumath.h"
+#include "bx/uint32_t.h"
+#include "bx/string.h"
 #include "bxx/array.h"
 #include "memory_pool.h"
+#include "job_dispatcher.h"
+#include "camera.h"
+
+#include "Remotery.h"
+
+#include <algorithm>
 
 #include "gfx_model.h"
 
 #include "../include_common/t3d_format.h"
+#include "../include_common/tanim_format.h"
 
 using namespace termite;
 
@@ -15,15 +26,22 @@ struct ModelInstanceImpl
     struct Pose
     {
         int numJoints;
-        mtx4x4_t* mtxs; // Final joint matrices
-        mtx4x4_t* offsetMtxs;   // offset matrices
-        mtx4x4_t* skinMtxs; // Skinning matrices (mtx*offsetMtx)
+        int* order;     // Joints sorted parents first
+        int* channels;  // Bound animation channel for each joint, -1 if not animated
+        bx::float4x4_t* mtxs;       // Final joint matrices
+        bx::float4x4_t* offsetMtxs; // offset matrices
+        bx::float4x4_t* skinMtxs;   // Skinning matrices (offsetMtx*mtx)
     };
 
-    struct Material
-    {
-        ProgramHandle program;
-    };
+    ModelInstance i;
+    bx::AllocatorI* alloc;
+    int numNodes;
+    int numGeos;
+    int* nodeOrder;         // Nodes sorted parents first
+    int* nodeChannels;      // Bound animation channel for each node, -1 if not animated
+    bx::float4x4_t* nodeMtxs;   // World matrices of nodes
+    Pose* poses;            // One for each geometry, numJoints = 0 for static geometries
+    const ModelAnim* boundAnim;
 };
 
 struct ModelImpl
@@ -31,12 +49,16 @@ struct ModelImpl
     Model m;
     VertexBufferHandle* vertexBuffers;     // 1 for each geometry
     IndexBufferHandle* indexBuffers;       // 1 for each geometry
+    MemoryBlock* mem;                      // v2.0: Loaded file, geometry data points into it
+    int* nodeOrder;                        // Nodes sorted parents first
 
     ModelImpl()
     {
         memset(&m, 0x00, sizeof(m));
         vertexBuffers = nullptr;
         indexBuffers = nullptr;
+        mem = nullptr;
+        nodeOrder = nullptr;
     }
 };
 
@@ -48,11 +70,20 @@ public:
     void onReload(ResourceHandle handle, bx::AllocatorI* alloc) override;
 };
 
+class ModelAnimLoader : public ResourceCallbacksI
+{
+public:
+    bool loadObj(const MemoryBlock* mem, const ResourceTypeParams& params, uintptr_t* obj, bx::AllocatorI* alloc) override;
+    void unloadObj(uintptr_t obj, bx::AllocatorI* alloc) override;
+    void onReload(ResourceHandle handle, bx::AllocatorI* alloc) override;
+};
+
 struct ModelManager
 {
     bx::AllocatorI* alloc;
     GfxDriverApi* driver;
     ModelLoader loader;
+    ModelAnimLoader animLoader;
 
     PageAllocator allocStub;
 
@@ -96,13 +127,434 @@ void termite::registerModelToResourceLib()
     ResourceTypeHandle handle;
     handle = registerResourceType("model", &g_modelMgr->loader, sizeof(LoadModelParams));
     assert(handle.isValid());
+    handle = registerResourceType("modelanim", &g_modelMgr->animLoader);
+    assert(handle.isValid());
+}
+
+// Writes indices so that each parent comes before its children
+static void sortByHierarchy(int* order, const int* parents, int count, bool* placed)
+{
+    memset(placed, 0x00, sizeof(bool)*count);
+    int numPlaced = 0;
+    while (numPlaced < count) {
+        int prevPlaced = numPlaced;
+        for (int i = 0; i < count; i++) {
+            if (!placed[i] && (parents[i] < 0 || parents[i] >= count || placed[parents[i]])) {
+                order[numPlaced++] = i;
+                placed[i] = true;
+            }
+        }
+
+        // Cycles in bad data, append the rest as is
+        if (prevPlaced == numPlaced) {
+            for (int i = 0; i < count; i++) {
+                if (!placed[i])
+                    order[numPlaced++] = i;
+            }
+        }
+    }
 }
 
-ModelInstance* termite::createModelInstance(Model* model)
+static int findAnimChannel(const ModelAnim* anim, const char* name)
+{
+    for (int i = 0; i < anim->numChannels; i++) {
+        if (strcmp(anim->channels[i].bindto, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void bindModelInstanceAnim(ModelInstanceImpl* inst, const Model* model, const ModelAnim* anim)
+{
+    for (int i = 0; i < inst->numNodes; i++)
+        inst->nodeChannels[i] = anim ? findAnimChannel(anim, model->nodes[i].name) : -1;
+
+    for (int g = 0; g < inst->numGeos; g++) {
+        ModelInstanceImpl::Pose& pose = inst->poses[g];
+        for (int i = 0; i < pose.numJoints; i++)
+            pose.channels[i] = anim ? findAnimChannel(anim, model->geos[g].skel->joints[i].name) : -1;
+    }
+    inst->boundAnim = anim;
+}
+
+static inline void loadMtx(bx::float4x4_t* dest, const mtx4x4_t& src)
+{
+    memcpy(dest, src.f, sizeof(float)*16);
+}
+
+ModelInstance* termite::createModelInstance(ResourceHandle modelHandle, bx::AllocatorI* alloc)
 {
     assert(g_modelMgr);
 
-    return nullptr;
+    Model* model = getResourcePtr<Model>(modelHandle);
+    if (!model)
+        return nullptr;
+
+    if (!alloc)
+        alloc = g_modelMgr->alloc;
+
+    // Everything goes into one buffer, matrices first to keep them aligned
+    int numNodes = model->numNodes;
+    int numGeos = model->numGeos;
+    int numMtxs = numNodes;
+    int numInts = numNodes*2;
+    int maxCount = numNodes;
+    for (int g = 0; g < numGeos; g++) {
+        const Model::Skeleton* skel = model->geos[g].skel;
+        if (skel) {
+            numMtxs += skel->numJoints*3;
+            numInts += skel->numJoints*2;
+            maxCount = bx::uint32_max(maxCount, skel->numJoints);
+        }
+    }
+
+    size_t totalSize = BX_ALIGN_16(sizeof(ModelInstanceImpl)) + sizeof(bx::float4x4_t)*numMtxs + 
+        sizeof(ModelInstanceImpl::Pose)*numGeos + sizeof(int)*numInts;
+    uint8_t* buff = (uint8_t*)BX_ALIGNED_ALLOC(alloc, totalSize, 16);
+    if (!buff)
+        return nullptr;
+
+    ModelInstanceImpl* inst = (ModelInstanceImpl*)buff;
+    buff += BX_ALIGN_16(sizeof(ModelInstanceImpl));
+    inst->i.modelHandle = modelHandle;
+    inst->i.animHandle.reset();
+    inst->i.time = 0;
+    inst->i.speed = 1.0f;
+    inst->i.looped = true;
+    inst->alloc = alloc;
+    inst->numNodes = numNodes;
+    inst->numGeos = numGeos;
+    inst->boundAnim = nullptr;
+
+    // Node matrices, pose matrices, pose headers and indices
+    inst->nodeMtxs = (bx::float4x4_t*)buff;     buff += sizeof(bx::float4x4_t)*numNodes;
+    bx::float4x4_t* mtxs = (bx::float4x4_t*)buff;
+    buff += sizeof(bx::float4x4_t)*(numMtxs - numNodes);
+    inst->poses = (ModelInstanceImpl::Pose*)buff;   buff += sizeof(ModelInstanceImpl::Pose)*numGeos;
+    int* ints = (int*)buff;
+
+    inst->nodeOrder = ints;         ints += numNodes;
+    inst->nodeChannels = ints;      ints += numNodes;
+
+    bx::AllocatorI* tmpAlloc = getTempAlloc();
+    int* parents = (int*)BX_ALLOC(tmpAlloc, sizeof(int)*maxCount);
+    bool* placed = (bool*)BX_ALLOC(tmpAlloc, sizeof(bool)*maxCount);
+
+    for (int i = 0; i < numNodes; i++) {
+        parents[i] = model->nodes[i].parent;
+        inst->nodeChannels[i] = -1;
+        loadMtx(&inst->nodeMtxs[i], model->nodes[i].localMtx);
+    }
+    sortByHierarchy(inst->nodeOrder, parents, numNodes, placed);
+
+    for (int g = 0; g < numGeos; g++) {
+        ModelInstanceImpl::Pose& pose = inst->poses[g];
+        const Model::Skeleton* skel = model->geos[g].skel;
+        if (!skel) {
+            memset(&pose, 0x00, sizeof(pose));
+            continue;
+        }
+
+        int numJoints = skel->numJoints;
+        pose.numJoints = numJoints;
+        pose.mtxs = mtxs;           mtxs += numJoints;
+        pose.offsetMtxs = mtxs;     mtxs += numJoints;
+        pose.skinMtxs = mtxs;       mtxs += numJoints;
+        pose.order = ints;          ints += numJoints;
+        pose.channels = ints;       ints += numJoints;
+
+        for (int i = 0; i < numJoints; i++) {
+            parents[i] = skel->joints[i].parent;
+            pose.channels[i] = -1;
+            loadMtx(&pose.offsetMtxs[i], skel->joints[i].offsetMtx);
+            loadMtx(&pose.mtxs[i], skel->initPose[i]);
+            loadMtx(&pose.skinMtxs[i], mtx4x4Ident());
+        }
+        sortByHierarchy(pose.order, parents, numJoints, placed);
+    }
+
+    BX_FREE(tmpAlloc, placed);
+    BX_FREE(tmpAlloc, parents);
+
+    return &inst->i;
+}
+
+void termite::destroyModelInstance(ModelInstance* _inst)
+{
+    ModelInstanceImpl* inst = (ModelInstanceImpl*)_inst;
+    BX_ALIGNED_FREE(inst->alloc, inst, 16);
+}
+
+void termite::setModelInstanceAnim(ModelInstance* inst, ResourceHandle animHandle, bool looped, float speed)
+{
+    inst->animHandle = animHandle;
+    inst->looped = looped;
+    inst->speed = speed;
+    inst->time = 0;
+}
+
+// Finds the key pair for frame0/frame1 in reduced keys, and the interpolation factor between them
+// Keys always include the first and last frames, frame1 < frame0 means looping back to the first frame
+static inline float findAnimKeys(const uint16_t* frames, int numKeys, int frame0, int frame1, float t, int* key0, int* key1)
+{
+    if (frame1 < frame0) {
+        *key0 = numKeys - 1;
+        *key1 = 0;
+        return t;
+    }
+
+    // Last key with frame <= frame0
+    int first = 0, count = numKeys;
+    while (count > 1) {
+        int half = count >> 1;
+        if (frames[first + half] <= frame0) {
+            first += half;
+            count -= half;
+        } else {
+            count = half;
+        }
+    }
+
+    int k0 = first;
+    int k1 = bx::uint32_min(k0 + 1, numKeys - 1);
+    *key0 = k0;
+    *key1 = k1;
+    int span = frames[k1] - frames[k0];
+    return span > 0 ? bx::fsaturate((float(frame0 - frames[k0]) + t) / float(span)) : 0;
+}
+
+static inline bx::simd128_t unpackAnimPos(const ModelAnim::Channel& channel, int key)
+{
+    using namespace bx;
+    const uint16_t* k = &channel.posKeys[key*4];
+    const simd128_t q = simd_ld(float(k[0]), float(k[1]), float(k[2]), float(k[3]));
+    const simd128_t pmin = simd_ld(channel.posMin.x, channel.posMin.y, channel.posMin.z, channel.posMin.w);
+    const simd128_t pscale = simd_ld(channel.posScale.x, channel.posScale.y, channel.posScale.z, channel.posScale.w);
+    return simd_madd(q, pscale, pmin);
+}
+
+// Smallest three, see taChannelPacked
+static inline bx::simd128_t unpackAnimRot(const ModelAnim::Channel& channel, int key)
+{
+    const uint16_t* k = &channel.rotKeys[key*3];
+    int largest = (k[0] >> 15) | ((k[1] >> 15) << 1);
+    float c[3];
+    float sum = 0;
+    for (int i = 0; i < 3; i++) {
+        c[i] = (float(k[i] & 0x7fff) / 32767.0f * 2.0f - 1.0f) * (1.0f / bx::sqrt2);
+        sum += c[i]*c[i];
+    }
+
+    BX_ALIGN_DECL_16(float) q[4];
+    for (int i = 0, ci = 0; i < 4; i++)
+        q[i] = i == largest ? bx::fsqrt(bx::fmax(0, 1.0f - sum)) : c[ci++];
+    return bx::simd_ld(q);
+}
+
+// Interpolates channel keys and writes the local matrix (scale*rotation*translation)
+static void sampleAnimChannel(bx::float4x4_t* result, const ModelAnim::Channel& channel, int frame0, int frame1,
+                              bx::simd128_t t)
+{
+    using namespace bx;
+
+    simd128_t p0, p1, q0, q1;
+    simd128_t tp = t, tr = t;
+    if (!channel.poss) {
+        int k0, k1;
+        tp = simd_splat(findAnimKeys(channel.posFrames, channel.numPosKeys, frame0, frame1, simd_x(t), &k0, &k1));
+        p0 = unpackAnimPos(channel, k0);
+        p1 = unpackAnimPos(channel, k1);
+
+        tr = simd_splat(findAnimKeys(channel.rotFrames, channel.numRotKeys, frame0, frame1, simd_x(t), &k0, &k1));
+        q0 = unpackAnimRot(channel, k0);
+        q1 = unpackAnimRot(channel, k1);
+    } else {
+        p0 = simd_ld(channel.poss[frame0].f);
+        p1 = simd_ld(channel.poss[frame1].f);
+        q0 = simd_ld(channel.rots[frame0].f);
+        q1 = simd_ld(channel.rots[frame1].f);
+    }
+
+    const simd128_t pos = simd_madd(simd_sub(p1, p0), tp, p0);
+
+    // nlerp on the shortest path
+    q1 = simd_selb(simd_cmplt(simd_dot(q0, q1), simd_zero()), simd_neg(q1), q1);
+    simd128_t q = simd_madd(simd_sub(q1, q0), tr, q0);
+    q = simd_mul(q, simd_rsqrt(simd_dot(q, q)));
+
+    BX_ALIGN_DECL_16(float) qf[4];
+    BX_ALIGN_DECL_16(float) pf[4];
+    BX_ALIGN_DECL_16(float) rot[16];
+    simd_st(qf, q);
+    simd_st(pf, pos);
+    bx::mtxQuat(rot, qf);
+
+    const simd128_t scale = simd_splat(pf[3]);
+    result->col[0] = simd_mul(simd_ld(&rot[0]), scale);
+    result->col[1] = simd_mul(simd_ld(&rot[4]), scale);
+    result->col[2] = simd_mul(simd_ld(&rot[8]), scale);
+    result->col[3] = simd_ld(pf[0], pf[1], pf[2], 1.0f);
+}
+
+static void evalModelInstance(ModelInstanceImpl* inst, float dt)
+{
+    using namespace bx;
+
+    const Model* model = getResourcePtr<Model>(inst->i.modelHandle);
+    if (!model || model->numNodes != inst->numNodes || model->numGeos != inst->numGeos)
+        return;
+
+    const ModelAnim* anim = inst->i.animHandle.isValid() ? getResourcePtr<ModelAnim>(inst->i.animHandle) : nullptr;
+    if (anim && anim->numFrames == 0)
+        anim = nullptr;
+    if (anim != inst->boundAnim)
+        bindModelInstanceAnim(inst, model, anim);
+
+    // Advance time and find the frames to interpolate
+    int frame0 = 0, frame1 = 0;
+    float t = 0;
+    if (anim) {
+        float duration = float(anim->numFrames) / float(anim->fps > 0 ? anim->fps : 30);
+        float time = inst->i.time + dt*inst->i.speed;
+        if (inst->i.looped) {
+            time = bx::fmod(time, duration);
+            if (time < 0)
+                time += duration;
+        } else {
+            time = bx::fclamp(time, 0, duration);
+        }
+        inst->i.time = time;
+
+        float frame = time * float(anim->fps > 0 ? anim->fps : 30);
+        frame0 = bx::uint32_min(int(frame), anim->numFrames - 1);
+        frame1 = inst->i.looped ? (frame0 + 1) % anim->numFrames : bx::uint32_min(frame0 + 1, anim->numFrames - 1);
+        t = bx::fclamp(frame - float(frame0), 0, 1.0f);
+    }
+    const simd128_t tt = simd_splat(t);
+
+    // Nodes: world = local*parentWorld
+    bx::float4x4_t local;
+    for (int k = 0; k < inst->numNodes; k++) {
+        int i = inst->nodeOrder[k];
+        const Model::Node& node = model->nodes[i];
+        int channel = inst->nodeChannels[i];
+        if (channel >= 0)
+            sampleAnimChannel(&local, anim->channels[channel], frame0, frame1, tt);
+        else
+            loadMtx(&local, node.localMtx);
+
+        if (node.parent >= 0)
+            float4x4_mul(&inst->nodeMtxs[i], &local, &inst->nodeMtxs[node.parent]);
+        else
+            inst->nodeMtxs[i] = local;
+    }
+
+    // Joints: Same as nodes, joints under the scene root are also transformed by skeleton's root
+    //         The exporter bakes the root (and scale) into their initPose, animated poses must do the same
+    for (int g = 0; g < inst->numGeos; g++) {
+        ModelInstanceImpl::Pose& pose = inst->poses[g];
+        if (pose.numJoints == 0)
+            continue;
+        const Model::Skeleton* skel = model->geos[g].skel;
+
+        for (int k = 0; k < pose.numJoints; k++) {
+            int i = pose.order[k];
+            int parent = skel->joints[i].parent;
+            int channel = pose.channels[i];
+            if (channel >= 0) {
+                sampleAnimChannel(&local, anim->channels[channel], frame0, frame1, tt);
+                if (skel->joints[i].sceneRoot) {
+                    bx::float4x4_t rootMtx;
+                    bx::float4x4_t animMtx = local;
+                    loadMtx(&rootMtx, skel->rootMtx);
+                    float4x4_mul(&local, &animMtx, &rootMtx);
+                }
+            } else {
+                loadMtx(&local, skel->initPose[i]);
+            }
+
+            if (parent >= 0)
+                float4x4_mul(&pose.mtxs[i], &local, &pose.mtxs[parent]);
+            else
+                pose.mtxs[i] = local;
+        }
+
+        // Skinning matrices in bulk
+        const bx::float4x4_t* offsetMtxs = pose.offsetMtxs;
+        const bx::float4x4_t* mtxs = pose.mtxs;
+        bx::float4x4_t* skinMtxs = pose.skinMtxs;
+        for (int i = 0, c = pose.numJoints; i < c; i++)
+            float4x4_mul(&skinMtxs[i], &offsetMtxs[i], &mtxs[i]);
+    }
+}
+
+struct ModelInstanceJobData
+{
+    ModelInstance** insts;
+    int start;
+    int count;
+    float dt;
+};
+
+static void updateModelInstancesJob(int jobIndex, void* userParam)
+{
+    const ModelInstanceJobData* data = (const ModelInstanceJobData*)userParam + jobIndex;
+    for (int i = data->start, end = data->start + data->count; i < end; i++)
+        evalModelInstance((ModelInstanceImpl*)data->insts[i], data->dt);
+}
+
+void termite::updateModelInstances(ModelInstance** insts, int numInsts, float dt)
+{
+    static const int kMinInstancesPerJob = 16;
+    static const int kMaxJobs = 32;
+
+    if (numInsts <= 0)
+        return;
+
+    ModelInstanceJobData jobData[kMaxJobs];
+    int numJobs = bx::uint32_min(bx::uint32_min(getNumWorkerThreads() + 1, numInsts / kMinInstancesPerJob), kMaxJobs);
+    if (numJobs > 1) {
+        int countPerJob = numInsts / numJobs;
+        for (int i = 0; i < numJobs; i++) {
+            ModelInstanceJobData& data = jobData[i];
+            data.insts = insts;
+            data.dt = dt;
+            data.start = i*countPerJob;
+            data.count = i < numJobs - 1 ? countPerJob : (numInsts - data.start);
+        }
+
+        JobDesc jobs[kMaxJobs];
+        for (int i = 0; i < numJobs; i++)
+            jobs[i] = JobDesc(updateModelInstancesJob, jobData, JobPriority::High);
+        JobHandle handle = dispatchSmallJobs(jobs, uint16_t(numJobs));
+        if (handle) {
+            waitJobs(handle);
+            return;
+        }
+    }
+
+    // Serial
+    ModelInstanceJobData& data = jobData[0];
+    data.insts = insts;
+    data.dt = dt;
+    data.start = 0;
+    data.count = numInsts;
+    updateModelInstancesJob(0, jobData);
+}
+
+const mtx4x4_t* termite::getModelInstanceNodeMtxs(ModelInstance* inst)
+{
+    return (const mtx4x4_t*)((ModelInstanceImpl*)inst)->nodeMtxs;
+}
+
+const mtx4x4_t* termite::getModelInstanceSkinMtxs(ModelInstance* _inst, int geo, int* numJoints)
+{
+    ModelInstanceImpl* inst = (ModelInstanceImpl*)_inst;
+    assert(geo < inst->numGeos);
+    const ModelInstanceImpl::Pose& pose = inst->poses[geo];
+    if (numJoints)
+        *numJoints = pose.numJoints;
+    return pose.numJoints ? (const mtx4x4_t*)pose.skinMtxs : nullptr;
 }
 
 VertexBufferHandle termite::getModelVertexBuffer(Model* model, int index)
@@ -137,30 +589,31 @@ static void unloadModel(ModelImpl* model)
                 driver->destroyVertexBuffer(model->vertexBuffers[i]);
         }
     }
+
+    if (model->mem) {
+        releaseMemoryBlock(model->mem);
+        model->mem = nullptr;
+    }
 }
 
-static bool loadModel10(bx::MemoryReader* data, const t3dHeader& header, const ResourceTypeParams& params, uintptr_t* obj)
+static ModelImpl* createModel(const t3dHeader& header, bx::AllocatorI* alloc)
 {
-    assert(g_modelMgr);
-
-    bx::Error err;
-
-    GfxDriverApi* driver = g_modelMgr->driver;
-    bx::AllocatorI* alloc = &g_modelMgr->allocStub;
-
-    // Create model
     ModelImpl* model = BX_NEW(alloc, ModelImpl);
     model->m.nodes = (Model::Node*)BX_ALLOC(alloc, sizeof(Model::Node)*header.numNodes);
     model->m.geos = (Model::Geometry*)BX_ALLOC(alloc, sizeof(Model::Geometry)*header.numGeos);
     model->m.meshes = (Model::Mesh*)BX_ALLOC(alloc, sizeof(Model::Mesh)*header.numMeshes);
-    
+
     model->m.numGeos = header.numGeos;
     model->m.numMeshes = header.numMeshes;
     model->m.numNodes = header.numNodes;
     model->m.rootMtx = mtx4x4Ident();
+    return model;
+}
 
-    // Nodes
-    for (int i = 0; i < header.numNodes; i++) {
+static void loadModelNodes(bx::MemoryReader* data, ModelImpl* model, bx::AllocatorI* alloc)
+{
+    bx::Error err;
+    for (int i = 0; i < model->m.numNodes; i++) {
         t3dNode tnode;
         data->read(&tnode, sizeof(tnode), &err);
 
@@ -170,6 +623,7 @@ static bool loadModel10(bx::MemoryReader* data, const t3dHeader& header, const R
         node.parent = tnode.parent;
         node.numChilds = tnode.numChilds;
         node.localMtx = mtx4x4fv3(&tnode.xformMtx[0], &tnode.xformMtx[3], &tnode.xformMtx[6], &tnode.xformMtx[9]);
+        node.bb = aabbfv(tnode.aabbMin, tnode.aabbMax);
         
         if (tnode.numChilds) {
             node.childs = (int*)BX_ALLOC(alloc, sizeof(int)*tnode.numChilds);
@@ -179,8 +633,23 @@ static bool loadModel10(bx::MemoryReader* data, const t3dHeader& header, const R
         }
     }
 
-    // Meshes
-    for (int i = 0; i < header.numMeshes; i++) {
+    // Draw order for flattening the hierarchy
+    int numNodes = model->m.numNodes;
+    bx::AllocatorI* tmpAlloc = getTempAlloc();
+    int* parents = (int*)BX_ALLOC(tmpAlloc, sizeof(int)*numNodes);
+    bool* placed = (bool*)BX_ALLOC(tmpAlloc, sizeof(bool)*numNodes);
+    for (int i = 0; i < numNodes; i++)
+        parents[i] = model->m.nodes[i].parent;
+    model->nodeOrder = (int*)BX_ALLOC(alloc, sizeof(int)*numNodes);
+    sortByHierarchy(model->nodeOrder, parents, numNodes, placed);
+    BX_FREE(tmpAlloc, placed);
+    BX_FREE(tmpAlloc, parents);
+}
+
+static void loadModelMeshes(bx::MemoryReader* data, ModelImpl* model, bx::AllocatorI* alloc)
+{
+    bx::Error err;
+    for (int i = 0; i < model->m.numMeshes; i++) {
         t3dMesh tmesh;
         data->read(&tmesh, sizeof(tmesh), &err);
 
@@ -200,6 +669,90 @@ static bool loadModel10(bx::MemoryReader* data, const t3dHeader& header, const R
             submesh.startIndex = tsubmesh.startIndex;
         }
     }
+}
+
+static void loadGeoSkeleton(bx::MemoryReader* data, uint32_t version, const t3dGeometry& tgeo, Model::Geometry* geo, 
+                            bx::AllocatorI* alloc)
+{
+    bx::Error err;
+    geo->skel = nullptr;
+    if (!tgeo.skel.numJoints)
+        return;
+
+    geo->skel = (Model::Skeleton*)BX_ALLOC(alloc, sizeof(Model::Skeleton));
+
+    geo->skel->joints = (Model::Joint*)BX_ALLOC(alloc, sizeof(Model::Joint)*tgeo.skel.numJoints);
+    geo->skel->initPose = (mtx4x4_t*)BX_ALLOC(alloc, sizeof(mtx4x4_t)*tgeo.skel.numJoints);
+
+    geo->skel->numJoints = tgeo.skel.numJoints;
+    geo->skel->rootMtx = mtx4x4fv3(&tgeo.skel.rootMtx[0], &tgeo.skel.rootMtx[3], &tgeo.skel.rootMtx[6],
+                                   &tgeo.skel.rootMtx[9]);
+
+    for (int c = 0; c < tgeo.skel.numJoints; c++) {
+        t3dJoint tjoint;
+        data->read(&tjoint, sizeof(tjoint), &err);
+        Model::Joint& joint = geo->skel->joints[c];
+        strcpy(joint.name, tjoint.name);
+        joint.parent = tjoint.parent;
+        joint.sceneRoot = tjoint.parent < 0;
+        joint.offsetMtx = mtx4x4fv3(&tjoint.offsetMtx[0], &tjoint.offsetMtx[3], &tjoint.offsetMtx[6],
+                                    &tjoint.offsetMtx[9]);
+    }
+
+    for (int c = 0; c < tgeo.skel.numJoints; c++) {
+        float mtx[12];
+        data->read(mtx, sizeof(float) * 12, &err);
+        geo->skel->initPose[c] = mtx4x4fv3(&mtx[0], &mtx[3], &mtx[6], &mtx[9]);
+    }
+
+    // Older versions don't tell which joints are under the scene root, assume all root joints are
+    if (version >= T3D_VERSION_21) {
+        for (int c = 0; c < tgeo.skel.numJoints; c++) {
+            int flags;
+            data->read(&flags, sizeof(flags), &err);
+            geo->skel->joints[c].sceneRoot = (flags & t3dJointFlag::SceneRoot) != 0;
+        }
+    }
+}
+
+static bool createModelBuffers(ModelImpl* model, bx::AllocatorI* alloc)
+{
+    GfxDriverApi* driver = g_modelMgr->driver;
+    int numGeos = model->m.numGeos;
+
+    model->vertexBuffers = (VertexBufferHandle*)BX_ALLOC(alloc, sizeof(VertexBufferHandle)*numGeos);
+    model->indexBuffers = (IndexBufferHandle*)BX_ALLOC(alloc, sizeof(IndexBufferHandle)*numGeos);
+
+    for (int i = 0; i < numGeos; i++) {
+        model->vertexBuffers[i].reset();
+        model->indexBuffers[i].reset();
+    }
+
+    // Buffers reference geometry data, which stays alive until the model is unloaded
+    for (int i = 0; i < numGeos; i++) {
+        const Model::Geometry& geo = model->m.geos[i];
+        model->vertexBuffers[i] = driver->createVertexBuffer(
+            driver->makeRef(geo.verts, geo.numVerts*geo.vdecl.stride, nullptr, nullptr), geo.vdecl, GpuBufferFlag::None);
+        model->indexBuffers[i] = driver->createIndexBuffer(
+            driver->makeRef(geo.indices, sizeof(uint16_t)*geo.numIndices, nullptr, nullptr), GpuBufferFlag::None);
+        if (!model->vertexBuffers[i].isValid() || !model->indexBuffers[i].isValid())
+            return false;
+    }
+    return true;
+}
+
+static bool loadModel10(bx::MemoryReader* data, const t3dHeader& header, const ResourceTypeParams& params, uintptr_t* obj)
+{
+    assert(g_modelMgr);
+
+    bx::Error err;
+
+    bx::AllocatorI* alloc = &g_modelMgr->allocStub;
+
+    // Create model
+    ModelImpl* model = createModel(header, alloc);
+    loadModelNodes(data, model, alloc);
+    loadModelMeshes(data, model, alloc);
 
     // Geos
     for (int i = 0; i < header.numGeos; i++) {
@@ -209,33 +762,9 @@ static bool loadModel10(bx::MemoryReader* data, const t3dHeader& header, const R
         Model::Geometry& geo = model->m.geos[i];
         geo.numIndices = tgeo.numTris * 3;
         geo.numVerts = tgeo.numVerts;
-        
-        if (tgeo.skel.numJoints) {
-            geo.skel = (Model::Skeleton*)BX_ALLOC(alloc, sizeof(Model::Skeleton));
-
-            geo.skel->joints = (Model::Joint*)BX_ALLOC(alloc, sizeof(Model::Joint)*tgeo.skel.numJoints);
-            geo.skel->initPose = (mtx4x4_t*)BX_ALLOC(alloc, sizeof(mtx4x4_t)*tgeo.skel.numJoints);
-
-            geo.skel->numJoints = tgeo.skel.numJoints;
-            geo.skel->rootMtx = mtx4x4fv3(&tgeo.skel.rootMtx[0], &tgeo.skel.rootMtx[3], &tgeo.skel.rootMtx[6],
-                                          &tgeo.skel.rootMtx[9]);
-
-            for (int c = 0; c < tgeo.skel.numJoints; c++) {
-                t3dJoint tjoint;
-                data->read(&tjoint, sizeof(tjoint), &err);
-                Model::Joint& joint = geo.skel->joints[c];
-                strcpy(joint.name, tjoint.name);
-                joint.parent = tjoint.parent;
-                joint.offsetMtx = mtx4x4fv3(&tjoint.offsetMtx[0], &tjoint.offsetMtx[3], &tjoint.offsetMtx[6],
-                                            &tjoint.offsetMtx[9]);
-            }
-
-            for (int c = 0; c < tgeo.skel.numJoints; c++) {
-                float mtx[12];
-                data->read(mtx, sizeof(float) * 12, &err);
-                geo.skel->initPose[c] = mtx4x4fv3(&mtx[0], &mtx[3], &mtx[6], &mtx[9]);
-            }
-        } // skeleton
+        geo.posOffset = vec3f(0, 0, 0);
+        geo.posScale = vec3f(1.0f, 1.0f, 1.0f);
+        loadGeoSkeleton(data, header.version, tgeo, &geo, alloc);
 
         // Vertex Decl
         vdeclBegin(&geo.vdecl);
@@ -297,26 +826,93 @@ static bool loadModel10(bx::MemoryReader* data, const t3dHeader& header, const R
     }
 
     // Create Gfx buffers
-    model->vertexBuffers = (VertexBufferHandle*)BX_ALLOC(alloc, sizeof(VertexBufferHandle)*header.numGeos);
-    model->indexBuffers = (IndexBufferHandle*)BX_ALLOC(alloc, sizeof(IndexBufferHandle)*header.numGeos);
-
-    for (int i = 0; i < header.numGeos; i++) {
-        model->vertexBuffers[i].reset();
-        model->indexBuffers[i].reset();
+    if (!createModelBuffers(model, alloc)) {
+        unloadModel(model);
+        return false;
     }
+    
+    *obj = uintptr_t(model);
+    return true;
+}
+
+// Returns a pointer to a blob inside the file, data is copied only if the blob is misaligned in memory
+static void* getModelBlob(const MemoryBlock* mem, int64_t offset, uint32_t size, bx::AllocatorI* alloc)
+{
+    if (offset < 0 || uint64_t(offset) + size > mem->size)
+        return nullptr;
+
+    uint8_t* blob = mem->data + offset;
+    if ((uintptr_t(blob) & (T3D_BLOB_ALIGN - 1)) == 0)
+        return blob;
 
+    void* data = BX_ALLOC(alloc, size);
+    if (data)
+        memcpy(data, blob, size);
+    return data;
+}
+
+static bool loadModel20(bx::MemoryReader* data, const MemoryBlock* mem, const t3dHeader& header,
+                        const ResourceTypeParams& params, uintptr_t* obj)
+{
+    assert(g_modelMgr);
+
+    bx::Error err;
+
+    bx::AllocatorI* alloc = &g_modelMgr->allocStub;
+
+    // Keep the file alive, vertex/index buffers reference it directly
+    ModelImpl* model = createModel(header, alloc);
+    model->mem = refMemoryBlock(const_cast<MemoryBlock*>(mem));
+    loadModelNodes(data, model, alloc);
+    loadModelMeshes(data, model, alloc);
+
+    // Geos
     for (int i = 0; i < header.numGeos; i++) {
-        const Model::Geometry& geo = model->m.geos[i];
-        model->vertexBuffers[i] = driver->createVertexBuffer(
-            driver->makeRef(geo.verts, geo.numVerts*geo.vdecl.stride, nullptr, nullptr), geo.vdecl, GpuBufferFlag::None);
-        model->indexBuffers[i] = driver->createIndexBuffer(
-            driver->makeRef(geo.indices, sizeof(uint16_t)*geo.numIndices, nullptr, nullptr), GpuBufferFlag::None);
-        if (!model->vertexBuffers[i].isValid() || !model->indexBuffers[i].isValid()) {
+        t3dGeometry tgeo;
+        t3dGeometryBlobs tblobs;
+        data->read(&tgeo, sizeof(tgeo), &err);
+        data->read(&tblobs, sizeof(tblobs), &err);
+
+        Model::Geometry& geo = model->m.geos[i];
+        geo.numIndices = tgeo.numTris * 3;
+        geo.numVerts = tgeo.numVerts;
+        geo.posOffset = vec3fv(tblobs.posOffset);
+        geo.posScale = vec3fv(tblobs.posScale);
+        if (geo.posScale.x != geo.posScale.y || geo.posScale.x != geo.posScale.z)
+            BX_WARN("Model geometry %d has non-uniform position scale, normals will be skewed. Re-export with modelc", i);
+        loadGeoSkeleton(data, header.version, tgeo, &geo, alloc);
+
+        // Vertex Decl
+        vdeclBegin(&geo.vdecl);
+        for (int c = 0; c < tgeo.numAttribs; c++) {
+            t3dVertexAttribDesc tdesc;
+            data->read(&tdesc, sizeof(tdesc), &err);
+            vdeclAdd(&geo.vdecl, (VertexAttrib::Enum)tdesc.attrib, tdesc.num, (VertexAttribType::Enum)tdesc.type,
+                     tdesc.normalized ? true : false, tdesc.asInt ? true : false);
+        }
+        vdeclEnd(&geo.vdecl);
+
+        if (geo.vdecl.stride != tgeo.vertStride) {
+            T_ERROR("Load model failed: Vertex stride mismatch (%d != %d)", geo.vdecl.stride, tgeo.vertStride);
+            unloadModel(model);
+            return false;
+        }
+
+        geo.indices = (uint16_t*)getModelBlob(mem, tblobs.indicesOffset, sizeof(uint16_t)*geo.numIndices, alloc);
+        geo.verts = getModelBlob(mem, tblobs.vertsOffset, geo.vdecl.stride*geo.numVerts, alloc);
+        if (!geo.indices || !geo.verts) {
+            T_ERROR("Load model failed: Invalid geometry data");
             unloadModel(model);
             return false;
         }
     }
-    
+
+    // Create Gfx buffers
+    if (!createModelBuffers(model, alloc)) {
+        unloadModel(model);
+        return false;
+    }
+
     *obj = uintptr_t(model);
     return true;
 }
@@ -338,6 +934,9 @@ bool ModelLoader::loadObj(const MemoryBlock* mem, const ResourceTypeParams& para
     switch (header.version) {
     case T3D_VERSION_10:
         return loadModel10(&reader, header, params, obj);
+    case T3D_VERSION_20:
+    case T3D_VERSION_21:
+        return loadModel20(&reader, mem, header, params, obj);
     default:
         T_ERROR("Load model failed: Invalid version: 0x%x", header.version);
         return false;
@@ -355,3 +954,385 @@ void ModelLoader::onReload(ResourceHandle handle, bx::AllocatorI* alloc)
 {
 
 }
+
+static ModelAnim* createModelAnim(bx::AllocatorI* alloc, const taHeader& header, size_t keysSize, uint8_t** keysBuff)
+{
+    int numChannels = header.numChannels;
+    size_t totalSize = BX_ALIGN_16(sizeof(ModelAnim)) + BX_ALIGN_16(sizeof(ModelAnim::Channel)*numChannels) + keysSize;
+    uint8_t* buff = (uint8_t*)BX_ALIGNED_ALLOC(alloc, totalSize, 16);
+    if (!buff) {
+        T_ERROR("Out of memory");
+        return nullptr;
+    }
+
+    ModelAnim* anim = (ModelAnim*)buff;
+    buff += BX_ALIGN_16(sizeof(ModelAnim));
+    anim->fps = header.fps;
+    anim->numFrames = header.numFrames;
+    anim->numChannels = numChannels;
+    anim->hasScale = header.hasScale ? true : false;
+    anim->compressed = false;
+    anim->channels = (ModelAnim::Channel*)buff;
+    buff += BX_ALIGN_16(sizeof(ModelAnim::Channel)*numChannels);
+    memset(anim->channels, 0x00, sizeof(ModelAnim::Channel)*numChannels);
+
+    *keysBuff = buff;
+    return anim;
+}
+
+// v1: Raw keys are copied into a single aligned buffer, aligned for SIMD sampling
+static ModelAnim* loadModelAnim10(bx::MemoryReader* reader, const taHeader& header, uint32_t size, bx::AllocatorI* alloc)
+{
+    bx::Error err;
+    int numChannels = header.numChannels;
+    size_t keysSize = sizeof(float)*4*header.numFrames;
+    if (size < sizeof(header) + numChannels*(sizeof(taChannel) + 2*keysSize)) {
+        T_ERROR("Load anim failed: Invalid data");
+        return nullptr;
+    }
+
+    uint8_t* buff;
+    ModelAnim* anim = createModelAnim(alloc, header, numChannels*keysSize*2, &buff);
+    if (!anim)
+        return nullptr;
+
+    for (int i = 0; i < numChannels; i++) {
+        ModelAnim::Channel& channel = anim->channels[i];
+        taChannel tchannel;
+        reader->read(&tchannel, sizeof(tchannel), &err);
+        bx::strlcpy(channel.bindto, tchannel.bindto, sizeof(channel.bindto));
+
+        channel.poss = (vec4_t*)buff;   buff += keysSize;
+        channel.rots = (quat_t*)buff;   buff += keysSize;
+        reader->read(channel.poss, int32_t(keysSize), &err);
+        reader->read(channel.rots, int32_t(keysSize), &err);
+    }
+
+    return anim;
+}
+
+static inline size_t getPackedChannelKeysSize(const taChannelPacked& pchannel)
+{
+    return sizeof(uint16_t)*5*pchannel.numPosKeys + sizeof(uint16_t)*4*pchannel.numRotKeys;
+}
+
+// v2: Keys stay quantized, each channel's keys are kept together in the order they are sampled
+static ModelAnim* loadModelAnim20(bx::MemoryReader* reader, const taHeader& header, const uint8_t* data, uint32_t size,
+                                  bx::AllocatorI* alloc)
+{
+    bx::Error err;
+    int numChannels = header.numChannels;
+
+    // Validate and find the total size of keys
+    size_t offset = sizeof(header);
+    size_t keysSize = 0;
+    for (int i = 0; i < numChannels; i++) {
+        taChannelPacked pchannel;
+        if (offset + sizeof(pchannel) > size) {
+            T_ERROR("Load anim failed: Invalid data");
+            return nullptr;
+        }
+        memcpy(&pchannel, data + offset, sizeof(pchannel));
+        if (pchannel.numPosKeys <= 0 || pchannel.numRotKeys <= 0 || 
+            pchannel.numPosKeys > header.numFrames || pchannel.numRotKeys > header.numFrames)
+        {
+            T_ERROR("Load anim failed: Invalid data");
+            return nullptr;
+        }
+
+        size_t channelKeysSize = getPackedChannelKeysSize(pchannel);
+        offset += sizeof(pchannel) + channelKeysSize;
+        keysSize += BX_ALIGN_16(channelKeysSize);
+    }
+    if (offset > size) {
+        T_ERROR("Load anim failed: Invalid data");
+        return nullptr;
+    }
+
+    uint8_t* buff;
+    ModelAnim* anim = createModelAnim(alloc, header, keysSize, &buff);
+    if (!anim)
+        return nullptr;
+    anim->compressed = true;
+
+    for (int i = 0; i < numChannels; i++) {
+        ModelAnim::Channel& channel = anim->channels[i];
+        taChannelPacked pchannel;
+        reader->read(&pchannel, sizeof(pchannel), &err);
+        bx::strlcpy(channel.bindto, pchannel.bindto, sizeof(channel.bindto));
+        channel.numPosKeys = pchannel.numPosKeys;
+        channel.numRotKeys = pchannel.numRotKeys;
+        channel.posMin = vec4fv(pchannel.posMin);
+        channel.posScale = vec4fv(pchannel.posScale);
+
+        size_t channelKeysSize = getPackedChannelKeysSize(pchannel);
+        reader->read(buff, int32_t(channelKeysSize), &err);
+        const uint16_t* keys = (const uint16_t*)buff;
+        channel.posFrames = keys;       keys += channel.numPosKeys;
+        channel.posKeys = keys;         keys += channel.numPosKeys*4;
+        channel.rotFrames = keys;       keys += channel.numRotKeys;
+        channel.rotKeys = keys;
+        buff += BX_ALIGN_16(channelKeysSize);
+    }
+
+    return anim;
+}
+
+bool ModelAnimLoader::loadObj(const MemoryBlock* mem, const ResourceTypeParams& params, uintptr_t* obj, bx::AllocatorI* alloc)
+{
+    assert(g_modelMgr);
+
+    bx::Error err;
+    bx::MemoryReader reader(mem->data, mem->size);
+
+    taHeader header;
+    reader.read(&header, sizeof(header), &err);
+    if (mem->size < sizeof(header) || header.sign != TANIM_SIGN) {
+        T_ERROR("Load anim failed: Invalid header");
+        return false;
+    }
+
+    if (header.numChannels < 0 || header.numFrames < 0) {
+        T_ERROR("Load anim failed: Invalid data");
+        return false;
+    }
+
+    if (!alloc)
+        alloc = g_modelMgr->alloc;
+
+    ModelAnim* anim;
+    switch (header.version) {
+    case TANIM_VERSION_10:
+        anim = loadModelAnim10(&reader, header, mem->size, alloc);
+        break;
+    case TANIM_VERSION_20:
+        anim = loadModelAnim20(&reader, header, mem->data, mem->size, alloc);
+        break;
+    default:
+        T_ERROR("Load anim failed: Invalid version: 0x%x", header.version);
+        return false;
+    }
+
+    if (!anim)
+        return false;
+
+    *obj = uintptr_t(anim);
+    return true;
+}
+
+void ModelAnimLoader::unloadObj(uintptr_t obj, bx::AllocatorI* alloc)
+{
+    assert(g_modelMgr);
+
+    BX_ALIGNED_FREE(alloc ? alloc : g_modelMgr->alloc, (void*)obj, 16);
+}
+
+void ModelAnimLoader::onReload(ResourceHandle handle, bx::AllocatorI* alloc)
+{
+}
+
+struct ModelDrawCmd
+{
+    const ModelImpl* model;
+    uint32_t key;       // mesh (high 16 bits), submesh (low 16 bits)
+    int node;           // Index into visible node matrices
+    int draw;
+};
+
+static inline bool isModelDrawCmdLess(const ModelDrawCmd& a, const ModelDrawCmd& b)
+{
+    return a.model != b.model ? (a.model < b.model) : (a.key < b.key);
+}
+
+static inline bool isModelDrawCmdEqual(const ModelDrawCmd& a, const ModelDrawCmd& b)
+{
+    return a.model == b.model && a.key == b.key;
+}
+
+// Positive vertex test, planes are facing inwards
+static bool testAabbFrustum(const aabb_t& bb, const plane_t* planes)
+{
+    for (int i = 0; i < CameraPlane::Count; i++) {
+        const plane_t& p = planes[i];
+        float x = p.nx >= 0 ? bb.xmax : bb.xmin;
+        float y = p.ny >= 0 ? bb.ymax : bb.ymin;
+        float z = p.nz >= 0 ? bb.zmax : bb.zmin;
+        if (p.nx*x + p.ny*y + p.nz*z + p.d < 0)
+            return false;
+    }
+    return true;
+}
+
+// Quantized positions are dequantized by the transform: pos = a_position*posScale + posOffset
+// posScale is uniform, so the result is still a similarity and normals only need to be renormalized
+static inline mtx4x4_t getGeoTransform(const Model::Geometry& geo, const mtx4x4_t& mtx)
+{
+    if (geo.posScale.x == 1.0f && geo.posScale.y == 1.0f && geo.posScale.z == 1.0f &&
+        geo.posOffset.x == 0 && geo.posOffset.y == 0 && geo.posOffset.z == 0)
+    {
+        return mtx;
+    }
+
+    mtx4x4_t dequant;
+    bx::mtxSRT(dequant.f, geo.posScale.x, geo.posScale.y, geo.posScale.z, 0, 0, 0, 
+               geo.posOffset.x, geo.posOffset.y, geo.posOffset.z);
+    return dequant * mtx;
+}
+
+int termite::drawModels(uint8_t viewId, const ModelDraw* draws, int numDraws, const mtx4x4_t& viewProjMtx,
+                        ProgramHandle prog, ProgramHandle instProg, GfxState::Bits state,
+                        SetModelStateCallback stateCallback, void* userData)
+{
+    assert(g_modelMgr);
+    rmt_ScopedCPUSample(Model_Draw, 0);
+
+    GfxDriverApi* driver = g_modelMgr->driver;
+    if (numDraws == 0)
+        return 0;
+
+    plane_t planes[CameraPlane::Count];
+    camCalcFrustumPlanes(planes, viewProjMtx);
+
+    // Count nodes and submeshes, for the upper bound of buffers
+    int maxNodes = 0;
+    int maxCmds = 0;
+    for (int i = 0; i < numDraws; i++) {
+        const Model* model = getResourcePtr<Model>(draws[i].model);
+        if (!model)
+            continue;
+        maxNodes += model->numNodes;
+        for (int k = 0; k < model->numNodes; k++) {
+            if (model->nodes[k].mesh >= 0)
+                maxCmds += model->meshes[model->nodes[k].mesh].numSubmeshes;
+        }
+    }
+    if (maxCmds == 0)
+        return 0;
+
+    bx::AllocatorI* tmpAlloc = getTempAlloc();
+    mtx4x4_t* mtxs = (mtx4x4_t*)BX_ALIGNED_ALLOC(tmpAlloc, sizeof(mtx4x4_t)*maxNodes, 16);
+    ModelDrawCmd* cmds = (ModelDrawCmd*)BX_ALLOC(tmpAlloc, sizeof(ModelDrawCmd)*maxCmds);
+    if (!mtxs || !cmds)
+        return 0;
+
+    // Flatten hierarchies to world matrices (world = local*parentWorld), and cull the nodes with meshes
+    int numMtxs = 0;
+    int numCmds = 0;
+    for (int i = 0; i < numDraws; i++) {
+        const ModelDraw& draw = draws[i];
+        const ModelImpl* model = getResourcePtr<ModelImpl>(draw.model);
+        if (!model)
+            continue;
+
+        mtx4x4_t* worldMtxs = mtxs + numMtxs;
+        const mtx4x4_t* instMtxs = draw.inst ? getModelInstanceNodeMtxs(draw.inst) : nullptr;
+        for (int k = 0; k < model->m.numNodes; k++) {
+            int n = model->nodeOrder[k];
+            const Model::Node& node = model->m.nodes[n];
+            if (instMtxs)
+                worldMtxs[n] = instMtxs[n] * draw.worldMtx;
+            else if (node.parent >= 0)
+                worldMtxs[n] = node.localMtx * worldMtxs[node.parent];
+            else
+                worldMtxs[n] = node.localMtx * model->m.rootMtx * draw.worldMtx;
+        }
+
+        for (int n = 0; n < model->m.numNodes; n++) {
+            const Model::Node& node = model->m.nodes[n];
+            if (node.mesh < 0 || !testAabbFrustum(aabbTransform(node.bb, worldMtxs[n]), planes))
+                continue;
+
+            const Model::Mesh& mesh = model->m.meshes[node.mesh];
+            for (int c = 0; c < mesh.numSubmeshes; c++) {
+                ModelDrawCmd& cmd = cmds[numCmds++];
+                cmd.model = model;
+                cmd.key = (uint32_t(node.mesh) << 16) | uint32_t(c);
+                cmd.node = numMtxs + n;
+                cmd.draw = i;
+            }
+        }
+
+        numMtxs += model->m.numNodes;
+    }
+
+    // Merge identical mesh/submesh pairs
+    std::sort(cmds, cmds + numCmds, isModelDrawCmdLess);
+
+    bool instancing = instProg.isValid() && (driver->getCaps().supported & GpuCapsFlag::Instancing);
+    const uint16_t stride = sizeof(mtx4x4_t);
+    GfxSubsystemStats* stats = getGfxSubsystemFrameStats(GfxSubsystem::Model);
+    int numSubmits = 0;
+
+    int i = 0;
+    while (i < numCmds) {
+        const ModelDrawCmd& cmd = cmds[i];
+        const ModelImpl* model = cmd.model;
+        const Model::Mesh& mesh = model->m.meshes[cmd.key >> 16];
+        const Model::Submesh& submesh = mesh.submeshes[cmd.key & 0xffff];
+        const Model::Geometry& geo = model->m.geos[mesh.geo];
+        const ModelDraw& draw = draws[cmd.draw];
+
+        int count = 1;
+        while (i + count < numCmds && isModelDrawCmdEqual(cmds[i + count], cmd))
+            count++;
+
+        driver->setState(state, 0);
+        driver->setVertexBuffer(model->vertexBuffers[mesh.geo]);
+        driver->setIndexBuffer(model->indexBuffers[mesh.geo], submesh.startIndex, submesh.numIndices);
+
+        int numJoints = 0;
+        const mtx4x4_t* skinMtxs = (geo.skel && draw.inst) ? 
+            getModelInstanceSkinMtxs(draw.inst, mesh.geo, &numJoints) : nullptr;
+
+        // Instanced: World matrices of the instances go to i_data0..i_data3
+        // Transient instance buffer may not have room for all, rest are drawn in the next loop
+        // Skinned geometries are never instanced, draws in the run may or may not be animated
+        uint32_t numInsts = (instancing && !geo.skel && count > 1) ? driver->getAvailInstanceDataBuffer(count, stride) : 0;
+        if (numInsts > 1) {
+            const InstanceDataBuffer* idb = driver->allocInstanceDataBuffer(numInsts, stride);
+            mtx4x4_t* instMtxs = (mtx4x4_t*)idb->data;
+            for (uint32_t k = 0; k < numInsts; k++)
+                instMtxs[k] = getGeoTransform(geo, mtxs[cmds[i + k].node]);
+            driver->setInstanceDataBuffer(idb, numInsts);
+
+            if (stateCallback)
+                stateCallback(driver, &model->m, submesh.mtl, userData);
+            driver->submit(viewId, instProg, 0, false);
+
+            stats->numBatches++;
+            stats->numVerts += geo.numVerts*numInsts;
+            stats->numIndices += submesh.numIndices*numInsts;
+            stats->transientBytes += idb->size;
+            numSubmits++;
+            i += numInsts;
+            continue;
+        }
+
+        // Single: Skinned geometries get a matrix for each joint (skinMtx*world)
+        if (skinMtxs) {
+            GpuTransform xform;
+            uint32_t cache = driver->allocTransform(&xform, uint16_t(numJoints));
+            mtx4x4_t* jointMtxs = (mtx4x4_t*)xform.data;
+            for (int k = 0; k < numJoints; k++)
+                jointMtxs[k] = getGeoTransform(geo, skinMtxs[k] * draw.worldMtx);
+            driver->setTransformCached(cache, uint16_t(numJoints));
+        } else {
+            mtx4x4_t mtx = getGeoTransform(geo, mtxs[cmd.node]);
+            driver->setTransform(&mtx, 1);
+        }
+
+        if (stateCallback)
+            stateCallback(driver, &model->m, submesh.mtl, userData);
+        driver->submit(viewId, prog, 0, false);
+
+        stats->numVerts += geo.numVerts;
+        stats->numIndices += submesh.numIndices;
+        numSubmits++;
+        i++;
+    }
+    stats->numSubmits += numSubmits;
+
+    BX_FREE(tmpAlloc, cmds);
+    BX_ALIGNED_FREE(tmpAlloc, mtxs, 16);
+    return numSubmits;
+}
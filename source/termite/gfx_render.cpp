@@ -0,0 +1,464 @@
+#include "pch.h"
+#include "gfx_render.h"
+#include "gfx_driver.h"
+
+#include "bx/string.h"
+#include "bxx/array.h"
+
+#define MAX_PASS_READS 8
+#define MAX_PASS_WRITES 4
+#define POOL_FB_MAX_IDLE_FRAMES 30
+
+using namespace termite;
+
+struct GraphPass
+{
+    char name[32];
+    RenderPassCallback callback;
+    int dataOffset;             // Offset into graph's data buffer, -1 if no data
+    uint8_t numViews;
+    bool sideEffect;
+    int refCount;
+    int numReads;
+    int numWrites;
+    uint16_t reads[MAX_PASS_READS];
+    uint16_t writes[MAX_PASS_WRITES];
+};
+
+struct GraphResource
+{
+    char name[32];
+    RenderTargetDesc desc;
+    bool imported;
+    FrameBufferHandle fb;       // Imported fb, or pooled fb during execute
+    int poolIndex;
+    int refCount;
+    int firstPass;
+    int lastPass;
+    uint16_t writerPasses;      // Number of passes that write to the resource
+};
+
+struct PooledFrameBuffer
+{
+    FrameBufferHandle fb;
+    RenderTargetDesc desc;
+    bool inUse;
+    uint32_t lastFrame;
+};
+
+namespace termite
+{
+    struct RenderGraph
+    {
+        bx::AllocatorI* alloc;
+        GfxDriverApi* driver;
+        uint8_t firstViewId;
+        uint16_t maxViews;
+        uint32_t frame;
+        RenderGraphResource backbuffer;
+        bx::Array<GraphPass> passes;
+        bx::Array<GraphResource> resources;
+        bx::Array<PooledFrameBuffer> pool;
+        bx::Array<uint8_t> data;
+
+        int numCulled;
+
+        RenderGraph()
+        {
+            alloc = nullptr;
+            driver = nullptr;
+            firstViewId = 0;
+            maxViews = 0;
+            frame = 0;
+            numCulled = 0;
+        }
+    };
+} // namespace termite
+
+static bool isDescEqual(const RenderTargetDesc& a, const RenderTargetDesc& b)
+{
+    return a.width == b.width && a.height == b.height && a.format == b.format && a.flags == b.flags &&
+        (a.width > 0 || a.ratio == b.ratio);
+}
+
+static FrameBufferHandle acquireFrameBuffer(RenderGraph* graph, const RenderTargetDesc& desc, int* poolIndex)
+{
+    for (int i = 0, c = graph->pool.getCount(); i < c; i++) {
+        PooledFrameBuffer& pfb = graph->pool[i];
+        if (!pfb.inUse && isDescEqual(pfb.desc, desc)) {
+            pfb.inUse = true;
+            pfb.lastFrame = graph->frame;
+            *poolIndex = i;
+            return pfb.fb;
+        }
+    }
+
+    GfxDriverApi* driver = graph->driver;
+    FrameBufferHandle fb = desc.width > 0 ?
+        driver->createFrameBuffer(desc.width, desc.height, desc.format, desc.flags) :
+        driver->createFrameBufferRatio(desc.ratio, desc.format, desc.flags);
+    if (!fb.isValid()) {
+        T_ERROR("RenderGraph: Creating framebuffer failed");
+        return fb;
+    }
+
+    PooledFrameBuffer* pfb = graph->pool.push();
+    if (!pfb) {
+        driver->destroyFrameBuffer(fb);
+        return FrameBufferHandle();
+    }
+    pfb->fb = fb;
+    pfb->desc = desc;
+    pfb->inUse = true;
+    pfb->lastFrame = graph->frame;
+    *poolIndex = graph->pool.getCount() - 1;
+    return fb;
+}
+
+RenderGraph* termite::createRenderGraph(bx::AllocatorI* alloc, GfxDriverApi* driver, uint8_t firstViewId,
+                                        uint16_t maxViews)
+{
+    RenderGraph* graph = BX_NEW(alloc, RenderGraph);
+    if (!graph)
+        return nullptr;
+
+    graph->alloc = alloc;
+    graph->driver = driver;
+    graph->firstViewId = firstViewId;
+    graph->maxViews = maxViews;
+
+    if (!graph->passes.create(32, 32, alloc) ||
+        !graph->resources.create(32, 32, alloc) ||
+        !graph->pool.create(16, 16, alloc) ||
+        !graph->data.create(1024, 1024, alloc)) {
+        destroyRenderGraph(graph);
+        return nullptr;
+    }
+
+    graph->backbuffer = importRenderGraphTarget(graph, "Backbuffer", FrameBufferHandle(), 0, 0);
+    return graph;
+}
+
+void termite::destroyRenderGraph(RenderGraph* graph)
+{
+    assert(graph);
+
+    for (int i = 0, c = graph->pool.getCount(); i < c; i++) {
+        if (graph->pool[i].fb.isValid())
+            graph->driver->destroyFrameBuffer(graph->pool[i].fb);
+    }
+
+    graph->pool.destroy();
+    graph->passes.destroy();
+    graph->resources.destroy();
+    graph->data.destroy();
+    BX_DELETE(graph->alloc, graph);
+}
+
+void termite::resetRenderGraph(RenderGraph* graph)
+{
+    assert(graph);
+    graph->passes.clear();
+    graph->resources.clear();
+    graph->data.clear();
+    graph->backbuffer = importRenderGraphTarget(graph, "Backbuffer", FrameBufferHandle(), 0, 0);
+}
+
+static RenderGraphResource addResource(RenderGraph* graph, const char* name, const RenderTargetDesc& desc,
+                                       bool imported, FrameBufferHandle fb)
+{
+    if (graph->resources.getCount() >= UINT16_MAX)
+        return RenderGraphResource();
+
+    GraphResource* res = graph->resources.push();
+    if (!res)
+        return RenderGraphResource();
+    *res = GraphResource();
+    bx::strlcpy(res->name, name, sizeof(res->name));
+    res->desc = desc;
+    res->imported = imported;
+    res->fb = fb;
+    res->poolIndex = -1;
+    res->firstPass = -1;
+    res->lastPass = -1;
+    return RenderGraphResource(uint16_t(graph->resources.getCount() - 1));
+}
+
+RenderGraphResource termite::createRenderGraphTarget(RenderGraph* graph, const char* name,
+                                                     const RenderTargetDesc& desc)
+{
+    assert(graph);
+    return addResource(graph, name, desc, false, FrameBufferHandle());
+}
+
+RenderGraphResource termite::importRenderGraphTarget(RenderGraph* graph, const char* name, FrameBufferHandle fb,
+                                                     uint16_t width, uint16_t height)
+{
+    assert(graph);
+    RenderTargetDesc desc;
+    desc.width = width;
+    desc.height = height;
+    return addResource(graph, name, desc, true, fb);
+}
+
+RenderGraphResource termite::getRenderGraphBackbuffer(RenderGraph* graph)
+{
+    assert(graph);
+    return graph->backbuffer;
+}
+
+RenderPassHandle termite::addRenderPass(RenderGraph* graph, const char* name, RenderPassCallback callback,
+                                        const void* data, uint32_t dataSize, uint8_t numViews)
+{
+    assert(graph);
+    assert(callback);
+    assert(numViews > 0);
+
+    int dataOffset = -1;
+    if (data && dataSize > 0) {
+        // Keep pass data 16 byte aligned within the buffer
+        int offset = BX_ALIGN_16(graph->data.getCount());
+        uint8_t* buff = graph->data.pushMany(int(offset - graph->data.getCount() + dataSize));
+        if (!buff)
+            return RenderPassHandle();
+        memcpy(graph->data.getBuffer() + offset, data, dataSize);
+        dataOffset = offset;
+    }
+
+    GraphPass* pass = graph->passes.push();
+    if (!pass)
+        return RenderPassHandle();
+    *pass = GraphPass();
+    bx::strlcpy(pass->name, name, sizeof(pass->name));
+    pass->callback = callback;
+    pass->dataOffset = dataOffset;
+    pass->numViews = numViews;
+    return RenderPassHandle(uint16_t(graph->passes.getCount() - 1));
+}
+
+void termite::renderPassRead(RenderGraph* graph, RenderPassHandle handle, RenderGraphResource res)
+{
+    assert(graph);
+    assert(handle.isValid());
+    assert(res.isValid());
+
+    GraphPass& pass = graph->passes[handle];
+    if (pass.numReads == MAX_PASS_READS) {
+        BX_WARN("RenderGraph: Too many reads for pass '%s'", pass.name);
+        return;
+    }
+    pass.reads[pass.numReads++] = res;
+}
+
+void termite::renderPassWrite(RenderGraph* graph, RenderPassHandle handle, RenderGraphResource res)
+{
+    assert(graph);
+    assert(handle.isValid());
+    assert(res.isValid());
+
+    GraphPass& pass = graph->passes[handle];
+    if (pass.numWrites == MAX_PASS_WRITES) {
+        BX_WARN("RenderGraph: Too many writes for pass '%s'", pass.name);
+        return;
+    }
+    pass.writes[pass.numWrites++] = res;
+    graph->resources[res].writerPasses++;
+}
+
+void termite::setRenderPassSideEffect(RenderGraph* graph, RenderPassHandle handle)
+{
+    assert(graph);
+    assert(handle.isValid());
+    graph->passes[handle].sideEffect = true;
+}
+
+static void cullPasses(RenderGraph* graph)
+{
+    int numPasses = graph->passes.getCount();
+    int numResources = graph->resources.getCount();
+    GraphPass* passes = graph->passes.getBuffer();
+    GraphResource* resources = graph->resources.getBuffer();
+
+    // A pass is alive if it writes to imported targets, or it's marked, or its outputs are read by live passes
+    // Resources are referenced by the passes that read them, passes are referenced by their outputs
+    for (int i = 0; i < numPasses; i++) {
+        GraphPass& pass = passes[i];
+        pass.refCount = pass.numWrites;
+        for (int r = 0; r < pass.numReads; r++)
+            resources[pass.reads[r]].refCount++;
+    }
+
+    for (int i = 0; i < numResources; i++) {
+        if (resources[i].imported)
+            resources[i].refCount++;
+    }
+
+    // Resources that are not read by anyone, release their writer passes, propagating up the chain
+    // Passes are added in dependency order, so a single reverse walk is enough
+    for (int i = numPasses - 1; i >= 0; i--) {
+        GraphPass& pass = passes[i];
+        if (pass.sideEffect)
+            continue;
+
+        for (int w = 0; w < pass.numWrites; w++) {
+            if (resources[pass.writes[w]].refCount == 0)
+                pass.refCount--;
+        }
+
+        if (pass.refCount == 0) {
+            for (int r = 0; r < pass.numReads; r++)
+                resources[pass.reads[r]].refCount--;
+        }
+    }
+}
+
+void termite::executeRenderGraph(RenderGraph* graph)
+{
+    assert(graph);
+
+    graph->frame++;
+    graph->numCulled = 0;
+
+    cullPasses(graph);
+
+    int numPasses = graph->passes.getCount();
+    GraphPass* passes = graph->passes.getBuffer();
+    GraphResource* resources = graph->resources.getBuffer();
+
+    // Resource lifetimes, within live passes
+    for (int i = 0; i < numPasses; i++) {
+        GraphPass& pass = passes[i];
+        if (pass.refCount == 0 && !pass.sideEffect) {
+            graph->numCulled++;
+            continue;
+        }
+
+        for (int r = 0; r < pass.numReads; r++) {
+            GraphResource& res = resources[pass.reads[r]];
+            if (res.firstPass == -1)
+                res.firstPass = i;
+            res.lastPass = i;
+        }
+        for (int w = 0; w < pass.numWrites; w++) {
+            GraphResource& res = resources[pass.writes[w]];
+            if (res.firstPass == -1)
+                res.firstPass = i;
+            res.lastPass = i;
+        }
+    }
+
+    GfxDriverApi* driver = graph->driver;
+    int viewId = graph->firstViewId;
+    int lastViewId = int(graph->firstViewId) + int(graph->maxViews);
+    for (int i = 0; i < numPasses; i++) {
+        GraphPass& pass = passes[i];
+        if (pass.refCount == 0 && !pass.sideEffect)
+            continue;
+
+        if (viewId + pass.numViews > lastViewId) {
+            BX_WARN("RenderGraph: Out of view Ids, pass '%s' and the ones after it are skipped", pass.name);
+            break;
+        }
+
+        // Acquire transient targets on first use
+        for (int r = 0; r < pass.numReads; r++) {
+            GraphResource& res = resources[pass.reads[r]];
+            if (!res.imported && res.firstPass == i && res.poolIndex == -1)
+                res.fb = acquireFrameBuffer(graph, res.desc, &res.poolIndex);
+        }
+        for (int w = 0; w < pass.numWrites; w++) {
+            GraphResource& res = resources[pass.writes[w]];
+            if (!res.imported && res.firstPass == i && res.poolIndex == -1)
+                res.fb = acquireFrameBuffer(graph, res.desc, &res.poolIndex);
+        }
+
+        // View ids move between passes every frame, and view state persists in the driver
+        // So reset everything a previous owner of the view could have set
+        const GraphResource* target = pass.numWrites > 0 ? &resources[pass.writes[0]] : nullptr;
+        for (int v = 0; v < pass.numViews; v++) {
+            uint8_t id = uint8_t(viewId + v);
+            driver->setViewClear(id, GfxClearFlag::None, 0, 1.0f, 0);
+            driver->setViewSeq(id, false);
+            if (target) {
+                driver->setViewFrameBuffer(id, target->fb);
+                if (target->desc.width > 0)
+                    driver->setViewRect(id, 0, 0, target->desc.width, target->desc.height);
+                else
+                    driver->setViewRectRatio(id, 0, 0, target->desc.ratio);
+            } else {
+                driver->setViewFrameBuffer(id, FrameBufferHandle());
+                driver->setViewRectRatio(id, 0, 0, BackbufferRatio::Equal);
+            }
+        }
+
+        pass.callback(graph, uint8_t(viewId),
+                      pass.dataOffset >= 0 ? graph->data.getBuffer() + pass.dataOffset : nullptr);
+        viewId += pass.numViews;
+
+        // Return transient targets to the pool after their last use, so later targets can alias them
+        // Commands are submitted in view order, so reusing the fb in a later view is safe
+        for (int r = 0; r < pass.numReads; r++) {
+            GraphResource& res = resources[pass.reads[r]];
+            if (!res.imported && res.lastPass == i && res.poolIndex != -1) {
+                graph->pool[res.poolIndex].inUse = false;
+                res.poolIndex = -1;
+            }
+        }
+        for (int w = 0; w < pass.numWrites; w++) {
+            GraphResource& res = resources[pass.writes[w]];
+            if (!res.imported && res.lastPass == i && res.poolIndex != -1) {
+                graph->pool[res.poolIndex].inUse = false;
+                res.poolIndex = -1;
+            }
+        }
+    }
+
+    // Release any remaining targets (skipped passes), and destroy framebuffers that are not used for a while
+    for (int i = 0; i < graph->pool.getCount(); i++) {
+        PooledFrameBuffer& pfb = graph->pool[i];
+        pfb.inUse = false;
+        if (graph->frame - pfb.lastFrame > POOL_FB_MAX_IDLE_FRAMES) {
+            driver->destroyFrameBuffer(pfb.fb);
+            graph->pool[i] = graph->pool[graph->pool.getCount() - 1];
+            graph->pool.pop();
+            i--;
+        }
+    }
+}
+
+FrameBufferHandle termite::getRenderGraphFrameBuffer(RenderGraph* graph, RenderGraphResource res)
+{
+    assert(graph);
+    assert(res.isValid());
+    return graph->resources[res].fb;
+}
+
+TextureHandle termite::getRenderGraphTexture(RenderGraph* graph, RenderGraphResource res)
+{
+    assert(graph);
+    assert(res.isValid());
+
+    FrameBufferHandle fb = graph->resources[res].fb;
+    return fb.isValid() ? graph->driver->getFrameBufferTexture(fb, 0) : TextureHandle();
+}
+
+const RenderTargetDesc& termite::getRenderGraphTargetDesc(RenderGraph* graph, RenderGraphResource res)
+{
+    assert(graph);
+    assert(res.isValid());
+    return graph->resources[res].desc;
+}
+
+void termite::getRenderGraphStats(RenderGraph* graph, int* numPasses, int* numCulled, int* numTargets,
+                                  int* numPooledFbs)
+{
+    assert(graph);
+    if (numPasses)
+        *numPasses = graph->passes.getCount();
+    if (numCulled)
+        *numCulled = graph->numCulled;
+    if (numTargets)
+        *numTargets = graph->resources.getCount();
+    if (numPooledFbs)
+        *numPooledFbs = graph->pool.getCount();
+}
@@ -2,22 +2,31 @@
 #include "gfx_sprite.h"
 #include "gfx_texture.h"
 #include "math_util.h"
+#include "job_dispatcher.h"
 
 #include "bx/readerwriter.h"
+#include "bx/radixsort.h"
+#include "bx/simd_t.h"
 #include "bxx/path.h"
 #include "bxx/array.h"
 #include "bxx/linked_list.h"
 #include "bxx/pool.h"
+#include "bxx/hash_table.h"
 #include "bxx/logger.h"
 
+#include "Remotery.h"
+
 #include "rapidjson/error/en.h"
 #include "rapidjson/document.h"
 #include "bxx/rapidjson_allocator.h"
 
+#include "../include_common/sprite_format.h"
+
 #include T_MAKE_SHADER_PATH(shaders_h, sprite.vso)
 #include T_MAKE_SHADER_PATH(shaders_h, sprite.fso)
 #include T_MAKE_SHADER_PATH(shaders_h, sprite_add.vso)
 #include T_MAKE_SHADER_PATH(shaders_h, sprite_add.fso)
+#include T_MAKE_SHADER_PATH(shaders_h, sprite_inst.vso)
 
 #include <algorithm>
 
@@ -38,6 +47,9 @@ static const uint8_t kSpriteKeyTextureShift = kSpriteKeyIdBits;
     (uint64_t(_Order & kSpriteKeyOrderMask) << kSpriteKeyOrderShift) | (uint64_t(_Texture & kSpriteKeyTextureMask) << kSpriteKeyTextureShift) | uint64_t(_Id & kSpriteKeyIdMask)
 #define SPRITE_KEY_GET_BATCH(_Key) uint32_t((_Key >> kSpriteKeyIdBits) & kSpriteKeyIdMask)
 
+// Maximum quads that can be drawn with the shared 16bit quad index buffer in a single draw call
+static const int kMaxSpriteQuadsPerDraw = 16384;
+
 struct SpriteVertex
 {
     vec2_t pos;
@@ -61,6 +73,33 @@ struct SpriteVertex
 };
 VertexDecl SpriteVertex::Decl;
 
+// Unit quad vertex for instanced sprites, coords selects the corner of the instance's texture rect
+struct SpriteQuadVertex
+{
+    vec2_t pos;
+    vec2_t coords;
+
+    static void init()
+    {
+        vdeclBegin(&Decl);
+        vdeclAdd(&Decl, VertexAttrib::Position, 2, VertexAttribType::Float);
+        vdeclAdd(&Decl, VertexAttrib::TexCoord0, 2, VertexAttribType::Float);
+        vdeclEnd(&Decl);
+    }
+
+    static VertexDecl Decl;
+};
+VertexDecl SpriteQuadVertex::Decl;
+
+// Per-sprite instance data (i_data0..i_data3 in sprite_inst.vsc)
+struct SpriteInstance
+{
+    vec4_t rotScale;        // 2x2 part of the transform matrix (m11, m12, m21, m22)
+    vec4_t posHalfSize;     // xy = world position of the quad center, zw = half size
+    vec4_t texRect;         // Texture coords (xmin, ymin, xmax, ymax), flipped sprites have swapped values
+    vec4_t color;
+};
+
 class SpriteSheetLoader : public ResourceCallbacksI
 {
 public:
@@ -98,6 +137,18 @@ struct SpriteFrame
     }
 };
 
+// Name/Tag hash of a sprite frame, sorted by hash for binary search
+struct SpriteFrameKey
+{
+    size_t hash;
+    int index;
+
+    bool operator<(const SpriteFrameKey& other) const
+    {
+        return hash != other.hash ? hash < other.hash : index < other.index;
+    }
+};
+
 namespace termite
 {
     struct Sprite
@@ -127,6 +178,13 @@ namespace termite
         void* userData;
         bool triggerEndCallback;
 
+        // Frame lookup tables, built on the first name/tag lookup: [0..n) name keys, [n..2n) tag keys
+        SpriteFrameKey* frameKeys;
+        int numKeyedFrames;     // -1 if tables should be rebuilt
+
+        SpriteAnimGroup* animGroup;     // If set, animation timer and frame are advanced by the group
+        int animSlot;
+
         Sprite(bx::AllocatorI* _alloc) :
             alloc(_alloc),
             curFrameIdx(0),
@@ -145,6 +203,10 @@ namespace termite
             posOffset = vec2f(0, 0);
             sizeMultiplier = vec2f(1.0f, 1.0f);
             userData = nullptr;
+            frameKeys = nullptr;
+            numKeyedFrames = -1;
+            animGroup = nullptr;
+            animSlot = -1;
         }
 
         inline const SpriteFrame& getCurFrame() const
@@ -154,6 +216,78 @@ namespace termite
     };
 }
 
+struct SpriteAnimFlag
+{
+    enum Enum
+    {
+        Reverse = 0x1,
+        Clamp = 0x2,            // Sprite has end callback, so frames are clamped instead of wrapped
+        FrameCallbacks = 0x4,   // Some of the frames have callbacks
+        TriggerEnd = 0x8        // End callback is called on the next frame advance
+    };
+
+    typedef uint8_t Bits;
+};
+
+// Callbacks and frame changes are collected during the animation pass and applied afterwards
+struct SpriteAnimEvent
+{
+    Sprite* sprite;
+    int prevFrameIdx;
+    int frameIdx;
+    bool callEnd;
+    bool triggerEnd;
+};
+
+namespace termite
+{
+    // SoA animation state, arrays are aligned and padded to 4 for SIMD
+    struct SpriteAnimGroup
+    {
+        bx::AllocatorI* alloc;
+        int maxSprites;
+        int numSprites;
+        Sprite** sprites;
+        float* animTms;
+        float* speeds;          // 0 if paused or sprite has no frames
+        int* curFrames;
+        int* numFrames;
+        SpriteAnimFlag::Bits* flags;
+        SpriteAnimEvent* events;    // Each sprite produces one event at most, jobs write to their own range
+        int numEvents;              // Events waiting for callbacks, compacted after the jobs are done
+        int curEvent;               // Event that is being processed, events of the sprites removed in callbacks are cleared
+    };
+}
+
+// Copies animation state of the sprite to it's group, should be called when sprite's anim properties change
+static void syncSpriteAnim(Sprite* sprite)
+{
+    SpriteAnimGroup* group = sprite->animGroup;
+    if (!group)
+        return;
+
+    int slot = sprite->animSlot;
+    int numFrames = sprite->frames.getCount();
+    SpriteAnimFlag::Bits flags = 0;
+    if (sprite->playReverse)
+        flags |= SpriteAnimFlag::Reverse;
+    if (sprite->endCallback)
+        flags |= SpriteAnimFlag::Clamp;
+    if (sprite->triggerEndCallback)
+        flags |= SpriteAnimFlag::TriggerEnd;
+    for (int i = 0; i < numFrames; i++) {
+        if (sprite->frames[i].frameCallback) {
+            flags |= SpriteAnimFlag::FrameCallbacks;
+            break;
+        }
+    }
+
+    group->speeds[slot] = (numFrames > 0 && !bx::fequal(sprite->playSpeed, 0, 0.00001f)) ? sprite->playSpeed : 0;
+    group->curFrames[slot] = sprite->curFrameIdx;
+    group->numFrames[slot] = numFrames;
+    group->flags[slot] = flags;
+}
+
 struct SpriteSheetFrame
 {
     size_t filenameHash;
@@ -168,13 +302,17 @@ struct SpriteSheetFrame
 
 struct SpriteSheet
 {
+    typedef bx::HashTable<int, size_t> FrameTable;
+
     ResourceHandle texHandle;
     int numFrames;
     SpriteSheetFrame* frames;
+    FrameTable frameTable;      // filenameHash -> index to frames, immutable and built on load
 
     SpriteSheet() :
         numFrames(0),
-        frames(nullptr)
+        frames(nullptr),
+        frameTable(bx::HashTableType::Immutable)
     {
     }
 };
@@ -185,7 +323,11 @@ struct SpriteSystem
     bx::AllocatorI* alloc;
     ProgramHandle spriteProg;
     ProgramHandle spriteAddProg;
+    ProgramHandle spriteInstProg;       // Instanced variants, invalid if instancing is not supported
+    ProgramHandle spriteInstAddProg;
     UniformHandle u_texture;
+    IndexBufferHandle quadIb;           // Static quad indices (0, 1, 2, 2, 1, 3, ...) for kMaxSpriteQuadsPerDraw quads
+    VertexBufferHandle quadVb;          // Unit quad for instanced sprites
     SpriteSheetLoader loader;
     SpriteSheet* failSheet;
     SpriteSheet* asyncSheet;
@@ -202,25 +344,140 @@ struct SpriteSystem
 
 static SpriteSystem* g_spriteSys = nullptr;
 
-static const SpriteSheetFrame* findSpritesheetFrame(const SpriteSheet* sheet, size_t nameHash)
+// Allocates spritesheet, frames and the frame hash table in a single buffer
+static SpriteSheet* createSpriteSheet(int numFrames, bx::AllocatorI* alloc)
+{
+    size_t tableSz = SpriteSheet::FrameTable::GetImmutableSizeBytes(numFrames);
+    size_t totalSz = sizeof(SpriteSheet) + numFrames*sizeof(SpriteSheetFrame) + tableSz;
+    uint8_t* buff = (uint8_t*)BX_ALLOC(alloc, totalSz);
+    if (!buff) {
+        T_ERROR("Out of Memory");
+        return nullptr;
+    }
+    SpriteSheet* ss = new(buff) SpriteSheet();  buff += sizeof(SpriteSheet);
+    ss->frames = (SpriteSheetFrame*)buff;       buff += numFrames*sizeof(SpriteSheetFrame);
+    ss->numFrames = numFrames;
+    ss->frameTable.createWithBuffer(numFrames, buff);
+    return ss;
+}
+
+// Should be called after frames are filled
+static void buildSpriteSheetFrameTable(SpriteSheet* sheet)
 {
-    SpriteSheetFrame* sheetFrame = nullptr;
     for (int i = 0, c = sheet->numFrames; i < c; i++) {
-        if (sheet->frames[i].filenameHash != nameHash)
-            continue;
-        sheetFrame = &sheet->frames[i];
-        break;
+        size_t nameHash = sheet->frames[i].filenameHash;
+        if (nameHash && sheet->frameTable.find(nameHash) == -1)
+            sheet->frameTable.add(nameHash, i);
     }
+}
+
+static const SpriteSheetFrame* findSpritesheetFrame(const SpriteSheet* sheet, size_t nameHash)
+{
+    int index = sheet->frameTable.find(nameHash);
+    return index != -1 ? &sheet->frames[sheet->frameTable[index]] : nullptr;
+}
+
+static ResourceHandle loadSpriteSheetTexture(const char* filepath, const ResourceTypeParams& params,
+                                             bx::AllocatorI* alloc)
+{
+    const LoadSpriteSheetParams* ssParams = (const LoadSpriteSheetParams*)params.userParams;
 
-    return sheetFrame;
+    LoadTextureParams texParams;
+    texParams.flags = ssParams->flags;
+    texParams.generateMips = ssParams->generateMips;
+    texParams.skipMips = ssParams->skipMips;
+    texParams.fmt = ssParams->fmt;
+    return loadResource("texture", filepath, &texParams, params.flags, alloc ? alloc : nullptr);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // SpriteSheetLoader
-bool SpriteSheetLoader::loadObj(const MemoryBlock* mem, const ResourceTypeParams& params, uintptr_t* obj, 
+// Binary format (.tsheet) written by sheetmaker, see sprite_format.h
+static bool loadSpriteSheetBinary(const MemoryBlock* mem, const ResourceTypeParams& params, uintptr_t* obj,
+                                  bx::AllocatorI* alloc)
+{
+    bx::Error err;
+    bx::MemoryReader reader(mem->data, mem->size);
+
+    tsHeader header;
+    reader.read(&header, sizeof(header), &err);
+    if (!err.isOk() || header.sign != TSPRITE_SIGN) {
+        T_ERROR("Load spritesheet failed: Invalid header");
+        return false;
+    }
+
+    size_t spriteSize;
+    switch (header.version) {
+    case TSPRITE_VERSION_10:
+        spriteSize = sizeof(tsSprite10);
+        break;
+    case TSPRITE_VERSION_11:
+        spriteSize = sizeof(tsSprite);
+        break;
+    default:
+        T_ERROR("Load spritesheet failed: Invalid version: 0x%x", header.version);
+        return false;
+    }
+
+    int numFrames = header.numSprites;
+    if (numFrames <= 0)
+        return false;
+    if (mem->size < sizeof(header) + spriteSize*numFrames) {
+        T_ERROR("Load spritesheet failed: Invalid file size");
+        return false;
+    }
+
+    SpriteSheet* ss = createSpriteSheet(numFrames, alloc ? alloc : g_spriteSys->alloc);
+    if (!ss)
+        return false;
+
+    header.textureFilepath[sizeof(header.textureFilepath) - 1] = 0;
+    ss->texHandle = loadSpriteSheetTexture(header.textureFilepath, params, alloc);
+
+    const uint8_t* sprites = mem->data + sizeof(header);
+    if (header.version == TSPRITE_VERSION_11) {
+        const tsSprite* tsprites = (const tsSprite*)sprites;
+        for (int i = 0; i < numFrames; i++) {
+            const tsSprite& tsprite = tsprites[i];
+            SpriteSheetFrame& frame = ss->frames[i];
+            frame.filenameHash = size_t(tsprite.nameHash);
+            frame.frame = rectf(tsprite.tx0, tsprite.ty0, tsprite.tx1, tsprite.ty1);
+            frame.pivot = vec2f(tsprite.pivot[0], tsprite.pivot[1]);
+            frame.sourceSize = vec2f(tsprite.sourceSize[0], tsprite.sourceSize[1]);
+            frame.posOffset = vec2f(tsprite.posOffset[0], tsprite.posOffset[1]);
+            frame.sizeOffset = vec2f(tsprite.sizeOffset[0], tsprite.sizeOffset[1]);
+            frame.rotOffset = tsprite.rotOffset;
+            frame.pixelRatio = tsprite.pixelRatio;
+        }
+    } else {
+        // 1.0 only has texture coords, frames are untrimmed and named by their tag hash
+        Texture* tex = getResourcePtr<Texture>(ss->texHandle);
+        float imgWidth = tex ? float(tex->info.width) : 1.0f;
+        float imgHeight = tex ? float(tex->info.height) : 1.0f;
+        const tsSprite10* tsprites = (const tsSprite10*)sprites;
+        for (int i = 0; i < numFrames; i++) {
+            const tsSprite10& tsprite = tsprites[i];
+            SpriteSheetFrame& frame = ss->frames[i];
+            frame.filenameHash = size_t(tsprite.tag);
+            frame.frame = rectf(tsprite.tx0, tsprite.ty0, tsprite.tx1, tsprite.ty1);
+            frame.pivot = vec2f(0, 0);
+            frame.sourceSize = vec2f((tsprite.tx1 - tsprite.tx0)*imgWidth, (tsprite.ty1 - tsprite.ty0)*imgHeight);
+            frame.posOffset = vec2f(0, 0);
+            frame.sizeOffset = vec2f(1.0f, 1.0f);
+            frame.rotOffset = 0;
+            frame.pixelRatio = frame.sourceSize.y > 0 ? frame.sourceSize.x / frame.sourceSize.y : 1.0f;
+        }
+    }
+    buildSpriteSheetFrameTable(ss);
+
+    *obj = uintptr_t(ss);
+    return true;
+}
+
+// TexturePacker Json format
+static bool loadSpriteSheetJson(const MemoryBlock* mem, const ResourceTypeParams& params, uintptr_t* obj,
                                 bx::AllocatorI* alloc)
 {
-    const LoadSpriteSheetParams* ssParams = (const LoadSpriteSheetParams*)params.userParams;
 
     bx::AllocatorI* tmpAlloc = getTempAlloc();
     char* jsonStr = (char*)BX_ALLOC(tmpAlloc, mem->size + 1);
@@ -254,15 +511,9 @@ bool SpriteSheetLoader::loadObj(const MemoryBlock* mem, const ResourceTypeParams
         return false;
 
     // Create sprite sheet
-    size_t totalSz = sizeof(SpriteSheet) + numFrames*sizeof(SpriteSheetFrame);
-    uint8_t* buff = (uint8_t*)BX_ALLOC(alloc ? alloc : g_spriteSys->alloc, totalSz);
-    if (!buff) {
-        T_ERROR("Out of Memory");
+    SpriteSheet* ss = createSpriteSheet(numFrames, alloc ? alloc : g_spriteSys->alloc);
+    if (!ss)
         return false;
-    }
-    SpriteSheet* ss = new(buff) SpriteSheet();  buff += sizeof(SpriteSheet);
-    ss->frames = (SpriteSheetFrame*)buff;
-    ss->numFrames = numFrames;
 
     // image width/height
     const BxValue& jsize = jmeta["size"];
@@ -274,12 +525,7 @@ bool SpriteSheetLoader::loadObj(const MemoryBlock* mem, const ResourceTypeParams
     bx::Path texFilepath = bx::Path(params.uri).getDirectory();
     texFilepath.joinUnix(imageFile);
 
-    LoadTextureParams texParams;
-    texParams.flags = ssParams->flags;
-    texParams.generateMips = ssParams->generateMips;
-    texParams.skipMips = ssParams->skipMips;
-    texParams.fmt = ssParams->fmt;
-    ss->texHandle = loadResource("texture", texFilepath.cstr(), &texParams, params.flags, alloc ? alloc : nullptr);
+    ss->texHandle = loadSpriteSheetTexture(texFilepath.cstr(), params, alloc);
 
     for (int i = 0; i < numFrames; i++) {
         SpriteSheetFrame& frame = ss->frames[i];
@@ -331,12 +577,22 @@ bool SpriteSheetLoader::loadObj(const MemoryBlock* mem, const ResourceTypeParams
         vec2_t srcOffset = vec2f((srcx + srcw*0.5f)/frame.sourceSize.x - 0.5f, -(srcy + srch*0.5f)/frame.sourceSize.y + 0.5f);
         frame.posOffset = srcOffset;
     }
+    buildSpriteSheetFrameTable(ss);
 
     *obj = uintptr_t(ss);
 
     return true;
 }
 
+bool SpriteSheetLoader::loadObj(const MemoryBlock* mem, const ResourceTypeParams& params, uintptr_t* obj, 
+                                bx::AllocatorI* alloc)
+{
+    if (bx::Path(params.uri).getFileExt().isEqualNoCase("tsheet"))
+        return loadSpriteSheetBinary(mem, params, obj, alloc);
+    else
+        return loadSpriteSheetJson(mem, params, obj, alloc);
+}
+
 void SpriteSheetLoader::unloadObj(uintptr_t obj, bx::AllocatorI* alloc)
 {
     assert(g_spriteSys);
@@ -347,6 +603,7 @@ void SpriteSheetLoader::unloadObj(uintptr_t obj, bx::AllocatorI* alloc)
         unloadResource(sheet->texHandle);
         sheet->texHandle.reset();
     }
+    sheet->frameTable.destroy();
     
     BX_FREE(alloc ? alloc : g_spriteSys->alloc, sheet);
 }
@@ -394,15 +651,9 @@ void SpriteSheetLoader::onReload(ResourceHandle handle, bx::AllocatorI* alloc)
 static SpriteSheet* createDummySpriteSheet(ResourceHandle texHandle, bx::AllocatorI* alloc)
 {
     // Create sprite sheet
-    size_t totalSz = sizeof(SpriteSheet) + sizeof(SpriteSheetFrame);
-    uint8_t* buff = (uint8_t*)BX_ALLOC(alloc, totalSz);
-    if (!buff) {
-        T_ERROR("Out of Memory");
+    SpriteSheet* ss = createSpriteSheet(1, alloc);
+    if (!ss)
         return nullptr;
-    }
-    SpriteSheet* ss = new(buff) SpriteSheet();  buff += sizeof(SpriteSheet);
-    ss->frames = (SpriteSheetFrame*)buff;
-    ss->numFrames = 1;
 
     ss->texHandle = getResourceFailHandle("texture");
     assert(ss->texHandle.isValid());
@@ -437,6 +688,7 @@ result_t termite::initSpriteSystem(GfxDriverApi* driver, bx::AllocatorI* alloc)
     g_spriteSys->driver = driver;
 
     SpriteVertex::init();
+    SpriteQuadVertex::init();
 
     g_spriteSys->spriteProg = 
         driver->createProgram(driver->createShader(driver->makeRef(sprite_vso, sizeof(sprite_vso), nullptr, nullptr)),
@@ -454,6 +706,52 @@ result_t termite::initSpriteSystem(GfxDriverApi* driver, bx::AllocatorI* alloc)
 
     g_spriteSys->u_texture = driver->createUniform("u_texture", UniformType::Int1, 1);
 
+    // Quad index buffer, shared by all sprite draws
+    const GfxMemory* ibMem = driver->alloc(sizeof(uint16_t)*kMaxSpriteQuadsPerDraw*6);
+    uint16_t* indices = (uint16_t*)ibMem->data;
+    for (int i = 0; i < kMaxSpriteQuadsPerDraw; i++) {
+        uint16_t v = uint16_t(i*4);
+        indices[0] = v;         indices[1] = v + 1;     indices[2] = v + 2;
+        indices[3] = v + 2;     indices[4] = v + 1;     indices[5] = v + 3;
+        indices += 6;
+    }
+    g_spriteSys->quadIb = driver->createIndexBuffer(ibMem, GpuBufferFlag::None);
+    if (!g_spriteSys->quadIb.isValid())
+        return T_ERR_FAILED;
+
+    // Instanced sprites, share fragment shaders with normal sprite programs
+    if (driver->getCaps().supported & GpuCapsFlag::Instancing) {
+        static const SpriteQuadVertex quadVerts[] = {
+            { vec2f(-1.0f, 1.0f), vec2f(0, 0) },
+            { vec2f(1.0f, 1.0f), vec2f(1.0f, 0) },
+            { vec2f(-1.0f, -1.0f), vec2f(0, 1.0f) },
+            { vec2f(1.0f, -1.0f), vec2f(1.0f, 1.0f) }
+        };
+        g_spriteSys->quadVb = driver->createVertexBuffer(driver->makeRef(quadVerts, sizeof(quadVerts), nullptr, nullptr),
+                                                         SpriteQuadVertex::Decl, GpuBufferFlag::None);
+        g_spriteSys->spriteInstProg =
+            driver->createProgram(driver->createShader(driver->makeRef(sprite_inst_vso, sizeof(sprite_inst_vso), nullptr, nullptr)),
+                                  driver->createShader(driver->makeRef(sprite_fso, sizeof(sprite_fso), nullptr, nullptr)),
+                                  true);
+        g_spriteSys->spriteInstAddProg =
+            driver->createProgram(driver->createShader(driver->makeRef(sprite_inst_vso, sizeof(sprite_inst_vso), nullptr, nullptr)),
+                                  driver->createShader(driver->makeRef(sprite_add_fso, sizeof(sprite_add_fso), nullptr, nullptr)),
+                                  true);
+
+        // Instancing is optional, fallback to vertex path on failure
+        if (!g_spriteSys->quadVb.isValid() || !g_spriteSys->spriteInstProg.isValid() || 
+            !g_spriteSys->spriteInstAddProg.isValid()) 
+        {
+            BX_WARN("Creating instanced sprite programs failed, instancing is disabled for sprites");
+            if (g_spriteSys->spriteInstProg.isValid())
+                driver->destroyProgram(g_spriteSys->spriteInstProg);
+            if (g_spriteSys->spriteInstAddProg.isValid())
+                driver->destroyProgram(g_spriteSys->spriteInstAddProg);
+            g_spriteSys->spriteInstProg.reset();
+            g_spriteSys->spriteInstAddProg.reset();
+        }
+    }
+
     // Create fail spritesheet
     g_spriteSys->failSheet = createDummySpriteSheet(getResourceFailHandle("texture"), g_spriteSys->alloc);    
     g_spriteSys->asyncSheet = createDummySpriteSheet(getResourceAsyncHandle("texture"), g_spriteSys->alloc);
@@ -494,6 +792,10 @@ void termite::destroySprite(Sprite* sprite)
         }
     }
     sprite->frames.destroy();
+    if (sprite->frameKeys)
+        BX_FREE(sprite->alloc, sprite->frameKeys);
+    if (sprite->animGroup)
+        removeSpriteFromAnimGroup(sprite);
 
     // Remove from list
     g_spriteSys->spriteList.remove(&sprite->lnode);
@@ -516,6 +818,14 @@ void termite::shutdownSpriteSystem()
 
     if (g_spriteSys->u_texture.isValid())
         driver->destroyUniform(g_spriteSys->u_texture);
+    if (g_spriteSys->spriteInstProg.isValid())
+        driver->destroyProgram(g_spriteSys->spriteInstProg);
+    if (g_spriteSys->spriteInstAddProg.isValid())
+        driver->destroyProgram(g_spriteSys->spriteInstAddProg);
+    if (g_spriteSys->quadIb.isValid())
+        driver->destroyIndexBuffer(g_spriteSys->quadIb);
+    if (g_spriteSys->quadVb.isValid())
+        driver->destroyVertexBuffer(g_spriteSys->quadVb);
 
     // Move through the remaining sprites and unload their resources
     Sprite::LNode* node = g_spriteSys->spriteList.getFirst();
@@ -558,6 +868,7 @@ void termite::addSpriteFrameTexture(Sprite* sprite,
             frame->pixelRatio = ((bottomRightCoords.x - topLeftCoords.x)*frame->sourceSize.x) /
                 ((bottomRightCoords.y - topLeftCoords.y)*frame->sourceSize.y);
         }
+        syncSpriteAnim(sprite);
     }
 }
 
@@ -604,6 +915,7 @@ void termite::addSpriteFrameSpritesheet(Sprite* sprite,
                 frame->pixelRatio = 1.0f;
             }
         }
+        syncSpriteAnim(sprite);
     }
 }
 
@@ -631,6 +943,7 @@ void termite::addSpriteFrameAll(Sprite* sprite, ResourceHandle ssHandle, SpriteF
             frame->rotOffset = sheetFrame.rotOffset;
             frame->pixelRatio = sheetFrame.pixelRatio;
         }
+        syncSpriteAnim(sprite);
     }
 }
 
@@ -686,11 +999,13 @@ void termite::animateSprites(Sprite** sprites, uint16_t numSprites, float dt)
 void termite::invertSpriteAnim(Sprite* sprite)
 {
     sprite->playReverse = !sprite->playReverse;
+    syncSpriteAnim(sprite);
 }
 
 void termite::setSpriteAnimSpeed(Sprite* sprite, float speed)
 {
     sprite->playSpeed = sprite->resumeSpeed = speed;
+    syncSpriteAnim(sprite);
 }
 
 float termite::getSpriteAnimSpeed(Sprite* sprite)
@@ -701,11 +1016,13 @@ float termite::getSpriteAnimSpeed(Sprite* sprite)
 void termite::pauseSpriteAnim(Sprite* sprite)
 {
     sprite->playSpeed = 0;
+    syncSpriteAnim(sprite);
 }
 
 void termite::resumeSpriteAnim(Sprite* sprite)
 {
     sprite->playSpeed = sprite->resumeSpeed;
+    syncSpriteAnim(sprite);
 }
 
 void termite::stopSpriteAnim(Sprite* sprite)
@@ -713,6 +1030,7 @@ void termite::stopSpriteAnim(Sprite* sprite)
     sprite->triggerEndCallback = false;
     sprite->curFrameIdx = 0;
     sprite->playSpeed = 0;
+    syncSpriteAnim(sprite);
 }
 
 void termite::replaySpriteAnim(Sprite* sprite)
@@ -720,31 +1038,354 @@ void termite::replaySpriteAnim(Sprite* sprite)
     sprite->triggerEndCallback = false;
     sprite->curFrameIdx = 0;
     sprite->playSpeed = sprite->resumeSpeed;
+    syncSpriteAnim(sprite);
 }
 
-void termite::setSpriteFrameCallbackByTag(Sprite* sprite, const char* frameTag, SpriteFrameCallback callback, void* userData)
+SpriteAnimGroup* termite::createSpriteAnimGroup(int maxSprites, bx::AllocatorI* alloc)
 {
-    assert(frameTag);
-    size_t frameTagHash = tinystl::hash_string(frameTag, strlen(frameTag));
-    for (int i = 0, c = sprite->frames.getCount(); i < c; i++) {
-        if (sprite->frames[i].tagHash != frameTagHash)
-            continue;
-        SpriteFrame* frame = sprite->frames.itemPtr(i);
-        frame->frameCallback = callback;
-        frame->frameCallbackUserData = userData;
+    assert(maxSprites > 0);
+    int maxAligned = (maxSprites + 3) & ~3;
+
+    size_t totalSz = BX_ALIGN_16(sizeof(SpriteAnimGroup)) + 
+        maxAligned*(sizeof(float)*2 + sizeof(int)*2 + sizeof(Sprite*) + sizeof(SpriteAnimFlag::Bits) + 
+                    sizeof(SpriteAnimEvent));
+    uint8_t* buff = (uint8_t*)BX_ALIGNED_ALLOC(alloc, totalSz, 16);
+    if (!buff) {
+        T_ERROR("Out of Memory");
+        return nullptr;
     }
+    memset(buff, 0x00, totalSz);
+
+    SpriteAnimGroup* group = (SpriteAnimGroup*)buff;
+    buff += BX_ALIGN_16(sizeof(SpriteAnimGroup));
+    group->alloc = alloc;
+    group->maxSprites = maxSprites;
+    group->numSprites = 0;
+    group->numEvents = 0;
+    group->curEvent = 0;
+    // SIMD streams first, so they stay 16 byte aligned
+    group->animTms = (float*)buff;          buff += sizeof(float)*maxAligned;
+    group->speeds = (float*)buff;           buff += sizeof(float)*maxAligned;
+    group->curFrames = (int*)buff;          buff += sizeof(int)*maxAligned;
+    group->numFrames = (int*)buff;          buff += sizeof(int)*maxAligned;
+    group->sprites = (Sprite**)buff;        buff += sizeof(Sprite*)*maxAligned;
+    group->events = (SpriteAnimEvent*)buff; buff += sizeof(SpriteAnimEvent)*maxAligned;
+    group->flags = (SpriteAnimFlag::Bits*)buff;
+    return group;
 }
 
-void termite::setSpriteFrameCallbackByName(Sprite* sprite, const char* name, SpriteFrameCallback callback, void* userData)
+void termite::destroySpriteAnimGroup(SpriteAnimGroup* group)
 {
-    size_t nameHash = tinystl::hash_string(name, strlen(name));
-    for (int i = 0, c = sprite->frames.getCount(); i < c; i++) {
-        if (sprite->frames[i].nameHash != nameHash)
+    assert(group);
+    for (int i = 0; i < group->numSprites; i++) {
+        Sprite* sprite = group->sprites[i];
+        sprite->animTm = group->animTms[i];
+        sprite->animGroup = nullptr;
+        sprite->animSlot = -1;
+    }
+    BX_ALIGNED_FREE(group->alloc, group, 16);
+}
+
+bool termite::addSpriteToAnimGroup(SpriteAnimGroup* group, Sprite* sprite)
+{
+    assert(group);
+    if (sprite->animGroup == group)
+        return true;
+    if (group->numSprites == group->maxSprites)
+        return false;
+    if (sprite->animGroup)
+        removeSpriteFromAnimGroup(sprite);
+
+    int slot = group->numSprites++;
+    group->sprites[slot] = sprite;
+    group->animTms[slot] = sprite->animTm;
+    sprite->animGroup = group;
+    sprite->animSlot = slot;
+    syncSpriteAnim(sprite);
+    return true;
+}
+
+void termite::removeSpriteFromAnimGroup(Sprite* sprite)
+{
+    SpriteAnimGroup* group = sprite->animGroup;
+    if (!group)
+        return;
+
+    // Sprites removed (or destroyed) inside callbacks must not receive their pending events
+    for (int i = group->curEvent; i < group->numEvents; i++) {
+        if (group->events[i].sprite == sprite)
+            group->events[i].sprite = nullptr;
+    }
+
+    // Swap with the last one
+    int slot = sprite->animSlot;
+    int last = --group->numSprites;
+    sprite->animTm = group->animTms[slot];
+    if (slot != last) {
+        Sprite* lastSprite = group->sprites[last];
+        group->sprites[slot] = lastSprite;
+        group->animTms[slot] = group->animTms[last];
+        group->speeds[slot] = group->speeds[last];
+        group->curFrames[slot] = group->curFrames[last];
+        group->numFrames[slot] = group->numFrames[last];
+        group->flags[slot] = group->flags[last];
+        lastSprite->animSlot = slot;
+    }
+    group->speeds[last] = 0;    // keep padding lanes inactive
+    sprite->animGroup = nullptr;
+    sprite->animSlot = -1;
+}
+
+struct SpriteAnimJobData
+{
+    SpriteAnimGroup* group;
+    float dt;
+    int start;
+    int count;          // multiple of 4, except the last job
+    int numEvents;      // events are written from events[start]
+};
+
+static void animateSpriteGroupJob(int jobIndex, void* userParam)
+{
+    SpriteAnimJobData* data = (SpriteAnimJobData*)userParam + jobIndex;
+    SpriteAnimGroup* group = data->group;
+    SpriteAnimEvent* events = group->events + data->start;
+    int numEvents = 0;
+
+    const bx::simd128_t dt = bx::simd_splat(data->dt);
+    const bx::simd128_t zero = bx::simd_zero();
+    const bx::simd128_t one = bx::simd_splat(1.0f);
+    const bx::simd128_t epsilon = bx::simd_splat(0.00001f);
+    BX_ALIGN_DECL_16(int iframes[4]);
+
+    for (int i = data->start, end = data->start + data->count; i < end; i += 4) {
+        // Timer advance, same as 'animateSprites': t = fract((t + dt)*speed)/speed
+        bx::simd128_t speed = bx::simd_ld(group->speeds + i);
+        bx::simd128_t t = bx::simd_ld(group->animTms + i);
+        bx::simd128_t active = bx::simd_cmpgt(bx::simd_abs(speed), epsilon);
+        bx::simd128_t safeSpeed = bx::simd_selb(active, speed, one);
+        bx::simd128_t progress = bx::simd_mul(bx::simd_add(t, dt), safeSpeed);
+        bx::simd128_t frames = bx::simd_floor(progress);
+        frames = bx::simd_selb(bx::simd_cmpgt(frames, zero), frames, zero);
+        bx::simd128_t newT = bx::simd_div(bx::simd_sub(progress, frames), safeSpeed);
+        bx::simd_st(group->animTms + i, bx::simd_selb(active, newT, t));
+        bx::simd_st(iframes, bx::simd_and(bx::simd_ftoi(frames), active));
+
+        // Frame advance, only lanes that move or have callbacks produce events
+        for (int k = 0, kc = bx::uint32_min(4, end - i); k < kc; k++) {
+            int index = i + k;
+            int frameAdv = iframes[k];
+            SpriteAnimFlag::Bits flags = group->flags[index];
+            if (group->speeds[index] == 0)
+                continue;
+
+            // Keep the sprite's own timer valid, each job owns the sprites of it's range
+            group->sprites[index]->animTm = group->animTms[index];
+            if (frameAdv == 0 && !(flags & SpriteAnimFlag::FrameCallbacks))
+                continue;
+
+            int curFrameIdx = group->curFrames[index];
+            int lastFrameIdx = group->numFrames[index] - 1;
+            int nextFrame = !(flags & SpriteAnimFlag::Reverse) ? (curFrameIdx + frameAdv) : (curFrameIdx - frameAdv);
+            int frameIdx;
+            bool callEnd = false;
+            bool triggerEnd = false;
+            if (!(flags & SpriteAnimFlag::Clamp)) {
+                frameIdx = iwrap(nextFrame, 0, lastFrameIdx);
+            } else {
+                if ((flags & SpriteAnimFlag::TriggerEnd) && frameAdv > 0) {
+                    flags &= ~SpriteAnimFlag::TriggerEnd;
+                    callEnd = true;
+                }
+                frameIdx = iclamp(nextFrame, 0, lastFrameIdx);
+                if (frameIdx != nextFrame) {
+                    flags |= SpriteAnimFlag::TriggerEnd;
+                    triggerEnd = true;
+                }
+            }
+            group->flags[index] = flags;
+            group->curFrames[index] = frameIdx;
+
+            if (frameIdx != curFrameIdx || callEnd || triggerEnd || (flags & SpriteAnimFlag::FrameCallbacks)) {
+                SpriteAnimEvent& e = events[numEvents++];
+                e.sprite = group->sprites[index];
+                e.prevFrameIdx = curFrameIdx;
+                e.frameIdx = frameIdx;
+                e.callEnd = callEnd;
+                e.triggerEnd = triggerEnd;
+            }
+        }
+    }
+
+    data->numEvents = numEvents;
+}
+
+static void processSpriteAnimEvents(SpriteAnimGroup* group)
+{
+    // Callbacks can remove or destroy sprites of the group, which clears their events, so recheck after each call
+    const SpriteAnimEvent* events = group->events;
+    for (group->curEvent = 0; group->curEvent < group->numEvents; group->curEvent++) {
+        const SpriteAnimEvent& e = events[group->curEvent];
+        Sprite* sprite = e.sprite;
+        if (!sprite)
             continue;
-        SpriteFrame* frame = sprite->frames.itemPtr(i);
+
+        if (e.callEnd) {
+            sprite->triggerEndCallback = false;
+            sprite->endCallback(sprite, e.prevFrameIdx, sprite->endUserData);
+            if (!e.sprite)
+                continue;
+        }
+        if (e.triggerEnd)
+            sprite->triggerEndCallback = true;
+
+        const SpriteFrame& frame = sprite->frames[e.frameIdx];
+        if (frame.frameCallback) {
+            frame.frameCallback(sprite, e.frameIdx, frame.frameCallbackUserData);
+            if (!e.sprite)
+                continue;
+        }
+
+        // Update the frame index only if it's not modified inside any callbacks
+        if (sprite->curFrameIdx == e.prevFrameIdx) {
+            sprite->curFrameIdx = e.frameIdx;
+            if (sprite->animGroup)
+                sprite->animGroup->curFrames[sprite->animSlot] = e.frameIdx;
+        }
+    }
+
+    group->numEvents = 0;
+    group->curEvent = 0;
+}
+
+void termite::animateSpriteGroup(SpriteAnimGroup* group, float dt)
+{
+    static const int kMinSpritesPerJob = 4096;
+    static const int kMaxJobs = 32;
+
+    int numSprites = group->numSprites;
+    if (numSprites == 0)
+        return;
+
+    SpriteAnimJobData jobData[kMaxJobs];
+    int numJobs = bx::uint32_min(bx::uint32_min(getNumWorkerThreads() + 1, numSprites / kMinSpritesPerJob), kMaxJobs);
+    bool dispatched = false;
+    if (numJobs > 1) {
+        int countPerJob = (numSprites / numJobs) & ~3;
+        for (int i = 0; i < numJobs; i++) {
+            SpriteAnimJobData& data = jobData[i];
+            data.group = group;
+            data.dt = dt;
+            data.start = i*countPerJob;
+            data.count = i < numJobs - 1 ? countPerJob : (numSprites - data.start);
+            data.numEvents = 0;
+        }
+
+        JobDesc jobs[kMaxJobs];
+        for (int i = 0; i < numJobs; i++)
+            jobs[i] = JobDesc(animateSpriteGroupJob, jobData, JobPriority::High);
+        JobHandle handle = dispatchSmallJobs(jobs, uint16_t(numJobs));
+        if (handle) {
+            waitJobs(handle);
+            dispatched = true;
+        }
+    }
+
+    if (!dispatched) {
+        numJobs = 1;
+        SpriteAnimJobData& data = jobData[0];
+        data.group = group;
+        data.dt = dt;
+        data.start = 0;
+        data.count = numSprites;
+        data.numEvents = 0;
+        animateSpriteGroupJob(0, jobData);
+    }
+
+    // Callbacks are called on the caller thread, in sprite order
+    int numEvents = 0;
+    for (int i = 0; i < numJobs; i++) {
+        if (jobData[i].start != numEvents) {
+            memmove(group->events + numEvents, group->events + jobData[i].start, 
+                    sizeof(SpriteAnimEvent)*jobData[i].numEvents);
+        }
+        numEvents += jobData[i].numEvents;
+    }
+    group->numEvents = numEvents;
+    processSpriteAnimEvents(group);
+}
+
+// Finds the frames with the name (or tag) hash, returns the number of frames found
+// Keys of the found frames are written to 'pFirst', sorted by frame index
+static int findSpriteFrames(Sprite* sprite, size_t hash, bool tag, const SpriteFrameKey** pFirst)
+{
+    int numFrames = sprite->frames.getCount();
+    if (sprite->numKeyedFrames != numFrames) {
+        SpriteFrameKey* keys = (SpriteFrameKey*)BX_REALLOC(sprite->alloc, sprite->frameKeys, 
+                                                           sizeof(SpriteFrameKey)*numFrames*2);
+        if (!keys)
+            return 0;
+        for (int i = 0; i < numFrames; i++) {
+            const SpriteFrame& frame = sprite->frames[i];
+            keys[i].hash = frame.nameHash;
+            keys[i].index = i;
+            keys[numFrames + i].hash = frame.tagHash;
+            keys[numFrames + i].index = i;
+        }
+        std::sort(keys, keys + numFrames);
+        std::sort(keys + numFrames, keys + numFrames*2);
+        sprite->frameKeys = keys;
+        sprite->numKeyedFrames = numFrames;
+    }
+
+    const SpriteFrameKey* keys = sprite->frameKeys + (tag ? numFrames : 0);
+    SpriteFrameKey key;
+    key.hash = hash;
+    key.index = -1;
+    const SpriteFrameKey* first = std::lower_bound(keys, keys + numFrames, key);
+    const SpriteFrameKey* last = first;
+    while (last != keys + numFrames && last->hash == hash)
+        last++;
+
+    *pFirst = first;
+    return int(last - first);
+}
+
+// Finds the first frame with the name (or tag) hash, starting from 'startIdx' and wrapping around
+static int findSpriteFrameFrom(Sprite* sprite, size_t hash, bool tag, int startIdx)
+{
+    const SpriteFrameKey* keys;
+    int count = findSpriteFrames(sprite, hash, tag, &keys);
+    if (count == 0)
+        return -1;
+    for (int i = 0; i < count; i++) {
+        if (keys[i].index >= startIdx)
+            return keys[i].index;
+    }
+    return keys[0].index;
+}
+
+static void setSpriteFrameCallbackByHash(Sprite* sprite, size_t hash, bool tag, SpriteFrameCallback callback, 
+                                         void* userData)
+{
+    const SpriteFrameKey* keys;
+    for (int i = 0, c = findSpriteFrames(sprite, hash, tag, &keys); i < c; i++) {
+        SpriteFrame* frame = sprite->frames.itemPtr(keys[i].index);
         frame->frameCallback = callback;
         frame->frameCallbackUserData = userData;
     }
+    syncSpriteAnim(sprite);
+}
+
+void termite::setSpriteFrameCallbackByTag(Sprite* sprite, const char* frameTag, SpriteFrameCallback callback, void* userData)
+{
+    assert(frameTag);
+    setSpriteFrameCallbackByHash(sprite, tinystl::hash_string(frameTag, strlen(frameTag)), true, callback, userData);
+}
+
+void termite::setSpriteFrameCallbackByName(Sprite* sprite, const char* name, SpriteFrameCallback callback, void* userData)
+{
+    setSpriteFrameCallbackByHash(sprite, tinystl::hash_string(name, strlen(name)), false, callback, userData);
 }
 
 void termite::setSpriteFrameCallbackByIndex(Sprite* sprite, int frameIdx, SpriteFrameCallback callback, void* userData)
@@ -753,6 +1394,7 @@ void termite::setSpriteFrameCallbackByIndex(Sprite* sprite, int frameIdx, Sprite
     SpriteFrame* frame = sprite->frames.itemPtr(frameIdx);
     frame->frameCallback = callback;
     frame->frameCallbackUserData = userData;
+    syncSpriteAnim(sprite);
 }
 
 void termite::setSpriteFrameEndCallback(Sprite* sprite, SpriteFrameCallback callback, void* userData)
@@ -760,6 +1402,7 @@ void termite::setSpriteFrameEndCallback(Sprite* sprite, SpriteFrameCallback call
     sprite->endCallback = callback;
     sprite->endUserData = userData;
     sprite->triggerEndCallback = false;
+    syncSpriteAnim(sprite);
 }
 
 void termite::setSpriteHalfSize(Sprite* sprite, const vec2_t& halfSize)
@@ -776,32 +1419,25 @@ void termite::gotoSpriteFrameIndex(Sprite* sprite, int frameIdx)
 {
     assert(frameIdx < sprite->frames.getCount());
     sprite->curFrameIdx = frameIdx;
+    syncSpriteAnim(sprite);
 }
 
 void termite::gotoSpriteFrameName(Sprite* sprite, const char* name)
 {
-    size_t nameHash = tinystl::hash_string(name, strlen(name));
-    int curIdx = sprite->curFrameIdx;
-    for (int i = 0, c = sprite->frames.getCount(); i < c;  i++) {
-        int idx = (i + curIdx) % c;
-        if (sprite->frames[idx].nameHash == nameHash) {
-            sprite->curFrameIdx = idx;
-            return;
-        }
+    int idx = findSpriteFrameFrom(sprite, tinystl::hash_string(name, strlen(name)), false, sprite->curFrameIdx);
+    if (idx != -1) {
+        sprite->curFrameIdx = idx;
+        syncSpriteAnim(sprite);
     }
 }
 
 void termite::gotoSpriteFrameTag(Sprite* sprite, const char* frameTag)
 {
     assert(frameTag);
-    size_t tagHash = tinystl::hash_string(frameTag, strlen(frameTag));
-    int curIdx = sprite->curFrameIdx;
-    for (int i = 0, c = sprite->frames.getCount(); i < c; i++) {
-        int idx = (i + curIdx) % c;
-        if (sprite->frames[idx].tagHash == tagHash) {
-            sprite->curFrameIdx = idx;
-            return;
-        }
+    int idx = findSpriteFrameFrom(sprite, tinystl::hash_string(frameTag, strlen(frameTag)), true, sprite->curFrameIdx);
+    if (idx != -1) {
+        sprite->curFrameIdx = idx;
+        syncSpriteAnim(sprite);
     }
 }
 
@@ -819,6 +1455,7 @@ void termite::setSpriteFrameIndex(Sprite* sprite, int index)
 {
     assert(index < sprite->frames.getCount());
     sprite->curFrameIdx = index;
+    syncSpriteAnim(sprite);
 }
 
 void termite::setSpriteFlip(Sprite* sprite, SpriteFlag::Bits flip)
@@ -845,6 +1482,7 @@ void termite::setSpriteCurFrameTag(Sprite* sprite, const char* frameTag)
 {
     SpriteFrame& frame = sprite->frames[sprite->curFrameIdx];
     frame.tagHash = tinystl::hash_string(frameTag, strlen(frameTag));
+    sprite->numKeyedFrames = -1;
 }
 
 void termite::setSpriteOrder(Sprite* sprite, uint8_t order)
@@ -979,169 +1617,420 @@ void termite::convertSpritePhysicsVerts(vec2_t* ptsOut, const vec2_t* ptsIn, int
     }
 }
 
-void termite::drawSprites(uint8_t viewId, Sprite** sprites, uint16_t numSprites, const mtx3x3_t* mats,
-                          ProgramHandle progOverride /*= ProgramHandle()*/, SetSpriteStateCallback stateCallback /*= nullptr*/,
-                          void* stateUserData)
+// Calculates the quad of the sprite's current frame in sprite's local space
+static void calcSpriteQuad(const Sprite* sprite, vec2_t* pHalfSize, vec2_t* pOffset, SpriteFlag::Bits* pFlip)
 {
-    assert(sprites);
-    assert(mats);
+    const SpriteFrame& frame = sprite->getCurFrame();
+    vec2_t halfSize = sprite->halfSize;
+    float pixelRatio = frame.pixelRatio;
+    SpriteFlag::Bits flip = sprite->flip | frame.flags;
 
-    if (numSprites <= 0)
-        return;
+    if (halfSize.y <= 0)
+        halfSize.y = halfSize.x / pixelRatio;
+    else if (halfSize.x <= 0)
+        halfSize.x = halfSize.y * pixelRatio;
+    halfSize = halfSize * sprite->sizeMultiplier;
+
+    // calculate final pivot offset to make geometry
+    vec2_t fullSize = halfSize * 2.0f;
+    vec2_t offset = frame.posOffset + sprite->posOffset - frame.pivot;
+    if (flip & SpriteFlip::FlipX)
+        offset.x = -offset.x;
+    if (flip & SpriteFlip::FlipY)
+        offset.y = -offset.y;
+
+    // shrink and offset to match the image inside sprite
+    *pHalfSize = halfSize * frame.sizeOffset;
+    *pOffset = offset * fullSize;
+    *pFlip = flip;
+}
+
+// Fills 4 vertices of the sprite's current frame, transform matrix is encoded into vertices
+static void fillSpriteQuad(SpriteVertex* verts, const Sprite* sprite, const mtx3x3_t& mat)
+{
+    vec2_t halfSize, offset;
+    SpriteFlag::Bits flip;
+    calcSpriteQuad(sprite, &halfSize, &offset, &flip);
+    rect_t texRect = sprite->getCurFrame().frame;
+
+    // Encode transform matrix into vertices
+    vec3_t transform1 = vec3f(mat.m11, mat.m12, mat.m21);
+    vec3_t transform2 = vec3f(mat.m22, mat.m31, mat.m32);
+
+    SpriteVertex& v0 = verts[0];
+    SpriteVertex& v1 = verts[1];
+    SpriteVertex& v2 = verts[2];
+    SpriteVertex& v3 = verts[3];
+
+    // Top-Left
+    v0.pos = vec2f(-halfSize.x, halfSize.y) + offset;
+    v0.coords = vec2f(texRect.xmin, texRect.ymin);
+
+    // Top-Right
+    v1.pos = vec2f(halfSize.x, halfSize.y) + offset;
+    v1.coords = vec2f(texRect.xmax, texRect.ymin);
+
+    // Bottom-Left
+    v2.pos = vec2f(-halfSize.x, -halfSize.y) + offset;
+    v2.coords = vec2f(texRect.xmin, texRect.ymax);
+
+    // Bottom-Right
+    v3.pos = vec2f(halfSize.x, -halfSize.y) + offset;
+    v3.coords = vec2f(texRect.xmax, texRect.ymax);
+
+    v0.transform1 = v1.transform1 = v2.transform1 = v3.transform1 = transform1;
+    v0.transform2 = v1.transform2 = v2.transform2 = v3.transform2 = transform2;
+    v0.color = v1.color = v2.color = v3.color = sprite->tint.n;
+
+    if (flip & SpriteFlip::FlipX) {
+        std::swap<float>(v0.coords.x, v1.coords.x);
+        std::swap<float>(v2.coords.x, v3.coords.x);
+    }
+
+    if (flip & SpriteFlip::FlipY) {
+        std::swap<float>(v0.coords.y, v2.coords.y);
+        std::swap<float>(v1.coords.y, v3.coords.y);
+    }
+}
+
+// Fills the instance record of the sprite's current frame, quad center is pre-transformed on CPU
+static void fillSpriteInstance(SpriteInstance* inst, const Sprite* sprite, const mtx3x3_t& mat)
+{
+    vec2_t halfSize, offset;
+    SpriteFlag::Bits flip;
+    calcSpriteQuad(sprite, &halfSize, &offset, &flip);
+    rect_t texRect = sprite->getCurFrame().frame;
+
+    if (flip & SpriteFlip::FlipX)
+        std::swap<float>(texRect.xmin, texRect.xmax);
+    if (flip & SpriteFlip::FlipY)
+        std::swap<float>(texRect.ymin, texRect.ymax);
+
+    inst->rotScale = vec4f(mat.m11, mat.m12, mat.m21, mat.m22);
+    inst->posHalfSize = vec4f(offset.x*mat.m11 + offset.y*mat.m21 + mat.m31,
+                              offset.x*mat.m12 + offset.y*mat.m22 + mat.m32,
+                              halfSize.x, halfSize.y);
+    inst->texRect = vec4f(texRect.xmin, texRect.ymin, texRect.xmax, texRect.ymax);
+    inst->color = colorToVec4(sprite->tint);
+}
+
+// Returns the instanced variant of the sprite program, or invalid handle if instancing is not possible
+static ProgramHandle getSpriteInstanceProgram(ProgramHandle prog)
+{
+    if (prog == g_spriteSys->spriteProg)
+        return g_spriteSys->spriteInstProg;
+    else if (prog == g_spriteSys->spriteAddProg)
+        return g_spriteSys->spriteInstAddProg;
+    else
+        return ProgramHandle();
+}
+
+struct SpriteBatch
+{
+    int index;
+    int count;
+    ResourceHandle texHandle;
+};
+
+// Quad generation is split between worker threads, each job fills a disjoint range of the sorted sprites
+struct SpriteFillJobData
+{
+    Sprite** sprites;
+    const mtx3x3_t* mats;
+    const uint32_t* sortedIndices;
+    void* dest;         // SpriteVertex (4 per sprite) or SpriteInstance (1 per sprite) array
+    bool instanced;
+    int start;
+    int count;
+};
+
+static void fillSpritesJob(int jobIndex, void* userParam)
+{
+    const SpriteFillJobData* data = (const SpriteFillJobData*)userParam + jobIndex;
+    Sprite** sprites = data->sprites;
+    const mtx3x3_t* mats = data->mats;
+    const uint32_t* sortedIndices = data->sortedIndices;
+
+    if (!data->instanced) {
+        SpriteVertex* verts = (SpriteVertex*)data->dest;
+        for (int i = data->start, end = data->start + data->count; i < end; i++) {
+            uint32_t index = sortedIndices[i];
+            fillSpriteQuad(&verts[i*4], sprites[index], mats[index]);
+        }
+    } else {
+        SpriteInstance* instances = (SpriteInstance*)data->dest;
+        for (int i = data->start, end = data->start + data->count; i < end; i++) {
+            uint32_t index = sortedIndices[i];
+            fillSpriteInstance(&instances[i], sprites[index], mats[index]);
+        }
+    }
+}
+
+static void fillSprites(Sprite** sprites, const mtx3x3_t* mats, const uint32_t* sortedIndices, int numSprites,
+                        void* dest, bool instanced)
+{
+    static const int kMinSpritesPerJob = 1024;
+    static const int kMaxJobs = 32;
+
+    SpriteFillJobData jobData[kMaxJobs];
+    int numJobs = bx::uint32_min(bx::uint32_min(getNumWorkerThreads() + 1, numSprites / kMinSpritesPerJob), kMaxJobs);
+    if (numJobs > 1) {
+        int countPerJob = numSprites / numJobs;
+        for (int i = 0; i < numJobs; i++) {
+            SpriteFillJobData& data = jobData[i];
+            data.sprites = sprites;
+            data.mats = mats;
+            data.sortedIndices = sortedIndices;
+            data.dest = dest;
+            data.instanced = instanced;
+            data.start = i*countPerJob;
+            data.count = i < numJobs - 1 ? countPerJob : (numSprites - data.start);
+        }
 
+        // userParam of all jobs point to the start of data array, jobs pick their own range by jobIndex
+        JobDesc jobs[kMaxJobs];
+        for (int i = 0; i < numJobs; i++)
+            jobs[i] = JobDesc(fillSpritesJob, jobData, JobPriority::High);
+        JobHandle handle = dispatchSmallJobs(jobs, uint16_t(numJobs));
+        if (handle) {
+            waitJobs(handle);
+            return;
+        }
+    }
+
+    // Serial
+    SpriteFillJobData& data = jobData[0];
+    data.sprites = sprites;
+    data.mats = mats;
+    data.sortedIndices = sortedIndices;
+    data.dest = dest;
+    data.instanced = instanced;
+    data.start = 0;
+    data.count = numSprites;
+    fillSpritesJob(0, jobData);
+}
+
+static bool drawSpritesInstanced(uint8_t viewId, Sprite** sprites, const mtx3x3_t* mats, const uint32_t* sortedIndices, 
+                                 int numSprites, const SpriteBatch* batches, int numBatches, ProgramHandle prog,
+                                 SetSpriteStateCallback stateCallback, void* stateUserData)
+{
     GfxDriverApi* driver = g_spriteSys->driver;
-    bx::AllocatorI* tmpAlloc = getTempAlloc();
+    const uint16_t stride = sizeof(SpriteInstance);
+    if (driver->getAvailInstanceDataBuffer(numSprites, stride) != uint32_t(numSprites))
+        return false;
+    const InstanceDataBuffer* idb = driver->allocInstanceDataBuffer(numSprites, stride);
+    if (!idb)
+        return false;
+
+    fillSprites(sprites, mats, sortedIndices, numSprites, idb->data, true);
+
+    GfxSubsystemStats* stats = getGfxSubsystemFrameStats(GfxSubsystem::Sprite);
+    stats->numVerts += numSprites;
+    stats->transientBytes += idb->size;
+    stats->numBatches += numBatches;
+    stats->numSubmits += numBatches;
 
-    TransientVertexBuffer tvb;
-    TransientIndexBuffer tib;
-    const int numVerts = numSprites * 4;
-    const int numIndices = numSprites * 6;
     GfxState::Bits baseState = gfxStateBlendAlpha() | GfxState::RGBWrite | GfxState::AlphaWrite | GfxState::CullCCW;
+    for (int i = 0; i < numBatches; i++) {
+        const SpriteBatch batch = batches[i];
 
-    if (driver->getAvailTransientVertexBuffer(numVerts, SpriteVertex::Decl) != numVerts)
-        return;
-    driver->allocTransientVertexBuffer(&tvb, numVerts, SpriteVertex::Decl);
+        // Point to the batch's range of instances
+        InstanceDataBuffer batchIdb = *idb;
+        batchIdb.data += batch.index*stride;
+        batchIdb.offset += batch.index*stride;
+        batchIdb.size = batch.count*stride;
+        batchIdb.num = batch.count;
 
-    if (driver->getAvailTransientIndexBuffer(numIndices) != numIndices)
-        return;
-    driver->allocTransientIndexBuffer(&tib, numIndices);
+        driver->setState(baseState, 0);
+        driver->setVertexBuffer(g_spriteSys->quadVb);
+        driver->setIndexBuffer(g_spriteSys->quadIb, 0, 6);
+        driver->setInstanceDataBuffer(&batchIdb, batch.count);
+        if (batch.texHandle.isValid()) {
+            driver->setTexture(0, g_spriteSys->u_texture, getResourcePtr<Texture>(batch.texHandle)->handle,
+                               TextureFlag::FromTexture);
+        }
 
-    // Sort sprites by texture and batch them
-    struct SortedSprite
-    {
-        int index;
-        Sprite* sprite;
-        uint64_t key;
-    };
+        if (stateCallback) {
+            stateCallback(driver, stateUserData);
+        }
+        driver->submit(viewId, prog, 0, false);
+    }
 
-    SortedSprite* sortedSprites = (SortedSprite*)BX_ALLOC(tmpAlloc, sizeof(SortedSprite)*numSprites);
-    for (int i = 0; i < numSprites; i++) {
-        const SpriteFrame& frame = sprites[i]->getCurFrame();
-        sortedSprites[i].index = i;
-        sortedSprites[i].sprite = sprites[i];
-        sortedSprites[i].key = MAKE_SPRITE_KEY(sprites[i]->order, frame.texHandle.value, sprites[i]->id);
+    return true;
+}
+
+// Culls sprites against the view rect, writes the indices of visible sprites and returns their count
+// Local quads are gathered into SoA arrays, then world AABBs are calculated and tested 4 sprites at a time
+static int cullSprites(Sprite** sprites, const mtx3x3_t* mats, int numSprites, const rect_t& viewRect,
+                       uint32_t* visibleIndices)
+{
+    using namespace bx;
+
+    bx::AllocatorI* tmpAlloc = getTempAlloc();
+    const int numAligned = (numSprites + 3) & ~3;
+    const int numStreams = 10;
+    float* buff = (float*)BX_ALIGNED_ALLOC(tmpAlloc, sizeof(float)*numAligned*numStreams, 16);
+    if (!buff) {
+        for (int i = 0; i < numSprites; i++)
+            visibleIndices[i] = uint32_t(i);
+        return numSprites;
     }
-    std::sort(sortedSprites, sortedSprites + numSprites, [](const SortedSprite& a, const SortedSprite&b)->bool {
-        return a.key < b.key;
-    });
+    memset(buff, 0x00, sizeof(float)*numAligned*numStreams);
+
+    float* ox = buff;       float* oy = ox + numAligned;
+    float* hx = oy + numAligned;    float* hy = hx + numAligned;
+    float* m11 = hy + numAligned;   float* m12 = m11 + numAligned;
+    float* m21 = m12 + numAligned;  float* m22 = m21 + numAligned;
+    float* m31 = m22 + numAligned;  float* m32 = m31 + numAligned;
 
-    // Fill sprite quads
-    SpriteVertex* verts = (SpriteVertex*)tvb.data;
-    uint16_t* indices = (uint16_t*)tib.data;
-    int indexIdx = 0;
-    int vertexIdx = 0;
     for (int i = 0; i < numSprites; i++) {
-        const SortedSprite& ss = sortedSprites[i];
-        const mtx3x3_t& mat = mats[ss.index];
-        const SpriteFrame& frame = ss.sprite->getCurFrame();
-        vec2_t halfSize = ss.sprite->halfSize;
-        rect_t texRect = frame.frame;
-        float pixelRatio = frame.pixelRatio;
-        SpriteFlag::Bits flipX = ss.sprite->flip | frame.flags;
-        SpriteFlag::Bits flipY = ss.sprite->flip | frame.flags;
-
-        if (halfSize.y <= 0)
-            halfSize.y = halfSize.x / pixelRatio;
-        else if (halfSize.x <= 0)
-            halfSize.x = halfSize.y * pixelRatio;
-        halfSize = halfSize * ss.sprite->sizeMultiplier;
-
-        // calculate final pivot offset to make geometry
-        vec2_t fullSize = halfSize * 2.0f;
-        vec2_t offset = frame.posOffset + ss.sprite->posOffset - frame.pivot;
-        if (flipX & SpriteFlip::FlipX)
-            offset.x = -offset.x;
-        if (flipY & SpriteFlip::FlipY)
-            offset.y = -offset.y;
-
-        // shrink and offset to match the image inside sprite
-        halfSize = halfSize * frame.sizeOffset;
-        offset = offset * fullSize;
-
-        // Encode transform matrix into vertices
-        vec3_t transform1 = vec3f(mat.m11, mat.m12, mat.m21);
-        vec3_t transform2 = vec3f(mat.m22, mat.m31, mat.m32);
-
-        SpriteVertex& v0 = verts[vertexIdx];
-        SpriteVertex& v1 = verts[vertexIdx + 1];
-        SpriteVertex& v2 = verts[vertexIdx + 2];
-        SpriteVertex& v3 = verts[vertexIdx + 3];
-
-        // Top-Left
-        v0.pos = vec2f(-halfSize.x, halfSize.y) + offset;
-        v0.coords = vec2f(texRect.xmin, texRect.ymin);
-
-        // Top-Right
-        v1.pos = vec2f(halfSize.x, halfSize.y) + offset;
-        v1.coords = vec2f(texRect.xmax, texRect.ymin);
-
-        // Bottom-Left
-        v2.pos = vec2f(-halfSize.x, -halfSize.y) + offset;
-        v2.coords = vec2f(texRect.xmin, texRect.ymax);
-
-        // Bottom-Right
-        v3.pos = vec2f(halfSize.x, -halfSize.y) + offset;
-        v3.coords = vec2f(texRect.xmax, texRect.ymax);
-
-        v0.transform1 = v1.transform1 = v2.transform1 = v3.transform1 = transform1;
-        v0.transform2 = v1.transform2 = v2.transform2 = v3.transform2 = transform2;
-        v0.color = v1.color = v2.color = v3.color = ss.sprite->tint.n;
-
-        if (flipX & SpriteFlip::FlipX) {
-            std::swap<float>(v0.coords.x, v1.coords.x);
-            std::swap<float>(v2.coords.x, v3.coords.x);
-        }
+        vec2_t halfSize, offset;
+        SpriteFlag::Bits flip;
+        calcSpriteQuad(sprites[i], &halfSize, &offset, &flip);
+        const mtx3x3_t& mat = mats[i];
+        ox[i] = offset.x;   oy[i] = offset.y;
+        hx[i] = halfSize.x; hy[i] = halfSize.y;
+        m11[i] = mat.m11;   m12[i] = mat.m12;
+        m21[i] = mat.m21;   m22[i] = mat.m22;
+        m31[i] = mat.m31;   m32[i] = mat.m32;
+    }
 
-        if (flipY & SpriteFlip::FlipY) {
-            std::swap<float>(v0.coords.y, v2.coords.y);
-            std::swap<float>(v1.coords.y, v3.coords.y);
+    const simd128_t vxmin = simd_splat(viewRect.xmin);
+    const simd128_t vymin = simd_splat(viewRect.ymin);
+    const simd128_t vxmax = simd_splat(viewRect.xmax);
+    const simd128_t vymax = simd_splat(viewRect.ymax);
+    BX_ALIGN_DECL_16(uint32_t) mask[4];
+    int numVisible = 0;
+
+    for (int i = 0; i < numAligned; i += 4) {
+        const simd128_t _ox = simd_ld(&ox[i]);
+        const simd128_t _oy = simd_ld(&oy[i]);
+        const simd128_t _hx = simd_ld(&hx[i]);
+        const simd128_t _hy = simd_ld(&hy[i]);
+        const simd128_t _m11 = simd_ld(&m11[i]);
+        const simd128_t _m12 = simd_ld(&m12[i]);
+        const simd128_t _m21 = simd_ld(&m21[i]);
+        const simd128_t _m22 = simd_ld(&m22[i]);
+
+        // World center = mat * localCenter, world extents = abs(mat) * halfSize
+        const simd128_t cx = simd_madd(_ox, _m11, simd_madd(_oy, _m21, simd_ld(&m31[i])));
+        const simd128_t cy = simd_madd(_ox, _m12, simd_madd(_oy, _m22, simd_ld(&m32[i])));
+        const simd128_t ex = simd_madd(_hx, simd_abs(_m11), simd_mul(_hy, simd_abs(_m21)));
+        const simd128_t ey = simd_madd(_hx, simd_abs(_m12), simd_mul(_hy, simd_abs(_m22)));
+
+        const simd128_t inx = simd_and(simd_cmple(simd_sub(cx, ex), vxmax), simd_cmpge(simd_add(cx, ex), vxmin));
+        const simd128_t iny = simd_and(simd_cmple(simd_sub(cy, ey), vymax), simd_cmpge(simd_add(cy, ey), vymin));
+        simd_st(mask, simd_and(inx, iny));
+
+        for (int k = 0, c = bx::uint32_min(4, numSprites - i); k < c; k++) {
+            if (mask[k])
+                visibleIndices[numVisible++] = uint32_t(i + k);
         }
+    }
+
+    BX_ALIGNED_FREE(tmpAlloc, buff, 16);
+    return numVisible;
+}
 
-        // Make a quad from 4 verts
-        indices[indexIdx] = vertexIdx;
-        indices[indexIdx + 1] = vertexIdx + 1;
-        indices[indexIdx + 2] = vertexIdx + 2;
-        indices[indexIdx + 3] = vertexIdx + 2;
-        indices[indexIdx + 4] = vertexIdx + 1;
-        indices[indexIdx + 5] = vertexIdx + 3;
+void termite::drawSprites(uint8_t viewId, Sprite** sprites, uint16_t numSprites, const mtx3x3_t* mats,
+                          ProgramHandle progOverride /*= ProgramHandle()*/, SetSpriteStateCallback stateCallback /*= nullptr*/,
+                          void* stateUserData, const rect_t* viewRect)
+{
+    assert(sprites);
+    assert(mats);
 
-        indexIdx += 6;
-        vertexIdx += 4;
+    if (numSprites <= 0)
+        return;
+
+    rmt_ScopedCPUSample(Sprite_Draw, 0);
+    GfxDriverApi* driver = g_spriteSys->driver;
+    bx::AllocatorI* tmpAlloc = getTempAlloc();
+
+    // Sort sprites by order/texture keys, values are indices to the input sprites
+    uint8_t* buff = (uint8_t*)BX_ALLOC(tmpAlloc, (2*sizeof(uint64_t) + 2*sizeof(uint32_t))*numSprites);
+    if (!buff)
+        return;
+    uint64_t* keys = (uint64_t*)buff;               buff += sizeof(uint64_t)*numSprites;
+    uint64_t* tempKeys = (uint64_t*)buff;           buff += sizeof(uint64_t)*numSprites;
+    uint32_t* sortedIndices = (uint32_t*)buff;      buff += sizeof(uint32_t)*numSprites;
+    uint32_t* tempIndices = (uint32_t*)buff;
+
+    // Cull the sprites that are outside the view rect, so only visible sprites are sorted and filled
+    int numVisible = numSprites;
+    if (viewRect) {
+        numVisible = cullSprites(sprites, mats, numSprites, *viewRect, sortedIndices);
+        if (numVisible == 0) {
+            BX_FREE(tmpAlloc, keys);
+            return;
+        }
+    } else {
+        for (int i = 0; i < numSprites; i++)
+            sortedIndices[i] = uint32_t(i);
     }
 
-    // Batch by texture
-    struct Batch
-    {
-        int index;
-        int count;
-    };
-    bx::Array<Batch> batches;
+    for (int i = 0; i < numVisible; i++) {
+        const Sprite* sprite = sprites[sortedIndices[i]];
+        keys[i] = MAKE_SPRITE_KEY(sprite->order, sprite->getCurFrame().texHandle.value, sprite->id);
+    }
+    bx::radixSort(keys, tempKeys, sortedIndices, tempIndices, numVisible);
+
+    // Batch by texture, batches are also limited to the size of shared quad index buffer
+    bx::Array<SpriteBatch> batches;
     batches.create(32, 64, tmpAlloc);
 
     uint32_t prevKey = UINT32_MAX;
-    Batch* curBatch = nullptr;
-    for (int i = 0; i < numSprites; i++) {
-        uint32_t batchKey = SPRITE_KEY_GET_BATCH(sortedSprites[i].key);
-        if (batchKey != prevKey) {
+    SpriteBatch* curBatch = nullptr;
+    for (int i = 0; i < numVisible; i++) {
+        uint32_t batchKey = SPRITE_KEY_GET_BATCH(keys[i]);
+        if (batchKey != prevKey || curBatch->count == kMaxSpriteQuadsPerDraw) {
             curBatch = batches.push();
             curBatch->index = i;
             curBatch->count = 0;
+            curBatch->texHandle = sprites[sortedIndices[i]]->getCurFrame().texHandle;
             prevKey = batchKey;
         }
         curBatch->count++;
     }
 
-    // Draw
+    // Instanced path: One unit quad per batch and a compact instance record per sprite
+    // Falls back to the vertex path for custom programs, or if instancing is not supported
     ProgramHandle prog = !progOverride.isValid() ? g_spriteSys->spriteProg : progOverride;
+    ProgramHandle instProg = getSpriteInstanceProgram(prog);
+    if (instProg.isValid() && 
+        drawSpritesInstanced(viewId, sprites, mats, sortedIndices, numVisible, batches.getBuffer(), batches.getCount(),
+                             instProg, stateCallback, stateUserData))
+    {
+        batches.destroy();
+        return;
+    }
+
+    // Vertex path: Quads are drawn with the shared quad index buffer, batch's first vertex is the base vertex
+    TransientVertexBuffer tvb;
+    const int numVerts = numVisible * 4;
+    GfxState::Bits baseState = gfxStateBlendAlpha() | GfxState::RGBWrite | GfxState::AlphaWrite | GfxState::CullCCW;
+
+    GfxSubsystemStats* stats = getGfxSubsystemFrameStats(GfxSubsystem::Sprite);
+    if (driver->getAvailTransientVertexBuffer(numVerts, SpriteVertex::Decl) != numVerts) {
+        stats->numDropped++;
+        batches.destroy();
+        return;
+    }
+    driver->allocTransientVertexBuffer(&tvb, numVerts, SpriteVertex::Decl);
+
+    fillSprites(sprites, mats, sortedIndices, numVisible, tvb.data, false);
+    stats->numVerts += numVerts;
+    stats->transientBytes += tvb.size;
+    stats->numBatches += batches.getCount();
+    stats->numSubmits += batches.getCount();
+
+    // Draw
     for (int i = 0, c = batches.getCount(); i < c; i++) {
-        const Batch batch = batches[i];
+        const SpriteBatch batch = batches[i];
         driver->setState(baseState, 0);
-        driver->setTransientVertexBufferI(&tvb, 0, batch.count*4);
-        driver->setTransientIndexBufferI(&tib, batch.index*6, batch.count*6);
-        Sprite* sprite = sortedSprites[batch.index].sprite;
-        ResourceHandle texHandle = sprite->getCurFrame().texHandle;
-        if (texHandle.isValid()) {
-            driver->setTexture(0, g_spriteSys->u_texture, getResourcePtr<Texture>(texHandle)->handle, 
+        driver->setTransientVertexBufferI(&tvb, batch.index*4, batch.count*4);
+        driver->setIndexBuffer(g_spriteSys->quadIb, 0, batch.count*6);
+        if (batch.texHandle.isValid()) {
+            driver->setTexture(0, g_spriteSys->u_texture, getResourcePtr<Texture>(batch.texHandle)->handle, 
                                TextureFlag::FromTexture);
         }
 
@@ -1154,6 +2043,307 @@ void termite::drawSprites(uint8_t viewId, Sprite** sprites, uint16_t numSprites,
     batches.destroy();
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SpriteCache
+// Sprites with single frame go to a static vertex buffer, animated ones to a dynamic vertex buffer
+// Batches are kept in draw order (order, texture) and reference a range of quads in one of the buffers
+struct SpriteCacheItem
+{
+    Sprite* sprite;
+    mtx3x3_t mat;
+    ResourceHandle texHandle;   // Texture of the batch that the item is in
+    int frameIdx;               // Last frame that is written to the vertex buffer
+    int numFrames;              // Frame count at build time, static/dynamic classification depends on it
+    color_t tint;
+    SpriteFlip::Bits flip;
+};
+
+struct SpriteCacheBatch
+{
+    ResourceHandle texHandle;
+    bool dynamic;
+    int index;      // Index of the first quad in vertex buffer
+    int count;      // Number of quads
+};
+
+namespace termite
+{
+    struct SpriteCache
+    {
+        bx::AllocatorI* alloc;
+        int maxSprites;
+        int numSprites;
+        int numDynSprites;
+        SpriteCacheItem* items;     // Sorted: all static items first, then dynamic items
+        SpriteVertex* dynVerts;     // CPU copy of dynamic vertex buffer, for partial updates
+        bx::Array<SpriteCacheBatch> batches;
+
+        VertexBufferHandle staticVb;
+        DynamicVertexBufferHandle dynVb;
+
+        ProgramHandle prog;
+        SetSpriteStateCallback stateCallback;
+        void* stateUserData;
+    };
+}
+
+SpriteCache* termite::createSpriteCache(uint16_t maxSprites)
+{
+    assert(maxSprites > 0);
+    bx::AllocatorI* alloc = g_spriteSys->alloc;
+
+    size_t totalSz = sizeof(SpriteCache) + maxSprites*sizeof(SpriteCacheItem) + maxSprites*4*sizeof(SpriteVertex);
+    uint8_t* buff = (uint8_t*)BX_ALLOC(alloc, totalSz);
+    if (!buff) {
+        T_ERROR("Out of Memory");
+        return nullptr;
+    }
+    SpriteCache* scache = new(buff) SpriteCache();      buff += sizeof(SpriteCache);
+    scache->items = (SpriteCacheItem*)buff;             buff += maxSprites*sizeof(SpriteCacheItem);
+    scache->dynVerts = (SpriteVertex*)buff;
+    scache->alloc = alloc;
+    scache->maxSprites = maxSprites;
+    scache->numSprites = 0;
+    scache->numDynSprites = 0;
+    scache->stateCallback = nullptr;
+    scache->stateUserData = nullptr;
+
+    if (!scache->batches.create(32, 64, alloc)) {
+        BX_FREE(alloc, scache);
+        return nullptr;
+    }
+
+    return scache;
+}
+
+static void releaseSpriteCacheBuffers(SpriteCache* scache)
+{
+    GfxDriverApi* driver = g_spriteSys->driver;
+    if (scache->staticVb.isValid()) {
+        driver->destroyVertexBuffer(scache->staticVb);
+        scache->staticVb.reset();
+    }
+    if (scache->dynVb.isValid()) {
+        driver->destroyDynamicVertexBuffer(scache->dynVb);
+        scache->dynVb.reset();
+    }
+    scache->batches.clear();
+}
+
+void termite::destroySpriteCache(SpriteCache* scache)
+{
+    assert(scache);
+
+    releaseSpriteCacheBuffers(scache);
+    scache->batches.destroy();
+    BX_FREE(scache->alloc, scache);
+}
+
+static inline bool isSpriteCacheItemDynamic(const SpriteCacheItem& item)
+{
+    return item.sprite->frames.getCount() > 1;
+}
+
+// Sorts the items, fills vertex buffers and makes batches
+static void buildSpriteCache(SpriteCache* scache)
+{
+    GfxDriverApi* driver = g_spriteSys->driver;
+    releaseSpriteCacheBuffers(scache);
+
+    int numSprites = scache->numSprites;
+    if (numSprites == 0)
+        return;
+
+    // Sort by order and texture, keep static and dynamic sprites apart in each (order, texture) group
+    SpriteCacheItem* items = scache->items;
+    for (int i = 0; i < numSprites; i++) {
+        SpriteCacheItem& item = items[i];
+        item.texHandle = item.sprite->getCurFrame().texHandle;
+        item.frameIdx = item.sprite->curFrameIdx;
+        item.numFrames = item.sprite->frames.getCount();
+        item.tint = item.sprite->tint;
+        item.flip = item.sprite->flip;
+    }
+    std::sort(items, items + numSprites, [](const SpriteCacheItem& a, const SpriteCacheItem& b)->bool {
+        uint32_t dynA = isSpriteCacheItemDynamic(a) ? 1 : 0;
+        uint32_t dynB = isSpriteCacheItemDynamic(b) ? 1 : 0;
+        uint64_t keyA = MAKE_SPRITE_KEY(a.sprite->order, a.texHandle.value, dynA);
+        uint64_t keyB = MAKE_SPRITE_KEY(b.sprite->order, b.texHandle.value, dynB);
+        if (keyA != keyB)
+            return keyA < keyB;
+        return a.sprite->id < b.sprite->id;
+    });
+
+    // Make batches, vertex offsets are counted separately for static and dynamic buffers
+    int numStatic = 0;
+    int numDynamic = 0;
+    uint64_t prevKey = UINT64_MAX;
+    SpriteCacheBatch* curBatch = nullptr;
+    for (int i = 0; i < numSprites; i++) {
+        const SpriteCacheItem& item = items[i];
+        bool dynamic = isSpriteCacheItemDynamic(item);
+        uint32_t dyn = dynamic ? 1 : 0;
+        uint64_t key = MAKE_SPRITE_KEY(item.sprite->order, item.texHandle.value, dyn);
+        if (key != prevKey) {
+            curBatch = scache->batches.push();
+            curBatch->texHandle = item.texHandle;
+            curBatch->dynamic = dynamic;
+            curBatch->index = dynamic ? numDynamic : numStatic;
+            curBatch->count = 0;
+            prevKey = key;
+        }
+        curBatch->count++;
+        if (dynamic)
+            numDynamic++;
+        else
+            numStatic++;
+    }
+
+    // Fill vertices, static quads are uploaded once and dynamic ones are kept for partial updates
+    // Move dynamic items to the end of the array, so updates can index dynamic quads directly
+    bx::AllocatorI* tmpAlloc = getTempAlloc();
+    SpriteCacheItem* sorted = (SpriteCacheItem*)BX_ALLOC(tmpAlloc, sizeof(SpriteCacheItem)*numSprites);
+    if (!sorted)
+        return;
+    memcpy(sorted, items, sizeof(SpriteCacheItem)*numSprites);
+
+    const GfxMemory* staticMem = numStatic > 0 ? driver->alloc(sizeof(SpriteVertex)*numStatic*4) : nullptr;
+    SpriteVertex* staticVerts = staticMem ? (SpriteVertex*)staticMem->data : nullptr;
+    int staticIdx = 0;
+    int dynIdx = 0;
+    for (int i = 0; i < numSprites; i++) {
+        const SpriteCacheItem& item = sorted[i];
+        if (isSpriteCacheItemDynamic(item)) {
+            fillSpriteQuad(&scache->dynVerts[dynIdx*4], item.sprite, item.mat);
+            items[numStatic + dynIdx] = item;
+            dynIdx++;
+        } else {
+            fillSpriteQuad(&staticVerts[staticIdx*4], item.sprite, item.mat);
+            items[staticIdx] = item;
+            staticIdx++;
+        }
+    }
+    BX_FREE(tmpAlloc, sorted);
+
+    if (staticMem)
+        scache->staticVb = driver->createVertexBuffer(staticMem, SpriteVertex::Decl, GpuBufferFlag::None);
+    if (numDynamic > 0) {
+        scache->dynVb = driver->createDynamicVertexBufferMem(
+            driver->copy(scache->dynVerts, sizeof(SpriteVertex)*numDynamic*4), SpriteVertex::Decl, GpuBufferFlag::None);
+    }
+    scache->numDynSprites = numDynamic;
+}
+
+void termite::fillSpriteCache(SpriteCache* scache, Sprite** sprites, uint16_t numSprites, const mtx3x3_t* mats,
+                              ProgramHandle progOverride, SetSpriteStateCallback stateCallback, void* stateUserData)
+{
+    assert(scache);
+    assert(sprites);
+    assert(mats);
+
+    if (numSprites > scache->maxSprites) {
+        BX_WARN("SpriteCache: Number of sprites (%d) exceeds the maximum (%d)", numSprites, scache->maxSprites);
+        numSprites = uint16_t(scache->maxSprites);
+    }
+
+    for (int i = 0; i < numSprites; i++) {
+        SpriteCacheItem& item = scache->items[i];
+        item.sprite = sprites[i];
+        item.mat = mats[i];
+    }
+    scache->numSprites = numSprites;
+    scache->prog = !progOverride.isValid() ? g_spriteSys->spriteProg : progOverride;
+    scache->stateCallback = stateCallback;
+    scache->stateUserData = stateUserData;
+
+    buildSpriteCache(scache);
+}
+
+void termite::updateSpriteCache(SpriteCache* scache)
+{
+    assert(scache);
+
+    // Sprites that got new frames may move between static and dynamic buffers, so rebuild
+    for (int i = 0, c = scache->numSprites; i < c; i++) {
+        const SpriteCacheItem& item = scache->items[i];
+        if (item.sprite->frames.getCount() != item.numFrames) {
+            buildSpriteCache(scache);
+            return;
+        }
+    }
+
+    int numDynamic = scache->numDynSprites;
+    if (numDynamic == 0)
+        return;
+
+    // Rewrite the quads of the sprites that are changed, and upload the dirty range
+    // If any frame is moved to another texture, batches are invalid and the whole cache should be rebuilt
+    SpriteCacheItem* items = scache->items + (scache->numSprites - numDynamic);
+    int dirtyStart = 0;
+    int dirtyEnd = -1;
+    for (int i = 0; i < numDynamic; i++) {
+        SpriteCacheItem& item = items[i];
+        const Sprite* sprite = item.sprite;
+        if (sprite->curFrameIdx == item.frameIdx && sprite->tint.n == item.tint.n && sprite->flip == item.flip)
+            continue;
+
+        if (sprite->getCurFrame().texHandle != item.texHandle) {
+            buildSpriteCache(scache);
+            return;
+        }
+
+        fillSpriteQuad(&scache->dynVerts[i*4], sprite, item.mat);
+        item.frameIdx = sprite->curFrameIdx;
+        item.tint = sprite->tint;
+        item.flip = sprite->flip;
+        if (dirtyEnd < 0)
+            dirtyStart = i;
+        dirtyEnd = i;
+    }
+
+    if (dirtyEnd >= 0) {
+        int count = dirtyEnd - dirtyStart + 1;
+        g_spriteSys->driver->updateDynamicVertexBuffer(scache->dynVb, dirtyStart*4,
+            g_spriteSys->driver->copy(&scache->dynVerts[dirtyStart*4], sizeof(SpriteVertex)*count*4));
+    }
+}
+
+void termite::drawSpriteCache(uint8_t viewId, SpriteCache* scache)
+{
+    assert(scache);
+
+    GfxDriverApi* driver = g_spriteSys->driver;
+    GfxState::Bits baseState = gfxStateBlendAlpha() | GfxState::RGBWrite | GfxState::AlphaWrite | GfxState::CullCCW;
+
+    // Cached vertices live in persistent buffers, so there are no transient bytes to count
+    GfxSubsystemStats* stats = getGfxSubsystemFrameStats(GfxSubsystem::Sprite);
+    stats->numBatches += scache->batches.getCount();
+
+    for (int i = 0, c = scache->batches.getCount(); i < c; i++) {
+        const SpriteCacheBatch& batch = scache->batches[i];
+        Texture* tex = batch.texHandle.isValid() ? getResourcePtr<Texture>(batch.texHandle) : nullptr;
+
+        // Break big batches into draw calls that fit the quad index buffer
+        for (int start = batch.index, end = batch.index + batch.count; start < end; start += kMaxSpriteQuadsPerDraw) {
+            int count = (int)bx::uint32_min(end - start, kMaxSpriteQuadsPerDraw);
+
+            driver->setState(baseState, 0);
+            if (batch.dynamic)
+                driver->setDynamicVertexBuffer(scache->dynVb, start*4, count*4);
+            else
+                driver->setVertexBufferI(scache->staticVb, start*4, count*4);
+            driver->setIndexBuffer(g_spriteSys->quadIb, 0, count*6);
+            if (tex)
+                driver->setTexture(0, g_spriteSys->u_texture, tex->handle, TextureFlag::FromTexture);
+
+            if (scache->stateCallback)
+                scache->stateCallback(driver, scache->stateUserData);
+            driver->submit(viewId, scache->prog, 0, false);
+            stats->numVerts += count*4;
+            stats->numSubmits++;
+        }
+    }
+}
 
 void termite::registerSpriteSheetToResourceLib()
 {
@@ -1166,14 +2356,8 @@ void termite::registerSpriteSheetToResourceLib()
 rect_t termite::getSpriteSheetTextureFrame(ResourceHandle spritesheet, const char* name)
 {
     SpriteSheet* ss = getResourcePtr<SpriteSheet>(spritesheet);
-    size_t filenameHash = tinystl::hash_string(name, strlen(name));
-    for (int i = 0, c = ss->numFrames; i < c; i++) {
-        if (ss->frames[i].filenameHash != filenameHash)
-            continue;
-        
-        return ss->frames[i].frame;
-    }
-    return rectf(0, 0, 1.0f, 1.0f);
+    const SpriteSheetFrame* sheetFrame = findSpritesheetFrame(ss, tinystl::hash_string(name, strlen(name)));
+    return sheetFrame ? sheetFrame->frame : rectf(0, 0, 1.0f, 1.0f);
 }
 
 ResourceHandle termite::getSpriteSheetTexture(ResourceHandle spritesheet)
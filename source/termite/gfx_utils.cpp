@@ -2,6 +2,7 @@
 
 #include "gfx_driver.h"
 #include "gfx_utils.h"
+#include "gfx_render.h"
 #include "io_driver.h"
 
 #include T_MAKE_SHADER_PATH(shaders_h, blit.vso)
@@ -38,7 +39,8 @@ namespace termite
         uint16_t width;
         uint16_t height;
         vec4_t kernel[BLUR_KERNEL_SIZE];
-        FrameBufferHandle fbs[2];
+        TextureFormat::Enum fmt;
+        FrameBufferHandle fbs[2];       // Created on first drawBlurPostProcess or getBlurPostProcessTexture
         TextureHandle textures[2];
         ProgramHandle prog;
         UniformHandle uBlurKernel;
@@ -48,6 +50,7 @@ namespace termite
         {
             width = 0;
             height = 0;
+            fmt = TextureFormat::RGBA8;
         }
     };
 
@@ -269,6 +272,10 @@ namespace termite
         return vec2i(int(w), int(h));
     }
 
+    static const TextureFlag::Bits kBlurTargetFlags = TextureFlag::RT |
+                                                      TextureFlag::MagPoint | TextureFlag::MinPoint |
+                                                      TextureFlag::U_Clamp | TextureFlag::V_Clamp;
+
     PostProcessBlur* createBlurPostProcess(bx::AllocatorI* alloc, uint16_t width, uint16_t height, float stdDev,
                                            TextureFormat::Enum fmt /*= TextureFormat::RGBA8*/)
     {
@@ -277,18 +284,10 @@ namespace termite
             return nullptr;
 
         GfxDriverApi* driver = g_gutils->driver;
-        for (int i = 0; i < 2; i++) {
-            blur->fbs[i] = driver->createFrameBuffer(width, height, fmt,
-                                                     TextureFlag::RT |
-                                                     TextureFlag::MagPoint | TextureFlag::MinPoint |
-                                                     TextureFlag::U_Clamp | TextureFlag::V_Clamp);
-            assert(blur->fbs[i].isValid());
-            blur->textures[i] = driver->getFrameBufferTexture(blur->fbs[i], 0);
-        }
-
         calcGaussKernel(blur->kernel, BLUR_KERNEL_SIZE, stdDev, 1.0f);
         blur->width = width;
         blur->height = height;
+        blur->fmt = fmt;
 
         blur->prog = driver->createProgram(
             driver->createShader(driver->makeRef(blur_vso, sizeof(blur_vso), nullptr, nullptr)),
@@ -300,56 +299,142 @@ namespace termite
         return blur;
     }
 
+    // Draws one blur direction from sourceTexture, view framebuffer and rect must be set
+    static void drawBlurKernel(PostProcessBlur* blur, uint8_t viewId, TextureHandle sourceTexture, float radius,
+                               bool vertical)
+    {
+        GfxDriverApi* driver = g_gutils->driver;
+
+        vec4_t kernel[BLUR_KERNEL_SIZE];
+        memcpy(kernel, blur->kernel, sizeof(kernel));
+        if (!vertical) {
+            float hRadius = radius / float(blur->width);
+            for (int i = 0; i < BLUR_KERNEL_SIZE; i++) {
+                kernel[i].x *= hRadius;
+                kernel[i].y = 0;
+            }
+        } else {
+            float vRadius = radius / float(blur->height);
+            for (int i = 0; i < BLUR_KERNEL_SIZE; i++) {
+                kernel[i].x = 0;
+                kernel[i].y *= vRadius;
+            }
+        }
+
+        driver->setState(GfxState::RGBWrite, 0);
+        driver->setTexture(0, blur->uTexture, sourceTexture, TextureFlag::FromTexture);
+        driver->setUniform(blur->uBlurKernel, kernel, BLUR_KERNEL_SIZE);
+        drawFullscreenQuad(viewId, blur->prog);
+    }
+
+    // Framebuffers are only needed by the view Id path, render graph passes use transient targets
+    static void createBlurTargets(PostProcessBlur* blur)
+    {
+        if (blur->fbs[0].isValid())
+            return;
+
+        GfxDriverApi* driver = g_gutils->driver;
+        for (int i = 0; i < 2; i++) {
+            blur->fbs[i] = driver->createFrameBuffer(blur->width, blur->height, blur->fmt, kBlurTargetFlags);
+            assert(blur->fbs[i].isValid());
+            blur->textures[i] = driver->getFrameBufferTexture(blur->fbs[i], 0);
+        }
+    }
+
     TextureHandle drawBlurPostProcess(PostProcessBlur* blur, uint8_t* viewId, TextureHandle sourceTexture, float radius)
     {
         uint8_t vid = *viewId;
         GfxDriverApi* driver = g_gutils->driver;
 
+        createBlurTargets(blur);
+
         // Downsample to our first blur frameBuffer
         driver->setViewFrameBuffer(vid, blur->fbs[0]);
         driver->setViewRect(vid, 0, 0, blur->width, blur->height);
         blitToFramebuffer(vid, sourceTexture);
         vid++;
 
-        vec4_t kernel[BLUR_KERNEL_SIZE];
-        float hRadius = radius / float(blur->width);
-        float vRadius = radius / float(blur->height);
-
         // Blur horizontally to 2nd framebuffer
-        memcpy(kernel, blur->kernel, sizeof(kernel));
-        for (int i = 0; i < BLUR_KERNEL_SIZE; i++) {
-            kernel[i].x *= hRadius;
-            kernel[i].y = 0;
-        }
-
         driver->setViewRect(vid, 0, 0, blur->width, blur->height);
         driver->setViewFrameBuffer(vid, blur->fbs[1]);
-        driver->setState(GfxState::RGBWrite, 0);
-        driver->setTexture(0, blur->uTexture, blur->textures[0], TextureFlag::FromTexture);
-        driver->setUniform(blur->uBlurKernel, kernel, BLUR_KERNEL_SIZE);
-        drawFullscreenQuad(vid, blur->prog);
+        drawBlurKernel(blur, vid, blur->textures[0], radius, false);
         vid++;
 
         // Blur vertically to 1st framebuffer
-        memcpy(kernel, blur->kernel, sizeof(kernel));
-        for (int i = 0; i < BLUR_KERNEL_SIZE; i++) {
-            kernel[i].x = 0;
-            kernel[i].y *= vRadius;
-        }
         driver->setViewRect(vid, 0, 0, blur->width, blur->height);
         driver->setViewFrameBuffer(vid, blur->fbs[0]);
-        driver->setState(GfxState::RGBWrite, 0);
-        driver->setTexture(0, blur->uTexture, blur->textures[1], TextureFlag::FromTexture);
-        driver->setUniform(blur->uBlurKernel, kernel, BLUR_KERNEL_SIZE);
-        drawFullscreenQuad(vid, blur->prog);
+        drawBlurKernel(blur, vid, blur->textures[1], radius, true);
         vid++;
 
         *viewId = vid;
         return blur->textures[0];
     }
 
+    struct BlurPassData
+    {
+        PostProcessBlur* blur;
+        RenderGraphResource source;
+        float radius;
+    };
+
+    static void blurDownsamplePass(RenderGraph* graph, uint8_t viewId, const void* data)
+    {
+        const BlurPassData* d = (const BlurPassData*)data;
+        blitToFramebuffer(viewId, getRenderGraphTexture(graph, d->source));
+    }
+
+    static void blurHorizontalPass(RenderGraph* graph, uint8_t viewId, const void* data)
+    {
+        const BlurPassData* d = (const BlurPassData*)data;
+        drawBlurKernel(d->blur, viewId, getRenderGraphTexture(graph, d->source), d->radius, false);
+    }
+
+    static void blurVerticalPass(RenderGraph* graph, uint8_t viewId, const void* data)
+    {
+        const BlurPassData* d = (const BlurPassData*)data;
+        drawBlurKernel(d->blur, viewId, getRenderGraphTexture(graph, d->source), d->radius, true);
+    }
+
+    static RenderGraphResource addBlurPass(RenderGraph* graph, const char* name, RenderPassCallback callback,
+                                           PostProcessBlur* blur, RenderGraphResource source, float radius)
+    {
+        RenderTargetDesc desc;
+        desc.width = blur->width;
+        desc.height = blur->height;
+        desc.format = blur->fmt;
+        desc.flags = kBlurTargetFlags;
+        RenderGraphResource target = createRenderGraphTarget(graph, name, desc);
+
+        BlurPassData data;
+        data.blur = blur;
+        data.source = source;
+        data.radius = radius;
+        RenderPassHandle pass = addRenderPass(graph, name, callback, &data, sizeof(data));
+        if (!target.isValid() || !pass.isValid())
+            return RenderGraphResource();
+        renderPassRead(graph, pass, source);
+        renderPassWrite(graph, pass, target);
+        return target;
+    }
+
+    RenderGraphResource addBlurRenderPasses(RenderGraph* graph, PostProcessBlur* blur, RenderGraphResource source,
+                                            float radius)
+    {
+        assert(graph);
+        assert(blur);
+
+        // Downsample target is released after the horizontal pass, so the graph reuses it for the vertical pass
+        RenderGraphResource res = addBlurPass(graph, "BlurDownsample", blurDownsamplePass, blur, source, radius);
+        if (res.isValid())
+            res = addBlurPass(graph, "BlurHorizontal", blurHorizontalPass, blur, res, radius);
+        if (res.isValid())
+            res = addBlurPass(graph, "BlurVertical", blurVerticalPass, blur, res, radius);
+        return res;
+    }
+
     TextureHandle getBlurPostProcessTexture(PostProcessBlur* blur)
     {
+        createBlurTargets(blur);
         return blur->textures[0];
     }
 
@@ -401,9 +486,8 @@ namespace termite
         return vignette;
     }
 
-    TextureHandle drawVignetteSepiaPostProcess(PostProcessVignetteSepia* vignette, uint8_t viewId,
-                                               FrameBufferHandle targetFb, TextureHandle sourceTexture,
-                                               float intensity)
+    static void drawVignetteSepia(PostProcessVignetteSepia* vignette, uint8_t viewId, TextureHandle sourceTexture,
+                                  float intensity)
     {
         GfxDriverApi* driver = g_gutils->driver;
 
@@ -411,16 +495,66 @@ namespace termite
         vec4_t sepiaParams = vec4f(vignette->sepiaColor.x, vignette->sepiaColor.y, vignette->sepiaColor.z, 
                                    intensity*vignette->sepiaIntensity);
 
-        driver->setViewRect(viewId, 0, 0, vignette->width, vignette->height);
-        driver->setViewFrameBuffer(viewId, targetFb);
         driver->setState(GfxState::RGBWrite, 0);
         driver->setTexture(0, vignette->uTexture, sourceTexture, TextureFlag::FromTexture);
         driver->setUniform(vignette->uVignetteParams, vigParams.f, 1);
         driver->setUniform(vignette->uSepiaParams, sepiaParams.f, 1);
         drawFullscreenQuad(viewId, vignette->prog);
+    }
+
+    TextureHandle drawVignetteSepiaPostProcess(PostProcessVignetteSepia* vignette, uint8_t viewId,
+                                               FrameBufferHandle targetFb, TextureHandle sourceTexture,
+                                               float intensity)
+    {
+        GfxDriverApi* driver = g_gutils->driver;
+
+        driver->setViewRect(viewId, 0, 0, vignette->width, vignette->height);
+        driver->setViewFrameBuffer(viewId, targetFb);
+        drawVignetteSepia(vignette, viewId, sourceTexture, intensity);
         return driver->getFrameBufferTexture(targetFb, 0);
     }
 
+    struct VignettePassData
+    {
+        PostProcessVignetteSepia* vignette;
+        RenderGraphResource source;
+        float intensity;
+    };
+
+    static void vignetteSepiaPass(RenderGraph* graph, uint8_t viewId, const void* data)
+    {
+        const VignettePassData* d = (const VignettePassData*)data;
+        drawVignetteSepia(d->vignette, viewId, getRenderGraphTexture(graph, d->source), d->intensity);
+    }
+
+    RenderGraphResource addVignetteSepiaRenderPass(RenderGraph* graph, PostProcessVignetteSepia* vignette,
+                                                   RenderGraphResource source, float intensity,
+                                                   RenderGraphResource target)
+    {
+        assert(graph);
+        assert(vignette);
+
+        if (!target.isValid()) {
+            RenderTargetDesc desc;
+            desc.width = vignette->width;
+            desc.height = vignette->height;
+            target = createRenderGraphTarget(graph, "VignetteSepia", desc);
+            if (!target.isValid())
+                return target;
+        }
+
+        VignettePassData data;
+        data.vignette = vignette;
+        data.source = source;
+        data.intensity = intensity;
+        RenderPassHandle pass = addRenderPass(graph, "VignetteSepia", vignetteSepiaPass, &data, sizeof(data));
+        if (!pass.isValid())
+            return RenderGraphResource();
+        renderPassRead(graph, pass, source);
+        renderPassWrite(graph, pass, target);
+        return target;
+    }
+
     void destroyVignetteSepiaPostProcess(PostProcessVignetteSepia* vignette)
     {
         assert(vignette);
@@ -6,9 +6,11 @@
 #include "gfx_font.h"
 #include "gfx_texture.h"
 
+#include "bx/uint32_t.h"
 #include "bxx/pool.h"
 #include "bxx/stack.h"
 #include "bxx/logger.h"
+#include "Remotery.h"
 
 #include <cstdarg>
 
@@ -17,8 +19,8 @@
 
 using namespace termite;
 
-#define MAX_BATCHES 256
-#define MAX_VERTICES 2048
+#define MAX_BATCHES 256         // Initial size, batch buffer grows if needed
+#define MAX_VERTICES 2048       // Initial size, vertex/index buffers grow if needed
 #define MAX_TEXT_SIZE 256
 #define MAX_PARAM_SIZE 384
 #define STATE_POOL_SIZE 8
@@ -65,7 +67,6 @@ struct Batch
     int firstIdx;
     int numIndices;
     recti_t scissorRect;
-    mtx3x3_t xformMtx;
 };
 
 struct VgState
@@ -209,46 +210,95 @@ void VgState::setDefault(VectorGfxContext* ctx)
     fontHandle = ctx->defaultFontHandle;
 }
 
-static void pushBatch(VectorGfxContext* ctx, DrawHandler* handler, const void* params, size_t paramsSize)
+// Grows the buffers to fit 'numVerts' more vertices (as quads) and a new batch
+static bool growBuffers(VectorGfxContext* ctx, int numVerts)
 {
-    if (ctx->numBatches == ctx->maxBatches)
-        return;
+    bx::AllocatorI* alloc = ctx->alloc;
 
-    int firstVert = ctx->numVerts;
-    int maxVerts = ctx->maxVerts - firstVert;
-    if (maxVerts <= 0)
-        return;
-    int firstIdx = ctx->numIndices;
-    int maxIndices = ctx->maxIndices - firstIdx;
-    if (maxIndices <= 0)
+    if (ctx->numVerts + numVerts > ctx->maxVerts) {
+        int maxVerts = bx::uint32_max(ctx->maxVerts*2, ctx->numVerts + numVerts);
+        vgVertexPosCoordColor* vertexBuff = (vgVertexPosCoordColor*)BX_REALLOC(alloc, ctx->vertexBuff, 
+                                                                              sizeof(vgVertexPosCoordColor)*maxVerts);
+        if (!vertexBuff)
+            return false;
+        ctx->vertexBuff = vertexBuff;
+        ctx->maxVerts = maxVerts;
+    }
+
+    int numIndices = (numVerts / 4) * 6;
+    if (ctx->numIndices + numIndices > ctx->maxIndices) {
+        int maxIndices = bx::uint32_max(ctx->maxIndices*2, ctx->numIndices + numIndices);
+        uint16_t* indexBuff = (uint16_t*)BX_REALLOC(alloc, ctx->indexBuff, sizeof(uint16_t)*maxIndices);
+        if (!indexBuff)
+            return false;
+        ctx->indexBuff = indexBuff;
+        ctx->maxIndices = maxIndices;
+    }
+
+    if (ctx->numBatches == ctx->maxBatches) {
+        int maxBatches = ctx->maxBatches*2;
+        Batch* batches = (Batch*)BX_REALLOC(alloc, ctx->batches, sizeof(Batch)*maxBatches);
+        if (!batches)
+            return false;
+        ctx->batches = batches;
+        ctx->maxBatches = maxBatches;
+    }
+
+    return true;
+}
+
+// Transform is applied to the vertices here, so batches don't break on transform changes
+static void transformVerts(vgVertexPosCoordColor* verts, int numVerts, const mtx3x3_t& mtx)
+{
+    if (mtx.m11 == 1.0f && mtx.m12 == 0 && mtx.m21 == 0 && mtx.m22 == 1.0f && mtx.m31 == 0 && mtx.m32 == 0)
         return;
-    int numVertsWritten;
-    int numIndicesWritten;
-    handler->writePrimitives(ctx, params, &ctx->vertexBuff[firstVert], maxVerts, &ctx->indexBuff[firstIdx], 
-                             firstVert, maxIndices, &numVertsWritten, &numIndicesWritten);
-    if (numVertsWritten == 0 || numIndicesWritten == 0)
+
+    for (int i = 0; i < numVerts; i++) {
+        float x = verts[i].x;
+        float y = verts[i].y;
+        verts[i].x = x*mtx.m11 + y*mtx.m21 + mtx.m31;
+        verts[i].y = x*mtx.m12 + y*mtx.m22 + mtx.m32;
+    }
+}
+
+// 'maxVerts': Maximum vertices that the handler may write for these params
+static void pushBatch(VectorGfxContext* ctx, DrawHandler* handler, const void* params, size_t paramsSize, int maxVerts)
+{
+    if (!growBuffers(ctx, maxVerts))
         return;
-    ctx->numVerts += numVertsWritten;
-    ctx->numIndices += numIndicesWritten;
 
     // Hash batch based on states that break the drawcall
     const BatchParams* bparams = (const BatchParams*)params;
-    VgState* state;
-    ctx->stateStack.peek(&state);
     bx::HashMurmur2A hasher;
     hasher.begin();
     hasher.add<uint32_t>(handler->getHash(params));
     hasher.add<recti_t>(bparams->scissor);
-    hasher.add<mtx3x3_t>(bparams->mtx);
     uint32_t hash = hasher.end();
 
     // If hash is different from the previous one, create a new batch
     // we can only check with the previous call, because drawing is supposed to be sequential
+    // Indices are relative to the batch's start vertex, so a batch can't span more than 16bit range of vertices
+    int firstVert = ctx->numVerts;
+    int firstIdx = ctx->numIndices;
     int batchIdx = ctx->numBatches;
-    if (batchIdx > 0 && ctx->batches[batchIdx - 1].hash == hash) {
+    Batch* prevBatch = batchIdx > 0 ? &ctx->batches[batchIdx - 1] : nullptr;
+    bool merge = prevBatch && prevBatch->hash == hash && (firstVert + maxVerts - prevBatch->startVertex) <= UINT16_MAX;
+    int baseVertex = merge ? prevBatch->startVertex : firstVert;
+
+    int numVertsWritten;
+    int numIndicesWritten;
+    handler->writePrimitives(ctx, params, &ctx->vertexBuff[firstVert], maxVerts, &ctx->indexBuff[firstIdx], 
+                             firstVert - baseVertex, (maxVerts / 4) * 6, &numVertsWritten, &numIndicesWritten);
+    if (numVertsWritten == 0 || numIndicesWritten == 0)
+        return;
+    transformVerts(&ctx->vertexBuff[firstVert], numVertsWritten, bparams->mtx);
+    ctx->numVerts += numVertsWritten;
+    ctx->numIndices += numIndicesWritten;
+
+    if (merge) {
         // Expand the previous batch
-        ctx->batches[batchIdx - 1].numVerts += numVertsWritten;
-        ctx->batches[batchIdx - 1].numIndices += numIndicesWritten;
+        prevBatch->numVerts += numVertsWritten;
+        prevBatch->numIndices += numIndicesWritten;
     } else {
         // Create a new batch
         Batch& batch = ctx->batches[batchIdx];
@@ -261,7 +311,6 @@ static void pushBatch(VectorGfxContext* ctx, DrawHandler* handler, const void* p
         batch.firstIdx = firstIdx;
         batch.numIndices = numIndicesWritten;
         batch.scissorRect = bparams->scissor;
-        batch.xformMtx = bparams->mtx;
 
         ctx->numBatches++;
     }
@@ -269,6 +318,7 @@ static void pushBatch(VectorGfxContext* ctx, DrawHandler* handler, const void* p
 
 static void drawBatches(VectorGfxContext* ctx)
 {
+    rmt_ScopedCPUSample(VectorGfx_Draw, 0);
     GfxDriverApi* driver = ctx->driver;
     GfxState::Bits baseState = gfxStateBlendAlpha() | GfxState::RGBWrite | GfxState::AlphaWrite;
 
@@ -282,30 +332,43 @@ static void drawBatches(VectorGfxContext* ctx)
     driver->setViewTransform(viewId, ctx->viewMtx.f, ctx->projMtx.f, GfxViewFlag::Stereo, nullptr);
     driver->setViewSeq(viewId, true);
 
+    // Check both buffers before allocating, so vertices are not wasted if indices don't fit
+    GfxSubsystemStats* stats = getGfxSubsystemFrameStats(GfxSubsystem::VectorGfx);
+    if (driver->getAvailTransientVertexBuffer(numVerts, vgVertexPosCoordColor::Decl) != numVerts) {
+        BX_WARN("VectorGfx: Not enough transient vertex buffer for %d vertices", numVerts);
+        stats->numDropped++;
+        return;
+    }
+    if (driver->getAvailTransientIndexBuffer(numIndices) != numIndices) {
+        BX_WARN("VectorGfx: Not enough transient index buffer for %d indices", numIndices);
+        stats->numDropped++;
+        return;
+    }
+
     // Allocate and fill vertices
     TransientVertexBuffer tvb;
-    if (driver->getAvailTransientVertexBuffer(numVerts, vgVertexPosCoordColor::Decl) != numVerts)
-        return;
     driver->allocTransientVertexBuffer(&tvb, numVerts, vgVertexPosCoordColor::Decl);
     memcpy(tvb.data, ctx->vertexBuff, sizeof(vgVertexPosCoordColor)*numVerts);
 
     // Allocate and fill indices
     TransientIndexBuffer tib;
-    if (driver->getAvailTransientIndexBuffer(numIndices) != numIndices)
-        return;
     driver->allocTransientIndexBuffer(&tib, numIndices);
     memcpy(tib.data, ctx->indexBuff, sizeof(uint16_t)*numIndices);
 
+    stats->numVerts += numVerts;
+    stats->numIndices += numIndices;
+    stats->transientBytes += tvb.size + tib.size;
+    stats->numBatches += ctx->numBatches;
+    stats->numSubmits += ctx->numBatches;
+
+    // Vertices are already transformed
+    mtx4x4_t worldMtx = mtx4x4Ident();
+
     for (int i = 0, c = ctx->numBatches; i < c; i++) {
         const Batch& batch = ctx->batches[i];
 
         GfxState::Bits state = baseState | batch.handler->setStates(ctx, driver, batch.params);
 
-        const mtx3x3_t xf = batch.xformMtx;
-        mtx4x4_t worldMtx = mtx4x4f3(xf.m11, xf.m12, 0.0f,
-                                     xf.m21, xf.m22, 0.0f,
-                                     0.0f,   0.0f,   1.0f,
-                                     xf.m31, xf.m32, 0.0f);
         driver->setTransform(&worldMtx, 1);
         driver->setState(state, 0);
         driver->setScissor(batch.scissorRect.xmin,
@@ -313,7 +376,7 @@ static void drawBatches(VectorGfxContext* ctx)
                            batch.scissorRect.xmax - batch.scissorRect.xmin,
                            batch.scissorRect.ymax - batch.scissorRect.ymin);
         driver->setTransientIndexBufferI(&tib, batch.firstIdx, batch.numIndices);
-        driver->setTransientVertexBufferI(&tvb, 0, batch.numVerts);       
+        driver->setTransientVertexBufferI(&tvb, batch.startVertex, numVerts - batch.startVertex);
         driver->submit(viewId, ctx->program, 0, false); 
     }
 }
@@ -512,7 +575,7 @@ void termite::vgText(VectorGfxContext* ctx, float x, float y, const char* text)
     textParams.fontHandle = state->fontHandle;
     textParams.pos = vec2f(x, y);
 
-    pushBatch(ctx, &g_vg->textHandler, &textParams, sizeof(textParams));
+    pushBatch(ctx, &g_vg->textHandler, &textParams, sizeof(textParams), int(strlen(textParams.text))*4);
 }
 
 void termite::vgTextf(VectorGfxContext* ctx, float x, float y, const char* fmt, ...)
@@ -561,7 +624,7 @@ void termite::vgRect(VectorGfxContext* ctx, const rect_t& rect)
     rectParams.image = nullptr;
     rectParams.rect = rect;
 
-    pushBatch(ctx, &g_vg->rectHandler, &rectParams, sizeof(rectParams));
+    pushBatch(ctx, &g_vg->rectHandler, &rectParams, sizeof(rectParams), 4);
 }
 
 void termite::vgImage(VectorGfxContext* ctx, float x, float y, const Texture* image)
@@ -591,7 +654,7 @@ void termite::vgImageRect(VectorGfxContext* ctx, const rect_t& rect, const Textu
     rectParams.image = image;
     rectParams.rect = rect;
 
-    pushBatch(ctx, &g_vg->rectHandler, &rectParams, sizeof(rectParams));
+    pushBatch(ctx, &g_vg->rectHandler, &rectParams, sizeof(rectParams), 4);
 }
 
 void termite::vgScissor(VectorGfxContext* ctx, const recti_t& rect)
@@ -544,5 +544,5 @@ void termite::shutdownJobDispatcher()
 
 uint8_t termite::getNumWorkerThreads()
 {
-	return g_dispatcher->numThreads;
+	return g_dispatcher ? g_dispatcher->numThreads : 0;
 }
@@ -349,20 +349,39 @@ void* termite::getEngineApi(uint16_t apiId, uint32_t version)
         core0.endCPUSample = _rmt_EndCPUSample;
 #endif
         return &core0;
-    } else if (apiId == ApiId::Gfx && version == 0) {
-        static GfxApi_v0 gfx0;
-        gfx0.calcGaussKernel = calcGaussKernel;
-        gfx0.drawFullscreenQuad = drawFullscreenQuad;
-        gfx0.loadShaderProgram = loadShaderProgram;
-        gfx0.vdeclAdd = vdeclAdd;
-        gfx0.vdeclBegin = vdeclBegin;
-        gfx0.vdeclEnd = vdeclEnd;
-        gfx0.vdeclDecode = vdeclDecode;
-        gfx0.vdeclGetSize = vdeclGetSize;
-        gfx0.vdeclHas = vdeclHas;
-        gfx0.vdeclSkip = vdeclSkip;
+    } else if (apiId == ApiId::Gfx && version <= 1) {
+        // v1 extends v0, so the same struct serves both
+        static GfxApi_v1 gfx;
+        gfx.calcGaussKernel = calcGaussKernel;
+        gfx.drawFullscreenQuad = drawFullscreenQuad;
+        gfx.loadShaderProgram = loadShaderProgram;
+        gfx.vdeclAdd = vdeclAdd;
+        gfx.vdeclBegin = vdeclBegin;
+        gfx.vdeclEnd = vdeclEnd;
+        gfx.vdeclDecode = vdeclDecode;
+        gfx.vdeclGetSize = vdeclGetSize;
+        gfx.vdeclHas = vdeclHas;
+        gfx.vdeclSkip = vdeclSkip;
 
-        return &gfx0;
+        // v1
+        gfx.createMaterialLib = createMaterialLib;
+        gfx.destroyMaterialLib = destroyMaterialLib;
+        gfx.createMaterial = createMaterial;
+        gfx.destroyMaterial = destroyMaterial;
+        gfx.findMaterialVar = findMaterialVar;
+        gfx.setMaterialVar = setMaterialVar;
+        gfx.getMaterialProgram = getMaterialProgram;
+        gfx.applyMaterial = applyMaterial;
+        gfx.createRenderGraphTarget = createRenderGraphTarget;
+        gfx.importRenderGraphTarget = importRenderGraphTarget;
+        gfx.getRenderGraphBackbuffer = getRenderGraphBackbuffer;
+        gfx.addRenderPass = addRenderPass;
+        gfx.renderPassRead = renderPassRead;
+        gfx.renderPassWrite = renderPassWrite;
+        gfx.setRenderPassSideEffect = setRenderPassSideEffect;
+        gfx.getRenderGraphFrameBuffer = getRenderGraphFrameBuffer;
+        gfx.getRenderGraphTexture = getRenderGraphTexture;
+        return &gfx;
 	} else if (apiId == ApiId::ImGui && version == 0) {
 		return getImGuiApi0();
     } else if (apiId == ApiId::Camera) {
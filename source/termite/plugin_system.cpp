@@ -49,6 +49,10 @@ PluginDesc* getBgfxDriverDesc();
 void* initBgfxDriver(bx::AllocatorI* alloc, GetApiFunc getApi);
 void shutdownBgfxDriver();
 
+PluginDesc* getNullDriverDesc();
+void* initNullDriver(bx::AllocatorI* alloc, GetApiFunc getApi);
+void shutdownNullDriver();
+
 PluginDesc* getBox2dDriverDesc();
 void* initBox2dDriver(bx::AllocatorI* alloc, GetApiFunc getApi);
 void shutdownBox2dDriver();
@@ -91,6 +95,16 @@ static void loadStaticPlugins()
     bgfxApi.shutdown = shutdownBgfxDriver;
     p->api = &bgfxApi;
 
+    // Null graphics driver
+    static PluginApi_v0 nullGfxApi;
+    p = g_pluginSys->plugins.push();
+    memset(p, 0x00, sizeof(*p));
+    memcpy(&p->desc, getNullDriverDesc(), sizeof(p->desc));
+    nullGfxApi.getDesc = getNullDriverDesc;
+    nullGfxApi.init = initNullDriver;
+    nullGfxApi.shutdown = shutdownNullDriver;
+    p->api = &nullGfxApi;
+
     // Box2D driver
     static PluginApi_v0 box2dApi;
     p = g_pluginSys->plugins.push();
@@ -0,0 +1,276 @@
+#include "termite/core.h"
+#include "termite/component_system.h"
+#include "bxx/path.h"
+#include "bxx/logger.h"
+#include "bx/timer.h"
+#include "bx/uint32_t.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+// Headless benchmarks for the component system, no graphics/sound/physics drivers are initialized
+// Each benchmark reports nanoseconds per operation, so regressions show up as numbers
+
+using namespace termite;
+
+#define MAX_TYPES 16
+#define MAX_ENTITIES 62500  // Entity index is 16 bits
+
+struct BenchComponent
+{
+    float pos[2];
+    float vel[2];
+};
+
+static ComponentTypeHandle g_types[MAX_TYPES];
+static ComponentTypeHandle g_gcType;
+static Entity* g_ents = nullptr;
+static ComponentHandle* g_handles = nullptr;
+static volatile float g_sink = 0;
+
+static void updateComponents(const ComponentHandle* handles, uint16_t count, float dt)
+{
+    float sum = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        BenchComponent* c = getComponentData<BenchComponent>(handles[i]);
+        c->pos[0] += c->vel[0] * dt;
+        c->pos[1] += c->vel[1] * dt;
+        sum += c->pos[0];
+    }
+    g_sink += sum;
+}
+
+static double getTimeNs(int64_t start)
+{
+    return double(bx::getHPCounter() - start) * 1e9 / bx::getHPFrequency();
+}
+
+static void report(const char* name, int ops, double totalNs)
+{
+    printf("%-48s %10d ops %12.2f ns/op\n", name, ops, totalNs / double(ops > 0 ? ops : 1));
+}
+
+static void benchEntities(int count)
+{
+    char name[64];
+    EntityManager* emgr = createEntityManager(getHeapAlloc(), count);
+
+    // Single entity creation/destruction
+    int64_t start = bx::getHPCounter();
+    for (int i = 0; i < count; i++)
+        g_ents[i] = createEntity(emgr);
+    bx::snprintf(name, sizeof(name), "createEntity (%d)", count);
+    report(name, count, getTimeNs(start));
+
+    start = bx::getHPCounter();
+    for (int i = 0; i < count; i++)
+        destroyEntity(emgr, g_ents[i]);
+    bx::snprintf(name, sizeof(name), "destroyEntity (%d)", count);
+    report(name, count, getTimeNs(start));
+
+    // Bulk
+    start = bx::getHPCounter();
+    int n = createEntities(emgr, g_ents, count);
+    bx::snprintf(name, sizeof(name), "createEntities (%d)", count);
+    report(name, n, getTimeNs(start));
+
+    start = bx::getHPCounter();
+    destroyEntities(emgr, g_ents, n);
+    bx::snprintf(name, sizeof(name), "destroyEntities (%d)", count);
+    report(name, n, getTimeNs(start));
+
+    destroyEntityManager(emgr);
+}
+
+static void benchComponents(int count)
+{
+    char name[64];
+    EntityManager* emgr = createEntityManager(getHeapAlloc(), count);
+    int n = createEntities(emgr, g_ents, count);
+
+    int64_t start = bx::getHPCounter();
+    for (int i = 0; i < n; i++)
+        g_handles[i] = createComponent(emgr, g_ents[i], g_types[0]);
+    bx::snprintf(name, sizeof(name), "createComponent (%d)", count);
+    report(name, n, getTimeNs(start));
+
+    start = bx::getHPCounter();
+    for (int i = 0; i < n; i++)
+        destroyComponent(emgr, g_ents[i], g_handles[i]);
+    bx::snprintf(name, sizeof(name), "destroyComponent (%d)", count);
+    report(name, n, getTimeNs(start));
+
+    start = bx::getHPCounter();
+    int nc = createComponents(emgr, g_ents, n, g_types[0], g_handles);
+    bx::snprintf(name, sizeof(name), "createComponents (%d)", count);
+    report(name, nc, getTimeNs(start));
+
+    for (int i = 0; i < nc; i++)
+        destroyComponent(emgr, g_ents[i], g_handles[i]);
+    destroyEntities(emgr, g_ents, n);
+    destroyEntityManager(emgr);
+}
+
+// Iterates 'numComponents' in a group, components are spread over multiple types (max 62500 per type)
+static void benchGroupIteration(int numComponents, int iterations)
+{
+    char name[64];
+    EntityManager* emgr = createEntityManager(getHeapAlloc(), MAX_ENTITIES);
+    ComponentGroupHandle group = createComponentGroup(getHeapAlloc(), 1024);
+
+    int numTypes = (numComponents + MAX_ENTITIES - 1) / MAX_ENTITIES;
+    int numEnts = bx::uint32_min(numComponents, MAX_ENTITIES);
+    int n = createEntities(emgr, g_ents, numEnts);
+    int total = 0;
+    for (int t = 0; t < numTypes && t < MAX_TYPES; t++) {
+        int count = bx::uint32_min(numComponents - total, n);
+        total += createComponents(emgr, g_ents, count, g_types[t], nullptr, group);
+    }
+
+    int64_t start = bx::getHPCounter();
+    for (int i = 0; i < iterations; i++)
+        runComponentGroup(ComponentUpdateStage::Update, group, 0.016f);
+    bx::snprintf(name, sizeof(name), "runComponentGroup (%d comps)", total);
+    report(name, total*iterations, getTimeNs(start));
+
+    destroyComponentGroup(group);
+    for (int t = 0; t < numTypes && t < MAX_TYPES; t++) {
+        for (int i = 0; i < n; i++) {
+            ComponentHandle handle = getComponent(g_types[t], g_ents[i]);
+            if (handle.isValid())
+                destroyComponent(emgr, g_ents[i], handle);
+        }
+    }
+    destroyEntities(emgr, g_ents, n);
+    destroyEntityManager(emgr);
+}
+
+// Adds and removes components of a group every frame, and runs the group
+static void benchGroupChurn(int numComponents, int churnPerFrame, int frames)
+{
+    char name[64];
+    EntityManager* emgr = createEntityManager(getHeapAlloc(), MAX_ENTITIES);
+    ComponentGroupHandle group = createComponentGroup(getHeapAlloc(), 1024);
+
+    int n = createEntities(emgr, g_ents, numComponents);
+    for (int i = 0; i < n; i++)
+        g_handles[i] = createComponent(emgr, g_ents[i], g_types[i % 4], group);
+
+    srand(0);
+    int64_t start = bx::getHPCounter();
+    for (int f = 0; f < frames; f++) {
+        for (int k = 0; k < churnPerFrame; k++) {
+            int i = rand() % n;
+            Entity ent = g_ents[i];
+            destroyComponent(emgr, ent, g_handles[i]);
+            destroyEntity(emgr, ent);
+            g_ents[i] = createEntity(emgr);
+            g_handles[i] = createComponent(emgr, g_ents[i], g_types[rand() % 4], group);
+        }
+        runComponentGroup(ComponentUpdateStage::Update, group, 0.016f);
+    }
+    bx::snprintf(name, sizeof(name), "group churn (%d comps, %d/frame)", n, churnPerFrame);
+    report(name, frames, getTimeNs(start));
+
+    destroyComponentGroup(group);
+    for (int i = 0; i < n; i++)
+        destroyComponent(emgr, g_ents[i], g_handles[i]);
+    destroyEntities(emgr, g_ents, n);
+    destroyEntityManager(emgr);
+}
+
+static void benchGarbageCollect(int count, bool aggressive)
+{
+    char name[64];
+    EntityManager* emgr = createEntityManager(getHeapAlloc(), count);
+    int n = createEntities(emgr, g_ents, count);
+    createComponents(emgr, g_ents, n, g_gcType);
+
+    // Kill half of the entities, components are left for the garbage collector
+    for (int i = 0; i < n; i += 2)
+        destroyEntity(emgr, g_ents[i]);
+
+    int calls = 0;
+    int64_t start = bx::getHPCounter();
+    if (aggressive) {
+        garbageCollectComponentsAggressive(emgr);
+        calls = 1;
+    } else {
+        int maxCalls = count * 4;
+        while (getAllComponents(g_gcType, nullptr, 0) > uint16_t((n + 1) / 2) && calls < maxCalls) {
+            garbageCollectComponents(emgr);
+            calls++;
+        }
+    }
+    double ns = getTimeNs(start);
+    bx::snprintf(name, sizeof(name), "%s (%d dead)",
+                 aggressive ? "garbageCollectComponentsAggressive" : "garbageCollectComponents", n / 2);
+    report(name, calls, ns);
+    bx::snprintf(name, sizeof(name), "  per dead component");
+    report(name, n / 2, ns);
+
+    // Destroy the rest
+    for (int i = 1; i < n; i += 2)
+        destroyEntity(emgr, g_ents[i]);
+    garbageCollectComponentsAggressive(emgr);
+    destroyEntityManager(emgr);
+}
+
+int main(int /*argc*/, char* argv[])
+{
+    bx::enableLogToFileHandle(stdout, stderr);
+
+    termite::Config conf;
+    bx::Path pluginPath(argv[0]);
+    strcpy(conf.gfxName, "");
+    strcpy(conf.phys2dName, "");
+    strcpy(conf.soundName, "");
+    strcpy(conf.pluginPath, pluginPath.getDirectory().cstr());
+    conf.engineFlags = 0;
+
+    if (termite::initialize(conf, nullptr)) {
+        BX_FATAL(termite::getErrorString());
+        BX_VERBOSE(termite::getErrorCallstack());
+        termite::shutdown();
+        return -1;
+    }
+
+    ComponentCallbacks callbacks;
+    callbacks.updateStageFn[ComponentUpdateStage::Update] = updateComponents;
+    for (int i = 0; i < MAX_TYPES; i++) {
+        char name[32];
+        bx::snprintf(name, sizeof(name), "Bench%d", i);
+        g_types[i] = registerComponentType(name, &callbacks, ComponentFlag::ImmediateDestroy,
+                                           sizeof(BenchComponent), 1024, 4096);
+    }
+    g_gcType = registerComponentType("BenchGC", &callbacks, ComponentFlag::None, sizeof(BenchComponent), 1024, 4096);
+
+    g_ents = (Entity*)BX_ALLOC(getHeapAlloc(), sizeof(Entity)*MAX_ENTITIES);
+    g_handles = (ComponentHandle*)BX_ALLOC(getHeapAlloc(), sizeof(ComponentHandle)*MAX_ENTITIES);
+
+    puts("");
+    benchEntities(10000);
+    benchEntities(MAX_ENTITIES);
+
+    benchComponents(10000);
+    benchComponents(MAX_ENTITIES);
+
+    benchGroupIteration(10000, 100);
+    benchGroupIteration(100000, 20);
+    benchGroupIteration(1000000, 5);
+
+    benchGroupChurn(10000, 100, 200);
+    benchGroupChurn(50000, 500, 50);
+
+    benchGarbageCollect(10000, false);
+    benchGarbageCollect(10000, true);
+    benchGarbageCollect(MAX_ENTITIES, false);
+    benchGarbageCollect(MAX_ENTITIES, true);
+    puts("");
+
+    BX_FREE(getHeapAlloc(), g_handles);
+    BX_FREE(getHeapAlloc(), g_ents);
+
+    termite::shutdown();
+    return 0;
+}